@@ -3,6 +3,7 @@
 #define SPDLOG_NO_ATOMIC_LEVELS
 
 #include "GPCS4Log.h"
+#include "GPCS4LogAsync.h"
 
 #include "UtilString.h"
 
@@ -95,51 +96,100 @@ void initLogChannel(const cxxopts::ParseResult& optResult)
 	//}
 }
 
+void initAsyncLog(const cxxopts::ParseResult& optResult)
+{
+	/// Init deferred logging
+
+	if (!optResult.count("log-async") && !optResult.count("log-trace"))
+	{
+		return;
+	}
+
+	std::string traceFileName;
+	if (optResult.count("log-trace"))
+	{
+		traceFileName = optResult["log-trace"].as<std::string>();
+	}
+
+	if (!startAsyncLog(g_logger->sinks(), traceFileName))
+	{
+		g_logger->error("open log trace file {} failed, logging synchronously.", traceFileName);
+	}
+}
+
 void init(const cxxopts::ParseResult& optResult)
 {
 	initSpdLog();
+	initAsyncLog(optResult);
 	initLogChannel(optResult);
 }
 
-void Channel::print(Level nLevel, const char* szFunction, const char* szSourcePath, int nLine, const char* szFormat, ...)
+void getLevelInfo(Level nLevel, spdlog::level::level_enum* pSpdLevel, const char** pPrefix)
 {
-	if (!m_enabled)
-	{
-		return;
-	}
-	// generate format string
-	va_list stArgList;
-	va_start(stArgList, szFormat);
-	char szTempStr[LOG_STR_BUFFER_LEN + 1] = { 0 };
-	vsprintf_s(szTempStr, LOG_STR_BUFFER_LEN, szFormat, stArgList);
-	va_end(stArgList);
-
 	switch (nLevel)
 	{
 	case Level::kDebug:
-		g_logger->debug("{}({}): {}", szFunction, nLine, szTempStr);
+		*pSpdLevel = spdlog::level::debug;
+		*pPrefix   = "";
 		break;
 	case Level::kTrace:
-		g_logger->trace("{}({}): {}", szFunction, nLine, szTempStr);
+		*pSpdLevel = spdlog::level::trace;
+		*pPrefix   = "";
 		break;
 	case Level::kFixme:
-		g_logger->warn("<FIXME>{}({}): {}", szFunction, nLine, szTempStr);
+		*pSpdLevel = spdlog::level::warn;
+		*pPrefix   = "<FIXME>";
 		break;
 	case Level::kWarning:
-		g_logger->warn("{}({}): {}", szFunction, nLine, szTempStr);
+		*pSpdLevel = spdlog::level::warn;
+		*pPrefix   = "";
 		break;
 	case Level::kError:
-		g_logger->error("{}({}): {}", szFunction, nLine, szTempStr);
+		*pSpdLevel = spdlog::level::err;
+		*pPrefix   = "";
 		break;
 	case Level::kSceTrace:
-		g_logger->trace("<SCE>{}({}): {}", szFunction, nLine, szTempStr);
+		*pSpdLevel = spdlog::level::trace;
+		*pPrefix   = "<SCE>";
 		break;
 	case Level::kSceGraphic:
-		g_logger->trace("<GRAPH>{}({}): {}", szFunction, nLine, szTempStr);
+		*pSpdLevel = spdlog::level::trace;
+		*pPrefix   = "<GRAPH>";
+		break;
+	default:
+		*pSpdLevel = spdlog::level::trace;
+		*pPrefix   = "";
 		break;
 	}
 }
 
+void Channel::print(Level nLevel, const char* szFunction, const char* szSourcePath, int nLine, const char* szFormat, ...)
+{
+	if (!m_enabled)
+	{
+		return;
+	}
+	va_list stArgList;
+	va_start(stArgList, szFormat);
+	if (isAsyncLogEnabled())
+	{
+		// formatting is left to the writer thread
+		pushAsyncLog(this, nLevel, szFunction, nLine, szFormat, stArgList);
+		va_end(stArgList);
+		return;
+	}
+
+	// generate format string
+	char szTempStr[LOG_STR_BUFFER_LEN + 1] = { 0 };
+	vsprintf_s(szTempStr, LOG_STR_BUFFER_LEN, szFormat, stArgList);
+	va_end(stArgList);
+
+	spdlog::level::level_enum spdLevel;
+	const char*               szPrefix;
+	getLevelInfo(nLevel, &spdLevel, &szPrefix);
+	g_logger->log(spdLevel, "{}{}({}): {}", szPrefix, szFunction, nLine, szTempStr);
+}
+
 void Channel::assert_(const char* szExpression, const char* szFunction, const char* szSourcePath, int nLine, const char* szFormat, ...)
 {
 	if (!m_enabled)
@@ -155,6 +205,9 @@ void Channel::assert_(const char* szExpression, const char* szFunction, const ch
 	sprintf_s(szMsgBoxStr, LOG_STR_BUFFER_LEN, "[Assert@%s]: %s\n[Cause]: %s\n[Path]: %s(%d): %s", getName().c_str(), szExpression, szTempStr, szSourcePath, nLine, szFunction);
 	va_end(stArgList);
 
+	// make sure everything logged before the assert shows up first
+	flushAsyncLog();
+
 	g_logger->critical("[{}]{}({}): [Assert: {}] {}", getName(), szFunction, nLine, szExpression, szTempStr);
 
 	showMessageBox("Assertion Fail", szMsgBoxStr);
@@ -58,6 +58,9 @@ private:
 
 }  // namespace log
 
+// format strings must be string literals,
+// with --log-async only the pointer is recorded and the string is read later on the writer thread.
+
 //do not use these directly
 #define _LOG_PRINT_(level, format, ...)    __logger_handle.print(level, __FUNCTION__, __FILE__, __LINE__, format, __VA_ARGS__)
 #define _LOG_ASSERT_(expr, format, ...)    (void)(!!(expr) || (__logger_handle.assert_(#expr, __FUNCTION__, __FILE__, __LINE__, format, __VA_ARGS__), 0))
@@ -0,0 +1,1086 @@
+#define SPDLOG_NO_NAME
+#define SPDLOG_NO_ATOMIC_LEVELS
+
+#include "GPCS4LogAsync.h"
+
+#include "PlatFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <spdlog/details/log_msg.h>
+#include <spdlog/details/os.h>
+#include <spdlog/sinks/sink.h>
+
+#define LOG_STR_BUFFER_LEN     0x2000
+#define LOG_RING_BUFFER_SIZE   0x100000  // per thread, must be a power of two
+#define LOG_DRAIN_BATCH        0x1000    // records written before the writer checks for flush requests
+#define LOG_IDLE_WAIT_MS       2
+#define LOG_TRACE_BUFFER_SIZE  0x100000
+#define LOG_MAX_SPEC_LEN       32        // longest conversion spec (flags, width, precision) we store raw
+
+namespace logsys
+{;
+
+struct RecordHeader
+{
+	uint32_t    m_size;  // whole record including this header, multiple of 8
+	uint8_t     m_flags;
+	uint8_t     m_level;
+	uint16_t    m_reserved;
+	int32_t     m_line;
+	uint32_t    m_argSize;
+	uint64_t    m_timestamp;
+	Channel*    m_channel;
+	const char* m_function;
+	const char* m_format;
+};
+
+static_assert(sizeof(RecordHeader) % sizeof(uint64_t) == 0, "records must stay 8 byte aligned in the ring.");
+
+static uint64_t alignSlot(uint64_t size)
+{
+	return (size + sizeof(uint64_t) - 1) & ~uint64_t(sizeof(uint64_t) - 1);
+}
+
+static uint64_t getTimestamp()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   spdlog::log_clock::now().time_since_epoch())
+		.count();
+}
+
+///
+// printf format parsing, shared by the capturing and the formatting side,
+// so both agree on which arguments a format string consumes.
+
+enum class ArgType
+{
+	kLiteral,  // %%
+	kSigned,
+	kUnsigned,
+	kCharacter,
+	kFloat,
+	kPointer,
+	kString,
+	kUnsupported,
+};
+
+enum class ArgLength
+{
+	kDefault,
+	kChar,
+	kShort,
+	kLong,
+	kLongLong,
+	kIntMax,
+	kSize,
+	kPtrDiff,
+	kLongDouble,
+};
+
+struct FormatSpec
+{
+	const char* m_begin;      // the '%'
+	const char* m_length;     // first length modifier character, or the conversion character
+	const char* m_end;        // one past the conversion character
+	ArgType     m_type;
+	ArgLength   m_argLength;
+	uint32_t    m_starCount;  // '*' width and precision arguments consumed before the value
+	bool        m_starPrecision;
+	int32_t     m_precision;  // -1 if not given
+};
+
+static bool nextFormatSpec(const char** ppCursor, FormatSpec* spec)
+{
+	const char* p = strchr(*ppCursor, '%');
+	if (!p)
+	{
+		return false;
+	}
+
+	spec->m_begin         = p++;
+	spec->m_starCount     = 0;
+	spec->m_starPrecision = false;
+	spec->m_precision     = -1;
+	while (*p && strchr("-+ #0'", *p))
+	{
+		++p;
+	}
+	if (*p == '*')
+	{
+		++spec->m_starCount;
+		++p;
+	}
+	while (*p >= '0' && *p <= '9')
+	{
+		++p;
+	}
+	if (*p == '.')
+	{
+		++p;
+		spec->m_precision = 0;
+		if (*p == '*')
+		{
+			++spec->m_starCount;
+			spec->m_starPrecision = true;
+			++p;
+		}
+		while (*p >= '0' && *p <= '9')
+		{
+			spec->m_precision = spec->m_precision * 10 + (*p - '0');
+			++p;
+		}
+	}
+
+	spec->m_length    = p;
+	spec->m_argLength = ArgLength::kDefault;
+	switch (*p)
+	{
+	case 'h':
+		++p;
+		spec->m_argLength = (*p == 'h') ? (++p, ArgLength::kChar) : ArgLength::kShort;
+		break;
+	case 'l':
+		++p;
+		spec->m_argLength = (*p == 'l') ? (++p, ArgLength::kLongLong) : ArgLength::kLong;
+		break;
+	case 'j':
+		++p;
+		spec->m_argLength = ArgLength::kIntMax;
+		break;
+	case 'z':
+		++p;
+		spec->m_argLength = ArgLength::kSize;
+		break;
+	case 't':
+		++p;
+		spec->m_argLength = ArgLength::kPtrDiff;
+		break;
+	case 'L':
+		++p;
+		spec->m_argLength = ArgLength::kLongDouble;
+		break;
+	case 'I':  // MSVC I64, I32 and I
+		++p;
+		if (p[0] == '6' && p[1] == '4')
+		{
+			p += 2;
+			spec->m_argLength = ArgLength::kLongLong;
+		}
+		else if (p[0] == '3' && p[1] == '2')
+		{
+			p += 2;
+		}
+		else
+		{
+			spec->m_argLength = ArgLength::kSize;
+		}
+		break;
+	default:
+		break;
+	}
+
+	const char conversion = *p;
+	if (conversion)
+	{
+		++p;
+	}
+	spec->m_end = p;
+	*ppCursor   = p;
+
+	switch (conversion)
+	{
+	case '%':
+		spec->m_type = ArgType::kLiteral;
+		break;
+	case 'd':
+	case 'i':
+		spec->m_type = ArgType::kSigned;
+		break;
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		spec->m_type = ArgType::kUnsigned;
+		break;
+	case 'c':
+		spec->m_type = (spec->m_argLength == ArgLength::kDefault) ? ArgType::kCharacter : ArgType::kUnsupported;
+		break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->m_type = ArgType::kFloat;
+		break;
+	case 'p':
+		spec->m_type = ArgType::kPointer;
+		break;
+	case 's':
+		spec->m_type = (spec->m_argLength == ArgLength::kDefault) ? ArgType::kString : ArgType::kUnsupported;
+		break;
+	default:
+		// %n, MSVC %S and %C, or a truncated spec at the end of the string.
+		spec->m_type = ArgType::kUnsupported;
+		break;
+	}
+
+	if (spec->m_length - spec->m_begin > LOG_MAX_SPEC_LEN)
+	{
+		spec->m_type = ArgType::kUnsupported;
+	}
+	return true;
+}
+
+///
+// Capturing side, runs on the logging thread.
+
+class RecordBuilder
+{
+public:
+	RecordBuilder(uint8_t* buffer, uint32_t capacity) :
+		m_buffer(buffer),
+		m_capacity(capacity),
+		m_size(sizeof(RecordHeader))
+	{
+	}
+
+	void reset()
+	{
+		m_size = sizeof(RecordHeader);
+	}
+
+	uint32_t size() const
+	{
+		return m_size;
+	}
+
+	bool putSlot(uint64_t value)
+	{
+		if (m_capacity - m_size < sizeof(uint64_t))
+		{
+			return false;
+		}
+		memcpy(m_buffer + m_size, &value, sizeof(value));
+		m_size += sizeof(uint64_t);
+		return true;
+	}
+
+	// Long strings are truncated to what's left of the record.
+	bool putString(const char* str, size_t maxLength)
+	{
+		if (!str)
+		{
+			return putSlot(~uint64_t(0));
+		}
+		if (m_capacity - m_size < 2 * sizeof(uint64_t))
+		{
+			return false;
+		}
+		size_t length = strnlen(str, std::min(maxLength, size_t(m_capacity - m_size - sizeof(uint64_t) - 1)));
+		putSlot(length);
+		memcpy(m_buffer + m_size, str, length);
+		m_buffer[m_size + length] = '\0';
+		m_size += static_cast<uint32_t>(alignSlot(length + 1));
+		return true;
+	}
+
+	void putFormattedString(const char* szFormat, va_list args)
+	{
+		char* text   = reinterpret_cast<char*>(m_buffer + m_size + sizeof(uint64_t));
+		size_t avail = m_capacity - m_size - sizeof(uint64_t);
+		int length   = vsnprintf(text, avail, szFormat, args);
+		length       = std::max(0, std::min(length, int(avail - 1)));
+		text[length] = '\0';
+		putSlot(length);
+		m_size += static_cast<uint32_t>(alignSlot(length + 1));
+	}
+
+private:
+	uint8_t* m_buffer;
+	uint32_t m_capacity;
+	uint32_t m_size;
+};
+
+static bool captureArgs(RecordBuilder& builder, const char* szFormat, va_list args)
+{
+	const char* cursor  = szFormat;
+	bool        success = true;
+	FormatSpec  spec;
+	while (success && nextFormatSpec(&cursor, &spec))
+	{
+		if (spec.m_type == ArgType::kLiteral)
+		{
+			continue;
+		}
+		if (spec.m_type == ArgType::kUnsupported)
+		{
+			return false;
+		}
+
+		// A '*' precision is the last of the star arguments.
+		int32_t precision = spec.m_precision;
+		for (uint32_t i = 0; i != spec.m_starCount; ++i)
+		{
+			int value = va_arg(args, int);
+			success   = builder.putSlot(int64_t(value)) && success;
+			if (spec.m_starPrecision)
+			{
+				precision = value < 0 ? -1 : value;
+			}
+		}
+
+		switch (spec.m_type)
+		{
+		case ArgType::kSigned:
+		{
+			int64_t value = 0;
+			switch (spec.m_argLength)
+			{
+			case ArgLength::kChar: value = static_cast<signed char>(va_arg(args, int)); break;
+			case ArgLength::kShort: value = static_cast<short>(va_arg(args, int)); break;
+			case ArgLength::kLong: value = va_arg(args, long); break;
+			case ArgLength::kLongLong: value = va_arg(args, long long); break;
+			case ArgLength::kIntMax: value = va_arg(args, intmax_t); break;
+			case ArgLength::kSize:
+			case ArgLength::kPtrDiff: value = va_arg(args, ptrdiff_t); break;
+			default: value = va_arg(args, int); break;
+			}
+			success = builder.putSlot(value);
+		}
+			break;
+		case ArgType::kUnsigned:
+		{
+			uint64_t value = 0;
+			switch (spec.m_argLength)
+			{
+			case ArgLength::kChar: value = static_cast<unsigned char>(va_arg(args, unsigned int)); break;
+			case ArgLength::kShort: value = static_cast<unsigned short>(va_arg(args, unsigned int)); break;
+			case ArgLength::kLong: value = va_arg(args, unsigned long); break;
+			case ArgLength::kLongLong: value = va_arg(args, unsigned long long); break;
+			case ArgLength::kIntMax: value = va_arg(args, uintmax_t); break;
+			case ArgLength::kSize:
+			case ArgLength::kPtrDiff: value = va_arg(args, size_t); break;
+			default: value = va_arg(args, unsigned int); break;
+			}
+			success = builder.putSlot(value);
+		}
+			break;
+		case ArgType::kCharacter:
+			success = builder.putSlot(int64_t(va_arg(args, int)));
+			break;
+		case ArgType::kFloat:
+		{
+			double value = (spec.m_argLength == ArgLength::kLongDouble) ? double(va_arg(args, long double)) : va_arg(args, double);
+			uint64_t bits = 0;
+			memcpy(&bits, &value, sizeof(bits));
+			success = builder.putSlot(bits);
+		}
+			break;
+		case ArgType::kPointer:
+			success = builder.putSlot(reinterpret_cast<uintptr_t>(va_arg(args, void*)));
+			break;
+		case ArgType::kString:
+			// With a precision the string needn't be terminated,
+			// never read past it.
+			success = builder.putString(va_arg(args, const char*),
+										precision < 0 ? SIZE_MAX : size_t(precision));
+			break;
+		default:
+			break;
+		}
+	}
+	return success;
+}
+
+///
+// Formatting side, runs on the writer thread.
+
+class ArgReader
+{
+public:
+	ArgReader(const uint8_t* args, uint32_t size) :
+		m_cursor(args),
+		m_end(args + size)
+	{
+	}
+
+	uint64_t getSlot()
+	{
+		uint64_t value = 0;
+		if (m_end - m_cursor >= ptrdiff_t(sizeof(value)))
+		{
+			memcpy(&value, m_cursor, sizeof(value));
+			m_cursor += sizeof(value);
+		}
+		return value;
+	}
+
+	const char* getString()
+	{
+		uint64_t length = getSlot();
+		if (length == ~uint64_t(0))
+		{
+			return nullptr;
+		}
+		const char* str = reinterpret_cast<const char*>(m_cursor);
+		m_cursor += alignSlot(length + 1);
+		return str;
+	}
+
+private:
+	const uint8_t* m_cursor;
+	const uint8_t* m_end;
+};
+
+template <typename T>
+static void appendFormatted(std::string& out, const char* szConversion, const int* stars, uint32_t starCount, T value)
+{
+	auto print = [&](char* buffer, size_t size) {
+		switch (starCount)
+		{
+		case 0: return snprintf(buffer, size, szConversion, value);
+		case 1: return snprintf(buffer, size, szConversion, stars[0], value);
+		default: return snprintf(buffer, size, szConversion, stars[0], stars[1], value);
+		}
+	};
+
+	char buffer[256];
+	int  length = print(buffer, sizeof(buffer));
+	if (length <= 0)
+	{
+		return;
+	}
+	if (size_t(length) < sizeof(buffer))
+	{
+		out.append(buffer, length);
+		return;
+	}
+	size_t offset = out.size();
+	out.resize(offset + length + 1);
+	print(&out[offset], length + 1);
+	out.resize(offset + length);
+}
+
+static void formatRecord(std::string& out, const RecordHeader* header)
+{
+	ArgReader reader(reinterpret_cast<const uint8_t*>(header + 1), header->m_argSize);
+	if (header->m_flags & kRecordPreformatted)
+	{
+		out.append(reader.getString());
+		return;
+	}
+
+	const char* cursor  = header->m_format;
+	const char* literal = cursor;
+	FormatSpec  spec;
+	while (nextFormatSpec(&cursor, &spec))
+	{
+		out.append(literal, spec.m_begin - literal);
+		literal = cursor;
+		if (spec.m_type == ArgType::kLiteral)
+		{
+			out.push_back('%');
+			continue;
+		}
+
+		int stars[2] = {};
+		for (uint32_t i = 0; i != spec.m_starCount; ++i)
+		{
+			stars[i] = static_cast<int>(reader.getSlot());
+		}
+
+		// Rebuild the conversion with a length modifier matching the 64 bit slot.
+		char   szConversion[LOG_MAX_SPEC_LEN + 4];
+		size_t prefixLength = spec.m_length - spec.m_begin;
+		memcpy(szConversion, spec.m_begin, prefixLength);
+		char* p = szConversion + prefixLength;
+		if (spec.m_type == ArgType::kSigned || spec.m_type == ArgType::kUnsigned)
+		{
+			*p++ = 'l';
+			*p++ = 'l';
+		}
+		*p++ = spec.m_end[-1];
+		*p   = '\0';
+
+		switch (spec.m_type)
+		{
+		case ArgType::kSigned:
+			appendFormatted(out, szConversion, stars, spec.m_starCount, static_cast<long long>(reader.getSlot()));
+			break;
+		case ArgType::kUnsigned:
+			appendFormatted(out, szConversion, stars, spec.m_starCount, static_cast<unsigned long long>(reader.getSlot()));
+			break;
+		case ArgType::kCharacter:
+			appendFormatted(out, szConversion, stars, spec.m_starCount, static_cast<int>(reader.getSlot()));
+			break;
+		case ArgType::kFloat:
+		{
+			uint64_t bits  = reader.getSlot();
+			double   value = 0.0;
+			memcpy(&value, &bits, sizeof(value));
+			appendFormatted(out, szConversion, stars, spec.m_starCount, value);
+		}
+			break;
+		case ArgType::kPointer:
+			appendFormatted(out, szConversion, stars, spec.m_starCount, reinterpret_cast<void*>(static_cast<uintptr_t>(reader.getSlot())));
+			break;
+		case ArgType::kString:
+		{
+			const char* str = reader.getString();
+			appendFormatted(out, szConversion, stars, spec.m_starCount, str ? str : "(null)");
+		}
+			break;
+		default:
+			break;
+		}
+	}
+	out.append(literal);
+}
+
+///
+// Single producer, single consumer ring of records.
+// The owning thread pushes, the writer thread consumes.
+
+class LogRing
+{
+public:
+	LogRing(uint32_t threadId) :
+		m_buffer(new uint64_t[LOG_RING_BUFFER_SIZE / sizeof(uint64_t)]),
+		m_threadId(threadId),
+		m_retired(false),
+		m_head(0),
+		m_tail(0)
+	{
+	}
+
+	bool push(const void* record, uint32_t size)
+	{
+		const uint64_t head       = m_head.load(std::memory_order_relaxed);
+		const uint64_t tail       = m_tail.load(std::memory_order_acquire);
+		const uint64_t offset     = head & (LOG_RING_BUFFER_SIZE - 1);
+		const uint64_t contiguous = LOG_RING_BUFFER_SIZE - offset;
+		// Records never wrap, the tail end of the buffer is skipped with a padding record instead.
+		const uint64_t padding = (contiguous < size) ? contiguous : 0;
+		if (LOG_RING_BUFFER_SIZE - (head - tail) < padding + size)
+		{
+			return false;
+		}
+
+		uint8_t* base = reinterpret_cast<uint8_t*>(m_buffer.get());
+		if (padding)
+		{
+			auto header     = reinterpret_cast<RecordHeader*>(base + offset);
+			header->m_size  = static_cast<uint32_t>(padding);
+			header->m_flags = kRecordPadding;
+		}
+		memcpy(base + ((head + padding) & (LOG_RING_BUFFER_SIZE - 1)), record, size);
+		m_head.store(head + padding + size, std::memory_order_release);
+		return true;
+	}
+
+	// Oldest record in the ring, or nullptr if it is empty.
+	const RecordHeader* front()
+	{
+		const uint8_t* base = reinterpret_cast<const uint8_t*>(m_buffer.get());
+		uint64_t       tail = m_tail.load(std::memory_order_relaxed);
+		const uint64_t head = m_head.load(std::memory_order_acquire);
+		while (tail != head)
+		{
+			auto header = reinterpret_cast<const RecordHeader*>(base + (tail & (LOG_RING_BUFFER_SIZE - 1)));
+			if (!(header->m_flags & kRecordPadding))
+			{
+				return header;
+			}
+			tail += header->m_size;
+			m_tail.store(tail, std::memory_order_release);
+		}
+		return nullptr;
+	}
+
+	// Release the record returned by front().
+	void pop(const RecordHeader* header)
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + header->m_size, std::memory_order_release);
+	}
+
+	bool empty() const
+	{
+		return m_tail.load(std::memory_order_relaxed) == m_head.load(std::memory_order_acquire);
+	}
+
+	uint32_t threadId() const
+	{
+		return m_threadId;
+	}
+
+	void retire()
+	{
+		m_retired.store(true, std::memory_order_release);
+	}
+
+	bool retired() const
+	{
+		return m_retired.load(std::memory_order_acquire);
+	}
+
+private:
+	std::unique_ptr<uint64_t[]> m_buffer;
+	uint32_t                    m_threadId;
+	std::atomic<bool>           m_retired;
+	alignas(64) std::atomic<uint64_t> m_head;  // written by the owning thread
+	alignas(64) std::atomic<uint64_t> m_tail;  // written by the writer thread
+};
+
+///
+
+class AsyncLogWriter
+{
+public:
+	AsyncLogWriter(const std::vector<spdlog::sink_ptr>& sinks, plat::file_uptr traceFile);
+
+	LogRing* registerThread();
+
+	void flush();
+
+	void stop();
+
+	std::atomic<uint64_t> m_dropCount;
+
+private:
+	void run();
+
+	size_t drain();
+
+	void writeRecord(const LogRing* ring, const RecordHeader* header);
+
+	void writeDrops();
+
+	void writeMessage(uint64_t timestamp, uint32_t threadId, spdlog::level::level_enum level, const spdlog::memory_buf_t& payload);
+
+	uint32_t getTraceStringId(const void* key, const char* text);
+
+	template <typename T>
+	void putTrace(T value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		m_traceBlock.insert(m_traceBlock.end(), bytes, bytes + sizeof(value));
+	}
+
+	void commitTrace();
+
+private:
+	std::vector<spdlog::sink_ptr> m_sinks;
+	plat::file_uptr               m_traceFile;
+
+	// Writer thread only.
+	std::unordered_map<const void*, uint32_t> m_traceStrings;
+	std::vector<uint8_t>                      m_traceBlock;
+	std::vector<LogRing*>                     m_activeRings;
+	std::string                               m_message;
+	spdlog::memory_buf_t                      m_payload;
+	uint64_t                                  m_reportedDrops;
+	uint64_t                                  m_flushDone;
+
+	std::mutex                            m_ringMutex;
+	std::vector<std::unique_ptr<LogRing>> m_rings;
+
+	std::mutex              m_wakeMutex;
+	std::condition_variable m_wakeCond;
+	std::condition_variable m_flushCond;
+	uint64_t                m_flushRequest;
+	bool                    m_stopping;
+
+	std::thread m_thread;
+};
+
+AsyncLogWriter::AsyncLogWriter(const std::vector<spdlog::sink_ptr>& sinks, plat::file_uptr traceFile) :
+	m_dropCount(0),
+	m_sinks(sinks),
+	m_traceFile(std::move(traceFile)),
+	m_reportedDrops(0),
+	m_flushDone(0),
+	m_flushRequest(0),
+	m_stopping(false)
+{
+	m_thread = std::thread([this] { run(); });
+}
+
+LogRing* AsyncLogWriter::registerThread()
+{
+	auto     ring   = std::make_unique<LogRing>(static_cast<uint32_t>(spdlog::details::os::thread_id()));
+	LogRing* result = ring.get();
+
+	std::lock_guard<std::mutex> lock(m_ringMutex);
+	m_rings.push_back(std::move(ring));
+	return result;
+}
+
+void AsyncLogWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(m_wakeMutex);
+	if (m_stopping)
+	{
+		return;
+	}
+	uint64_t request = ++m_flushRequest;
+	m_wakeCond.notify_one();
+	m_flushCond.wait(lock, [&] { return m_flushDone >= request || m_stopping; });
+}
+
+void AsyncLogWriter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_stopping = true;
+	}
+	m_wakeCond.notify_one();
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+	m_flushCond.notify_all();
+	m_traceFile.reset();
+}
+
+void AsyncLogWriter::run()
+{
+	std::unique_lock<std::mutex> lock(m_wakeMutex);
+	while (true)
+	{
+		const uint64_t flushRequest = m_flushRequest;
+		const bool     stopping     = m_stopping;
+		const bool     flushing     = stopping || flushRequest != m_flushDone;
+		lock.unlock();
+
+		size_t count = drain();
+		if (flushing)
+		{
+			while (count == LOG_DRAIN_BATCH)
+			{
+				count = drain();
+			}
+		}
+		writeDrops();
+
+		if (flushing)
+		{
+			for (auto& sink : m_sinks)
+			{
+				sink->flush();
+			}
+			if (m_traceFile)
+			{
+				fflush(m_traceFile.get());
+			}
+		}
+
+		lock.lock();
+		if (flushRequest != m_flushDone)
+		{
+			m_flushDone = flushRequest;
+			m_flushCond.notify_all();
+		}
+		if (stopping)
+		{
+			break;
+		}
+		if (count == 0)
+		{
+			m_wakeCond.wait_for(lock, std::chrono::milliseconds(LOG_IDLE_WAIT_MS), [this] {
+				return m_stopping || m_flushRequest != m_flushDone;
+			});
+		}
+	}
+}
+
+size_t AsyncLogWriter::drain()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_ringMutex);
+		// Rings of exited threads are freed once everything they pushed has been written.
+		m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(),
+									 [](const std::unique_ptr<LogRing>& ring) { return ring->retired() && ring->empty(); }),
+					  m_rings.end());
+		m_activeRings.clear();
+		for (auto& ring : m_rings)
+		{
+			m_activeRings.push_back(ring.get());
+		}
+	}
+
+	size_t count = 0;
+	while (count != LOG_DRAIN_BATCH)
+	{
+		// Always write the oldest pending record, so output stays in timestamp order across threads.
+		LogRing*            oldestRing   = nullptr;
+		const RecordHeader* oldestHeader = nullptr;
+		for (auto ring : m_activeRings)
+		{
+			const RecordHeader* header = ring->front();
+			if (header && (!oldestHeader || header->m_timestamp < oldestHeader->m_timestamp))
+			{
+				oldestRing   = ring;
+				oldestHeader = header;
+			}
+		}
+		if (!oldestRing)
+		{
+			break;
+		}
+
+		writeRecord(oldestRing, oldestHeader);
+		oldestRing->pop(oldestHeader);
+		++count;
+	}
+	return count;
+}
+
+void AsyncLogWriter::writeRecord(const LogRing* ring, const RecordHeader* header)
+{
+	spdlog::level::level_enum spdLevel;
+	const char*               szPrefix;
+	getLevelInfo(static_cast<Level>(header->m_level), &spdLevel, &szPrefix);
+
+	bool shouldLog = std::any_of(m_sinks.begin(), m_sinks.end(),
+								 [spdLevel](const spdlog::sink_ptr& sink) { return sink->should_log(spdLevel); });
+	if (shouldLog)
+	{
+		m_message.clear();
+		formatRecord(m_message, header);
+		m_payload.clear();
+		fmt::format_to(m_payload, "{}{}({}): {}", szPrefix, header->m_function, header->m_line, m_message);
+		writeMessage(header->m_timestamp, ring->threadId(), spdLevel, m_payload);
+	}
+
+	if (m_traceFile)
+	{
+		uint32_t channelId = 0;
+		auto     iter      = m_traceStrings.find(header->m_channel);
+		if (iter != m_traceStrings.end())
+		{
+			channelId = iter->second;
+		}
+		else
+		{
+			channelId = getTraceStringId(header->m_channel, header->m_channel->getName().c_str());
+		}
+		uint32_t functionId = getTraceStringId(header->m_function, header->m_function);
+		uint32_t formatId   = getTraceStringId(header->m_format, header->m_format);
+
+		putTrace<uint8_t>(kTraceRecord);
+		putTrace<uint8_t>(header->m_level);
+		putTrace<uint8_t>(header->m_flags);
+		putTrace<int32_t>(header->m_line);
+		putTrace<uint32_t>(ring->threadId());
+		putTrace<uint64_t>(header->m_timestamp);
+		putTrace<uint32_t>(channelId);
+		putTrace<uint32_t>(functionId);
+		putTrace<uint32_t>(formatId);
+		putTrace<uint32_t>(header->m_argSize);
+		const uint8_t* args = reinterpret_cast<const uint8_t*>(header + 1);
+		m_traceBlock.insert(m_traceBlock.end(), args, args + header->m_argSize);
+		commitTrace();
+	}
+}
+
+void AsyncLogWriter::writeDrops()
+{
+	uint64_t dropCount = m_dropCount.load(std::memory_order_relaxed);
+	if (dropCount == m_reportedDrops)
+	{
+		return;
+	}
+
+	uint64_t timestamp = getTimestamp();
+	m_payload.clear();
+	fmt::format_to(m_payload, "<LOG>{} records dropped, logging threads outran the writer ({} in total).",
+				   dropCount - m_reportedDrops, dropCount);
+	writeMessage(timestamp, static_cast<uint32_t>(spdlog::details::os::thread_id()), spdlog::level::warn, m_payload);
+
+	if (m_traceFile)
+	{
+		putTrace<uint8_t>(kTraceDrop);
+		putTrace<uint64_t>(timestamp);
+		putTrace<uint64_t>(dropCount);
+		commitTrace();
+	}
+	m_reportedDrops = dropCount;
+}
+
+void AsyncLogWriter::writeMessage(uint64_t timestamp, uint32_t threadId, spdlog::level::level_enum level, const spdlog::memory_buf_t& payload)
+{
+	auto time = spdlog::log_clock::time_point(
+		std::chrono::duration_cast<spdlog::log_clock::duration>(std::chrono::nanoseconds(timestamp)));
+	spdlog::details::log_msg msg(time, spdlog::source_loc{}, spdlog::string_view_t{}, level,
+								 spdlog::string_view_t(payload.data(), payload.size()));
+	// Report the thread that logged the record, not the writer thread.
+	msg.thread_id = threadId;
+	for (auto& sink : m_sinks)
+	{
+		if (sink->should_log(level))
+		{
+			sink->log(msg);
+		}
+	}
+}
+
+uint32_t AsyncLogWriter::getTraceStringId(const void* key, const char* text)
+{
+	auto iter = m_traceStrings.find(key);
+	if (iter != m_traceStrings.end())
+	{
+		return iter->second;
+	}
+
+	uint32_t id     = static_cast<uint32_t>(m_traceStrings.size());
+	uint32_t length = static_cast<uint32_t>(strlen(text));
+	m_traceStrings.emplace(key, id);
+	putTrace<uint8_t>(kTraceString);
+	putTrace<uint32_t>(id);
+	putTrace<uint32_t>(length);
+	m_traceBlock.insert(m_traceBlock.end(), text, text + length);
+	commitTrace();
+	return id;
+}
+
+void AsyncLogWriter::commitTrace()
+{
+	fwrite(m_traceBlock.data(), 1, m_traceBlock.size(), m_traceFile.get());
+	m_traceBlock.clear();
+}
+
+///
+
+// Never freed, threads may still log while the process exits.
+static std::atomic<AsyncLogWriter*> g_asyncWriter(nullptr);
+
+struct ThreadRing
+{
+	LogRing* m_ring = nullptr;
+
+	~ThreadRing()
+	{
+		if (m_ring)
+		{
+			m_ring->retire();
+		}
+	}
+};
+
+static thread_local ThreadRing t_threadRing;
+
+// Write out everything still queued when the process exits.
+struct AsyncLogShutdown
+{
+	~AsyncLogShutdown()
+	{
+		if (auto writer = g_asyncWriter.load(std::memory_order_acquire))
+		{
+			writer->stop();
+		}
+	}
+};
+
+static AsyncLogShutdown g_asyncLogShutdown;
+
+bool startAsyncLog(const std::vector<spdlog::sink_ptr>& sinks, const std::string& traceFileName)
+{
+	bool ret = false;
+	do
+	{
+		plat::file_uptr traceFile;
+		if (!traceFileName.empty())
+		{
+			traceFile.reset(fopen(traceFileName.c_str(), "wb"));
+			if (!traceFile)
+			{
+				break;
+			}
+			setvbuf(traceFile.get(), nullptr, _IOFBF, LOG_TRACE_BUFFER_SIZE);
+
+			const uint32_t header[] = { kTraceMagic, kTraceVersion };
+			if (fwrite(header, sizeof(header), 1, traceFile.get()) != 1)
+			{
+				break;
+			}
+		}
+
+		g_asyncWriter.store(new AsyncLogWriter(sinks, std::move(traceFile)), std::memory_order_release);
+		ret = true;
+	} while (false);
+	return ret;
+}
+
+bool isAsyncLogEnabled()
+{
+	return g_asyncWriter.load(std::memory_order_relaxed) != nullptr;
+}
+
+void pushAsyncLog(Channel* channel, Level nLevel, const char* szFunction, int nLine, const char* szFormat, va_list args)
+{
+	AsyncLogWriter* writer = g_asyncWriter.load(std::memory_order_acquire);
+
+	ThreadRing& threadRing = t_threadRing;
+	if (!threadRing.m_ring)
+	{
+		threadRing.m_ring = writer->registerThread();
+	}
+
+	uint64_t recordBuffer[(sizeof(RecordHeader) + LOG_STR_BUFFER_LEN) / sizeof(uint64_t)];
+	auto     header     = reinterpret_cast<RecordHeader*>(recordBuffer);
+	header->m_flags     = 0;
+	header->m_level     = static_cast<uint8_t>(nLevel);
+	header->m_reserved  = 0;
+	header->m_line      = nLine;
+	header->m_timestamp = getTimestamp();
+	header->m_channel   = channel;
+	header->m_function  = szFunction;
+	header->m_format    = szFormat;
+
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	RecordBuilder builder(reinterpret_cast<uint8_t*>(recordBuffer), sizeof(recordBuffer));
+	if (!captureArgs(builder, szFormat, args))
+	{
+		// Conversions which can't be stored raw (wide strings, %n) are formatted right away.
+		builder.reset();
+		builder.putFormattedString(szFormat, argsCopy);
+		header->m_flags = kRecordPreformatted;
+	}
+	va_end(argsCopy);
+
+	header->m_size    = builder.size();
+	header->m_argSize = builder.size() - sizeof(RecordHeader);
+	if (!threadRing.m_ring->push(recordBuffer, header->m_size))
+	{
+		writer->m_dropCount.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void flushAsyncLog()
+{
+	if (auto writer = g_asyncWriter.load(std::memory_order_acquire))
+	{
+		writer->flush();
+	}
+}
+
+uint64_t getAsyncLogDropCount()
+{
+	auto writer = g_asyncWriter.load(std::memory_order_acquire);
+	return writer ? writer->m_dropCount.load(std::memory_order_relaxed) : 0;
+}
+
+}  // namespace logsys
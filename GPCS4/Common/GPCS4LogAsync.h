@@ -0,0 +1,93 @@
+#pragma once
+
+#include "GPCS4Log.h"
+
+#include <cstdarg>
+#include <string>
+#include <vector>
+#include <spdlog/common.h>
+
+// Deferred logging backend.
+//
+// In deferred mode Channel::print doesn't format anything on the calling thread.
+// It packs the format pointer, the raw arguments and a timestamp into a record
+// and pushes it into a lock-free ring owned by the calling thread.
+// A background thread pulls records from all rings, formats them and hands them to the sinks,
+// and optionally appends them to a binary trace file.
+// When a ring is full the record is dropped and counted, the caller never waits.
+//
+// Since only the pointer is kept, the format string must outlive the record,
+// which is why log formats must be string literals.
+//
+// Binary trace file layout, all values little endian:
+//
+// Header:
+//   uint32_t magic         kTraceMagic
+//   uint32_t version       kTraceVersion
+//
+// Followed by blocks, each starting with a uint8_t tag:
+//
+// kTraceString:   defines a string referenced by later records
+//   uint32_t id
+//   uint32_t length
+//   char     text[length]
+//
+// kTraceRecord:   one log record
+//   uint8_t  level         logsys::Level
+//   uint8_t  flags         kRecordPreformatted if args holds the final message instead of the arguments
+//   int32_t  line
+//   uint32_t threadId
+//   uint64_t timestamp     nanoseconds since the Unix epoch
+//   uint32_t channelId     string id of the channel name
+//   uint32_t functionId    string id of the function name
+//   uint32_t formatId      string id of the format string
+//   uint32_t argSize
+//   uint8_t  args[argSize]
+//
+// kTraceDrop:     records were dropped before this point
+//   uint64_t timestamp
+//   uint64_t droppedCount  total number of dropped records so far
+//
+// Arguments are stored in 8 byte slots, in the order the format string consumes them:
+// integers are sign or zero extended to 64 bits, floating point values are stored as double,
+// pointers as their address. A string is a slot holding its length (~0 for NULL),
+// followed by the characters, a terminating zero and padding up to the next slot.
+
+namespace logsys
+{;
+
+enum TraceBlockTag : uint8_t
+{
+	kTraceString = 1,
+	kTraceRecord = 2,
+	kTraceDrop   = 3,
+};
+
+enum RecordFlags : uint8_t
+{
+	kRecordPadding      = 1 << 0,
+	kRecordPreformatted = 1 << 1,
+};
+
+constexpr uint32_t kTraceMagic   = 0x474F4C54;  // TLOG
+constexpr uint32_t kTraceVersion = 1;
+
+// spdlog level and message prefix used for the given log level.
+void getLevelInfo(Level nLevel, spdlog::level::level_enum* pSpdLevel, const char** pPrefix);
+
+// Start the background writer. Records are written to the given sinks,
+// and to a binary trace file if traceFileName is not empty.
+bool startAsyncLog(const std::vector<spdlog::sink_ptr>& sinks, const std::string& traceFileName);
+
+bool isAsyncLogEnabled();
+
+// Capture a record into the calling thread's ring.
+void pushAsyncLog(Channel* channel, Level nLevel, const char* szFunction, int nLine, const char* szFormat, va_list args);
+
+// Block until every record pushed before this call has been written out.
+void flushAsyncLog();
+
+// Number of records dropped because a ring was full.
+uint64_t getAsyncLogDropCount();
+
+}  // namespace logsys
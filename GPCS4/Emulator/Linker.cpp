@@ -2,13 +2,28 @@
 #include "ModuleSystemCommon.h"
 #include "SceModuleSystem.h"
 #include "UtilString.h"
+#include "UtilThreadPool.h"
+#include "PlatDebug.h"
 #include "Loader/FuncStub.h"
 
+#include "xbyak/xbyak.h"
+
 
 LOG_CHANNEL(Linker);
 
+constexpr size_t LazyResolverSize = 0x100;
+constexpr size_t LazySlotSize     = 0x10;
+
 CLinker::CLinker() : m_modSystem{*CSceModuleSystem::GetInstance()} {}
 
+// Target of a lazily bound function which resolved to nothing,
+// when not even an unknown function stub could be generated for it.
+static void PS4API unresolvedLazyCall()
+{
+	LOG_ERR("unresolved lazily bound function is called");
+	plat::debugBreakPoint();
+}
+
 // resolveSymbol always returns true
 bool CLinker::resolveSymbol(NativeModule const &mod,
 							std::string const &name,
@@ -19,19 +34,36 @@ bool CLinker::resolveSymbol(NativeModule const &mod,
 	do
 	{
 		const SymbolInfo *info = nullptr;
-		void *address    = nullptr;
-		bool useNative   = false;
 
-		if (addrOut == nullptr)
+		auto ret = mod.getSymbol(name, &info);
+		if (!ret)
 		{
-			LOG_ERR("null pointer");
+			LOG_ERR("fail to find symbol: %s", name.c_str());
 			break;
 		}
 
-		auto ret = mod.getSymbol(name, &info);
-		if (!ret)
+		retVal = resolveSymbolInfo(*info, name, mod.fileName, addrOut);
+	} while (false);
+
+	return retVal;
+}
+
+bool CLinker::resolveSymbolInfo(SymbolInfo const &symbolInfo,
+								std::string const &name,
+								std::string const &fileName,
+								uint64_t *addrOut) const
+{
+	bool retVal = true;
+
+	do
+	{
+		const SymbolInfo *info = &symbolInfo;
+		void *address    = nullptr;
+		bool useNative   = false;
+
+		if (addrOut == nullptr)
 		{
-			LOG_ERR("fail to find symbol: %s", name.c_str());
+			LOG_ERR("null pointer");
 			break;
 		}
 
@@ -49,21 +81,21 @@ bool CLinker::resolveSymbol(NativeModule const &mod,
 		}
 		else
 		{
-			address = getSymbolAddress(info->moduleName,
-									   info->libraryName,
-									   info->nid);
-
-			auto policy = m_modSystem.getSymbolPolicy(info->moduleName,
-													  info->libraryName,
-													  info->nid);
-
-			useNative  = (policy == Policy::UseNative);
+			// Names are interned at load time, so this is a single
+			// hash table probe with the policy cached in the entry.
+			auto policy = Policy::UseBuiltin;
+			address     = const_cast<void *>(m_modSystem.getSymbolAddress(info->moduleId,
+																		  info->libraryId,
+																		  info->nid,
+																		  &policy));
+
+			useNative = (policy == Policy::UseNative);
 		}
 
 		const char* source = useNative? "NATIVE":"BUILTIN";
 
 		LOG_ERR_IF(address == nullptr, "fail to resolve symbol: %s[%s] from %s for module %s",
-				   name.c_str(), source, info->moduleName.c_str(), mod.fileName.c_str());
+				   name.c_str(), source, info->moduleName.c_str(), fileName.c_str());
 
 #ifdef MODSYS_STUB_DISABLE
 
@@ -141,10 +173,13 @@ void* CLinker::generateStubFunction(const SymbolInfo* sybInfo, void* oldFunc) co
 									 sybInfo->libraryName.c_str(),
 									 oldFunc);
 
+		auto name = sybInfo->libraryName + " " +
+					(sybInfo->isEncoded ? nidString : sybInfo->symbolName);
+
 		auto stubMgr  = GetFuncStubManager();
 		stubFunc      = oldFunc == nullptr ? 
-			stubMgr->generateUnknown(msg) : 
-			stubMgr->generate(msg, oldFunc);
+			stubMgr->generateUnknown(name, msg) : 
+			stubMgr->generate(name, msg, oldFunc);
 
 	} while (false);
 	return stubFunc;
@@ -153,33 +188,38 @@ void* CLinker::generateStubFunction(const SymbolInfo* sybInfo, void* oldFunc) co
 
 bool CLinker::relocateModules()
 {
-	auto &mods  = m_modSystem.getAllNativeModules();
-	bool retVal = false;
+	auto &mods = m_modSystem.getAllNativeModules();
+
+	// Every module only writes to its own image,
+	// and the symbol tables are read only by now.
+	std::atomic<bool> retVal = { !mods.empty() };
+	auto relocate = [&](size_t i) {
+		auto &mod = mods[i];
+		if (!relocateModule(mod))
+		{
+			LOG_ERR("fail to relocate module: %s", mod.fileName.c_str());
+			retVal = false;
+		}
+	};
 
-	for (auto &mod : mods)
+	if (m_parallelRelocation)
+	{
+		util::ThreadPool::shared().parallelFor(mods.size(), relocate);
+	}
+	else
 	{
-		retVal = relocateModule(mod);
-		if (retVal == false)
+		for (size_t i = 0; i < mods.size() && retVal; i++)
 		{
-			LOG_ERR("fail to relocate module: %s", mod.fileName.c_str());
-			break;
+			relocate(i);
 		}
 	}
 
 	return retVal;
 }
 
-void* CLinker::getSymbolAddress(std::string const& modName,
-								std::string const& libName,
-							    uint64_t nid) const
-{
-	auto pointer = m_modSystem.getSymbolAddress(modName, libName, nid);
-	return const_cast<void*>(pointer);
-}
-
 void* CLinker::getSymbolAddress(std::string const& modName, std::string const& libName, std::string const& symbName) const
 {
-	auto symbolManager = m_modSystem.getSymbolManager();
+	auto& symbolManager = m_modSystem.getSymbolManager();
 	auto policy = m_modSystem.getSymbolPolicy(modName, libName, symbName);
 	const void* pointer = nullptr;
 
@@ -195,6 +235,16 @@ void* CLinker::getSymbolAddress(std::string const& modName, std::string const& l
 	return const_cast<void*>(pointer);
 }
 
+void CLinker::setLazyBinding(bool enable)
+{
+	m_lazyBinding = enable;
+}
+
+void CLinker::setParallelRelocation(bool enable)
+{
+	m_parallelRelocation = enable;
+}
+
 bool CLinker::relocateModule(NativeModule& mod)
 {
 	bool retVal = false;
@@ -212,7 +262,7 @@ bool CLinker::relocateRela(NativeModule &mod)
 	bool retVal = false;
 	do
 	{
-		if (mod.getFileMemory().empty())
+		if (mod.getFileMapping().empty())
 		{
 			break;
 		}
@@ -220,12 +270,12 @@ bool CLinker::relocateRela(NativeModule &mod)
 		auto &info = mod.getModuleInfo();
 
 		uint8_t *pImageBase         = info.pCodeAddr;
-		uint8_t *pStrTab            = info.pStrTab;
-		Elf64_Sym *pSymTab       = (Elf64_Sym *)info.pSymTab;
-		Elf64_Rela *pRelaEntries = (Elf64_Rela *)info.pRela;
+		const uint8_t *pStrTab      = info.pStrTab;
+		const Elf64_Sym *pSymTab       = reinterpret_cast<const Elf64_Sym *>(info.pSymTab);
+		const Elf64_Rela *pRelaEntries = reinterpret_cast<const Elf64_Rela *>(info.pRela);
 		for (uint32_t i = 0; i != info.nRelaCount; ++i)
 		{
-			Elf64_Rela *pRela = &pRelaEntries[i];
+			const Elf64_Rela *pRela = &pRelaEntries[i];
 			auto nType        = ELF64_R_TYPE(pRela->r_info);
 			auto nSymIdx      = ELF64_R_SYM(pRela->r_info);
 
@@ -242,7 +292,7 @@ bool CLinker::relocateRela(NativeModule &mod)
 				break;
 			case R_X86_64_64:
 			{
-				Elf64_Sym &symbol = pSymTab[nSymIdx];
+				const Elf64_Sym &symbol = pSymTab[nSymIdx];
 				auto nBinding     = ELF64_ST_BIND(symbol.st_info);
 				uint64_t nSymVal    = 0;
 
@@ -271,7 +321,7 @@ bool CLinker::relocateRela(NativeModule &mod)
 			break;
 			case R_X86_64_GLOB_DAT:
 			{
-				Elf64_Sym& symbol = pSymTab[nSymIdx];
+				const Elf64_Sym& symbol = pSymTab[nSymIdx];
 				auto nBinding     = ELF64_ST_BIND(symbol.st_info);
 				uint64_t nSymVal    = 0;
 				auto pName       = (const char*)&pStrTab[symbol.st_name];
@@ -309,7 +359,7 @@ bool CLinker::relocatePltRela(NativeModule &mod)
 	bool bRet = false;
 	do
 	{
-		auto &fileData = mod.getFileMemory();
+		auto &fileData = mod.getFileMapping();
 		auto &info     = mod.getModuleInfo();
 
 		if (fileData.empty())
@@ -318,14 +368,22 @@ bool CLinker::relocatePltRela(NativeModule &mod)
 		}
 
 		uint8_t *pImageBase         = info.pCodeAddr;
-		uint8_t *pStrTab            = info.pStrTab;
-		Elf64_Sym *pSymTab       = (Elf64_Sym *)info.pSymTab;
-		Elf64_Rela *pRelaEntries = (Elf64_Rela *)info.pPltRela;
+		const uint8_t *pStrTab      = info.pStrTab;
+		const Elf64_Sym *pSymTab       = reinterpret_cast<const Elf64_Sym *>(info.pSymTab);
+		const Elf64_Rela *pRelaEntries = reinterpret_cast<const Elf64_Rela *>(info.pPltRela);
+
+		std::vector<LazyBindSlot> lazySlots;
+		const std::string*        lazyFileName = nullptr;
+		if (m_lazyBinding)
+		{
+			std::lock_guard<std::mutex> lock(m_lazyBindMutex);
+			lazyFileName = &m_lazyBindFileNames.emplace_back(mod.fileName);
+		}
 
 		LOG_DEBUG("PLT RELA count: %d, for library: %s", info.nPltRelaCount, mod.fileName.c_str());
 		for (uint32_t i = 0; i != info.nPltRelaCount; ++i)
 		{
-			Elf64_Rela *pRela = &pRelaEntries[i];
+			const Elf64_Rela *pRela = &pRelaEntries[i];
 			auto nType        = ELF64_R_TYPE(pRela->r_info);
 			auto nSymIdx      = ELF64_R_SYM(pRela->r_info);
 
@@ -333,7 +391,7 @@ bool CLinker::relocatePltRela(NativeModule &mod)
 			{
 			case R_X86_64_JUMP_SLOT:
 			{
-				Elf64_Sym &symbol = pSymTab[nSymIdx];
+				const Elf64_Sym &symbol = pSymTab[nSymIdx];
 				auto nBinding     = ELF64_ST_BIND(symbol.st_info);
 				uint64_t nSymVal    = 0;
 
@@ -343,8 +401,16 @@ bool CLinker::relocatePltRela(NativeModule &mod)
 				}
 				else if (nBinding == STB_GLOBAL || nBinding == STB_WEAK)
 				{
-					char *pName = (char *)&pStrTab[symbol.st_name];
+					auto pName = (const char *)&pStrTab[symbol.st_name];
 					//LOG_DEBUG("PLT RELA symbol: %s", pName);
+					const SymbolInfo *info = nullptr;
+					if (m_lazyBinding && mod.getSymbol(pName, &info))
+					{
+						lazySlots.push_back({ this, info, pName, lazyFileName,
+											  (uint64_t *)&pImageBase[pRela->r_offset] });
+						break;
+					}
+
 					if (!resolveSymbol(mod, pName, &nSymVal))
 					{
 						LOG_ERR("can not get symbol address.");
@@ -366,8 +432,140 @@ bool CLinker::relocatePltRela(NativeModule &mod)
 			break;
 			}
 		}
+
+		if (!lazySlots.empty() && !bindLazySlots(lazySlots))
+		{
+			LOG_WARN("fail to bind lazily, resolve %zu slots now for module: %s",
+					 lazySlots.size(), mod.fileName.c_str());
+			for (auto &slot : lazySlots)
+			{
+				resolveLazySlot(&slot);
+			}
+		}
+
+		bRet = true;
+	} while (false);
+
+	return bRet;
+}
+
+bool CLinker::bindLazySlots(std::vector<LazyBindSlot>& slots)
+{
+	using namespace Xbyak::util;
+
+	bool bRet = false;
+	do
+	{
+		size_t codeSize = LazyResolverSize + slots.size() * LazySlotSize;
+		auto   codeMem  = plat::VMAllocate(nullptr, codeSize,
+										   plat::VMAT_RESERVE_COMMIT, plat::VMPF_CPU_RWX);
+		if (!codeMem)
+		{
+			LOG_ERR("fail to allocate lazy bind trampolines");
+			break;
+		}
+
+		LazyBindTable table;
+		table.code.reset(reinterpret_cast<uint8_t *>(codeMem));
+
+		std::vector<const uint8_t *> trampolines;
+		trampolines.reserve(slots.size());
+		try
+		{
+			Xbyak::CodeGenerator gen(codeSize, codeMem);
+
+			// Shared resolver, entered from a trampoline with the slot in r11.
+			// It's reached by a guest call through the PLT,
+			// so all argument registers of the callee must survive.
+			Xbyak::Label resolver;
+			gen.L(resolver);
+			gen.push(rbp);
+			gen.mov(rbp, rsp);
+			gen.push(rdi);
+			gen.push(rsi);
+			gen.push(rdx);
+			gen.push(rcx);
+			gen.push(r8);
+			gen.push(r9);
+			gen.push(r10);
+			// al holds vector register count of varargs calls
+			gen.push(rax);
+			gen.and_(rsp, -16);
+			gen.sub(rsp, 8 * 16);
+			for (int i = 0; i != 8; ++i)
+			{
+				gen.movdqu(gen.ptr[rsp + i * 16], Xbyak::Xmm(i));
+			}
+			gen.mov(rdi, r11);
+			gen.mov(rax, reinterpret_cast<uint64_t>(&CLinker::resolveLazySlot));
+			gen.call(rax);
+			gen.mov(r11, rax);
+			for (int i = 0; i != 8; ++i)
+			{
+				gen.movdqu(Xbyak::Xmm(i), gen.ptr[rsp + i * 16]);
+			}
+			gen.lea(rsp, gen.ptr[rbp - 8 * 8]);
+			gen.pop(rax);
+			gen.pop(r10);
+			gen.pop(r9);
+			gen.pop(r8);
+			gen.pop(rcx);
+			gen.pop(rdx);
+			gen.pop(rsi);
+			gen.pop(rdi);
+			gen.pop(rbp);
+			gen.jmp(r11);
+
+			// Moving the vector keeps its elements in place.
+			table.slots = std::move(slots);
+			for (auto &slot : table.slots)
+			{
+				gen.align(LazySlotSize);
+				trampolines.push_back(gen.getCurr());
+
+				gen.mov(r11, reinterpret_cast<uint64_t>(&slot));
+				gen.jmp(resolver, Xbyak::CodeGenerator::T_NEAR);
+			}
+		}
+		catch (const Xbyak::Error &e)
+		{
+			LOG_ERR("generate lazy bind trampoline failed: %s", e.what());
+			slots = std::move(table.slots);
+			break;
+		}
+
+		// Only redirect the guest once all trampolines are ready.
+		for (size_t i = 0; i != trampolines.size(); ++i)
+		{
+			*table.slots[i].got = reinterpret_cast<uint64_t>(trampolines[i]);
+		}
+
+		std::lock_guard<std::mutex> lock(m_lazyBindMutex);
+		m_lazyBindTables.push_back(std::move(table));
+
 		bRet = true;
 	} while (false);
 
 	return bRet;
 }
+
+uint64_t PS4API CLinker::resolveLazySlot(LazyBindSlot *slot)
+{
+	uint64_t address = 0;
+	if (!slot->linker->resolveSymbolInfo(*slot->info, slot->name, *slot->fileName, &address) || !address)
+	{
+		LOG_ERR("can not get symbol address: %s", slot->name);
+
+		// The resolver jumps to what we return, never let that be 0.
+		address = reinterpret_cast<uint64_t>(slot->linker->generateStubFunction(slot->info, nullptr));
+		if (!address)
+		{
+			address = reinterpret_cast<uint64_t>(&unresolvedLazyCall);
+		}
+	}
+
+	// Other threads may race us here, but they all store the same value,
+	// and an aligned 64 bit store is atomic on x64.
+	*slot->got = address;
+	return address;
+}
@@ -3,7 +3,12 @@
 #include "GPCS4Common.h"
 #include "SceModuleSystem.h"
 #include "Module.h"
+#include "PlatMemory.h"
+
+#include <deque>
+#include <mutex>
 #include <string>
+#include <vector>
 
 class CLinker
 {
@@ -17,14 +22,58 @@ public:
 
 	bool relocateModules();
 
+	// Bind JUMP_SLOT relocations on first call instead of at load time.
+	// Imports the game never calls are never resolved, which shortens startup,
+	// but resolve errors are only reported when the function is called.
+	void setLazyBinding(bool enable);
+
+	// Relocate modules on the shared thread pool, which is the default.
+	// Turned off, modules are relocated one after another, to compare load times.
+	void setParallelRelocation(bool enable);
+
 private:
-	void* getSymbolAddress(std::string const &modName, std::string const& libName, uint64_t nid) const;
+	// A JUMP_SLOT bound on first call, see setLazyBinding.
+	// Modules may be loaded while the guest runs, which moves the NativeModule objects,
+	// so a slot only points to what stays in place: the symbol list and the string table.
+	struct LazyBindSlot
+	{
+		const CLinker*     linker;
+		const SymbolInfo*  info;
+		const char*        name;
+		const std::string* fileName;  // of the importing module
+		uint64_t*          got;
+	};
+
+	struct LazyBindTable
+	{
+		std::vector<LazyBindSlot> slots;
+		plat::memory_ptr          code;
+	};
+
+	bool resolveSymbolInfo(SymbolInfo const &info,
+						   std::string const &name,
+						   std::string const &fileName,
+						   uint64_t *addr) const;
 	void* getSymbolAddress(std::string const& modName, std::string const& libName, std::string const& symbName) const;
 	bool relocateModule(NativeModule &mod);
 	bool relocateRela(NativeModule &mod);
 	bool relocatePltRela(NativeModule &mod);
 	void* generateStubFunction(const SymbolInfo* sybInfo, void* oldFunc) const;
 
+	// Points every slot's GOT entry to a trampoline which resolves the symbol
+	// and patches the entry on first call.
+	// Takes the slots on success, leaves them and the GOT untouched on failure.
+	bool bindLazySlots(std::vector<LazyBindSlot>& slots);
+	static uint64_t PS4API resolveLazySlot(LazyBindSlot* slot);
+
 private:
 	CSceModuleSystem &m_modSystem;
+	bool              m_lazyBinding = false;
+	bool              m_parallelRelocation = true;
+
+	// Slots and trampolines stay alive as long as the guest may call them.
+	std::mutex                 m_lazyBindMutex;
+	std::vector<LazyBindTable> m_lazyBindTables;
+	// deque never moves the names the slots point to
+	std::deque<std::string>    m_lazyBindFileNames;
 };
@@ -1,11 +1,14 @@
 #include "Memory.h"
 
 #include "SceModules/sce_errors.h"
+
+#include <algorithm>
 #include <mutex>
 
 LOG_CHANNEL(Memory);
 
-MemoryAllocator::MemoryAllocator()
+MemoryAllocator::MemoryAllocator() :
+	m_heap(*this)
 {
 }
 
@@ -142,15 +145,81 @@ int32_t MemoryAllocator::mapDirectMemory(
 
 int32_t MemoryAllocator::memoryUnmap(void* addr, size_t len)
 {
-	plat::VMFree(addr);
-
-	auto iter = findMemoryBlock(addr);
-	if (iter.has_value())
+	int32_t err = SCE_KERNEL_ERROR_UNKNOWN;
+	do
 	{
-		m_memBlocks.erase(*iter);
-	}
+		std::lock_guard<util::sync::Spinlock> guard(m_lock);
 
-	return SCE_OK;
+		size_t start = reinterpret_cast<size_t>(addr);
+		size_t end   = 0;
+		if (len == 0)
+		{
+			// Internal callers release a whole block by its start address.
+			auto block = findMemoryBlock(addr);
+			if (!block)
+			{
+				plat::VMFree(addr);
+				err = SCE_OK;
+				break;
+			}
+
+			if ((*block)->second.start != start)
+			{
+				// Never drop a whole block, maybe a heap arena, for a pointer into it.
+				LOG_ERR("unmap %p which is inside block %p, ignored.",
+						addr, reinterpret_cast<void*>((*block)->second.start));
+				err = SCE_KERNEL_ERROR_EINVAL;
+				break;
+			}
+
+			end = start + (*block)->second.size;
+		}
+		else
+		{
+			if (!util::isAligned(start, (size_t)plat::VM_PAGE_SIZE))
+			{
+				err = SCE_KERNEL_ERROR_EINVAL;
+				break;
+			}
+			end = start + len;
+		}
+		end = util::align(end, (size_t)plat::VM_PAGE_SIZE);
+
+		// first block which may overlap the range
+		auto iter = m_memBlocks.upper_bound(start);
+		if (iter != m_memBlocks.begin())
+		{
+			auto prev = std::prev(iter);
+			if (start < prev->second.start + util::align(prev->second.size, (size_t)plat::VM_PAGE_SIZE))
+			{
+				iter = prev;
+			}
+		}
+
+		if (iter == m_memBlocks.end() || iter->second.start >= end)
+		{
+			// not mapped by us
+			plat::VMFree(addr);
+			err = SCE_OK;
+			break;
+		}
+
+		err = SCE_OK;
+		while (iter != m_memBlocks.end() && iter->second.start < end)
+		{
+			// a split only adds blocks at or after end, so next stays the right one to visit.
+			auto next = std::next(iter);
+			if (!unmapBlockRange(iter, start, end))
+			{
+				LOG_ERR("unmap %zx-%zx of block %zx size %zx failed.",
+						start, end, iter->second.start, iter->second.size);
+				err = SCE_KERNEL_ERROR_EINVAL;
+				break;
+			}
+			iter = next;
+		}
+	} while (false);
+	return err;
 }
 
 int32_t MemoryAllocator::checkedReleaseDirectMemory(int64_t start, size_t len)
@@ -172,6 +241,8 @@ int32_t MemoryAllocator::queryMemoryProtection(
 			break;
 		}
 
+		std::lock_guard<util::sync::Spinlock> guard(m_lock);
+
 		auto iter = findMemoryBlock(addr);
 		if (!iter)
 		{
@@ -179,17 +250,18 @@ int32_t MemoryAllocator::queryMemoryProtection(
 			break;
 		}
 
+		const auto& block = (*iter)->second;
 		if (start)
 		{
-			*start = reinterpret_cast<void*>((*iter)->start);
+			*start = reinterpret_cast<void*>(block.start);
 		}
 		if (end)
 		{
-			*end = reinterpret_cast<void*>((*iter)->start + (*iter)->size);
+			*end = reinterpret_cast<void*>(block.start + block.size);
 		}
 		if (prot)
 		{
-			*prot = (*iter)->protection;
+			*prot = block.protection;
 		}
 
 		err = SCE_OK;
@@ -197,49 +269,110 @@ int32_t MemoryAllocator::queryMemoryProtection(
 	return err;
 }
 
-// TODO:
-// for malloc series functions, we need to implement somewhat memory pool
-// algorithm, Nginx Slab may be a choice.
 void* MemoryAllocator::sce_malloc(size_t size)
 {
-	return allocateInternal(0, size, 0, SCE_KERNEL_PROT_CPU_RW);
+	void* ptr = m_heap.allocate(size);
+	if (!ptr)
+	{
+		// too large for the heap, or the heap can't get a new arena.
+		ptr = allocateInternal(0, size, 0, SCE_KERNEL_PROT_CPU_RW);
+	}
+	return ptr;
 }
 
 void* MemoryAllocator::sce_realloc(void* ptr, size_t new_size)
 {
 	void* ret = nullptr;
-	void* backup = nullptr;
 	do 
 	{
-		auto iter = findMemoryBlock(ptr);
-		if (!iter)
+		if (!ptr)
 		{
+			ret = sce_malloc(new_size);
 			break;
 		}
 
-		auto oldSize = iter.value()->size;
-		backup = malloc(oldSize);
-		if (!backup)
+		if (new_size == 0)
 		{
+			// A zero sized block can't be found by address anymore.
+			sce_free(ptr);
 			break;
 		}
-		memcpy(backup, ptr, oldSize);
 
-		memoryUnmap(ptr, 0);
-		ret = MemoryAllocator::sce_malloc(new_size);
+		if (m_heap.owns(ptr))
+		{
+			size_t oldSize = m_heap.blockSize(ptr);
+			if (!oldSize)
+			{
+				LOG_ERR("realloc a pointer not owned by heap %p", ptr);
+				break;
+			}
+
+			if (new_size <= oldSize)
+			{
+				ret = ptr;
+				break;
+			}
+
+			ret = sce_malloc(new_size);
+			if (!ret)
+			{
+				break;
+			}
+			memcpy(ret, ptr, oldSize);
+			m_heap.free(ptr);
+			break;
+		}
+
+		size_t oldSize = 0;
+		{
+			std::lock_guard<util::sync::Spinlock> guard(m_lock);
+			auto iter = findMemoryBlock(ptr);
+			if (!iter || (*iter)->second.start != reinterpret_cast<size_t>(ptr))
+			{
+				LOG_ERR("realloc a pointer not returned by malloc %p", ptr);
+				break;
+			}
+
+			auto& block = (*iter)->second;
+			if (new_size <= block.reserved)
+			{
+				// Still fits in the address range we reserved,
+				// commit the extra pages and we are done, no copy.
+				if (new_size > block.size &&
+					!plat::VMAllocate(ptr, new_size, plat::VMAT_COMMIT, convertProtectFlags(block.protection)))
+				{
+					break;
+				}
+
+				block.size = new_size;
+				ret        = ptr;
+				break;
+			}
+
+			oldSize = block.size;
+		}
+
+		// A block which grows once is likely to grow again (e.g. std::vector),
+		// so reserve address space after it for the next steps to commit into.
+		// With doubling growth every other step stays in place. The headroom is
+		// capped, only pages actually grown into are committed.
+		size_t headroom = std::min(new_size, MaxReallocHeadroom);
+		ret             = allocateInternal(nullptr, new_size, 0, SCE_KERNEL_PROT_CPU_RW, new_size + headroom);
+		if (!ret)
+		{
+			// no room for the headroom, a plain block will do.
+			ret = allocateInternal(nullptr, new_size, 0, SCE_KERNEL_PROT_CPU_RW);
+		}
 		if (!ret)
 		{
 			break;
 		}
-		memcpy(ret, backup, oldSize);
+
+		memcpy(ret, ptr, oldSize);
+		memoryUnmap(ptr, 0);
 
 	} while (false);
 	
-	if (backup)
-	{
-		free(backup);
-	}
-	
 	return ret;
 }
 
@@ -247,13 +380,30 @@ void* MemoryAllocator::sce_calloc(size_t num, size_t size)
 {
 	size_t total_size = num * size;
 	void*  mem        = sce_malloc(total_size);
-	memset(mem, 0, total_size);
+	if (mem)
+	{
+		memset(mem, 0, total_size);
+	}
 	return mem;
 }
 
 void MemoryAllocator::sce_free(void* ptr)
 {
-	memoryUnmap(ptr, 0);
+	if (!ptr)
+	{
+		return;
+	}
+
+	// Anything inside an arena goes to the heap, which rejects stale pointers,
+	// only pointers outside of it may release a mapping.
+	if (m_heap.owns(ptr))
+	{
+		m_heap.free(ptr);
+	}
+	else
+	{
+		memoryUnmap(ptr, 0);
+	}
 }
 
 void* MemoryAllocator::sce_mmap(void* addr, size_t length, int prot, int flags, int fd, int64_t offset)
@@ -285,13 +435,16 @@ plat::VM_PROTECT_FLAG MemoryAllocator::convertProtectFlags(int sceFlags)
 	return static_cast<plat::VM_PROTECT_FLAG>(utlFlags);
 }
 
-void* MemoryAllocator::allocateInternal(void* addrIn, size_t len, size_t alignment, int prot)
+void* MemoryAllocator::allocateInternal(void* addrIn, size_t len, size_t alignment, int prot, size_t reserveLen)
 {
 	void* addrOut = nullptr;
 	do
 	{
 		auto uprot = convertProtectFlags(prot);
 
+		// only the first len bytes are committed.
+		size_t mapLen = std::max(len, reserveLen);
+
 		if (alignment == 0)
 		{
 			alignment = SCE_KERNEL_PAGE_SIZE;
@@ -340,14 +493,29 @@ void* MemoryAllocator::allocateInternal(void* addrIn, size_t len, size_t alignme
 				}
 			}
 
-			if (regionSize < len)
+			if (regionSize < mapLen)
 			{
 				searchAddr = reinterpret_cast<size_t>(mi.pRegionStart) + mi.nRegionSize;
 				continue;
 			}
 
-			void* retAddress = VMAllocate(reinterpret_cast<void*>(regionAddress), len,
-										  plat::VMAT_RESERVE_COMMIT, uprot);
+			void* retAddress = nullptr;
+			if (mapLen == len)
+			{
+				retAddress = VMAllocate(reinterpret_cast<void*>(regionAddress), len,
+										plat::VMAT_RESERVE_COMMIT, uprot);
+			}
+			else
+			{
+				retAddress = VMAllocate(reinterpret_cast<void*>(regionAddress), mapLen,
+										plat::VMAT_RESERVE, uprot);
+				if (retAddress && !VMAllocate(retAddress, len, plat::VMAT_COMMIT, uprot))
+				{
+					plat::VMFree(retAddress);
+					retAddress = nullptr;
+				}
+			}
+
 			if (!retAddress)
 			{
 				searchAddr = reinterpret_cast<size_t>(mi.pRegionStart) + mi.nRegionSize;
@@ -355,7 +523,7 @@ void* MemoryAllocator::allocateInternal(void* addrIn, size_t len, size_t alignme
 			}
 
 			if (reinterpret_cast<size_t>(retAddress) >= SCE_KERNEL_SYS_MANAGE_AREA_START_ADDR &&
-				reinterpret_cast<size_t>(retAddress) + len <= SCE_KERNEL_SYS_MANAGE_AREA_END_ADDR)
+				reinterpret_cast<size_t>(retAddress) + mapLen <= SCE_KERNEL_SYS_MANAGE_AREA_END_ADDR)
 			{
 				// found it in system managed area
 				addrOut = retAddress;
@@ -363,7 +531,7 @@ void* MemoryAllocator::allocateInternal(void* addrIn, size_t len, size_t alignme
 			}
 
 			if (reinterpret_cast<size_t>(retAddress) >= SCE_KERNEL_APP_MAP_AREA_START_ADDR &&
-				reinterpret_cast<size_t>(retAddress) + len <= SCE_KERNEL_APP_MAP_AREA_END_ADDR)
+				reinterpret_cast<size_t>(retAddress) + mapLen <= SCE_KERNEL_APP_MAP_AREA_END_ADDR)
 			{
 				// found it in user area
 				addrOut = retAddress;
@@ -387,34 +555,110 @@ void* MemoryAllocator::allocateInternal(void* addrIn, size_t len, size_t alignme
 			{
 				reinterpret_cast<size_t>(addrOut),
 				len,
-				static_cast<uint32_t>(prot) 
+				mapLen,
+				static_cast<uint32_t>(prot),
+				reinterpret_cast<size_t>(addrOut)
 			};
-			m_memBlocks.emplace_back(block);
+			m_memBlocks.emplace(block.start, block);
 		}
 
 	} while (false);
 	return addrOut;
 }
 
-std::optional<MemoryAllocator::MemoryBlockList::iterator>
+std::optional<MemoryAllocator::MemoryBlockMap::iterator>
 MemoryAllocator::findMemoryBlock(void* addr)
 {
-	std::lock_guard<util::sync::Spinlock> guard(m_lock);
-
-	std::optional<MemoryBlockList::iterator> optResult;
-	auto iter = std::find_if(m_memBlocks.begin(), m_memBlocks.end(),
-							 [=](const MemoryBlock& block)
-							 {
-								 uintptr_t a = reinterpret_cast<size_t>(addr);
-								 return (a >= block.start && a < block.start + block.size);
-							 });
-	if (iter != m_memBlocks.end())
+	std::optional<MemoryBlockMap::iterator> optResult;
+	do
 	{
+		size_t a = reinterpret_cast<size_t>(addr);
+		// first block starts after addr, the previous one is the only candidate.
+		auto iter = m_memBlocks.upper_bound(a);
+		if (iter == m_memBlocks.begin())
+		{
+			break;
+		}
+
+		--iter;
+		if (a >= iter->second.start + iter->second.size)
+		{
+			break;
+		}
+
 		optResult.emplace(iter);
-	}
+	} while (false);
 	return optResult;
 }
 
+bool MemoryAllocator::unmapBlockRange(MemoryBlockMap::iterator iter, size_t start, size_t end)
+{
+	bool ret = false;
+	do
+	{
+		MemoryBlock block    = iter->second;
+		size_t      blockEnd = block.start + util::align(block.size, (size_t)plat::VM_PAGE_SIZE);
+		size_t      cutStart = std::max(start, block.start);
+		size_t      cutEnd   = std::min(end, blockEnd);
+
+		if (cutStart == block.start && cutEnd == blockEnd)
+		{
+			// Blocks split from the same reservation are neighbours in the map,
+			// nothing else can be mapped in between.
+			bool shared = (iter != m_memBlocks.begin() && std::prev(iter)->second.base == block.base) ||
+						  (std::next(iter) != m_memBlocks.end() && std::next(iter)->second.base == block.base);
+			if (shared)
+			{
+				if (!plat::VMDecommit(reinterpret_cast<void*>(cutStart), cutEnd - cutStart))
+				{
+					break;
+				}
+			}
+			else
+			{
+				plat::VMFree(reinterpret_cast<void*>(block.base));
+			}
+
+			m_memBlocks.erase(iter);
+			ret = true;
+			break;
+		}
+
+		if (!plat::VMDecommit(reinterpret_cast<void*>(cutStart), cutEnd - cutStart))
+		{
+			break;
+		}
+
+		if (cutStart != block.start)
+		{
+			// keep the head
+			auto& head = iter->second;
+			head.size  = cutStart - block.start;
+			if (cutEnd != blockEnd)
+			{
+				head.reserved = head.size;
+			}
+		}
+		else
+		{
+			m_memBlocks.erase(iter);
+		}
+
+		if (cutEnd != blockEnd)
+		{
+			// keep the tail
+			MemoryBlock tail = block;
+			tail.start       = cutEnd;
+			tail.size        = block.start + block.size - cutEnd;
+			tail.reserved    = block.start + block.reserved - cutEnd;
+			m_memBlocks.emplace(tail.start, tail);
+		}
+
+		ret = true;
+	} while (false);
+	return ret;
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -1,13 +1,14 @@
 #pragma once
 
 #include "GPCS4Common.h"
+#include "MemoryHeap.h"
 #include "PlatMemory.h"
 #include "UtilSync.h"
 
 #include "SceLibkernel/sce_kernel_memory.h"
 #include "tinydbr/memory_callback.h"
 
-#include <list>
+#include <map>
 #include <optional>
 
 // The emulated target process's memory must be allocated using this class.
@@ -18,17 +19,26 @@
 
 class MemoryAllocator
 {
+	friend class MemoryHeap;
+
 private:
 	struct MemoryBlock
 	{
 		size_t   start;
 		size_t   size;
+		size_t   reserved;  // reserved address range, larger than size for realloc headroom or after shrinking
 		uint32_t protection;
+		size_t   base;      // start of the platform reservation, shared by blocks split by a partial unmap
 	};
 
-	using MemoryBlockList = std::list<MemoryBlock>;
+	// Blocks keyed by start address, so the block containing
+	// any given address can be found in O(log n).
+	using MemoryBlockMap = std::map<size_t, MemoryBlock>;
 
 public:
+	// Most address space a block moved by sce_realloc reserves after its new size.
+	constexpr static size_t MaxReallocHeadroom = 256 * 1024 * 1024;
+
 	MemoryAllocator();
 	~MemoryAllocator();
 
@@ -98,14 +108,24 @@ private:
 	// convert SCE flags to UtilMemory flags.
 	plat::VM_PROTECT_FLAG convertProtectFlags(int sceFlags);
 
-	void* allocateInternal(void* addrIn, size_t len, size_t alignment, int prot);
+	// reserveLen larger than len reserves extra address space after the block,
+	// which sce_realloc can commit later to grow the block in place.
+	void* allocateInternal(void* addrIn, size_t len, size_t alignment, int prot, size_t reserveLen = 0);
 
-	std::optional<MemoryBlockList::iterator>
+	// Find the block which contains addr, not only starts at addr.
+	// Caller must hold m_lock.
+	std::optional<MemoryBlockMap::iterator>
 	findMemoryBlock(void* addr);
 
+	// Remove [start, end) from the block, which must overlap it.
+	// Caller must hold m_lock.
+	bool unmapBlockRange(MemoryBlockMap::iterator iter, size_t start, size_t end);
+
 private:
 	util::sync::Spinlock m_lock;
-	MemoryBlockList m_memBlocks;
+	MemoryBlockMap m_memBlocks;
+	// small allocations of the malloc series functions
+	MemoryHeap m_heap;
 };
 
 class MemoryController : public MemoryCallback
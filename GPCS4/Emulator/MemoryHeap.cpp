@@ -0,0 +1,489 @@
+#include "MemoryHeap.h"
+#include "Memory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+LOG_CHANNEL(MemoryHeap);
+
+// Blocks smaller than 1KB grow by 16 bytes, larger ones by 1/4 of the power of two below,
+// this keeps the internal fragmentation under 25%.
+static const std::array<uint32_t, MemoryHeap::SizeClassCount> g_sizeClassTable = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512,
+	640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+	2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192
+};
+
+// Heaps which are not destroyed yet.
+// A thread cache outlives its heap if the thread exits after the heap is destroyed,
+// and a new heap may be created at the same address, so heaps are identified by a serial number.
+static util::sync::Spinlock                          g_liveHeapLock;
+static std::vector<std::pair<MemoryHeap*, uint64_t>> g_liveHeaps;
+static std::atomic<uint64_t>                         g_heapSerial = { 0 };
+
+static bool isHeapAlive(MemoryHeap* heap, uint64_t serial)
+{
+	return std::find(g_liveHeaps.begin(), g_liveHeaps.end(), std::make_pair(heap, serial)) != g_liveHeaps.end();
+}
+
+struct MemoryHeap::ThreadCache
+{
+	constexpr static uint32_t Capacity   = 64;
+	constexpr static uint32_t BatchCount = Capacity / 2;
+
+	struct Bin
+	{
+		uint32_t count;
+		void*    blocks[Capacity];
+	};
+
+	~ThreadCache()
+	{
+		if (!owner)
+		{
+			return;
+		}
+
+		// The owner may have been destroyed before this thread exits,
+		// hold the registry lock so it can't go away while we give the blocks back.
+		std::lock_guard<util::sync::Spinlock> guard(g_liveHeapLock);
+		if (!isHeapAlive(owner, ownerSerial))
+		{
+			// The arenas are unmapped already, nothing to return.
+			return;
+		}
+
+		// The thread is exiting, give everything back so other threads can reuse it.
+		for (uint32_t i = 0; i != SizeClassCount; ++i)
+		{
+			owner->freeBatch(i, bins[i].blocks, bins[i].count);
+			bins[i].count = 0;
+		}
+	}
+
+	MemoryHeap*                     owner       = nullptr;
+	uint64_t                        ownerSerial = 0;
+	std::array<Bin, SizeClassCount> bins        = {};
+};
+
+thread_local MemoryHeap::ThreadCache MemoryHeap::t_threadCache;
+
+MemoryHeap::MemoryHeap(MemoryAllocator& allocator) :
+	m_allocator(allocator),
+	m_serial(++g_heapSerial)
+{
+	for (uint32_t i = 0; i != SizeClassCount; ++i)
+	{
+		m_classes[i].size     = g_sizeClassTable[i];
+		m_classes[i].capacity = static_cast<uint32_t>(SlabSize / g_sizeClassTable[i]);
+	}
+
+	for (auto& entry : m_arenaTable)
+	{
+		entry.store(nullptr, std::memory_order_relaxed);
+	}
+
+	std::lock_guard<util::sync::Spinlock> guard(g_liveHeapLock);
+	g_liveHeaps.emplace_back(this, m_serial);
+}
+
+MemoryHeap::~MemoryHeap()
+{
+	{
+		// After this point, exiting threads will drop their cached blocks instead of returning them.
+		std::lock_guard<util::sync::Spinlock> guard(g_liveHeapLock);
+		g_liveHeaps.erase(std::remove(g_liveHeaps.begin(), g_liveHeaps.end(), std::make_pair(this, m_serial)),
+						  g_liveHeaps.end());
+	}
+
+	if (t_threadCache.owner == this)
+	{
+		// The cached blocks go away with the arenas.
+		t_threadCache.owner = nullptr;
+		for (auto& bin : t_threadCache.bins)
+		{
+			bin.count = 0;
+		}
+	}
+
+	for (auto arena : m_arenas)
+	{
+		m_allocator.memoryUnmap(arena->base, ArenaSize);
+		delete arena;
+	}
+}
+
+void* MemoryHeap::allocate(size_t size)
+{
+	if (size > MaxSmallSize)
+	{
+		return nullptr;
+	}
+
+	uint32_t sizeClass = sizeToClass(size);
+	auto     cache     = threadCache();
+	if (unlikely(!cache))
+	{
+		void* block = nullptr;
+		allocateBatch(sizeClass, &block, 1);
+		return block;
+	}
+
+	auto& bin = cache->bins[sizeClass];
+	if (unlikely(bin.count == 0))
+	{
+		bin.count = allocateBatch(sizeClass, bin.blocks, ThreadCache::BatchCount);
+		if (!bin.count)
+		{
+			return nullptr;
+		}
+	}
+
+	return bin.blocks[--bin.count];
+}
+
+void MemoryHeap::free(void* ptr)
+{
+	Slab* slab = findSlab(ptr);
+	if (!slab)
+	{
+		LOG_ERR("free a pointer not owned by heap %p", ptr);
+		return;
+	}
+
+	// The slab can't change its size class while one of its blocks is alive,
+	// so reading it without the class lock is fine.
+	uint32_t sizeClass = slab->sizeClass;
+	auto     cache     = threadCache();
+	if (unlikely(!cache))
+	{
+		freeBatch(sizeClass, &ptr, 1);
+		return;
+	}
+
+	auto& bin = cache->bins[sizeClass];
+	if (unlikely(bin.count == ThreadCache::Capacity))
+	{
+		// Return the older half to the slabs, keep the recently freed (hot) ones.
+		freeBatch(sizeClass, bin.blocks, ThreadCache::BatchCount);
+		std::memmove(bin.blocks, bin.blocks + ThreadCache::BatchCount,
+					 (ThreadCache::Capacity - ThreadCache::BatchCount) * sizeof(void*));
+		bin.count -= ThreadCache::BatchCount;
+	}
+
+	bin.blocks[bin.count++] = ptr;
+}
+
+bool MemoryHeap::owns(const void* ptr) const
+{
+	return findArena(ptr) != nullptr;
+}
+
+size_t MemoryHeap::blockSize(const void* ptr) const
+{
+	size_t size = 0;
+	Slab*  slab = findSlab(ptr);
+	if (slab)
+	{
+		size = m_classes[slab->sizeClass].size;
+	}
+	return size;
+}
+
+uint32_t MemoryHeap::sizeToClass(size_t size)
+{
+	static const auto s_classIndexTable = []()
+	{
+		std::array<uint8_t, MaxSmallSize / MinAlignment + 1> table = {};
+
+		uint32_t sizeClass = 0;
+		for (uint32_t i = 0; i != table.size(); ++i)
+		{
+			while (g_sizeClassTable[sizeClass] < i * MinAlignment)
+			{
+				++sizeClass;
+			}
+			table[i] = static_cast<uint8_t>(sizeClass);
+		}
+		return table;
+	}();
+
+	return s_classIndexTable[(size + MinAlignment - 1) / MinAlignment];
+}
+
+MemoryHeap::Arena* MemoryHeap::findArena(const void* ptr) const
+{
+	size_t index = reinterpret_cast<size_t>(ptr) / ArenaSize;
+	if (index >= MaxArenaCount)
+	{
+		return nullptr;
+	}
+	return m_arenaTable[index].load(std::memory_order_acquire);
+}
+
+MemoryHeap::Slab* MemoryHeap::findSlab(const void* ptr) const
+{
+	Slab*  slab  = nullptr;
+	Arena* arena = findArena(ptr);
+	if (arena)
+	{
+		size_t index = (reinterpret_cast<const uint8_t*>(ptr) - arena->base) / SlabSize;
+		// A slab which is not in use has zero capacity.
+		if (arena->slabs[index].capacity.load(std::memory_order_acquire))
+		{
+			slab = &arena->slabs[index];
+		}
+	}
+	return slab;
+}
+
+MemoryHeap::Slab* MemoryHeap::acquireSlab(uint32_t sizeClass)
+{
+	std::lock_guard<util::sync::Spinlock> guard(m_arenaLock);
+
+	Slab* slab = nullptr;
+	for (auto arena : m_arenas)
+	{
+		if (!arena->freeSlabs.empty())
+		{
+			slab = arena->freeSlabs.back();
+			if (!plat::VMAllocate(slab->base, SlabSize, plat::VMAT_COMMIT, plat::VMPF_CPU_RW))
+			{
+				LOG_ERR("recommit heap slab %p failed.", slab->base);
+				slab = nullptr;
+				break;
+			}
+			arena->freeSlabs.pop_back();
+			break;
+		}
+
+		if (arena->unusedSlabIndex != SlabsPerArena)
+		{
+			slab = &arena->slabs[arena->unusedSlabIndex++];
+			break;
+		}
+	}
+
+	if (!slab)
+	{
+		Arena* arena = createArena();
+		if (arena)
+		{
+			slab = &arena->slabs[arena->unusedSlabIndex++];
+		}
+	}
+
+	if (slab)
+	{
+		slab->freeList      = nullptr;
+		slab->sizeClass     = sizeClass;
+		slab->carved        = 0;
+		slab->used          = 0;
+		slab->prev          = nullptr;
+		slab->next          = nullptr;
+		slab->inPartialList = false;
+		// Publish the slab last, findSlab must see the fields above once it sees the capacity.
+		slab->capacity.store(m_classes[sizeClass].capacity, std::memory_order_release);
+	}
+
+	return slab;
+}
+
+void MemoryHeap::releaseSlab(Slab* slab)
+{
+	std::lock_guard<util::sync::Spinlock> guard(m_arenaLock);
+
+	Arena* arena = findArena(slab->base);
+	slab->capacity.store(0, std::memory_order_release);
+	slab->freeList = nullptr;
+
+	// No block of the slab is alive, give the pages back to the host.
+	if (!plat::VMDecommit(slab->base, SlabSize))
+	{
+		LOG_WARN("decommit heap slab %p failed.", slab->base);
+	}
+
+	arena->freeSlabs.push_back(slab);
+}
+
+MemoryHeap::Arena* MemoryHeap::createArena()
+{
+	Arena* arena = nullptr;
+	do
+	{
+		void* base = m_allocator.allocateInternal(nullptr, ArenaSize, ArenaSize, SCE_KERNEL_PROT_CPU_RW);
+		if (!base)
+		{
+			LOG_ERR("map heap arena failed.");
+			break;
+		}
+
+		size_t index = reinterpret_cast<size_t>(base) / ArenaSize;
+		if (index >= MaxArenaCount ||
+			reinterpret_cast<size_t>(base) + ArenaSize > SCE_KERNEL_SYS_MANAGE_AREA_END_ADDR)
+		{
+			// system managed area exhausted, let the caller fall back to VM mapping.
+			LOG_WARN("heap arena %p out of system managed area.", base);
+			m_allocator.memoryUnmap(base, ArenaSize);
+			break;
+		}
+
+		arena                  = new Arena();
+		arena->base            = reinterpret_cast<uint8_t*>(base);
+		arena->unusedSlabIndex = 0;
+		arena->slabs           = std::make_unique<Slab[]>(SlabsPerArena);
+		for (size_t i = 0; i != SlabsPerArena; ++i)
+		{
+			arena->slabs[i].base = arena->base + i * SlabSize;
+		}
+
+		m_arenas.push_back(arena);
+		m_arenaTable[index].store(arena, std::memory_order_release);
+
+		LOG_DEBUG("new heap arena %p", base);
+	} while (false);
+	return arena;
+}
+
+void MemoryHeap::linkPartial(SizeClass& cls, Slab* slab)
+{
+	slab->prev = nullptr;
+	slab->next = cls.partial;
+	if (cls.partial)
+	{
+		cls.partial->prev = slab;
+	}
+	cls.partial         = slab;
+	slab->inPartialList = true;
+}
+
+void MemoryHeap::unlinkPartial(SizeClass& cls, Slab* slab)
+{
+	if (slab->prev)
+	{
+		slab->prev->next = slab->next;
+	}
+	else
+	{
+		cls.partial = slab->next;
+	}
+
+	if (slab->next)
+	{
+		slab->next->prev = slab->prev;
+	}
+
+	slab->prev          = nullptr;
+	slab->next          = nullptr;
+	slab->inPartialList = false;
+}
+
+uint32_t MemoryHeap::allocateBatch(uint32_t sizeClass, void** out, uint32_t count)
+{
+	auto& cls = m_classes[sizeClass];
+	std::lock_guard<util::sync::Spinlock> guard(cls.lock);
+
+	uint32_t filled = 0;
+	while (filled != count)
+	{
+		Slab* slab = cls.partial;
+		if (!slab)
+		{
+			slab = acquireSlab(sizeClass);
+			if (!slab)
+			{
+				break;
+			}
+			linkPartial(cls, slab);
+		}
+
+		while (filled != count && slab->used != cls.capacity)
+		{
+			void* block = nullptr;
+			if (slab->freeList)
+			{
+				block          = slab->freeList;
+				slab->freeList = *reinterpret_cast<void**>(block);
+			}
+			else
+			{
+				// Carve lazily so untouched pages never become resident.
+				block = slab->base + static_cast<size_t>(slab->carved) * cls.size;
+				++slab->carved;
+			}
+
+			++slab->used;
+			out[filled++] = block;
+		}
+
+		if (slab->used == cls.capacity)
+		{
+			unlinkPartial(cls, slab);
+		}
+	}
+
+	return filled;
+}
+
+void MemoryHeap::freeBatch(uint32_t sizeClass, void* const* blocks, uint32_t count)
+{
+	if (!count)
+	{
+		return;
+	}
+
+	auto& cls = m_classes[sizeClass];
+	std::lock_guard<util::sync::Spinlock> guard(cls.lock);
+
+	for (uint32_t i = 0; i != count; ++i)
+	{
+		void* block = blocks[i];
+		Slab* slab  = findSlab(block);
+
+		*reinterpret_cast<void**>(block) = slab->freeList;
+		slab->freeList                   = block;
+		--slab->used;
+
+		if (!slab->inPartialList)
+		{
+			linkPartial(cls, slab);
+		}
+		else if (slab->used == 0 && (slab->prev || slab->next))
+		{
+			// Keep at least one partial slab per class,
+			// otherwise a malloc/free loop would acquire and release the same slab forever.
+			unlinkPartial(cls, slab);
+			releaseSlab(slab);
+		}
+	}
+}
+
+MemoryHeap::ThreadCache* MemoryHeap::threadCache()
+{
+	ThreadCache* cache = &t_threadCache;
+	// A new heap may live at the address of a destroyed one, so compare the serial too.
+	if (unlikely(cache->owner != this || cache->ownerSerial != m_serial))
+	{
+		if (cache->owner)
+		{
+			std::lock_guard<util::sync::Spinlock> guard(g_liveHeapLock);
+			if (isHeapAlive(cache->owner, cache->ownerSerial))
+			{
+				// This thread's cache serves another heap.
+				return nullptr;
+			}
+
+			// The previous owner is gone together with its arenas, drop the stale blocks.
+			for (auto& bin : cache->bins)
+			{
+				bin.count = 0;
+			}
+		}
+		cache->owner       = this;
+		cache->ownerSerial = m_serial;
+	}
+	return cache;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "GPCS4Common.h"
+#include "UtilSync.h"
+
+#include "SceLibkernel/sce_kernel_memory.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class MemoryAllocator;
+
+// Small object heap backing the guest's malloc series functions.
+//
+// Memory is carved from large arenas which are mapped in the system managed area
+// through MemoryAllocator, so a 16 bytes malloc no longer costs a whole page plus a syscall.
+// An arena is split into fixed size slabs, each slab serves a single size class.
+// Slab bookkeeping lives on the host side, guest memory only holds the free list links.
+//
+// Every thread keeps a small cache of free blocks per size class,
+// so most malloc/free pairs never touch a lock.
+//
+// Requests larger than MaxSmallSize are not handled here,
+// the caller should map them with the VM functions instead.
+
+class MemoryHeap
+{
+public:
+	constexpr static size_t   MinAlignment   = 16;
+	constexpr static size_t   MaxSmallSize   = 8192;
+	constexpr static size_t   SlabSize       = 64 * 1024;
+	constexpr static size_t   ArenaSize      = 64 * 1024 * 1024;
+	constexpr static size_t   SlabsPerArena  = ArenaSize / SlabSize;
+	constexpr static uint32_t SizeClassCount = 32;
+
+	// Arenas are always placed in the system managed area, aligned to ArenaSize,
+	// so the owner arena of any address can be found by a single table lookup.
+	constexpr static size_t MaxArenaCount = SCE_KERNEL_SYS_MANAGE_AREA_END_ADDR / ArenaSize + 1;
+
+	explicit MemoryHeap(MemoryAllocator& allocator);
+	~MemoryHeap();
+
+	MemoryHeap(const MemoryHeap&) = delete;
+	MemoryHeap& operator=(const MemoryHeap&) = delete;
+
+	// Returns nullptr if size is larger than MaxSmallSize or we are out of memory.
+	void* allocate(size_t size);
+
+	// Pointers inside an arena but not in a slab in use are logged and ignored.
+	void free(void* ptr);
+
+	// Whether the pointer lies inside one of the heap's arenas.
+	// Such pointers must never be passed to the VM functions,
+	// that would unmap the whole arena.
+	bool owns(const void* ptr) const;
+
+	// Usable size of a block returned by allocate, 0 if ptr is not in a slab in use.
+	size_t blockSize(const void* ptr) const;
+
+private:
+	struct Slab
+	{
+		void*    freeList;
+		uint8_t* base;
+		uint32_t sizeClass;
+		uint32_t carved;    // blocks ever handed out from the bump area
+		uint32_t used;
+		// Zero while the slab is not in use.
+		// Written under the arena lock, read by findSlab without it.
+		std::atomic<uint32_t> capacity;
+		Slab*    prev;
+		Slab*    next;
+		bool     inPartialList;
+	};
+
+	struct Arena
+	{
+		uint8_t*                base;
+		uint32_t                unusedSlabIndex;
+		std::unique_ptr<Slab[]> slabs;
+		// Released slabs, decommitted until they are acquired again.
+		std::vector<Slab*>      freeSlabs;
+	};
+
+	struct SizeClass
+	{
+		util::sync::Spinlock lock;
+		uint32_t             size;
+		uint32_t             capacity;
+		Slab*                partial = nullptr;
+	};
+
+	struct ThreadCache;
+
+private:
+	static uint32_t sizeToClass(size_t size);
+
+	Arena* findArena(const void* ptr) const;
+
+	Slab* findSlab(const void* ptr) const;
+
+	Slab* acquireSlab(uint32_t sizeClass);
+
+	void releaseSlab(Slab* slab);
+
+	Arena* createArena();
+
+	void linkPartial(SizeClass& cls, Slab* slab);
+
+	void unlinkPartial(SizeClass& cls, Slab* slab);
+
+	// Fill up to count blocks of the given class into out, return filled count.
+	uint32_t allocateBatch(uint32_t sizeClass, void** out, uint32_t count);
+
+	// Give count blocks back to their slabs, all blocks must belong to the same class.
+	void freeBatch(uint32_t sizeClass, void* const* blocks, uint32_t count);
+
+	ThreadCache* threadCache();
+
+private:
+	MemoryAllocator& m_allocator;
+	uint64_t         m_serial;
+
+	std::array<SizeClass, SizeClassCount> m_classes;
+
+	util::sync::Spinlock m_arenaLock;
+	std::vector<Arena*>  m_arenas;
+	std::array<std::atomic<Arena*>, MaxArenaCount> m_arenaTable;
+
+	static thread_local ThreadCache t_threadCache;
+};
@@ -1,5 +1,4 @@
 #include "Module.h"
-#include "UtilString.h"
 #include "Emulator/SceModuleSystem.h"
 
 #include <spdlog/fmt/fmt.h>
@@ -11,8 +10,7 @@ LOG_CHANNEL(Module);
 const MODULE_INFO &NativeModule::getModuleInfo() const { return m_moduleInfo; }
 MODULE_INFO &NativeModule::getModuleInfo() { return m_moduleInfo; }
 
-const ByteArray &NativeModule::getFileMemory() const { return m_fileMemory; }
-ByteArray &NativeModule::getFileMemory() { return m_fileMemory; }
+const plat::FileMapping &NativeModule::getFileMapping() const { return m_fileMapping; }
 
 bool NativeModule::isModule() const
 {
@@ -191,63 +189,72 @@ bool NativeModule::getLibNameFromId(uint64_t id,
 	return retVal;
 }
 
-bool NativeModule::decodeValue(std::string const &encodedStr,
-									 uint64_t &value) const
+// the max length for an encode id is 11
+// from orbis-ld.exe
+constexpr uint32_t NidEncodeLengthMax = 11;
+constexpr uint8_t  NidInvalidCode     = 0x80;
+
+// Maps characters of the encoding alphabet to their 6 bit value,
+// all other characters have NidInvalidCode set.
+struct NidDecodeTable
 {
-	bool bRet = false;
+	constexpr NidDecodeTable() :
+		code()
+	{
+		const char alphabet[] =
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+-";
+
+		for (auto &c : code)
+		{
+			c = NidInvalidCode;
+		}
+
+		for (uint32_t i = 0; i < 64; ++i)
+		{
+			code[static_cast<uint8_t>(alphabet[i])] = static_cast<uint8_t>(i);
+		}
+	}
+
+	uint8_t code[256];
+};
 
-	// the max length for an encode id is 11
-	// from orbis-ld.exe
-	const uint32_t nEncLenMax = 11;
-	const char pCodes[] =
-		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+-";
+static constexpr NidDecodeTable g_nidDecodeTable = {};
+
+bool NativeModule::decodeValue(const char *encodedStr,
+							   size_t length,
+							   uint64_t &value) const
+{
+	bool bRet = false;
 
 	do
 	{
-
-		if (encodedStr.size() > nEncLenMax)
+		if (length > NidEncodeLengthMax)
 		{
-			LOG_ERR("encode id too long: %s", encodedStr.c_str());
+			LOG_ERR("encode id too long: %.*s", static_cast<int>(length), encodedStr);
 			break;
 		}
 
-		bool bError = false;
-		value       = 0;
-
-		for (int i = 0; i < encodedStr.size(); ++i)
+		// Invalid characters are only checked once at the end,
+		// so the loop has no data dependent branches.
+		uint64_t result = 0;
+		uint32_t error  = 0;
+		for (size_t i = 0; i < length; ++i)
 		{
-			auto pChPos = strchr(pCodes, encodedStr[i]);
-			uint32_t nIndex = 0;
-
-			if (pChPos != nullptr)
-			{
-				nIndex = static_cast<uint32_t>(pChPos - pCodes);
-			}
-			else
-			{
-				bError = true;
-				break;
-			}
+			uint32_t code = g_nidDecodeTable.code[static_cast<uint8_t>(encodedStr[i])];
+			error |= code;
 
 			// NID is 64 bits long, thus we do 6 x 10 + 4 times
-			if (i < nEncLenMax - 1)
-			{
-				value <<= 6;
-				value |= nIndex;
-			}
-			else
-			{
-				value <<= 4;
-				value |= (nIndex >> 2);
-			}
+			uint32_t bits = i < NidEncodeLengthMax - 1 ? 6 : 4;
+			result        = (result << bits) | (code >> (6 - bits));
 		}
 
-		if (bError)
+		if (error & NidInvalidCode)
 		{
 			break;
 		}
 
-		bRet = true;
+		value = result;
+		bRet  = true;
 	} while (false);
 	return bRet;
 }
@@ -266,34 +273,42 @@ bool NativeModule::decodeSymbol(std::string const &strEncName,
 			break;
 		}
 
-		auto &nModuleId  = *modId;
-		auto &nLibraryId = *libId;
-		auto &nNid       = *funcNid;
+		// nid#lib#mod, parsed in place
+		size_t libPos = strEncName.find('#');
+		if (libPos == std::string::npos)
+		{
+			break;
+		}
 
-		std::vector<std::string> vtNameParts = util::str::split(strEncName, '#');
-		if (vtNameParts.empty())
+		size_t modPos = strEncName.find('#', libPos + 1);
+		if (modPos == std::string::npos)
 		{
 			break;
 		}
 
-		if (!decodeValue(vtNameParts[0], nNid))
+		const char *str = strEncName.data();
+
+		uint64_t nNid = 0;
+		if (!decodeValue(str, libPos, nNid))
 		{
 			break;
 		}
 
 		uint64_t nLibId = 0;
-		if (!decodeValue(vtNameParts[1], nLibId))
+		if (!decodeValue(str + libPos + 1, modPos - libPos - 1, nLibId))
 		{
 			break;
 		}
-		nLibraryId = static_cast<uint32_t>(nLibId);
 
 		uint64_t nModId = 0;
-		if (!decodeValue(vtNameParts[2], nModId))
+		if (!decodeValue(str + modPos + 1, strEncName.size() - modPos - 1, nModId))
 		{
 			break;
 		}
-		nModuleId = static_cast<uint32_t>(nModId);
+
+		*funcNid = nNid;
+		*libId   = static_cast<uint32_t>(nLibId);
+		*modId   = static_cast<uint32_t>(nModId);
 
 		bRet = true;
 	} while (false);
@@ -3,6 +3,7 @@
 #include "GPCS4Common.h"
 #include "Loader/elf.h"
 #include "PlatMemory.h"
+#include "PlatFile.h"
 
 #include <vector>
 #include <memory>
@@ -34,29 +35,29 @@ struct MODULE_INFO
 
 	// the following segments do not have vaddr or memsz in phdr (at least in
 	// GOW4), so we don't have to load them into virtual memory, just record
-	// it's pointer in file memory
-	uint8_t *pDynamic;
+	// it's pointer in the read only file mapping
+	const uint8_t *pDynamic;
 	uint32_t nDynamicSize;
 
-	uint8_t *pSceDynLib;
+	const uint8_t *pSceDynLib;
 	uint32_t nSceDynLibSize;
 
-	uint8_t *pRela;
+	const uint8_t *pRela;
 	uint32_t nRelaCount;
-	uint8_t *pPltRela;
+	const uint8_t *pPltRela;
 	uint32_t nPltRelaCount;
 	uint32_t nPltRelType;
 
-	uint8_t *pSymTab;
+	const uint8_t *pSymTab;
 	uint32_t nSymTabSize;
 
-	uint8_t *pStrTab;
+	const uint8_t *pStrTab;
 	uint32_t nStrTabSize;
 
-	uint8_t *pSceComment;
+	const uint8_t *pSceComment;
 	uint32_t nSceCommentSize;
 
-	uint8_t *pSceLibVersion;
+	const uint8_t *pSceLibVersion;
 	uint32_t nSceLibVersionSize;
 };
 
@@ -118,6 +119,9 @@ struct SymbolInfo
 	std::string symbolName;
 	std::string moduleName;
 	std::string libraryName;
+	// interned by SymbolManager, for fast lookup
+	uint32_t moduleId  = ~0u;
+	uint32_t libraryId = ~0u;
 	uint64_t address;
 	uint64_t nid;
 	bool isEncoded;
@@ -130,12 +134,13 @@ using SymbolList         = std::vector<SymbolInfo>;
 using NameSymbolIndexMap = std::unordered_map<std::string, size_t>;
 using FileList           = std::vector<std::string>;
 using SymbolAddrMap      = std::map<std::string, void *>;
-using ByteArray          = std::vector<uint8_t>;
 
 class ELFMapper;
 struct NativeModule
 {
 	friend ELFMapper;
+	// Decodes symbol names on their own, see Tests/TestNativeModule.cpp
+	friend struct NativeModuleTester;
 
 public:
 	typedef int PS4API (*init_proc)(size_t argc, void* argv[], int (*post_init)(size_t argc, void* argv[]));
@@ -148,8 +153,7 @@ public:
 	plat::memory_ptr &getMappedMemory();
 	const MODULE_INFO &getModuleInfo() const;
 	MODULE_INFO &getModuleInfo();
-	const ByteArray &getFileMemory() const;
-	ByteArray &getFileMemory();
+	const plat::FileMapping &getFileMapping() const;
 	bool isModule() const;
 
 	int initialize();
@@ -191,7 +195,9 @@ private:
 						  LibraryList const &libs,
 						  std::string *libName) const;
 
-	bool decodeValue(std::string const &encodedStr, uint64_t &value) const;
+	bool decodeValue(const char *encodedStr,
+					 size_t length,
+					 uint64_t &value) const;
 
 	bool decodeSymbol(std::string const &strEncName,
 					  uint32_t *modId,
@@ -214,8 +220,8 @@ private:
 
 	plat::memory_ptr m_mappedMemory;
 	size_t m_mappedSize;
-	ByteArray m_fileMemory;
+	plat::FileMapping m_fileMapping;
 
-	Elf64_Ehdr *m_elfHeader;
+	const Elf64_Ehdr *m_elfHeader;
 	MODULE_INFO m_moduleInfo;
 };
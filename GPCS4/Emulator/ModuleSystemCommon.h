@@ -26,4 +26,21 @@
 // Use debug stub on unknown
 #define MODSYS_STUB_ON_UNKNOWN
 
+// Calls of unknown functions are always logged.
+
+// Log calls of native functions too, this is slow.
+// #define MODSYS_STUB_LOG_CALLS
+
+// Count calls per function in debug stubs, see FuncStubManager::dumpProfile.
+// #define MODSYS_STUB_PROFILE
+
+// Count cycles spent in stubbed functions with rdtsc, needs MODSYS_STUB_PROFILE.
+// The return address of every call is replaced,
+// so a longjmp or an exception across a stub breaks the profile of that thread.
+// #define MODSYS_STUB_PROFILE_TIME
+
+#if defined(MODSYS_STUB_PROFILE_TIME) && !defined(MODSYS_STUB_PROFILE)
+#error "MODSYS_STUB_PROFILE_TIME needs MODSYS_STUB_PROFILE"
+#endif
+
 
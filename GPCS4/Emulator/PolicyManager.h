@@ -1,3 +1,5 @@
+#pragma once
+
 #include "ModuleManger.h"
 
 #include <map>
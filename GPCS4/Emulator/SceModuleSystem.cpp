@@ -111,6 +111,11 @@ const SymbolManager& CSceModuleSystem::getSymbolManager() const
 	return m_symbolManager;
 }
 
+SymbolManager& CSceModuleSystem::getSymbolManager()
+{
+	return m_symbolManager;
+}
+
 PolicyManager& CSceModuleSystem::getPolicyManager()
 {
 	return m_policyManager;
@@ -202,6 +207,14 @@ const void* CSceModuleSystem::getSymbolAddress(std::string const& modName,
 	return address;
 }
 
+const void* CSceModuleSystem::getSymbolAddress(uint32_t modId,
+											   uint32_t libId,
+											   uint64_t nid,
+											   Policy* policy) const
+{
+	return m_symbolManager.resolveSymbol(m_policyManager, modId, libId, nid, policy);
+}
+
 // TODO: To be done
 void CSceModuleSystem::clearModules()
 {
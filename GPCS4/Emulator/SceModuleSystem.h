@@ -32,6 +32,22 @@ public:
 								 std::string const& libName,
 								 uint64_t nid) const;
 
+	/**
+	 * @brief Get symbol address according to the corresponding policy
+	 * 
+	 * Faster than looking up by names, the policy is cached.
+	 * 
+	 * @param modId module name id, see SymbolManager::internName
+	 * @param libId library name id
+	 * @param nid symbol NID
+	 * @param policy [out] policy applied to the symbol
+	 * @return const void* symbol address
+	 */
+	const void *getSymbolAddress(uint32_t modId,
+								 uint32_t libId,
+								 uint64_t nid,
+								 Policy *policy) const;
+
 	/**
 	 * @brief Clear modules. TODO: NOT IMPLEMENTED 
 	 * 
@@ -180,6 +196,7 @@ public:
 	 * @return const SymbolManager& 
 	 */
 	const SymbolManager& getSymbolManager() const;
+	SymbolManager& getSymbolManager();
 
 	/**
 	 * @brief Gets the Policy Manager object
@@ -1,16 +1,203 @@
 #include "SymbolManager.h"
 
+constexpr size_t InitialNidTableSize = 0x4000;
+
+// NIDs are truncated hashes already,
+// only the name ids need to be mixed in.
+static inline size_t hashNidSymbol(uint32_t modId, uint32_t libId, uint64_t nid)
+{
+	uint64_t ids  = (static_cast<uint64_t>(modId) << 32) | libId;
+	uint64_t hash = nid ^ (ids * 0x9E3779B97F4A7C15ull);
+	return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+SymbolManager::NidSymbolEntry::NidSymbolEntry(const NidSymbolEntry& other) :
+	modId(other.modId),
+	libId(other.libId),
+	nid(other.nid),
+	builtin(other.builtin),
+	native(other.native),
+	policy(other.policy.load())
+{
+}
+
+SymbolManager::NidSymbolEntry& SymbolManager::NidSymbolEntry::operator=(const NidSymbolEntry& other)
+{
+	modId   = other.modId;
+	libId   = other.libId;
+	nid     = other.nid;
+	builtin = other.builtin;
+	native  = other.native;
+	policy  = other.policy.load();
+	return *this;
+}
+
+SymbolManager::SymbolManager() :
+	m_nidTable(InitialNidTableSize)
+{
+}
+
+uint32_t SymbolManager::internName(std::string const& name)
+{
+	{
+		std::shared_lock<std::shared_mutex> lock(m_mutex);
+		auto iter = m_nameIds.find(name);
+		if (iter != m_nameIds.end())
+		{
+			return iter->second;
+		}
+	}
+
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	auto id     = static_cast<uint32_t>(m_names.size());
+	auto result = m_nameIds.emplace(name, id);
+	if (result.second)
+	{
+		m_names.push_back(name);
+	}
+	return result.first->second;
+}
+
+uint32_t SymbolManager::findNameId(std::string const& name) const
+{
+	auto iter = m_nameIds.find(name);
+	return iter != m_nameIds.end() ? iter->second : InvalidNameId;
+}
+
+const SymbolManager::NidSymbolEntry* SymbolManager::findNidSymbol(uint32_t modId,
+																   uint32_t libId,
+																   uint64_t nid) const
+{
+	const NidSymbolEntry* entry = nullptr;
+
+	size_t mask  = m_nidTable.size() - 1;
+	size_t index = hashNidSymbol(modId, libId, nid) & mask;
+	while (m_nidTable[index].modId != InvalidNameId)
+	{
+		auto& slot = m_nidTable[index];
+		if (slot.nid == nid && slot.modId == modId && slot.libId == libId)
+		{
+			entry = &slot;
+			break;
+		}
+
+		index = (index + 1) & mask;
+	}
+
+	return entry;
+}
+
+SymbolManager::NidSymbolEntry* SymbolManager::insertNidSymbol(uint32_t modId,
+															   uint32_t libId,
+															   uint64_t nid)
+{
+	// Keep the load factor at or below one half,
+	// so probe sequences stay short.
+	if ((m_nidCount + 1) * 2 > m_nidTable.size())
+	{
+		growNidTable();
+	}
+
+	size_t mask  = m_nidTable.size() - 1;
+	size_t index = hashNidSymbol(modId, libId, nid) & mask;
+	while (m_nidTable[index].modId != InvalidNameId)
+	{
+		auto& slot = m_nidTable[index];
+		if (slot.nid == nid && slot.modId == modId && slot.libId == libId)
+		{
+			return &slot;
+		}
+
+		index = (index + 1) & mask;
+	}
+
+	auto& slot = m_nidTable[index];
+	slot.modId = modId;
+	slot.libId = libId;
+	slot.nid   = nid;
+	++m_nidCount;
+	return &slot;
+}
+
+void SymbolManager::growNidTable()
+{
+	std::vector<NidSymbolEntry> newTable(m_nidTable.size() * 2);
+
+	size_t mask = newTable.size() - 1;
+	for (auto const& entry : m_nidTable)
+	{
+		if (entry.modId == InvalidNameId)
+		{
+			continue;
+		}
+
+		size_t index = hashNidSymbol(entry.modId, entry.libId, entry.nid) & mask;
+		while (newTable[index].modId != InvalidNameId)
+		{
+			index = (index + 1) & mask;
+		}
+		newTable[index] = entry;
+	}
+
+	m_nidTable = std::move(newTable);
+}
+
+const void* SymbolManager::resolveSymbol(PolicyManager const& policyManager,
+										 uint32_t modId,
+										 uint32_t libId,
+										 uint64_t nid,
+										 Policy* policy) const
+{
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+	const void* address = nullptr;
+	Policy      result  = Policy::UseBuiltin;
+	do
+	{
+		auto entry = findNidSymbol(modId, libId, nid);
+		if (entry == nullptr)
+		{
+			// Neither builtin nor native, the policy only matters for logging.
+			result = policyManager.getSymbolPolicy(m_names[modId], m_names[libId], nid);
+			break;
+		}
+
+		uint8_t cached = entry->policy.load(std::memory_order_relaxed);
+		if (cached == PolicyUnknown)
+		{
+			result = policyManager.getSymbolPolicy(m_names[modId], m_names[libId], nid);
+			entry->policy.store(static_cast<uint8_t>(result), std::memory_order_relaxed);
+		}
+		else
+		{
+			result = static_cast<Policy>(cached);
+		}
+
+		address = result == Policy::UseBuiltin ? entry->builtin : entry->native;
+	} while (false);
+
+	if (policy)
+	{
+		*policy = result;
+	}
+
+	return address;
+}
+
 const void *SymbolManager::findNativeSymbol(std::string const &modName,
 	                                   std::string const &libName,
 	                                   uint64_t nid) const
 {
-	return findSymbolGeneric(m_nativeModuleSymbolNidDir, modName, libName, nid);
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+	auto entry = findNidSymbol(findNameId(modName), findNameId(libName), nid);
+	return entry ? entry->native : nullptr;
 }
 
 const void* SymbolManager::findNativeSymbol(std::string const& modName,
 									  std::string const& libName,
 									  std::string const& symbName) const
 {
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
 	return findSymbolGeneric(m_nativeModuleSymbolNameDir, modName, libName, symbName);
 }
 
@@ -18,13 +205,16 @@ const void* SymbolManager::findBuiltinSymbol(std::string const& modName,
 											 std::string const& libName,
 											 uint64_t nid) const
 {
-	return findSymbolGeneric(m_builtinModuleSymbolNidDir, modName, libName, nid);
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
+	auto entry = findNidSymbol(findNameId(modName), findNameId(libName), nid);
+	return entry ? entry->builtin : nullptr;
 }
 
-const void* SymbolManager::findBuiltinSymbol(std::string const& modName, 
+const void* SymbolManager::findBuiltinSymbol(std::string const& modName,
 											 std::string const& libName,
 											 std::string const& name) const
 {
+	std::shared_lock<std::shared_mutex> lock(m_mutex);
 	return findSymbolGeneric(m_builtinModuleSymbolNameDir, modName, libName, name);
 }
 
@@ -33,11 +223,19 @@ bool SymbolManager::registerNativeSymbol(std::string const& modName,
 										 uint64_t nid,
 										 const void* address)
 {
-	return registerSymbolNidGeneric(m_nativeModuleSymbolNidDir,
-									modName,
-									libName,
-									nid,
-									address);
+	uint32_t modId = internName(modName);
+	uint32_t libId = internName(libName);
+
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	auto entry = insertNidSymbol(modId, libId, nid);
+	if (entry->native != nullptr)
+	{
+		// already registered
+		return false;
+	}
+
+	entry->native = address;
+	return true;
 }
 
 bool SymbolManager::registerNativeSymbol(std::string const& modName,
@@ -45,6 +243,7 @@ bool SymbolManager::registerNativeSymbol(std::string const& modName,
 										 std::string const& name,
 										 const void* address)
 {
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
 	return registerSymbolNidGeneric(m_nativeModuleSymbolNameDir,
 									modName,
 									libName,
@@ -57,11 +256,19 @@ bool SymbolManager::registerBuiltinSymbol(std::string const& modName,
 										  uint64_t nid,
 										  const void* address)
 {
-	return registerSymbolNidGeneric(m_builtinModuleSymbolNidDir,
-									modName,
-									libName,
-									nid,
-									address);
+	uint32_t modId = internName(modName);
+	uint32_t libId = internName(libName);
+
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	auto entry = insertNidSymbol(modId, libId, nid);
+	if (entry->builtin != nullptr)
+	{
+		// already registered
+		return false;
+	}
+
+	entry->builtin = address;
+	return true;
 }
 
 bool SymbolManager::registerBuiltinSymbol(std::string const& modName,
@@ -69,11 +276,10 @@ bool SymbolManager::registerBuiltinSymbol(std::string const& modName,
 										  std::string const& name,
 										  const void* address)
 {
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
 	return registerSymbolNidGeneric(m_builtinModuleSymbolNameDir,
 									modName,
 									libName,
 									name,
 									address);
 }
-
-
@@ -1,9 +1,54 @@
+#pragma once
+
+#include "PolicyManager.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+// Module and library names are interned to small ids,
+// NID symbols of both builtin and native modules then live
+// in a single open addressing table keyed by (module, library, nid).
+// Native symbols are registered and looked up by
+// several loader threads at once, so everything is locked.
 class SymbolManager
 {
 public:
+	constexpr static uint32_t InvalidNameId = ~0u;
+
+	SymbolManager();
+
+	/**
+	 * @brief Interns a module or library name
+	 * 
+	 * @param name module or library name
+	 * @return uint32_t id of the name, the same for equal names
+	 */
+	uint32_t internName(std::string const &name);
+
+	/**
+	 * @brief Resolves a symbol by interned names
+	 * 
+	 * Looks up the symbol according to the policy, which
+	 * is computed only once per symbol and cached in the table.
+	 * 
+	 * @param policyManager policies, which must not change anymore
+	 * @param modId module name id
+	 * @param libId library name id
+	 * @param nid symbol NID
+	 * @param policy [out] policy applied to the symbol
+	 * @return const void* symbol address, nullptr if not found
+	 */
+	const void *resolveSymbol(PolicyManager const &policyManager,
+							  uint32_t modId,
+							  uint32_t libId,
+							  uint64_t nid,
+							  Policy *policy) const;
+
 	const void *findNativeSymbol(std::string const &modName,
 								 std::string const &libName,
 								 uint64_t nid) const;
@@ -41,12 +86,39 @@ public:
 		                       const void *address);
 
 private:
-	using NidAddrMap = std::unordered_map<uint64_t, const void*>;
+	constexpr static uint8_t PolicyUnknown = 0xFF;
+
+	struct NidSymbolEntry
+	{
+		NidSymbolEntry() = default;
+		NidSymbolEntry(const NidSymbolEntry &other);
+		NidSymbolEntry &operator=(const NidSymbolEntry &other);
+
+		uint32_t modId   = InvalidNameId;
+		uint32_t libId   = InvalidNameId;
+		uint64_t nid     = 0;
+		const void *builtin = nullptr;
+		const void *native  = nullptr;
+		// Filled in on first lookup, policies are
+		// not yet declared when builtins are registered.
+		mutable std::atomic<uint8_t> policy = { PolicyUnknown };
+	};
+
 	using NameAddrMap = std::unordered_map<std::string, const void*>;
-	using LibSymbNidMap = std::unordered_map<std::string, NidAddrMap>;
 	using LibSymbNameMap = std::unordered_map<std::string, NameAddrMap>;
 	using ModSymbNameMap = std::unordered_map<std::string, LibSymbNameMap>;
-	using ModSymbNidMap = std::unordered_map<std::string, LibSymbNidMap>;
+
+	uint32_t findNameId(std::string const &name) const;
+
+	const NidSymbolEntry *findNidSymbol(uint32_t modId,
+										uint32_t libId,
+										uint64_t nid) const;
+
+	NidSymbolEntry *insertNidSymbol(uint32_t modId,
+									uint32_t libId,
+									uint64_t nid);
+
+	void growNidTable();
 
 	template<typename Table, typename KeyType>
 	const void *findSymbolGeneric(Table &table,
@@ -129,8 +201,14 @@ private:
 		return ret;
 	}
 
-	ModSymbNidMap m_nativeModuleSymbolNidDir;
-	ModSymbNidMap m_builtinModuleSymbolNidDir;
+	mutable std::shared_mutex m_mutex;
+
+	// deque keeps references stable while interning
+	std::deque<std::string> m_names;
+	std::unordered_map<std::string, uint32_t> m_nameIds;
+
+	std::vector<NidSymbolEntry> m_nidTable;
+	size_t m_nidCount = 0;
 
 	ModSymbNameMap m_nativeModuleSymbolNameDir;
 	ModSymbNameMap m_builtinModuleSymbolNameDir;
@@ -1,12 +1,20 @@
 #include "TLSHandler.h"
 #include "PlatMemory.h"
+#include "UtilLikely.h"
 #include "UtilMath.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
 LOG_CHANNEL(Emulator.TLSHandler);
 
 thread_local void* TLSManager::t_fsbase = nullptr;
 
-TLSManager::TLSManager()
+thread_local std::vector<TLSManager::DTVSlot> TLSManager::t_dtvSlots;
+
+TLSManager::TLSManager() :
+	m_patcher(m_asmHelper)
 {
 }
 
@@ -16,9 +24,18 @@ TLSManager::~TLSManager()
 
 bool TLSManager::install()
 {
-	// TODO:
-	// since now we have TinyDBR, we can just rewrite the tls access instruction,
-	// no exceptions are needed.
+	// Patched code reads fs base from a raw TLS slot directly.
+	// If we can't get one, every TLS access goes through the exception handler.
+	m_rawTlsIndex = plat::RawTlsAlloc();
+	if (m_rawTlsIndex != plat::RAW_TLS_INVALID_INDEX)
+	{
+		m_patcher.setup(plat::RawTlsGetOffset(m_rawTlsIndex), &fsBaseSlowPath);
+	}
+	else
+	{
+		LOG_WARN("allocate raw tls slot failed, tls access patch disabled.");
+	}
+
 	plat::ExceptionHandler handler;
 	handler.callback = &exceptionHandler;
 	handler.param  = this;
@@ -31,6 +48,15 @@ void TLSManager::uninstall()
 	handler.callback = &exceptionHandler;
 	handler.param  = this;
 	plat::removeExceptionHandler(handler);
+
+	if (m_rawTlsIndex != plat::RAW_TLS_INVALID_INDEX)
+	{
+		plat::RawTlsFree(m_rawTlsIndex);
+		m_rawTlsIndex = plat::RAW_TLS_INVALID_INDEX;
+	}
+
+	LOG_DEBUG("tls access patched %" PRIu64 ", exceptions taken %" PRIu64,
+			  m_patchCount.load(), m_exceptionCount.load());
 }
 
 void TLSManager::backupTLSImage(std::vector<uint8_t>& image, const TLSBlock& block)
@@ -77,6 +103,7 @@ void TLSManager::allocateTLSOffset(TLSBlock& block)
 
 void TLSManager::registerTLSBlock(const TLSBlock& block)
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
 	do 
 	{
 		if (!block.address || !block.totalSize)
@@ -91,6 +118,7 @@ void TLSManager::registerTLSBlock(const TLSBlock& block)
 
 		TLSBlock newBlock = block;
 		allocateTLSOffset(newBlock);
+		newBlock.serial = ++m_generation;
 
 		m_TLSImages.emplace_back(newBlock, std::move(tlsImage));
 
@@ -99,6 +127,7 @@ void TLSManager::registerTLSBlock(const TLSBlock& block)
 
 void TLSManager::unregisterTLSBlock(const TLSBlock& block)
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
 	do 
 	{
 		auto iter = std::find_if(m_TLSImages.begin(), m_TLSImages.end(),
@@ -113,20 +142,188 @@ void TLSManager::unregisterTLSBlock(const TLSBlock& block)
 		}
 
 		m_TLSImages.erase(iter);
+		++m_generation;
 
 	} while (false);
 }
 
 
-void* TLSManager::tlsGetAddr(uint32_t moduleId, uint32_t offset)
+void* TLSManager::tlsGetAddr(uint32_t moduleId, uint64_t offset)
 {
-	// TODO:
-	return calloc(1, 0x1000);
+	void* addr = nullptr;
+	do
+	{
+		TCB* tcb = reinterpret_cast<TCB*>(t_fsbase);
+		if (unlikely(!tcb))
+		{
+			break;
+		}
+
+		DTV* dtv = reinterpret_cast<DTV*>(tcb->dtv);
+		if (unlikely(dtv[0].counter != m_generation.load(std::memory_order_relaxed) ||
+					 moduleId > dtv[1].counter))
+		{
+			break;
+		}
+
+		void* block = dtv[moduleId + 1].pointer;
+		if (unlikely(!block))
+		{
+			break;
+		}
+
+		addr = reinterpret_cast<uint8_t*>(block) + offset;
+	} while (false);
+
+	if (unlikely(!addr))
+	{
+		addr = tlsGetAddrSlow(moduleId, offset);
+	}
+	return addr;
+}
+
+void* TLSManager::tlsGetAddrSlow(uint32_t moduleId, uint64_t offset)
+{
+	void* addr = nullptr;
+	do
+	{
+		TCB* tcb = reinterpret_cast<TCB*>(readFSRegister(0));
+		if (!tcb)
+		{
+			break;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		DTV* dtv = updateDTV(tcb, moduleId);
+		if (!dtv[moduleId + 1].pointer)
+		{
+			dtv[moduleId + 1].pointer = allocateDynamicTLS(moduleId);
+		}
+
+		if (!dtv[moduleId + 1].pointer)
+		{
+			LOG_ERR("no tls block for module id %d", moduleId);
+			break;
+		}
+
+		addr = reinterpret_cast<uint8_t*>(dtv[moduleId + 1].pointer) + offset;
+	} while (false);
+	return addr;
+}
+
+TLSManager::DTV* TLSManager::updateDTV(TCB* tcb, uint32_t moduleId)
+{
+	DTV*      dtv        = reinterpret_cast<DTV*>(tcb->dtv);
+	uintptr_t generation = m_generation.load();
+	if (dtv[0].counter == generation && moduleId <= dtv[1].counter)
+	{
+		return dtv;
+	}
+
+	// Drop blocks of modules which have been unloaded,
+	// a module loaded later may have taken the same id, so match the serial too.
+	for (auto iter = t_dtvSlots.begin(); iter != t_dtvSlots.end();)
+	{
+		bool loaded = std::any_of(m_TLSImages.begin(), m_TLSImages.end(),
+								  [&](const auto& imgPair)
+								  {
+									  return imgPair.first.index == iter->moduleId &&
+											 imgPair.first.serial == iter->serial;
+								  });
+		if (loaded)
+		{
+			++iter;
+			continue;
+		}
+
+		if (iter->moduleId <= dtv[1].counter)
+		{
+			dtv[iter->moduleId + 1].pointer = nullptr;
+		}
+		free(iter->memory);
+		iter = t_dtvSlots.erase(iter);
+	}
+
+	uint32_t count = std::max(maxModuleId(), moduleId);
+	if (count > dtv[1].counter)
+	{
+		DTV* newDtv = reinterpret_cast<DTV*>(calloc(1, (count + 2) * sizeof(DTV)));
+		std::memcpy(newDtv + 2, dtv + 2, dtv[1].counter * sizeof(DTV));
+		newDtv[1].counter = count;
+
+		free(dtv);
+		dtv      = newDtv;
+		tcb->dtv = dtv;
+	}
+
+	dtv[0].counter = generation;
+	return dtv;
+}
+
+void* TLSManager::allocateDynamicTLS(uint32_t moduleId)
+{
+	void* block = nullptr;
+	do
+	{
+		auto iter = std::find_if(m_TLSImages.begin(), m_TLSImages.end(),
+								 [&](const auto& imgPair)
+								 {
+									 return imgPair.first.index == moduleId;
+								 });
+		if (iter == m_TLSImages.end())
+		{
+			break;
+		}
+
+		const auto& image = iter->second;
+		size_t      align = std::max(iter->first.align, 1u);
+		uint8_t*    raw   = reinterpret_cast<uint8_t*>(malloc(image.size() + align));
+		if (!raw)
+		{
+			break;
+		}
+
+		uint8_t* aligned = reinterpret_cast<uint8_t*>(util::align(reinterpret_cast<uintptr_t>(raw), align));
+		std::memcpy(aligned, image.data(), image.size());
+
+		t_dtvSlots.push_back({ moduleId, iter->first.serial, raw });
+		block = aligned;
+	} while (false);
+	return block;
+}
+
+uint32_t TLSManager::maxModuleId()
+{
+	uint32_t maxId = 0;
+	for (const auto& imgPair : m_TLSImages)
+	{
+		maxId = std::max(maxId, imgPair.first.index);
+	}
+	return maxId;
 }
 
 void TLSManager::notifyThreadExit()
 {
 	freeTLS(t_fsbase);
+	t_fsbase = nullptr;
+
+	if (m_rawTlsIndex != plat::RAW_TLS_INVALID_INDEX)
+	{
+		plat::RawTlsSetValue(m_rawTlsIndex, nullptr);
+	}
+}
+
+void TLSManager::patchTLSAccess(uint8_t* code, size_t size)
+{
+	uint32_t count = m_patcher.patchCode(code, size);
+	m_patchCount += count;
+	LOG_DEBUG("%d tls access patched in code %p size %zx", count, code, size);
+}
+
+void* TLSManager::fsBaseSlowPath()
+{
+	return TLSManager::GetInstance()->readFSRegister(0);
 }
 
 plat::ExceptionAction TLSManager::exceptionHandler(
@@ -163,20 +360,10 @@ plat::ExceptionAction TLSManager::exceptionHandler(
 			break;
 		}
 
-		// I firstly tried to make a simple hook to the tls access instruction,
-		// hoping there's no rip-relative instruction around,
-		// but soon I found I was wrong, rip-relative instructions are everywhere
-		// thus I need to do relocation...
-		// fuck that.
-		// let's get rid of that shit and focus on more important things
-		// current implementation will raise an exception on every tls access
-		// which is not efficient
-		// I'll fix this soon or later
-		//if (!PatchTLSInstruction(pExcptAddr))
-		//{
-		//	LOG_ERR("patch tls instruction failed.");
-		//	break;
-		//}
+		// Most tls access instructions are rewritten by TLSPatcher at load time,
+		// we only get here for the ones it couldn't patch,
+		// e.g. no thunk memory could be found near the module.
+		++pthis->m_exceptionCount;
 
 		uint32_t instLen  = 0;
 		int64_t  fsOffset = 0;
@@ -197,17 +384,15 @@ void* TLSManager::allocateTLS()
 	TCB* tcbSegbase = nullptr;
 	do 
 	{
+		// The TCB is needed even without static TLS,
+		// its DTV holds the blocks of dynamic modules.
 		size_t imageSize = calculateStaticTLSSize();
-		if (!imageSize)
-		{
-			break;
-		}
 
-		uint32_t moduleCount = m_TLSImages.size();
+		uint32_t moduleCount = maxModuleId();
 		uint8_t* tlsAndTCB   = reinterpret_cast<uint8_t*>(calloc(1, imageSize + sizeof(TCB)));
 		DTV* dtv             = reinterpret_cast<DTV*>(calloc(1, (moduleCount + 2) * sizeof(DTV)));
 
-		dtv[0].counter = moduleCount;
+		dtv[0].counter = m_generation.load();
 		dtv[1].counter = moduleCount;
 
 		tcbSegbase          = reinterpret_cast<TCB*>(tlsAndTCB + imageSize);
@@ -216,11 +401,18 @@ void* TLSManager::allocateTLS()
 
 		for (const auto& imgPair : m_TLSImages)
 		{
+			if (imgPair.first.isDynamic)
+			{
+				// allocated on first __tls_get_addr
+				continue;
+			}
+
 			void* dst = reinterpret_cast<uint8_t*>(tcbSegbase) - imgPair.first.offset;
 			// copy tls image backup to new allocated memory bound to current thread.
 			std::memcpy(dst, imgPair.second.data(), imgPair.second.size());
 			// update dtv array
 			dtv[imgPair.first.index + 1].pointer = dst;
+			t_dtvSlots.push_back({ imgPair.first.index, imgPair.first.serial, nullptr });
 		}
 
 	} while (false);
@@ -244,6 +436,12 @@ void TLSManager::freeTLS(void* tls)
 		free(tlsStart);
 		free(dtv);
 
+		for (auto& slot : t_dtvSlots)
+		{
+			free(slot.memory);
+		}
+		t_dtvSlots.clear();
+
 	} while (false);
 }
 
@@ -252,6 +450,11 @@ void* TLSManager::readFSRegister(int32_t offset)
 	if (!t_fsbase)
 	{
 		t_fsbase = allocateTLS();
+
+		if (m_rawTlsIndex != plat::RAW_TLS_INVALID_INDEX)
+		{
+			plat::RawTlsSetValue(m_rawTlsIndex, t_fsbase);
+		}
 	}
 	return reinterpret_cast<uint8_t*>(t_fsbase) + offset;
 }
@@ -328,6 +531,16 @@ void AssembleHelper::getMovFsInfo(void* code, uint32_t& instLen, int64_t& fsOffs
 	fsOffset = instruction.raw.disp.value;
 }
 
+uint32_t AssembleHelper::getInstructionLength(const void* code, size_t maxLen)
+{
+	ZydisDecodedInstruction instruction;
+	ZydisDecoderContext     context;
+	ZyanStatus              status = ZydisDecoderDecodeInstruction(&m_decoder, &context, code,
+																   std::min<size_t>(maxLen, ZYDIS_MAX_INSTRUCTION_LENGTH),
+																   &instruction);
+	return ZYAN_SUCCESS(status) ? instruction.length : 0;
+}
+
 bool AssembleHelper::patchTLSInstruction(void* code)
 {
 	bool ret = false;
@@ -3,9 +3,12 @@
 #include "GPCS4Common.h"
 #include "UtilSingleton.h"
 #include "PlatException.h"
+#include "PlatThread.h"
+#include "TLSPatcher.h"
 #include "zydis/Zydis.h"
 
 #include <array>
+#include <atomic>
 #include <mutex>
 #include <vector>
 
@@ -40,6 +43,9 @@ public:
 
 	void getMovFsInfo(void* code, uint32_t& instLen, int64_t& fsOffset);
 
+	// Returns 0 if the bytes don't decode to an instruction.
+	uint32_t getInstructionLength(const void* code, size_t maxLen);
+
 	bool patchTLSInstruction(void* code);
 
 	void printInstruction(void* code);
@@ -74,6 +80,8 @@ struct TLSBlock
 	bool isDynamic = false;
 	// TLS image offset at TCB block
 	uint32_t offset;
+	// assigned on registration, tells a module apart from a later one reusing its index
+	uintptr_t serial = 0;
 };
 
 // The TLSManager implementation is based on FreeBSD 9.0 stable.
@@ -85,8 +93,13 @@ struct TLSBlock
 class TLSManager : public util::Singleton<TLSManager>
 {
 	friend class util::Singleton<TLSManager>;
+	// Times the slow path on its own, see Tests/TestTLSHandler.cpp
+	friend struct TLSManagerTester;
 
 private:
+	// dtv[0] is the generation the vector was built with,
+	// dtv[1] is the number of module slots,
+	// dtv[moduleId + 1] is the TLS block of that module, null if not allocated yet.
 	union DTV
 	{
 		void* pointer;
@@ -101,6 +114,16 @@ private:
 
 	using TLSImage = std::vector<uint8_t>;
 
+	// A DTV slot filled for the current thread.
+	struct DTVSlot
+	{
+		uint32_t  moduleId;
+		// serial of the TLS block the slot was filled from
+		uintptr_t serial;
+		// malloc'ed memory of a dynamic block, null for a static block
+		void*     memory;
+	};
+
 public:
 	bool install();
 
@@ -110,18 +133,33 @@ public:
 
 	void unregisterTLSBlock(const TLSBlock& block);
 
-	void* tlsGetAddr(uint32_t moduleId, uint32_t offset);
+	// Implement __tls_get_addr.
+	// Blocks of dynamically loaded modules are allocated on first access
+	// and cached in the thread's DTV.
+	void* tlsGetAddr(uint32_t moduleId, uint64_t offset);
 
 	void notifyThreadExit();
 
+	// Rewrite TLS access instructions in a newly mapped code segment,
+	// must be called before any of the code runs.
+	void patchTLSAccess(uint8_t* code, size_t size);
+
 private:
 
 	static plat::ExceptionAction exceptionHandler(
 		plat::ExceptionRecord* record, void* param);
 
+	// Called by patched code when current thread has no TLS block yet.
+	static void* fsBaseSlowPath();
+
 	void* allocateTLS();
 	void freeTLS(void* tls);
 
+	void* tlsGetAddrSlow(uint32_t moduleId, uint64_t offset);
+	DTV* updateDTV(TCB* tcb, uint32_t moduleId);
+	void* allocateDynamicTLS(uint32_t moduleId);
+	uint32_t maxModuleId();
+
 	void* readFSRegister(int32_t offset);
 
 	void backupTLSImage(std::vector<uint8_t>& image, const TLSBlock& block);
@@ -136,11 +174,23 @@ private:
 private:
 	// emulated fs register
 	static thread_local void* t_fsbase;
+	// DTV slots filled for current thread, static blocks and lazily allocated dynamic blocks
+	static thread_local std::vector<DTVSlot> t_dtvSlots;
 
 private:
 	std::vector<std::pair<TLSBlock, TLSImage>> m_TLSImages;
 	std::mutex                                 m_mutex;
 	AssembleHelper                             m_asmHelper;
+	TLSPatcher                                 m_patcher;
+	// host TLS slot mirroring t_fsbase, read directly by patched code.
+	uint32_t m_rawTlsIndex = plat::RAW_TLS_INVALID_INDEX;
+
+	// increased whenever a TLS block is registered or unregistered,
+	// a DTV with an older generation must be revalidated.
+	std::atomic<uintptr_t> m_generation = 1;
+
+	std::atomic<uint64_t> m_patchCount     = 0;
+	std::atomic<uint64_t> m_exceptionCount = 0;
 };
 
 
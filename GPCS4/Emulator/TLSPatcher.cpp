@@ -0,0 +1,231 @@
+#include "TLSPatcher.h"
+#include "TLSHandler.h"
+
+#include "xbyak/xbyak.h"
+
+#include <cstring>
+
+LOG_CHANNEL(Emulator.TLSPatcher);
+
+// mov rax, fs:[0x0000000000000000]
+static const uint8_t g_movRaxFs0[] = { 0x64, 0x48, 0x8B, 0x04, 0x25, 0x00, 0x00, 0x00, 0x00 };
+// 4 bytes nop: nop dword ptr [rax + 0]
+static const uint8_t g_nop4[] = { 0x0F, 0x1F, 0x40, 0x00 };
+
+constexpr size_t   ThunkSharedSize = 0x200;
+constexpr size_t   ThunkSiteSize   = 0x40;
+constexpr size_t   ThunkSearchStep = 0x10000;
+constexpr size_t   ThunkSearchMax  = 0x40000000;
+constexpr uint32_t RedZoneSize     = 128;
+
+TLSPatcher::TLSPatcher(AssembleHelper& asmHelper) :
+	m_asmHelper(asmHelper)
+{
+}
+
+TLSPatcher::~TLSPatcher()
+{
+}
+
+void TLSPatcher::setup(uint32_t tlsOffset, SlowPathFunc slowPath)
+{
+	m_tlsOffset = tlsOffset;
+	m_slowPath  = slowPath;
+}
+
+uint32_t TLSPatcher::patchCode(uint8_t* code, size_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint32_t count = 0;
+	do
+	{
+		if (!code || !size || !m_tlsOffset || !m_slowPath)
+		{
+			break;
+		}
+
+		auto sites = findTlsAccess(code, size);
+		if (sites.empty())
+		{
+			break;
+		}
+
+		size_t   thunkSize = ThunkSharedSize + sites.size() * ThunkSiteSize;
+		uint8_t* thunkMem  = allocateThunkMemory(code, size, thunkSize);
+		if (!thunkMem)
+		{
+			LOG_WARN("no thunk memory near %p, tls access falls back to exception.", code);
+			break;
+		}
+
+		if (!generateThunks(thunkMem, thunkSize, sites))
+		{
+			m_thunkMemory.pop_back();
+			break;
+		}
+
+		count = static_cast<uint32_t>(sites.size());
+	} while (false);
+	return count;
+}
+
+std::vector<uint8_t*> TLSPatcher::findTlsAccess(uint8_t* code, size_t size)
+{
+	std::vector<uint8_t*> sites;
+
+	// Decode linearly from the start of the segment, so a match is only taken
+	// on an instruction boundary, never inside another instruction.
+	// The code segment may contain read only data too, when some bytes don't decode,
+	// resume at the next 16 bytes boundary, where functions start.
+	const size_t instLen = sizeof(g_movRaxFs0);
+	uint8_t*     end     = code + size;
+	uint8_t*     cur     = code;
+	while (cur < end)
+	{
+		size_t left = end - cur;
+		if (left >= instLen && !std::memcmp(cur, g_movRaxFs0, instLen))
+		{
+			sites.push_back(cur);
+			cur += instLen;
+			continue;
+		}
+
+		uint32_t len = m_asmHelper.getInstructionLength(cur, left);
+		if (len == 0)
+		{
+			cur = reinterpret_cast<uint8_t*>(util::align(reinterpret_cast<uintptr_t>(cur) + 1, 16));
+			continue;
+		}
+
+		cur += len;
+	}
+
+	return sites;
+}
+
+uint8_t* TLSPatcher::allocateThunkMemory(uint8_t* code, size_t codeSize, size_t thunkSize)
+{
+	uint8_t* thunkMem = nullptr;
+
+	// Search upwards first, the module's data segments usually follow the code,
+	// then downwards, while both ends of the code stay within rel32 range.
+	uintptr_t codeEnd  = reinterpret_cast<uintptr_t>(code) + codeSize;
+	uintptr_t upStart  = util::align(codeEnd, ThunkSearchStep);
+	uintptr_t downBase = util::alignUp(reinterpret_cast<uintptr_t>(code), ThunkSearchStep);
+	for (size_t distance = 0; distance < ThunkSearchMax && !thunkMem; distance += ThunkSearchStep)
+	{
+		void* addr = plat::VMAllocate(reinterpret_cast<void*>(upStart + distance), thunkSize,
+									  plat::VMAT_RESERVE_COMMIT, plat::VMPF_CPU_RWX);
+		if (!addr && downBase > distance + thunkSize)
+		{
+			uintptr_t down = util::alignUp(downBase - distance - thunkSize, ThunkSearchStep);
+			addr           = plat::VMAllocate(reinterpret_cast<void*>(down), thunkSize,
+											  plat::VMAT_RESERVE_COMMIT, plat::VMPF_CPU_RWX);
+		}
+		thunkMem = reinterpret_cast<uint8_t*>(addr);
+	}
+
+	if (thunkMem)
+	{
+		m_thunkMemory.emplace_back(thunkMem);
+	}
+
+	return thunkMem;
+}
+
+bool TLSPatcher::generateThunks(uint8_t* thunkMem, size_t thunkSize, const std::vector<uint8_t*>& sites)
+{
+	using namespace Xbyak::util;
+
+	bool ret = false;
+	try
+	{
+		Xbyak::CodeGenerator gen(thunkSize, thunkMem);
+
+		// Shared slow path, called with the red zone already skipped.
+		// Returns fs base in rax and preserves everything else, including flags,
+		// since the guest expects a plain mov.
+		Xbyak::Label slowPath;
+		gen.L(slowPath);
+		gen.pushfq();
+		gen.cld();
+		gen.push(rcx);
+		gen.push(rdx);
+		gen.push(r8);
+		gen.push(r9);
+		gen.push(r10);
+		gen.push(r11);
+		// Guest stack alignment is unknown at an arbitrary instruction.
+		// The slow path is a host function, rbx survives the call, r10 doesn't.
+		gen.push(rbx);
+		gen.mov(rbx, rsp);
+		gen.and_(rsp, -16);
+		gen.sub(rsp, 6 * 16 + 32);
+		for (int i = 0; i != 6; ++i)
+		{
+			gen.movdqu(gen.ptr[rsp + 32 + i * 16], Xbyak::Xmm(i));
+		}
+		gen.mov(rax, reinterpret_cast<uint64_t>(m_slowPath));
+		gen.call(rax);
+		for (int i = 0; i != 6; ++i)
+		{
+			gen.movdqu(Xbyak::Xmm(i), gen.ptr[rsp + 32 + i * 16]);
+		}
+		gen.mov(rsp, rbx);
+		gen.pop(rbx);
+		gen.pop(r11);
+		gen.pop(r10);
+		gen.pop(r9);
+		gen.pop(r8);
+		gen.pop(rdx);
+		gen.pop(rcx);
+		gen.popfq();
+		gen.ret();
+
+		std::vector<uint8_t*> thunks;
+		thunks.reserve(sites.size());
+		for (auto site : sites)
+		{
+			uint8_t* back = site + sizeof(g_movRaxFs0);
+
+			gen.align(16);
+			thunks.push_back(const_cast<uint8_t*>(gen.getCurr()));
+
+			// rax is the destination, use it to hold rcx,
+			// jrcxz and xchg don't touch flags.
+			Xbyak::Label slow;
+			gen.mov(rax, rcx);
+			gen.putSeg(gs);
+			gen.mov(rcx, gen.qword[reinterpret_cast<void*>(static_cast<uintptr_t>(m_tlsOffset))]);
+			gen.jrcxz(slow);
+			gen.xchg(rax, rcx);
+			gen.jmp(back);
+
+			gen.L(slow);
+			gen.mov(rcx, rax);
+			gen.lea(rsp, gen.ptr[rsp - RedZoneSize]);
+			gen.call(slowPath);
+			gen.lea(rsp, gen.ptr[rsp + RedZoneSize]);
+			gen.jmp(back);
+		}
+
+		// All thunks are ready, now redirect the guest code.
+		for (size_t i = 0; i != sites.size(); ++i)
+		{
+			uint8_t* site = sites[i];
+			int64_t  rel  = thunks[i] - (site + 5);
+
+			site[0] = 0xE9;
+			std::memcpy(site + 1, &rel, sizeof(int32_t));
+			std::memcpy(site + 5, g_nop4, sizeof(g_nop4));
+		}
+
+		ret = true;
+	}
+	catch (const Xbyak::Error& e)
+	{
+		LOG_ERR("generate tls thunk failed: %s", e.what());
+	}
+	return ret;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "GPCS4Common.h"
+#include "PlatMemory.h"
+
+#include <mutex>
+#include <vector>
+
+class AssembleHelper;
+
+// Rewrite guest TLS access instructions once at load time,
+// so that hot guest code doesn't raise an exception on every TLS access.
+//
+// Every 'mov rax, fs:[0]' found in a code segment is replaced with
+// a 'jmp' to a thunk generated by xbyak. The instruction is 9 bytes long,
+// enough to hold the 5 bytes jmp, so no neighbour instruction is touched
+// and no rip-relative relocation is needed.
+//
+// The thunk reads the emulated fs base from a raw host TLS slot and jumps back.
+// Only when the slot is empty, i.e. the TLS block of current thread is not
+// allocated yet, it calls slowPath, which must return the fs base.
+//
+// Instructions which can't be patched keep raising exceptions,
+// and are handled by the TLSManager exception handler as before.
+
+class TLSPatcher
+{
+public:
+	using SlowPathFunc = void* (*)();
+
+	TLSPatcher(AssembleHelper& asmHelper);
+	~TLSPatcher();
+
+	// tlsOffset is the gs relative offset of the host TLS slot holding the fs base.
+	void setup(uint32_t tlsOffset, SlowPathFunc slowPath);
+
+	// Returns number of instructions patched.
+	uint32_t patchCode(uint8_t* code, size_t size);
+
+private:
+	std::vector<uint8_t*> findTlsAccess(uint8_t* code, size_t size);
+
+	// Thunks must be within rel32 range of the patched code.
+	uint8_t* allocateThunkMemory(uint8_t* code, size_t codeSize, size_t thunkSize);
+
+	bool generateThunks(uint8_t* thunkMem, size_t thunkSize, const std::vector<uint8_t*>& sites);
+
+private:
+	AssembleHelper& m_asmHelper;
+	uint32_t        m_tlsOffset = 0;
+	SlowPathFunc    m_slowPath  = nullptr;
+
+	std::mutex                    m_mutex;
+	std::vector<plat::memory_ptr> m_thunkMemory;
+};
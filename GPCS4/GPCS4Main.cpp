@@ -2,8 +2,12 @@
 #include "Emulator/SceModuleSystem.h"
 #include "Emulator/TLSHandler.h"
 #include "Loader/ModuleLoader.h"
+#include "Loader/FuncStub.h"
+#include "Graphics/Gnm/GnmCapture.h"
+#include "Tests/TestRunner.h"
 
 #include <cxxopts/cxxopts.hpp>
+#include <cinttypes>
 #include <memory>
 
 LOG_CHANNEL(Main);
@@ -12,7 +16,7 @@ cxxopts::ParseResult processCommandLine(int argc, char* argv[])
 {
 	cxxopts::Options opts("GPCS4", "PlayStation 4 Emulator");
 	opts.allow_unrecognised_options();
-	opts.add_options()("E,eboot", "Set main executable. The current working directory will be mapped to /app0.", cxxopts::value<std::string>())("D,debug-channel", "Enable debug channel. 'ALL' for all channels.", cxxopts::value<std::vector<std::string>>())("L,list-channels", "List debug channels.")("H,help", "Print help message.");
+	opts.add_options()("E,eboot", "Set main executable. The current working directory will be mapped to /app0.", cxxopts::value<std::string>())("D,debug-channel", "Enable debug channel. 'ALL' for all channels.", cxxopts::value<std::vector<std::string>>())("L,list-channels", "List debug channels.")("C,capture", "Capture submitted command buffers to file.", cxxopts::value<std::string>())("R,replay", "Replay a command buffer capture, then exit.", cxxopts::value<std::string>())("replay-loops", "Number of times to replay the capture.", cxxopts::value<uint32_t>()->default_value("1"))("lazy-binding", "Resolve imported functions on first call instead of at load time.")("serial-loading", "Load and relocate modules one at a time, to compare load times with the default parallel loading.")("log-async", "Format log records on a background thread instead of the logging thread.")("log-trace", "Also write log records to a binary trace file, implies log-async.", cxxopts::value<std::string>())("T,test", "Run self tests whose name contains the given filter, then exit.", cxxopts::value<std::string>()->implicit_value(""))("bench", "Run benchmarks whose name contains the given filter, then exit.", cxxopts::value<std::string>()->implicit_value(""))("H,help", "Print help message.");
 
 	// Backup arg count,
 	// because cxxopts will change argc value internally,
@@ -30,6 +34,45 @@ cxxopts::ParseResult processCommandLine(int argc, char* argv[])
 	return optResult;
 }
 
+int replayCapture(std::string const& fileName, uint32_t loopCount)
+{
+	int nRet = -1;
+	do
+	{
+		sce::Gnm::GnmCaptureReplayer replayer;
+		if (!replayer.open(fileName))
+		{
+			break;
+		}
+
+		sce::Gnm::GnmReplayStatistics stats = {};
+		if (!replayer.replay(loopCount, &stats))
+		{
+			break;
+		}
+
+		printf("replayed %" PRIu64 " submissions, %" PRIu64 " command bytes in %.3f ms, %.1f MB/s\n",
+			   stats.submitCount,
+			   stats.commandBytes,
+			   stats.seconds * 1000.0,
+			   stats.commandBytes / stats.seconds / (1024.0 * 1024.0));
+
+		auto const& state = stats.state;
+		printf("register packets %" PRIu64 ", redundant %" PRIu64 "\n",
+			   state.registerPackets,
+			   state.redundantPackets);
+		printf("draws %" PRIu64 ", dispatches %" PRIu64 "\n",
+			   state.drawCount,
+			   state.dispatchCount);
+		printf("indirect buffers %" PRIu64 ", not run %" PRIu64 "\n",
+			   state.indirectBufferCount,
+			   state.skippedIndirectBufferCount);
+
+		nRet = 0;
+	} while (false);
+	return nRet;
+}
+
 int main(int argc, char* argv[])
 {
 	int nRet = -1;
@@ -41,11 +84,36 @@ int main(int argc, char* argv[])
 		// Initialize log system.
 		logsys::init(optResult);
 
+		if (optResult["T"].count())
+		{
+			nRet = test::runCases(test::CaseType::Test, optResult["T"].as<std::string>());
+			break;
+		}
+
+		if (optResult["bench"].count())
+		{
+			nRet = test::runCases(test::CaseType::Bench, optResult["bench"].as<std::string>());
+			break;
+		}
+
+		if (optResult["R"].count())
+		{
+			nRet = replayCapture(optResult["R"].as<std::string>(),
+								 optResult["replay-loops"].as<uint32_t>());
+			break;
+		}
+
 		if (!optResult["E"].count())
 		{
 			break;
 		}
 
+		if (optResult["C"].count() &&
+			!sce::Gnm::GetGnmCaptureWriter().open(optResult["C"].as<std::string>()))
+		{
+			break;
+		}
+
 		// Initialize the whole emulator.
 
 		LOG_DEBUG("GPCS4 start.");
@@ -62,6 +130,9 @@ int main(int argc, char* argv[])
 
 		CLinker      linker = { *CSceModuleSystem::GetInstance() };
 		ModuleLoader loader = { *CSceModuleSystem::GetInstance(), linker };
+		linker.setLazyBinding(optResult.count("lazy-binding") != 0);
+		linker.setParallelRelocation(optResult.count("serial-loading") == 0);
+		loader.setParallelLoading(optResult.count("serial-loading") == 0);
 
 		auto          eboot       = optResult["E"].as<std::string>();
 		NativeModule* ebootModule = nullptr;
@@ -75,6 +146,10 @@ int main(int argc, char* argv[])
 			break;
 		}
 
+#ifdef MODSYS_STUB_PROFILE
+		GetFuncStubManager()->dumpProfile("stub_profile.txt");
+#endif  // MODSYS_STUB_PROFILE
+
 		uninstallTLSManager();
 		TheEmulator().Unit();
 
@@ -0,0 +1,608 @@
+#include "GnmCapture.h"
+
+#include "GnmCommandBufferDummy.h"
+#include "GnmCommandProcessor.h"
+#include "GnmGfx9MePm4Packets.h"
+#include "GnmStructure.h"
+#include "UtilMath.h"
+
+#include "Violet/VltCmdList.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+LOG_CHANNEL(Graphic.Gnm.GnmCapture);
+
+namespace sce::Gnm
+{
+
+// Shader code carries no size, the binary info the shader compiler
+// places right after the code marks its end.
+constexpr char   ShaderBinaryInfoSignature[] = "OrbShdr";
+constexpr size_t ShaderBinaryInfoSize        = 28;
+constexpr size_t MaxShaderSize               = 1024 * 1024;
+
+// Chunk payloads are padded, so that every chunk header is aligned.
+constexpr size_t ChunkAlignment = 8;
+
+// The submitted buffer is the first level, the hardware only
+// lets it call one more level of indirect buffers.
+constexpr uint32_t MaxIndirectBufferDepth = 1;
+
+// Windows reserves virtual memory at this granularity.
+constexpr size_t GuestMemoryAlignment = 0x10000;
+
+// Guest memory is shared with the game, the replay backend must not touch it,
+// or the next loop would not see what was captured.
+class GnmCommandBufferReplay : public GnmCommandBufferDummy
+{
+public:
+	GnmCommandBufferReplay() :
+		GnmCommandBufferDummy(nullptr)
+	{
+	}
+
+	using GnmCommandBufferDummy::prepareFlip;
+	using GnmCommandBufferDummy::prepareFlipWithEopInterrupt;
+
+	virtual void writeAtEndOfPipe(EndOfPipeEventType eventType, EventWriteDest dstSelector, void* dstGpuAddr, EventWriteSource srcSelector, uint64_t immValue, CacheAction cacheAction, CachePolicy cachePolicy) override
+	{
+	}
+
+	virtual void writeAtEndOfPipeWithInterrupt(EndOfPipeEventType eventType, EventWriteDest dstSelector, void* dstGpuAddr, EventWriteSource srcSelector, uint64_t immValue, CacheAction cacheAction, CachePolicy cachePolicy) override
+	{
+	}
+
+	virtual void prepareFlip(void* labelAddr, uint32_t value) override
+	{
+	}
+
+	virtual void prepareFlipWithEopInterrupt(EndOfPipeEventType eventType, void* labelAddr, uint32_t value, CacheAction cacheAction) override
+	{
+	}
+
+	virtual void writeReleaseMemEventWithInterrupt(ReleaseMemEventType eventType, EventWriteDest dstSelector, void* dstGpuAddr, EventWriteSource srcSelector, uint64_t immValue, CacheAction cacheAction, CachePolicy writePolicy) override
+	{
+	}
+
+	virtual void writeReleaseMemEvent(ReleaseMemEventType eventType, EventWriteDest dstSelector, void* dstGpuAddr, EventWriteSource srcSelector, uint64_t immValue, CacheAction cacheAction, CachePolicy writePolicy) override
+	{
+	}
+};
+
+GnmCaptureWriter::GnmCaptureWriter()
+{
+}
+
+GnmCaptureWriter::~GnmCaptureWriter()
+{
+	close();
+}
+
+bool GnmCaptureWriter::open(std::string const& fileName)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	bool ret = false;
+	do
+	{
+		m_file.reset(fopen(fileName.c_str(), "wb"));
+		if (!m_file)
+		{
+			LOG_ERR("open capture file %s failed.", fileName.c_str());
+			break;
+		}
+
+		GnmCaptureHeader header = {};
+		header.magic            = GnmCaptureMagic;
+		header.version          = GnmCaptureVersion;
+		if (fwrite(&header, sizeof(header), 1, m_file.get()) != 1)
+		{
+			m_file.reset();
+			break;
+		}
+
+		m_indexSize = sizeof(uint16_t);
+		m_opened.store(true, std::memory_order_release);
+
+		ret = true;
+	} while (false);
+	return ret;
+}
+
+void GnmCaptureWriter::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_opened.store(false, std::memory_order_release);
+	m_file.reset();
+}
+
+void GnmCaptureWriter::captureSubmit(uint32_t           count,
+									 const void* const* dcbGpuAddrs,
+									 const uint32_t*    dcbSizesInBytes,
+									 const void* const* ccbGpuAddrs,
+									 const uint32_t*    ccbSizesInBytes,
+									 uint32_t           videoOutHandle,
+									 uint32_t           displayBufferIndex,
+									 uint32_t           flipMode,
+									 int64_t            flipArg)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	do
+	{
+		if (!m_file)
+		{
+			break;
+		}
+
+		m_ranges.clear();
+
+		std::vector<GnmCaptureCommand> commands(count);
+		for (uint32_t i = 0; i != count; ++i)
+		{
+			const void* ccb     = ccbGpuAddrs ? ccbGpuAddrs[i] : nullptr;
+			uint32_t    ccbSize = ccb && ccbSizesInBytes ? ccbSizesInBytes[i] : 0;
+
+			auto& command          = commands[i];
+			command.dcbGpuAddr     = reinterpret_cast<uint64_t>(dcbGpuAddrs[i]);
+			command.dcbSizeInBytes = dcbSizesInBytes[i];
+			command.ccbGpuAddr     = reinterpret_cast<uint64_t>(ccb);
+			command.ccbSizeInBytes = ccbSize;
+
+			addRange(dcbGpuAddrs[i], dcbSizesInBytes[i]);
+			collectDcbRanges(dcbGpuAddrs[i], dcbSizesInBytes[i]);
+
+			if (ccb)
+			{
+				addRange(ccb, ccbSize);
+				collectCcbRanges(ccb, ccbSize);
+			}
+		}
+
+		// The same shader is usually bound by many draws.
+		std::sort(m_ranges.begin(), m_ranges.end());
+		m_ranges.erase(std::unique(m_ranges.begin(), m_ranges.end()), m_ranges.end());
+
+		bool success = true;
+		for (auto const& range : m_ranges)
+		{
+			uint64_t gpuAddr = reinterpret_cast<uint64_t>(range.first);
+			success          = success &&
+					  writeChunk(GnmCaptureChunkType::Memory,
+								 &gpuAddr, sizeof(gpuAddr),
+								 range.first, range.second);
+		}
+
+		GnmCaptureSubmit submit   = {};
+		submit.count              = count;
+		submit.videoOutHandle     = videoOutHandle;
+		submit.displayBufferIndex = displayBufferIndex;
+		submit.flipMode           = flipMode;
+		submit.flipArg            = flipArg;
+		success                   = success &&
+				  writeChunk(GnmCaptureChunkType::Submit,
+							 &submit, sizeof(submit),
+							 commands.data(), sizeof(GnmCaptureCommand) * count);
+
+		if (!success)
+		{
+			LOG_ERR("write capture failed, capture stopped.");
+			m_opened.store(false, std::memory_order_release);
+			m_file.reset();
+			break;
+		}
+	} while (false);
+}
+
+void GnmCaptureWriter::collectDcbRanges(const void* dcb, uint32_t sizeInBytes, uint32_t depth)
+{
+	const uint32_t* cursor = reinterpret_cast<const uint32_t*>(dcb);
+	const uint32_t* end    = cursor + sizeInBytes / sizeof(uint32_t);
+	while (cursor < end)
+	{
+		uint32_t header = *cursor;
+		if (PM4_TYPE(header) == PM4_TYPE_2)
+		{
+			++cursor;
+			continue;
+		}
+
+		if (PM4_TYPE(header) == PM4_TYPE_3)
+		{
+			auto pm4Hdr = reinterpret_cast<const PM4_TYPE_3_HEADER*>(cursor);
+			if (pm4Hdr->opcode == IT_INDEX_TYPE)
+			{
+				IndexSize indexSize = static_cast<IndexSize>(cursor[1] & 0x3F);
+				m_indexSize         = indexSize == kIndexSize32 ? sizeof(uint32_t) : sizeof(uint16_t);
+			}
+			else if (pm4Hdr->opcode == IT_INDIRECT_BUFFER)
+			{
+				collectIndirectBuffer(cursor, depth, false);
+			}
+			else if (pm4Hdr->opcode == IT_GNM_PRIVATE)
+			{
+				switch (PM4_PRIV(header))
+				{
+				case OP_PRIV_SET_VS_SHADER:
+				case OP_PRIV_UPDATE_VS_SHADER:
+					addShaderRange(reinterpret_cast<const GnmCmdVSShader*>(cursor)->vsRegs.getCodeAddress());
+					break;
+				case OP_PRIV_SET_PS_SHADER:
+				case OP_PRIV_UPDATE_PS_SHADER:
+					addShaderRange(reinterpret_cast<const GnmCmdPSShader*>(cursor)->psRegs.getCodeAddress());
+					break;
+				case OP_PRIV_SET_CS_SHADER:
+					addShaderRange(reinterpret_cast<const GnmCmdCSShader*>(cursor)->csRegs.getCodeAddress());
+					break;
+				case OP_PRIV_DRAW_INDEX:
+				{
+					auto param = reinterpret_cast<const GnmCmdDrawIndex*>(cursor);
+					addRange(reinterpret_cast<const void*>(param->indexAddr),
+							 static_cast<size_t>(param->indexCount) * m_indexSize);
+				}
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		cursor += PM4_LENGTH_DW(header);
+	}
+}
+
+void GnmCaptureWriter::collectCcbRanges(const void* ccb, uint32_t sizeInBytes, uint32_t depth)
+{
+	const uint32_t* cursor = reinterpret_cast<const uint32_t*>(ccb);
+	const uint32_t* end    = cursor + sizeInBytes / sizeof(uint32_t);
+	while (cursor < end)
+	{
+		uint32_t header = *cursor;
+		if (PM4_TYPE(header) != PM4_TYPE_3)
+		{
+			++cursor;
+			continue;
+		}
+
+		auto pm4Hdr = reinterpret_cast<const PM4_TYPE_3_HEADER*>(cursor);
+		if (pm4Hdr->opcode == IT_DUMP_CONST_RAM)
+		{
+			auto packet = reinterpret_cast<const PM4CE_DUMP_CONST_RAM*>(cursor);
+			addRange(reinterpret_cast<const void*>(util::buildUint64(packet->addr_hi, packet->addr_lo)),
+					 packet->bitfields3.num_dwords * sizeof(uint32_t));
+		}
+		else if (pm4Hdr->opcode == IT_LOAD_CONST_RAM)
+		{
+			auto packet = reinterpret_cast<const PM4CE_LOAD_CONST_RAM*>(cursor);
+			addRange(reinterpret_cast<const void*>(util::buildUint64(packet->addr_hi, packet->addr_lo)),
+					 packet->bitfields4.num_dwords * sizeof(uint32_t));
+		}
+		else if (pm4Hdr->opcode == IT_INDIRECT_BUFFER_CNST)
+		{
+			collectIndirectBuffer(cursor, depth, true);
+		}
+
+		cursor += PM4_LENGTH_DW(header);
+	}
+}
+
+void GnmCaptureWriter::collectIndirectBuffer(const uint32_t* packet, uint32_t depth, bool isConstant)
+{
+	do
+	{
+		auto        ib            = reinterpret_cast<const PM4ME_INDIRECT_BUFFER*>(packet);
+		const void* ibGpuAddr     = reinterpret_cast<const void*>(util::buildUint64(ib->bitfields3.ib_base_hi, ib->ib_base_lo));
+		uint32_t    ibSizeInBytes = ib->bitfields4.ib_size * sizeof(uint32_t);
+
+		if (depth >= MaxIndirectBufferDepth)
+		{
+			LOG_WARN("indirect buffer %p nested too deep, not captured.", ibGpuAddr);
+			break;
+		}
+
+		plat::MemoryInformation info = {};
+		if (!ibGpuAddr ||
+			!plat::VMQuery(const_cast<void*>(ibGpuAddr), &info) ||
+			info.nRegionState != plat::VMRS_COMMIT)
+		{
+			LOG_WARN("indirect buffer %p is not mapped.", ibGpuAddr);
+			break;
+		}
+
+		addRange(ibGpuAddr, ibSizeInBytes);
+		if (isConstant)
+		{
+			collectCcbRanges(ibGpuAddr, ibSizeInBytes, depth + 1);
+		}
+		else
+		{
+			collectDcbRanges(ibGpuAddr, ibSizeInBytes, depth + 1);
+		}
+	} while (false);
+}
+
+void GnmCaptureWriter::addRange(const void* gpuAddr, size_t size)
+{
+	if (gpuAddr && size)
+	{
+		m_ranges.emplace_back(gpuAddr, size);
+	}
+}
+
+void GnmCaptureWriter::addShaderRange(const void* code)
+{
+	do
+	{
+		plat::MemoryInformation info = {};
+		if (!code ||
+			!plat::VMQuery(const_cast<void*>(code), &info) ||
+			info.nRegionState != plat::VMRS_COMMIT)
+		{
+			LOG_WARN("shader code %p is not mapped.", code);
+			break;
+		}
+
+		// Never scan past the mapping the code lives in.
+		const uint8_t* begin     = reinterpret_cast<const uint8_t*>(code);
+		const uint8_t* regionEnd = reinterpret_cast<const uint8_t*>(info.pRegionStart) + info.nRegionSize;
+		size_t         limit     = std::min(static_cast<size_t>(regionEnd - begin), MaxShaderSize);
+
+		size_t infoOffset = 0;
+		bool   found      = false;
+		for (size_t offset = 0; offset + ShaderBinaryInfoSize <= limit; offset += sizeof(uint32_t))
+		{
+			if (std::memcmp(begin + offset, ShaderBinaryInfoSignature, sizeof(ShaderBinaryInfoSignature) - 1) == 0)
+			{
+				infoOffset = offset;
+				found      = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			LOG_WARN("shader binary info not found, shader %p not captured.", code);
+			break;
+		}
+
+		addRange(code, infoOffset + ShaderBinaryInfoSize);
+	} while (false);
+}
+
+bool GnmCaptureWriter::writeChunk(GnmCaptureChunkType type,
+								  const void*         head,
+								  size_t              headSize,
+								  const void*         body,
+								  size_t              bodySize)
+{
+	const static uint8_t padding[ChunkAlignment] = {};
+
+	bool ret = false;
+	do
+	{
+		GnmCaptureChunk chunk = {};
+		chunk.type            = type;
+		chunk.size            = headSize + bodySize;
+
+		size_t paddingSize = util::align(chunk.size, ChunkAlignment) - chunk.size;
+
+		FILE* file = m_file.get();
+		if (fwrite(&chunk, sizeof(chunk), 1, file) != 1 ||
+			fwrite(head, 1, headSize, file) != headSize ||
+			fwrite(body, 1, bodySize, file) != bodySize ||
+			fwrite(padding, 1, paddingSize, file) != paddingSize)
+		{
+			break;
+		}
+
+		ret = true;
+	} while (false);
+	return ret;
+}
+
+GnmCaptureWriter& GetGnmCaptureWriter()
+{
+	static GnmCaptureWriter writer;
+	return writer;
+}
+
+GnmCaptureReplayer::GnmCaptureReplayer()
+{
+}
+
+GnmCaptureReplayer::~GnmCaptureReplayer()
+{
+}
+
+bool GnmCaptureReplayer::open(std::string const& fileName)
+{
+	bool ret = false;
+	do
+	{
+		if (!m_file.open(fileName))
+		{
+			LOG_ERR("open capture file %s failed.", fileName.c_str());
+			break;
+		}
+
+		auto header = reinterpret_cast<const GnmCaptureHeader*>(m_file.data());
+		if (m_file.size() < sizeof(GnmCaptureHeader) ||
+			header->magic != GnmCaptureMagic ||
+			header->version != GnmCaptureVersion)
+		{
+			LOG_ERR("%s is not a supported capture file.", fileName.c_str());
+			break;
+		}
+
+		if (!indexChunks())
+		{
+			break;
+		}
+
+		if (!mapGuestMemory())
+		{
+			break;
+		}
+
+		m_cb = std::make_unique<GnmCommandBufferReplay>();
+		m_cp = std::make_unique<GnmCommandProcessor>();
+		m_cp->attachCommandBuffer(m_cb.get());
+
+		ret = true;
+	} while (false);
+	return ret;
+}
+
+bool GnmCaptureReplayer::indexChunks()
+{
+	bool ret = true;
+
+	size_t offset = sizeof(GnmCaptureHeader);
+	while (offset != m_file.size())
+	{
+		auto chunk = reinterpret_cast<const GnmCaptureChunk*>(m_file.data() + offset);
+		if (m_file.size() - offset < sizeof(GnmCaptureChunk) ||
+			m_file.size() - offset - sizeof(GnmCaptureChunk) < chunk->size)
+		{
+			LOG_ERR("capture truncated at offset %zX.", offset);
+			ret = false;
+			break;
+		}
+
+		bool valid = false;
+		if (chunk->type == GnmCaptureChunkType::Memory)
+		{
+			valid = chunk->size > sizeof(uint64_t);
+		}
+		else if (chunk->type == GnmCaptureChunkType::Submit)
+		{
+			auto submit = reinterpret_cast<const GnmCaptureSubmit*>(chunk + 1);
+			valid       = chunk->size >= sizeof(GnmCaptureSubmit) &&
+					(chunk->size - sizeof(GnmCaptureSubmit)) / sizeof(GnmCaptureCommand) >= submit->count;
+		}
+
+		if (!valid)
+		{
+			LOG_ERR("invalid chunk %X at offset %zX.", chunk->type, offset);
+			ret = false;
+			break;
+		}
+
+		m_chunks.push_back(chunk);
+
+		size_t next = offset + sizeof(GnmCaptureChunk) + util::align(chunk->size, ChunkAlignment);
+		offset      = std::min(next, m_file.size());
+	}
+
+	return ret;
+}
+
+bool GnmCaptureReplayer::mapGuestMemory()
+{
+	std::vector<std::pair<uint64_t, uint64_t>> spans;
+	for (auto chunk : m_chunks)
+	{
+		if (chunk->type != GnmCaptureChunkType::Memory)
+		{
+			continue;
+		}
+
+		uint64_t gpuAddr = *reinterpret_cast<const uint64_t*>(chunk + 1);
+		uint64_t end     = gpuAddr + chunk->size - sizeof(uint64_t);
+		spans.emplace_back(gpuAddr & ~(GuestMemoryAlignment - 1),
+						   util::align(end, GuestMemoryAlignment));
+	}
+
+	std::sort(spans.begin(), spans.end());
+
+	bool ret = true;
+	for (size_t i = 0; i != spans.size() && ret;)
+	{
+		uint64_t begin = spans[i].first;
+		uint64_t end   = spans[i].second;
+		for (++i; i != spans.size() && spans[i].first <= end; ++i)
+		{
+			end = std::max(end, spans[i].second);
+		}
+
+		void* address = reinterpret_cast<void*>(begin);
+		void* memory  = plat::VMAllocate(address, end - begin,
+										 plat::VMAT_RESERVE_COMMIT, plat::VMPF_CPU_RW);
+		if (memory != address)
+		{
+			LOG_ERR("guest memory %llX size %llX is not available.", begin, end - begin);
+			plat::MemoryUnMapper()(memory);
+			ret = false;
+			break;
+		}
+
+		m_guestMemory.emplace_back(reinterpret_cast<uint8_t*>(memory));
+	}
+
+	return ret;
+}
+
+bool GnmCaptureReplayer::replay(uint32_t loopCount, GnmReplayStatistics* stats)
+{
+	GnmReplayStatistics result = {};
+
+	std::vector<const void*> dcbs;
+	std::vector<uint32_t>    dcbSizes;
+	std::vector<const void*> ccbs;
+	std::vector<uint32_t>    ccbSizes;
+
+	for (uint32_t loop = 0; loop != loopCount; ++loop)
+	{
+		for (auto chunk : m_chunks)
+		{
+			auto payload = reinterpret_cast<const uint8_t*>(chunk + 1);
+			if (chunk->type == GnmCaptureChunkType::Memory)
+			{
+				// Also undoes what the command processor patched last loop.
+				uint64_t gpuAddr = *reinterpret_cast<const uint64_t*>(payload);
+				std::memcpy(reinterpret_cast<void*>(gpuAddr),
+							payload + sizeof(uint64_t),
+							chunk->size - sizeof(uint64_t));
+				continue;
+			}
+
+			auto submit   = reinterpret_cast<const GnmCaptureSubmit*>(payload);
+			auto commands = reinterpret_cast<const GnmCaptureCommand*>(submit + 1);
+
+			dcbs.clear();
+			dcbSizes.clear();
+			ccbs.clear();
+			ccbSizes.clear();
+			for (uint32_t i = 0; i != submit->count; ++i)
+			{
+				dcbs.push_back(reinterpret_cast<const void*>(commands[i].dcbGpuAddr));
+				dcbSizes.push_back(commands[i].dcbSizeInBytes);
+				ccbs.push_back(reinterpret_cast<const void*>(commands[i].ccbGpuAddr));
+				ccbSizes.push_back(commands[i].ccbSizeInBytes);
+				result.commandBytes += commands[i].dcbSizeInBytes + commands[i].ccbSizeInBytes;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			m_cp->processCommandBuffers(submit->count,
+										dcbs.data(), dcbSizes.data(),
+										ccbs.data(), ccbSizes.data());
+			auto elapsed = std::chrono::steady_clock::now() - start;
+
+			result.seconds += std::chrono::duration<double>(elapsed).count();
+			++result.submitCount;
+		}
+	}
+
+	result.state = m_cp->stateStatistics();
+
+	if (stats)
+	{
+		*stats = result;
+	}
+
+	return result.submitCount != 0;
+}
+
+}  // namespace sce::Gnm
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "GnmCommon.h"
+#include "GnmRegisterShadow.h"
+#include "PlatFile.h"
+#include "PlatMemory.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sce::Gnm
+{
+	class GnmCommandProcessor;
+	class GnmCommandBuffer;
+
+	// Capture file layout, little endian:
+	//
+	// GnmCaptureHeader
+	// Chunks, each one a GnmCaptureChunk followed by size bytes of payload:
+	//   Memory: the guest address as uint64_t, then the bytes found there.
+	//   Submit: GnmCaptureSubmit, then count GnmCaptureCommand.
+	//
+	// Memory chunks are written right before the submission reading them.
+	// A later chunk may hold the same address with newer content,
+	// since games reuse their command buffers frame after frame.
+
+	constexpr uint32_t GnmCaptureMagic   = 0x43344D50;  // PM4C
+	constexpr uint32_t GnmCaptureVersion = 1;
+
+	enum class GnmCaptureChunkType : uint32_t
+	{
+		Memory = 0x524D454D,  // MEMR
+		Submit = 0x4D425553,  // SUBM
+	};
+
+	struct GnmCaptureHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+	};
+
+	struct GnmCaptureChunk
+	{
+		GnmCaptureChunkType type;
+		uint32_t            reserved;
+		uint64_t            size;
+	};
+
+	struct GnmCaptureSubmit
+	{
+		uint32_t count;
+		uint32_t videoOutHandle;
+		uint32_t displayBufferIndex;
+		uint32_t flipMode;
+		int64_t  flipArg;
+	};
+
+	struct GnmCaptureCommand
+	{
+		uint64_t dcbGpuAddr;
+		uint64_t ccbGpuAddr;
+		uint32_t dcbSizeInBytes;
+		uint32_t ccbSizeInBytes;
+	};
+
+	// Writes submitted command buffers into a capture file,
+	// along with the guest memory the command processor reads through them:
+	// shader code, index buffers and constant engine memory.
+	//
+	// Resources referenced through V#, T# and S# are not captured,
+	// nor is anything only the GPU backend would read.
+	class GnmCaptureWriter
+	{
+	public:
+		GnmCaptureWriter();
+		~GnmCaptureWriter();
+
+		bool open(std::string const& fileName);
+
+		void close();
+
+		bool isOpen() const
+		{
+			return m_opened.load(std::memory_order_acquire);
+		}
+
+		// Must be called before the command processor sees the buffers,
+		// it patches some packets in place.
+		void captureSubmit(uint32_t           count,
+						   const void* const* dcbGpuAddrs,
+						   const uint32_t*    dcbSizesInBytes,
+						   const void* const* ccbGpuAddrs,
+						   const uint32_t*    ccbSizesInBytes,
+						   uint32_t           videoOutHandle,
+						   uint32_t           displayBufferIndex,
+						   uint32_t           flipMode,
+						   int64_t            flipArg);
+
+	private:
+		void collectDcbRanges(const void* dcb, uint32_t sizeInBytes, uint32_t depth = 0);
+		void collectCcbRanges(const void* ccb, uint32_t sizeInBytes, uint32_t depth = 0);
+		void collectIndirectBuffer(const uint32_t* packet, uint32_t depth, bool isConstant);
+		void addRange(const void* gpuAddr, size_t size);
+		void addShaderRange(const void* code);
+
+		bool writeChunk(GnmCaptureChunkType type,
+						const void*         head,
+						size_t              headSize,
+						const void*         body,
+						size_t              bodySize);
+
+	private:
+		std::mutex                                   m_mutex;
+		std::atomic<bool>                            m_opened = { false };
+		plat::file_uptr                              m_file;
+		std::vector<std::pair<const void*, size_t>> m_ranges;
+		uint32_t                                     m_indexSize = sizeof(uint16_t);
+	};
+
+	GnmCaptureWriter& GetGnmCaptureWriter();
+
+	struct GnmReplayStatistics
+	{
+		uint64_t submitCount;
+		uint64_t commandBytes;
+		// Time spent in the command processor only,
+		// restoring guest memory is not counted.
+		double seconds;
+
+		GnmStateStatistics state;
+	};
+
+	// Feeds a capture through GnmCommandProcessor
+	// into a backend which neither renders nor writes guest memory.
+	// Guest memory is restored at the addresses it was captured from,
+	// so the pointers inside the packets stay valid.
+	class GnmCaptureReplayer
+	{
+	public:
+		GnmCaptureReplayer();
+		~GnmCaptureReplayer();
+
+		bool open(std::string const& fileName);
+
+		// Runs all submissions of the capture in order, loopCount times.
+		bool replay(uint32_t loopCount, GnmReplayStatistics* stats);
+
+	private:
+		bool indexChunks();
+		bool mapGuestMemory();
+
+	private:
+		plat::FileMapping                     m_file;
+		std::vector<const GnmCaptureChunk*>   m_chunks;
+		std::vector<plat::memory_ptr>         m_guestMemory;
+		std::unique_ptr<GnmCommandProcessor> m_cp;
+		std::unique_ptr<GnmCommandBuffer>    m_cb;
+	};
+
+}  // namespace sce::Gnm
@@ -11,7 +11,11 @@ namespace sce::Gnm
 	GnmCommandBuffer::GnmCommandBuffer(vlt::VltDevice* device) :
 		m_device(device)
 	{
-		m_context = m_device->createContext();
+		// No device when replaying captures without a GPU.
+		if (m_device)
+		{
+			m_context = m_device->createContext();
+		}
 	}
 
 	GnmCommandBuffer::~GnmCommandBuffer()
@@ -20,15 +24,19 @@ namespace sce::Gnm
 
 	void GnmCommandBuffer::beginRecording()
 	{
-		m_context->beginRecording(
-			m_device->createCommandList()
-		);
+		if (m_context != nullptr)
+		{
+			m_context->beginRecording(
+				m_device->createCommandList());
+		}
 	}
 
 	vlt::Rc<vlt::VltCommandList>
 	GnmCommandBuffer::endRecording()
 	{
-		return m_context->endRecording();
+		return m_context != nullptr
+				   ? m_context->endRecording()
+				   : nullptr;
 	}
 
 	void GnmCommandBuffer::emuWriteGpuLabel(EventWriteSource selector, void* label, uint64_t value)
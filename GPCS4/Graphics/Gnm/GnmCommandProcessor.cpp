@@ -9,12 +9,18 @@
 #include "Pssl/PsslShaderRegister.h"
 #include "Violet/VltCmdList.h"
 
+#include <cstring>
+
 using namespace util;
 using namespace sce::vlt;
 
 
 LOG_CHANNEL(Graphic.Gnm.GnmCommandProcessor);
 
+// Log the name of every type 3 packet processed.
+// This is slow whenever the channel is enabled.
+// #define GNM_LOG_PM4_PACKETS
+
 namespace sce::Gnm
 {
 
@@ -37,8 +43,12 @@ namespace sce::Gnm
 
 const uint32_t c_stageBases[kShaderStageCount] = { 0x2E40, 0x2C0C, 0x2C4C, 0x2C8C, 0x2CCC, 0x2D0C, 0x2D4C };
 
+// Size of the constant engine's on-chip RAM.
+constexpr uint32_t c_constRamSize = 48 * 1024;
+
 GnmCommandProcessor::GnmCommandProcessor():
-	m_cb(nullptr)
+	m_cb(nullptr),
+	m_constRam(c_constRamSize)
 {
 }
 
@@ -65,6 +75,8 @@ bool GnmCommandProcessor::processCmdInternal(const void* commandBuffer, uint32_t
 		const PM4_HEADER* pm4Hdr           = reinterpret_cast<const PM4_HEADER*>(commandBuffer);
 		uint32_t          processedCmdSize = 0;
 
+		m_cmdEnd = reinterpret_cast<const uint32_t*>(commandBuffer) + commandSize / sizeof(uint32_t);
+
 		while (processedCmdSize < commandSize)
 		{
 			uint32_t pm4Type = pm4Hdr->type;
@@ -99,6 +111,7 @@ bool GnmCommandProcessor::processCmdInternal(const void* commandBuffer, uint32_t
 
 			if (m_skipPm4Count != 0)
 			{
+				shadowSkippedPackets(getNextPm4(pm4Hdr), m_skipPm4Count);
 				processedPm4Count += m_skipPm4Count;
 				m_skipPm4Count = 0;
 			}
@@ -118,227 +131,365 @@ bool GnmCommandProcessor::processCmdInternal(const void* commandBuffer, uint32_t
 	return bRet;
 }
 
+void GnmCommandProcessor::shadowSkippedPackets(const PM4_HEADER* pm4Hdr, uint32_t count)
+{
+	for (uint32_t i = 0; i != count; ++i)
+	{
+		if (pm4Hdr->type == PM4_TYPE_3)
+		{
+			auto pm4Type3 = reinterpret_cast<const PM4_TYPE_3_HEADER*>(pm4Hdr);
+			auto itBody   = reinterpret_cast<const uint32_t*>(pm4Hdr + 1);
+			switch (pm4Type3->opcode)
+			{
+			case IT_SET_CONTEXT_REG:
+				m_shadow.write(kRegisterSpaceContext, itBody[0] & 0xFFFF, &itBody[1], pm4Type3->count);
+				break;
+			case IT_SET_SH_REG:
+				m_shadow.write(kRegisterSpaceSh, itBody[0] & 0xFFFF, &itBody[1], pm4Type3->count);
+				break;
+			case IT_SET_UCONFIG_REG:
+				m_shadow.write(kRegisterSpaceUconfig, itBody[0] & 0xFFFF, &itBody[1], pm4Type3->count);
+				break;
+			default:
+				break;
+			}
+		}
+
+		pm4Hdr = getNextPm4(pm4Hdr);
+	}
+}
+
+bool GnmCommandProcessor::shadowContextRegs(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	PPM4ME_SET_CONTEXT_REG setCtxPacket = (PPM4ME_SET_CONTEXT_REG)pm4Hdr;
+	uint32_t               regOffset    = setCtxPacket->bitfields2.reg_offset;
+
+	++m_stateStats.registerPackets;
+	bool changed = m_shadow.write(kRegisterSpaceContext, regOffset, &itBody[1], pm4Hdr->count);
+
+	bool isViewport     = regOffset >= 0xB4 && regOffset <= 0xD2;
+	bool isRenderTarget = regOffset >= 0x318 && regOffset <= (0x31C + 15 * 7);
+	if (isViewport)
+	{
+		// The viewport transform follows in the next packet,
+		// see onSetViewport.
+		PPM4ME_SET_CONTEXT_REG nextPacket = (PPM4ME_SET_CONTEXT_REG)getNextPm4InBuffer(pm4Hdr);
+		if (nextPacket &&
+			nextPacket->header.type == PM4_TYPE_3 &&
+			nextPacket->header.opcode == IT_SET_CONTEXT_REG)
+		{
+			uint32_t* nextBody = reinterpret_cast<uint32_t*>(nextPacket) + 1;
+			changed |= m_shadow.write(kRegisterSpaceContext,
+									  nextPacket->bitfields2.reg_offset,
+									  &nextBody[1],
+									  nextPacket->header.count);
+		}
+		else
+		{
+			// Not the packet pair we know, or the buffer ends here,
+			// don't drop anything.
+			changed = true;
+		}
+	}
+	else if (isRenderTarget || regOffset == OP_HINT_SET_DEPTH_RENDER_TARGET)
+	{
+		// These calls span several packets, including non register ones,
+		// always forward them.
+		changed = true;
+	}
+
+	if (!changed)
+	{
+		++m_stateStats.redundantPackets;
+		if (isViewport)
+		{
+			m_skipPm4Count = 1;
+		}
+	}
+
+	return changed;
+}
+
 Rc<VltCommandList> 
 GnmCommandProcessor::processCommandBuffer(const void* commandBuffer, uint32_t commandSize)
+{
+	return processCommandBuffers(1, &commandBuffer, &commandSize, nullptr, nullptr);
+}
+
+Rc<VltCommandList>
+GnmCommandProcessor::processCommandBuffers(uint32_t           count,
+										   const void* const* dcbGpuAddrs,
+										   const uint32_t*    dcbSizesInBytes,
+										   const void* const* ccbGpuAddrs,
+										   const uint32_t*    ccbSizesInBytes)
 {
 	m_cb->beginRecording();
 
-	processCmdInternal(commandBuffer, commandSize);
+	// Each batch is recorded into a new command list,
+	// which must not rely on state set by the previous one.
+	m_shadow.invalidate();
+
+	for (uint32_t i = 0; i != count; ++i)
+	{
+		const void* ccb     = ccbGpuAddrs ? ccbGpuAddrs[i] : nullptr;
+		uint32_t    ccbSize = ccb && ccbSizesInBytes ? ccbSizesInBytes[i] : 0;
+
+		m_ceCursor       = reinterpret_cast<const uint32_t*>(ccb);
+		m_ceEnd          = m_ceCursor + ccbSize / sizeof(uint32_t);
+		m_ceCounter      = 0;
+		m_ceReturnCursor = nullptr;
+		m_ceReturnEnd    = nullptr;
+
+		processCmdInternal(dcbGpuAddrs[i], dcbSizesInBytes[i]);
+
+		// Whatever the DE didn't wait for still executes.
+		while (runConstantEngine())
+		{
+		}
+	}
 
 	return m_cb->endRecording();
 }
 
+bool GnmCommandProcessor::runConstantEngine()
+{
+	bool ran = false;
+	while (m_ceCursor)
+	{
+		if (m_ceCursor >= m_ceEnd)
+		{
+			if (!m_ceReturnCursor)
+			{
+				break;
+			}
+
+			// Back from a called constant buffer.
+			m_ceCursor       = m_ceReturnCursor;
+			m_ceEnd          = m_ceReturnEnd;
+			m_ceReturnCursor = nullptr;
+			m_ceReturnEnd    = nullptr;
+			continue;
+		}
+
+		// The cursor moves past the packet first, an indirect buffer packet redirects it.
+		const PM4_HEADER* pm4Hdr = reinterpret_cast<const PM4_HEADER*>(m_ceCursor);
+		if (pm4Hdr->type == PM4_TYPE_3)
+		{
+			m_ceCursor += PM4_LENGTH_DW(pm4Hdr->u32All);
+			processCEPacket((PPM4_TYPE_3_HEADER)pm4Hdr, (uint32_t*)(pm4Hdr + 1));
+		}
+		else
+		{
+			// type 2 nop
+			m_ceCursor += 1;
+		}
+
+		ran = true;
+		if (m_ceCounter != 0)
+		{
+			break;
+		}
+	}
+	return ran;
+}
+
 void GnmCommandProcessor::processPM4Type0(PPM4_TYPE_0_HEADER pm4Hdr, uint32_t* regDataX)
 {
 	LOG_FIXME("Type 0 PM4 packet is not supported.");
 }
 
-void GnmCommandProcessor::processPM4Type3(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+constexpr GnmCommandProcessor::PacketHandlerTable GnmCommandProcessor::buildType3Handlers()
 {
-	IT_OpCodeType opcode = (IT_OpCodeType)pm4Hdr->opcode;
+	PacketHandlerTable table = {};
+	for (auto& handler : table)
+	{
+		handler = &GnmCommandProcessor::onInvalidOpcode;
+	}
 
-	LOG_DEBUG("OpCode Name %s", opcodeName(*(uint32_t*)pm4Hdr));
+	table[IT_NOP]                           = &GnmCommandProcessor::onNop;
+	table[IT_SET_BASE]                      = &GnmCommandProcessor::onSetBase;
+	table[IT_INDEX_BUFFER_SIZE]             = &GnmCommandProcessor::onIndexBufferSize;
+	table[IT_SET_PREDICATION]               = &GnmCommandProcessor::onSetPredication;
+	table[IT_COND_EXEC]                     = &GnmCommandProcessor::onCondExec;
+	table[IT_INDEX_BASE]                    = &GnmCommandProcessor::onIndexBase;
+	table[IT_INDEX_TYPE]                    = &GnmCommandProcessor::onIndexType;
+	table[IT_NUM_INSTANCES]                 = &GnmCommandProcessor::onNumInstances;
+	table[IT_STRMOUT_BUFFER_UPDATE]         = &GnmCommandProcessor::onStrmoutBufferUpdate;
+	table[IT_WRITE_DATA]                    = &GnmCommandProcessor::onWriteData;
+	table[IT_MEM_SEMAPHORE]                 = &GnmCommandProcessor::onMemSemaphore;
+	table[IT_WAIT_REG_MEM]                  = &GnmCommandProcessor::onWaitRegMem;
+	table[IT_INDIRECT_BUFFER]               = &GnmCommandProcessor::onIndirectBuffer;
+	table[IT_PFP_SYNC_ME]                   = &GnmCommandProcessor::onPfpSyncMe;
+	table[IT_EVENT_WRITE]                   = &GnmCommandProcessor::onEventWrite;
+	table[IT_EVENT_WRITE_EOP]               = &GnmCommandProcessor::onEventWriteEop;
+	table[IT_EVENT_WRITE_EOS]               = &GnmCommandProcessor::onEventWriteEos;
+	table[IT_DMA_DATA]                      = &GnmCommandProcessor::onDmaData;
+	table[IT_ACQUIRE_MEM]                   = &GnmCommandProcessor::onAcquireMem;
+	table[IT_REWIND]                        = &GnmCommandProcessor::onRewind;
+	table[IT_SET_CONFIG_REG]                = &GnmCommandProcessor::onSetConfigReg;
+	table[IT_SET_CONTEXT_REG]               = &GnmCommandProcessor::onSetContextReg;  // 0x69
+	table[IT_SET_SH_REG]                    = &GnmCommandProcessor::onSetShReg;
+	table[IT_SET_UCONFIG_REG]               = &GnmCommandProcessor::onSetUconfigReg;  // 0x79
+	table[IT_INCREMENT_DE_COUNTER]          = &GnmCommandProcessor::onIncrementDeCounter;
+	table[IT_WAIT_ON_CE_COUNTER]            = &GnmCommandProcessor::onWaitOnCeCounter;
+	table[IT_DISPATCH_DRAW_PREAMBLE__GFX09] = &GnmCommandProcessor::onDispatchDrawPreambleGfx09;
+	table[IT_DISPATCH_DRAW__GFX09]          = &GnmCommandProcessor::onDispatchDrawGfx09;
+	table[IT_GET_LOD_STATS__GFX09]          = &GnmCommandProcessor::onGetLodStatsGfx09;
+	table[IT_RELEASE_MEM]                   = &GnmCommandProcessor::onReleaseMem;
 
-	switch (opcode)
-	{
-	case IT_NOP:
-		onNop(pm4Hdr, itBody);
-		break;
-	case IT_SET_BASE:
-		onSetBase(pm4Hdr, itBody);
-		break;
-	case IT_INDEX_BUFFER_SIZE:
-		onIndexBufferSize(pm4Hdr, itBody);
-		break;
-	case IT_SET_PREDICATION:
-		onSetPredication(pm4Hdr, itBody);
-		break;
-	case IT_COND_EXEC:
-		onCondExec(pm4Hdr, itBody);
-		break;
-	case IT_INDEX_BASE:
-		onIndexBase(pm4Hdr, itBody);
-		break;
-	case IT_INDEX_TYPE:
-		onIndexType(pm4Hdr, itBody);
-		break;
-	case IT_NUM_INSTANCES:
-		onNumInstances(pm4Hdr, itBody);
-		break;
-	case IT_STRMOUT_BUFFER_UPDATE:
-		onStrmoutBufferUpdate(pm4Hdr, itBody);
-		break;
-	case IT_WRITE_DATA:
-		onWriteData(pm4Hdr, itBody);
-		break;
-	case IT_MEM_SEMAPHORE:
-		onMemSemaphore(pm4Hdr, itBody);
-		break;
-	case IT_WAIT_REG_MEM:
-		onWaitRegMem(pm4Hdr, itBody);
-		break;
-	case IT_INDIRECT_BUFFER:
-		onIndirectBuffer(pm4Hdr, itBody);
-		break;
-	case IT_PFP_SYNC_ME:
-		onPfpSyncMe(pm4Hdr, itBody);
-		break;
-	case IT_EVENT_WRITE:
-		onEventWrite(pm4Hdr, itBody);
-		break;
-	case IT_EVENT_WRITE_EOP:
-		onEventWriteEop(pm4Hdr, itBody);
-		break;
-	case IT_EVENT_WRITE_EOS:
-		onEventWriteEos(pm4Hdr, itBody);
-		break;
-	case IT_DMA_DATA:
-		onDmaData(pm4Hdr, itBody);
-		break;
-	case IT_ACQUIRE_MEM:
-		onAcquireMem(pm4Hdr, itBody);
-		break;
-	case IT_REWIND:
-		onRewind(pm4Hdr, itBody);
-		break;
-	case IT_SET_CONFIG_REG:
-		onSetConfigReg(pm4Hdr, itBody);
-		break;
-	case IT_SET_CONTEXT_REG:  // 0x69
-		onSetContextReg(pm4Hdr, itBody);
-		break;
-	case IT_SET_SH_REG:
-		onSetShReg(pm4Hdr, itBody);
-		break;
-	case IT_SET_UCONFIG_REG:  // 0x79
-		onSetUconfigReg(pm4Hdr, itBody);
-		break;
-	case IT_INCREMENT_DE_COUNTER:
-		onIncrementDeCounter(pm4Hdr, itBody);
-		break;
-	case IT_WAIT_ON_CE_COUNTER:
-		onWaitOnCeCounter(pm4Hdr, itBody);
-		break;
-	case IT_DISPATCH_DRAW_PREAMBLE__GFX09:
-		onDispatchDrawPreambleGfx09(pm4Hdr, itBody);
-		break;
-	case IT_DISPATCH_DRAW__GFX09:
-		onDispatchDrawGfx09(pm4Hdr, itBody);
-		break;
-	case IT_GET_LOD_STATS__GFX09:
-		onGetLodStatsGfx09(pm4Hdr, itBody);
-		break;
-	case IT_RELEASE_MEM:
-		onReleaseMem(pm4Hdr, itBody);
-		break;
 	// Private handler
-	case IT_GNM_PRIVATE:
-		onGnmPrivate(pm4Hdr, itBody);
-		break;
+	table[IT_GNM_PRIVATE] = &GnmCommandProcessor::onGnmPrivate;
 
 	// Legacy packets used in old SDKs.
-	case IT_DRAW_INDEX_AUTO:
-	case IT_DISPATCH_DIRECT:
-		onGnmLegacy(pm4Hdr, itBody);
-		break;
+	table[IT_DRAW_INDEX_AUTO] = &GnmCommandProcessor::onGnmLegacy;
+	table[IT_DISPATCH_DIRECT] = &GnmCommandProcessor::onGnmLegacy;
 
 	// The following opcode types are not used by Gnm
 
 	// TODO:
 	// There maybe still some opcodes belongs to Gnm that is not found.
 	// We should find all and place them above.
-	case IT_CLEAR_STATE:
-	case IT_DISPATCH_INDIRECT:
-	case IT_INDIRECT_BUFFER_END:
-	case IT_INDIRECT_BUFFER_CNST_END:
-	case IT_ATOMIC_GDS:
-	case IT_ATOMIC_MEM:
-	case IT_OCCLUSION_QUERY:
-	case IT_REG_RMW:
-	case IT_PRED_EXEC:
-	case IT_DRAW_INDIRECT:
-	case IT_DRAW_INDEX_INDIRECT:
-	case IT_DRAW_INDEX_2:
-	case IT_CONTEXT_CONTROL:
-	case IT_DRAW_INDIRECT_MULTI:
-	case IT_DRAW_INDEX_MULTI_AUTO:
-	case IT_INDIRECT_BUFFER_PRIV:
-	case IT_INDIRECT_BUFFER_CNST:
-	case IT_DRAW_INDEX_OFFSET_2:
-	case IT_DRAW_PREAMBLE:
-	case IT_DRAW_INDEX_INDIRECT_MULTI:
-	case IT_DRAW_INDEX_MULTI_INST:
-	case IT_COPY_DW:
-	case IT_COPY_DATA:
-	case IT_CP_DMA:
-	case IT_SURFACE_SYNC:
-	case IT_ME_INITIALIZE:
-	case IT_COND_WRITE:
-	case IT_PREAMBLE_CNTL:
-	case IT_DRAW_RESERVED0:
-	case IT_DRAW_RESERVED1:
-	case IT_DRAW_RESERVED2:
-	case IT_DRAW_RESERVED3:
-	case IT_CONTEXT_REG_RMW:
-	case IT_GFX_CNTX_UPDATE:
-	case IT_BLK_CNTX_UPDATE:
-	case IT_INCR_UPDT_STATE:
-	case IT_INTERRUPT:
-	case IT_GEN_PDEPTE:
-	case IT_INDIRECT_BUFFER_PASID:
-	case IT_PRIME_UTCL2:
-	case IT_LOAD_UCONFIG_REG:
-	case IT_LOAD_SH_REG:
-	case IT_LOAD_CONFIG_REG:
-	case IT_LOAD_CONTEXT_REG:
-	case IT_LOAD_COMPUTE_STATE:
-	case IT_LOAD_SH_REG_INDEX:
-	case IT_SET_CONTEXT_REG_INDEX:
-	case IT_SET_VGPR_REG_DI_MULTI:
-	case IT_SET_SH_REG_DI:
-	case IT_SET_CONTEXT_REG_INDIRECT:
-	case IT_SET_SH_REG_DI_MULTI:
-	case IT_GFX_PIPE_LOCK:
-	case IT_SET_SH_REG_OFFSET:
-	case IT_SET_QUEUE_REG:
-	case IT_SET_UCONFIG_REG_INDEX:
-	case IT_FORWARD_HEADER:
-	case IT_SCRATCH_RAM_WRITE:
-	case IT_SCRATCH_RAM_READ:
-	case IT_LOAD_CONST_RAM:
-	case IT_WRITE_CONST_RAM:
-	case IT_DUMP_CONST_RAM:
-	case IT_INCREMENT_CE_COUNTER:
-	case IT_WAIT_ON_DE_COUNTER_DIFF:
-	case IT_SWITCH_BUFFER:
-	case IT_FRAME_CONTROL:
-	case IT_INDEX_ATTRIBUTES_INDIRECT:
-	case IT_WAIT_REG_MEM64:
-	case IT_COND_PREEMPT:
-	case IT_HDP_FLUSH:
-	case IT_INVALIDATE_TLBS:
-	case IT_DMA_DATA_FILL_MULTI:
-	case IT_SET_SH_REG_INDEX:
-	case IT_DRAW_INDIRECT_COUNT_MULTI:
-	case IT_DRAW_INDEX_INDIRECT_COUNT_MULTI:
-	case IT_DUMP_CONST_RAM_OFFSET:
-	case IT_LOAD_CONTEXT_REG_INDEX:
-	case IT_SET_RESOURCES:
-	case IT_MAP_PROCESS:
-	case IT_MAP_QUEUES:
-	case IT_UNMAP_QUEUES:
-	case IT_QUERY_STATUS:
-	case IT_RUN_LIST:
-	case IT_MAP_PROCESS_VM:
-	case IT_DRAW_MULTI_PREAMBLE__GFX09:
-	case IT_AQL_PACKET__GFX09:
-		LOG_ERR("Opcode not supported %X", opcode);
-		break;
-	default:
-		LOG_ERR("Invalid opcode %X", opcode);
-		break;
+	constexpr IT_OpCodeType unsupportedOpcodes[] = {
+		IT_CLEAR_STATE,
+		IT_DISPATCH_INDIRECT,
+		IT_INDIRECT_BUFFER_END,
+		IT_INDIRECT_BUFFER_CNST_END,
+		IT_ATOMIC_GDS,
+		IT_ATOMIC_MEM,
+		IT_OCCLUSION_QUERY,
+		IT_REG_RMW,
+		IT_PRED_EXEC,
+		IT_DRAW_INDIRECT,
+		IT_DRAW_INDEX_INDIRECT,
+		IT_DRAW_INDEX_2,
+		IT_CONTEXT_CONTROL,
+		IT_DRAW_INDIRECT_MULTI,
+		IT_DRAW_INDEX_MULTI_AUTO,
+		IT_INDIRECT_BUFFER_PRIV,
+		IT_INDIRECT_BUFFER_CNST,
+		IT_DRAW_INDEX_OFFSET_2,
+		IT_DRAW_PREAMBLE,
+		IT_DRAW_INDEX_INDIRECT_MULTI,
+		IT_DRAW_INDEX_MULTI_INST,
+		IT_COPY_DW,
+		IT_COPY_DATA,
+		IT_CP_DMA,
+		IT_SURFACE_SYNC,
+		IT_ME_INITIALIZE,
+		IT_COND_WRITE,
+		IT_PREAMBLE_CNTL,
+		IT_DRAW_RESERVED0,
+		IT_DRAW_RESERVED1,
+		IT_DRAW_RESERVED2,
+		IT_DRAW_RESERVED3,
+		IT_CONTEXT_REG_RMW,
+		IT_GFX_CNTX_UPDATE,
+		IT_BLK_CNTX_UPDATE,
+		IT_INCR_UPDT_STATE,
+		IT_INTERRUPT,
+		IT_GEN_PDEPTE,
+		IT_INDIRECT_BUFFER_PASID,
+		IT_PRIME_UTCL2,
+		IT_LOAD_UCONFIG_REG,
+		IT_LOAD_SH_REG,
+		IT_LOAD_CONFIG_REG,
+		IT_LOAD_CONTEXT_REG,
+		IT_LOAD_COMPUTE_STATE,
+		IT_LOAD_SH_REG_INDEX,
+		IT_SET_CONTEXT_REG_INDEX,
+		IT_SET_VGPR_REG_DI_MULTI,
+		IT_SET_SH_REG_DI,
+		IT_SET_CONTEXT_REG_INDIRECT,
+		IT_SET_SH_REG_DI_MULTI,
+		IT_GFX_PIPE_LOCK,
+		IT_SET_SH_REG_OFFSET,
+		IT_SET_QUEUE_REG,
+		IT_SET_UCONFIG_REG_INDEX,
+		IT_FORWARD_HEADER,
+		IT_SCRATCH_RAM_WRITE,
+		IT_SCRATCH_RAM_READ,
+		IT_LOAD_CONST_RAM,
+		IT_WRITE_CONST_RAM,
+		IT_DUMP_CONST_RAM,
+		IT_INCREMENT_CE_COUNTER,
+		IT_WAIT_ON_DE_COUNTER_DIFF,
+		IT_SWITCH_BUFFER,
+		IT_FRAME_CONTROL,
+		IT_INDEX_ATTRIBUTES_INDIRECT,
+		IT_WAIT_REG_MEM64,
+		IT_COND_PREEMPT,
+		IT_HDP_FLUSH,
+		IT_INVALIDATE_TLBS,
+		IT_DMA_DATA_FILL_MULTI,
+		IT_SET_SH_REG_INDEX,
+		IT_DRAW_INDIRECT_COUNT_MULTI,
+		IT_DRAW_INDEX_INDIRECT_COUNT_MULTI,
+		IT_DUMP_CONST_RAM_OFFSET,
+		IT_LOAD_CONTEXT_REG_INDEX,
+		IT_SET_RESOURCES,
+		IT_MAP_PROCESS,
+		IT_MAP_QUEUES,
+		IT_UNMAP_QUEUES,
+		IT_QUERY_STATUS,
+		IT_RUN_LIST,
+		IT_MAP_PROCESS_VM,
+		IT_DRAW_MULTI_PREAMBLE__GFX09,
+		IT_AQL_PACKET__GFX09,
+	};
+
+	for (auto opcode : unsupportedOpcodes)
+	{
+		table[opcode] = &GnmCommandProcessor::onUnsupportedOpcode;
+	}
+
+	return table;
+}
+
+constexpr GnmCommandProcessor::PacketHandlerTable GnmCommandProcessor::buildPrivateHandlers()
+{
+	PacketHandlerTable table = {};
+	for (auto& handler : table)
+	{
+		handler = &GnmCommandProcessor::onPrivateIgnored;
 	}
 
+	table[OP_PRIV_INITIALIZE_DEFAULT_HARDWARE_STATE] = &GnmCommandProcessor::onInitializeDefaultHardwareState;
+	table[OP_PRIV_SET_EMBEDDED_VS_SHADER]            = &GnmCommandProcessor::onSetEmbeddedVsShader;
+	table[OP_PRIV_SET_VS_SHADER]                     = &GnmCommandProcessor::onSetVsShader;
+	table[OP_PRIV_SET_PS_SHADER]                     = &GnmCommandProcessor::onSetPsShader;
+	table[OP_PRIV_SET_CS_SHADER]                     = &GnmCommandProcessor::onSetCsShader;
+	table[OP_PRIV_UPDATE_PS_SHADER]                  = &GnmCommandProcessor::onUpdatePsShader;
+	table[OP_PRIV_UPDATE_VS_SHADER]                  = &GnmCommandProcessor::onUpdateVsShader;
+	table[OP_PRIV_SET_VGT_CONTROL]                   = &GnmCommandProcessor::onSetVgtControl;
+	table[OP_PRIV_DRAW_INDEX]                        = &GnmCommandProcessor::onDrawIndex;
+	table[OP_PRIV_DRAW_INDEX_AUTO]                   = &GnmCommandProcessor::onDrawIndexAuto;
+	table[OP_PRIV_WAIT_UNTIL_SAFE_FOR_RENDERING]     = &GnmCommandProcessor::onWaitUntilSafeForRendering;
+	table[OP_PRIV_DISPATCH_DIRECT]                   = &GnmCommandProcessor::onDispatchDirect;
+
+	return table;
+}
+
+// Both tables are constant initialized, no static initialization order problem.
+const GnmCommandProcessor::PacketHandlerTable GnmCommandProcessor::s_type3Handlers   = buildType3Handlers();
+const GnmCommandProcessor::PacketHandlerTable GnmCommandProcessor::s_privateHandlers = buildPrivateHandlers();
+
+void GnmCommandProcessor::processPM4Type3(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+#ifdef GNM_LOG_PM4_PACKETS
+	LOG_DEBUG("OpCode Name %s", opcodeName(*(uint32_t*)pm4Hdr));
+#endif  // GNM_LOG_PM4_PACKETS
+
+	(this->*s_type3Handlers[pm4Hdr->opcode])(pm4Hdr, itBody);
+}
+
+void GnmCommandProcessor::onUnsupportedOpcode(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	LOG_ERR("Opcode not supported %X %s", pm4Hdr->opcode, opcodeName(pm4Hdr->u32All));
+}
+
+void GnmCommandProcessor::onInvalidOpcode(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	LOG_ERR("Invalid opcode %X", pm4Hdr->opcode);
 }
 
 // NOP packet usually used for providing a hint for the following packet,
@@ -467,9 +618,57 @@ void GnmCommandProcessor::onWaitRegMem(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBo
 	}
 }
 
+bool GnmCommandProcessor::getIndirectBuffer(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t depth, const uint32_t** buffer, uint32_t* sizeInBytes)
+{
+	auto packet  = reinterpret_cast<PPM4ME_INDIRECT_BUFFER>(pm4Hdr);
+	*buffer      = reinterpret_cast<const uint32_t*>(util::buildUint64(packet->bitfields3.ib_base_hi, packet->ib_base_lo));
+	*sizeInBytes = packet->bitfields4.ib_size * sizeof(uint32_t);
+
+	// The submitted buffer may call one level of indirect buffers, no more.
+	bool valid = depth == 0 && *buffer && *sizeInBytes;
+	if (!valid)
+	{
+		LOG_WARN("indirect buffer %p size %X at depth %u is not run.", *buffer, *sizeInBytes, depth);
+		++m_stateStats.skippedIndirectBufferCount;
+	}
+	else
+	{
+		++m_stateStats.indirectBufferCount;
+	}
+	return valid;
+}
+
 void GnmCommandProcessor::onIndirectBuffer(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
 {
+	const uint32_t* buffer      = nullptr;
+	uint32_t        sizeInBytes = 0;
+	if (!getIndirectBuffer(pm4Hdr, m_indirectDepth, &buffer, &sizeInBytes))
+	{
+		return;
+	}
+
+	// Run the called buffer in place, then carry on with this one.
+	const uint32_t* cmdEnd = m_cmdEnd;
+	++m_indirectDepth;
+	processCmdInternal(buffer, sizeInBytes);
+	--m_indirectDepth;
+	m_cmdEnd = cmdEnd;
+}
+
+void GnmCommandProcessor::onIndirectBufferConst(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	const uint32_t* buffer      = nullptr;
+	uint32_t        sizeInBytes = 0;
+	if (!getIndirectBuffer(pm4Hdr, m_ceReturnCursor ? 1 : 0, &buffer, &sizeInBytes))
+	{
+		return;
+	}
 
+	// runConstantEngine already moved the cursor past this packet.
+	m_ceReturnCursor = m_ceCursor;
+	m_ceReturnEnd    = m_ceEnd;
+	m_ceCursor       = buffer;
+	m_ceEnd          = buffer + sizeInBytes / sizeof(uint32_t);
 }
 
 void GnmCommandProcessor::onPfpSyncMe(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
@@ -569,6 +768,11 @@ void GnmCommandProcessor::onSetContextReg(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* i
 	uint32_t regOffset = setCtxPacket->bitfields2.reg_offset;
 	uint32_t hint = regOffset;
 
+	if (!shadowContextRegs(pm4Hdr, itBody))
+	{
+		return;
+	}
+
 	switch (hint)
 	{
 		case OP_HINT_SET_DB_RENDER_CONTROL:
@@ -698,6 +902,25 @@ void GnmCommandProcessor::onSetShReg(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody
 {
 	PPM4ME_SET_SH_REG shPacket = (PPM4ME_SET_SH_REG)pm4Hdr;
 
+	++m_stateStats.registerPackets;
+	bool changed = m_shadow.write(kRegisterSpaceSh, shPacket->bitfields2.reg_offset, &itBody[1], pm4Hdr->count);
+
+	// V#, T#, S# and other pointers in user data hold the address of memory
+	// whose content may have changed since the last write,
+	// so an unchanged address doesn't mean unchanged state.
+	bool holdsAddress = pm4Hdr->count != 1 && m_lastHint != OP_HINT_SET_USER_DATA_REGION;
+	if (holdsAddress)
+	{
+		changed = true;
+	}
+
+	if (!changed)
+	{
+		++m_stateStats.redundantPackets;
+		m_lastHint = 0;
+		return;
+	}
+
 	if (pm4Hdr->count != 1)
 	{
 		ShaderStage stage;
@@ -788,6 +1011,13 @@ void GnmCommandProcessor::onSetUconfigReg(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* i
 {
 	PPM4ME_SET_UCONFIG_REG setUcfgPacket = (PPM4ME_SET_UCONFIG_REG)pm4Hdr;
 
+	++m_stateStats.registerPackets;
+	if (!m_shadow.write(kRegisterSpaceUconfig, setUcfgPacket->bitfields2.reg_offset, &itBody[1], pm4Hdr->count))
+	{
+		++m_stateStats.redundantPackets;
+		return;
+	}
+
 	switch (setUcfgPacket->bitfields2.reg_offset)
 	{
 	case OP_HINT_SET_PRIMITIVE_TYPE_BASE:
@@ -800,12 +1030,99 @@ void GnmCommandProcessor::onSetUconfigReg(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* i
 
 void GnmCommandProcessor::onIncrementDeCounter(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
 {
-
+	// The CE only runs when the DE waits for it,
+	// so it can never get too far ahead of the DE.
 }
 
 void GnmCommandProcessor::onWaitOnCeCounter(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
 {
+	// Let the CE catch up to the point the DE is waiting for.
+	while (m_ceCounter == 0 && runConstantEngine())
+	{
+	}
 
+	if (m_ceCounter != 0)
+	{
+		--m_ceCounter;
+	}
+}
+
+void GnmCommandProcessor::processCEPacket(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	IT_OpCodeType opcode = (IT_OpCodeType)pm4Hdr->opcode;
+
+	switch (opcode)
+	{
+	case IT_NOP:
+		break;
+	case IT_WRITE_CONST_RAM:
+		onWriteConstRam(pm4Hdr, itBody);
+		break;
+	case IT_DUMP_CONST_RAM:
+		onDumpConstRam(pm4Hdr, itBody);
+		break;
+	case IT_LOAD_CONST_RAM:
+		onLoadConstRam(pm4Hdr, itBody);
+		break;
+	case IT_INCREMENT_CE_COUNTER:
+		onIncrementCeCounter(pm4Hdr, itBody);
+		break;
+	case IT_INDIRECT_BUFFER_CNST:
+		onIndirectBufferConst(pm4Hdr, itBody);
+		break;
+	case IT_WAIT_ON_DE_COUNTER_DIFF:
+		// See onIncrementDeCounter.
+		break;
+	default:
+		LOG_ERR("CE opcode not supported %X", opcode);
+		break;
+	}
+}
+
+void GnmCommandProcessor::onWriteConstRam(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	auto     packet   = reinterpret_cast<PPM4CE_WRITE_CONST_RAM>(pm4Hdr);
+	uint32_t offset   = packet->bitfields2.const_ram_offset;
+	uint32_t dataSize = (PM4_LENGTH_DW(pm4Hdr->u32All) - 2) * sizeof(uint32_t);
+	if (offset + dataSize > m_constRam.size())
+	{
+		LOG_ERR("write const ram out of range, offset %X size %X", offset, dataSize);
+		return;
+	}
+	std::memcpy(&m_constRam[offset], itBody + 1, dataSize);
+}
+
+void GnmCommandProcessor::onDumpConstRam(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	auto     packet   = reinterpret_cast<PPM4CE_DUMP_CONST_RAM>(pm4Hdr);
+	uint32_t offset   = packet->bitfields2.const_ram_offset;
+	uint32_t dataSize = packet->bitfields3.num_dwords * sizeof(uint32_t);
+	void*    dst      = reinterpret_cast<void*>(static_cast<uintptr_t>(packet->addr_hi) << 32 | packet->addr_lo);
+	if (offset + dataSize > m_constRam.size())
+	{
+		LOG_ERR("dump const ram out of range, offset %X size %X", offset, dataSize);
+		return;
+	}
+	std::memcpy(dst, &m_constRam[offset], dataSize);
+}
+
+void GnmCommandProcessor::onLoadConstRam(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	auto     packet   = reinterpret_cast<PPM4CE_LOAD_CONST_RAM>(pm4Hdr);
+	uint32_t offset   = packet->bitfields5.const_ram_offset;
+	uint32_t dataSize = packet->bitfields4.num_dwords * sizeof(uint32_t);
+	void*    src      = reinterpret_cast<void*>(static_cast<uintptr_t>(packet->addr_hi) << 32 | packet->addr_lo);
+	if (offset + dataSize > m_constRam.size())
+	{
+		LOG_ERR("load const ram out of range, offset %X size %X", offset, dataSize);
+		return;
+	}
+	std::memcpy(&m_constRam[offset], src, dataSize);
+}
+
+void GnmCommandProcessor::onIncrementCeCounter(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	++m_ceCounter;
 }
 
 void GnmCommandProcessor::onDispatchDrawPreambleGfx09(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
@@ -848,133 +1165,87 @@ void GnmCommandProcessor::onReleaseMem(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBo
 
 void GnmCommandProcessor::onGnmPrivate(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
 {
-	// Note:
-	// Most private opcode handle cases are not much complicated,
-	// just cast pm4Hdr to proper GnmCmdxxx and call the graphic function.
-	// But if it's going to be complicated (eg. contains 'if' statement), 
-	// please write a new function to handle it,
-	// like onDrawIndex
-
 	IT_OpCodePriv priv = PM4_PRIV(*(uint32_t*)pm4Hdr);
-	switch (priv)
-	{
-	case OP_PRIV_INITIALIZE_DEFAULT_HARDWARE_STATE:
-		m_cb->initializeDefaultHardwareState();
-		break;
-	case OP_PRIV_INITIALIZE_TO_DEFAULT_CONTEXT_STATE:
-		break;
-	case OP_PRIV_SET_EMBEDDED_VS_SHADER:
-	{
-		GnmCmdVSShader* param = (GnmCmdVSShader*)pm4Hdr;
-		m_cb->setEmbeddedVsShader(param->shaderId, param->modifier);
-	}
-		break;
-	case OP_PRIV_SET_EMBEDDED_PS_SHADER:
-		break;
-	case OP_PRIV_SET_VS_SHADER:
-	{
-		GnmCmdVSShader* param = (GnmCmdVSShader*)pm4Hdr;
-		m_cb->setVsShader(&param->vsRegs, param->modifier);
-	}
-		break;
-	case OP_PRIV_SET_PS_SHADER:
-	{
-		GnmCmdPSShader* param = (GnmCmdPSShader*)pm4Hdr;
-		m_cb->setPsShader(&param->psRegs);
-	}
-		break;
-	case OP_PRIV_SET_CS_SHADER:
-	{
-		GnmCmdCSShader* param = (GnmCmdCSShader*)pm4Hdr;
-		m_cb->setCsShader(&param->csRegs, param->modifier);
-	}
-		break;
-	case OP_PRIV_SET_ES_SHADER:
-		break;
-	case OP_PRIV_SET_GS_SHADER:
-		break;
-	case OP_PRIV_SET_HS_SHADER:
-		break;
-	case OP_PRIV_SET_LS_SHADER:
-		break;
-	case OP_PRIV_UPDATE_GS_SHADER:
-		break;
-	case OP_PRIV_UPDATE_HS_SHADER:
-		break;
-	case OP_PRIV_UPDATE_PS_SHADER:
-	{
-		GnmCmdPSShader* param = (GnmCmdPSShader*)pm4Hdr;
-		m_cb->updatePsShader(&param->psRegs);
-	}
-		break;
-	case OP_PRIV_UPDATE_VS_SHADER:
-	{
-		GnmCmdVSShader* param = (GnmCmdVSShader*)pm4Hdr;
-		m_cb->updateVsShader(&param->vsRegs, param->modifier);
-	}
-		break;
-	case OP_PRIV_SET_VGT_CONTROL:
-	{
-		GnmCmdVgtControl* param = (GnmCmdVgtControl*)pm4Hdr;
-		m_cb->setVgtControlForNeo(param->primGroupSizeMinusOne, 
-			(WdSwitchOnlyOnEopMode)param->wdSwitchOnlyOnEopMode, 
-			(VgtPartialVsWaveMode)param->partialVsWaveMode);
-	}
-		break;
-	case OP_PRIV_RESET_VGT_CONTROL:
-		break;
-	case OP_PRIV_DRAW_INDEX:
-		onDrawIndex(pm4Hdr, itBody);
-		break;
-	case OP_PRIV_DRAW_INDEX_AUTO:
-		onDrawIndexAuto(pm4Hdr, itBody);
-		break;
-	case OP_PRIV_DRAW_INDEX_INDIRECT:
-		break;
-	case OP_PRIV_DRAW_INDEX_INDIRECT_COUNT_MULTI:
-		break;
-	case OP_PRIV_DRAW_INDEX_MULTI_INSTANCED:
-		break;
-	case OP_PRIV_DRAW_INDEX_OFFSET:
-		break;
-	case OP_PRIV_DRAW_INDIRECT:
-		break;
-	case OP_PRIV_DRAW_INDIRECT_COUNT_MULTI:
-		break;
-	case OP_PRIV_DRAW_OPAQUE_AUTO:
-		break;
-	case OP_PRIV_WAIT_UNTIL_SAFE_FOR_RENDERING:
+	(this->*s_privateHandlers[priv])(pm4Hdr, itBody);
+}
+
+// Note:
+// Most private opcode handlers are not much complicated,
+// just cast pm4Hdr to proper GnmCmdxxx and call the graphic function.
+// Register new ones in buildPrivateHandlers.
+
+void GnmCommandProcessor::onPrivateIgnored(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+}
+
+void GnmCommandProcessor::onInitializeDefaultHardwareState(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	m_shadow.invalidate();
+	m_cb->initializeDefaultHardwareState();
+}
+
+void GnmCommandProcessor::onSetEmbeddedVsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdVSShader* param = (GnmCmdVSShader*)pm4Hdr;
+	m_cb->setEmbeddedVsShader(param->shaderId, param->modifier);
+}
+
+void GnmCommandProcessor::onSetVsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdVSShader* param = (GnmCmdVSShader*)pm4Hdr;
+	m_cb->setVsShader(&param->vsRegs, param->modifier);
+}
+
+void GnmCommandProcessor::onSetPsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdPSShader* param = (GnmCmdPSShader*)pm4Hdr;
+	m_cb->setPsShader(&param->psRegs);
+}
+
+void GnmCommandProcessor::onSetCsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdCSShader* param = (GnmCmdCSShader*)pm4Hdr;
+	m_cb->setCsShader(&param->csRegs, param->modifier);
+}
+
+void GnmCommandProcessor::onUpdatePsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdPSShader* param = (GnmCmdPSShader*)pm4Hdr;
+	m_cb->updatePsShader(&param->psRegs);
+}
+
+void GnmCommandProcessor::onUpdateVsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdVSShader* param = (GnmCmdVSShader*)pm4Hdr;
+	m_cb->updateVsShader(&param->vsRegs, param->modifier);
+}
+
+void GnmCommandProcessor::onSetVgtControl(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdVgtControl* param = (GnmCmdVgtControl*)pm4Hdr;
+	m_cb->setVgtControlForNeo(param->primGroupSizeMinusOne,
+							  (WdSwitchOnlyOnEopMode)param->wdSwitchOnlyOnEopMode,
+							  (VgtPartialVsWaveMode)param->partialVsWaveMode);
+}
+
+void GnmCommandProcessor::onWaitUntilSafeForRendering(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdWaitFlipDone* param = (GnmCmdWaitFlipDone*)pm4Hdr;
+	m_cb->waitUntilSafeForRendering(param->videoOutHandle, param->displayBufferIndex);
+}
+
+void GnmCommandProcessor::onDispatchDirect(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody)
+{
+	GnmCmdDispatchDirect*     param = (GnmCmdDispatchDirect*)pm4Hdr;
+	DispatchOrderedAppendMode mode  = (DispatchOrderedAppendMode)bit::extract(param->pred, 4, 3);
+	++m_stateStats.dispatchCount;
+	if (mode == kDispatchOrderedAppendModeDisabled)
 	{
-		GnmCmdWaitFlipDone* param = (GnmCmdWaitFlipDone*)pm4Hdr;
-		m_cb->waitUntilSafeForRendering(param->videoOutHandle, param->displayBufferIndex);
+		m_cb->dispatch(param->threadGroupX, param->threadGroupY, param->threadGroupZ);
 	}
-		break;
-	case OP_PRIV_PUSH_MARKER:
-		break;
-	case OP_PRIV_PUSH_COLOR_MARKER:
-		break;
-	case OP_PRIV_POP_MARKER:
-		break;
-	case OP_PRIV_SET_MARKER:
-		break;
-	case OP_PRIV_DISPATCH_DIRECT:
+	else
 	{
-		GnmCmdDispatchDirect*     param = (GnmCmdDispatchDirect*)pm4Hdr;
-		DispatchOrderedAppendMode mode  = (DispatchOrderedAppendMode)bit::extract(param->pred, 4, 3);
-		if (mode == kDispatchOrderedAppendModeDisabled)
-		{
-			m_cb->dispatch(param->threadGroupX, param->threadGroupY, param->threadGroupZ);
-		}
-		else
-		{
-			m_cb->dispatchWithOrderedAppend(param->threadGroupX, param->threadGroupY, param->threadGroupZ, mode);
-		}
-	}
-		break;
-	case OP_PRIV_DISPATCH_INDIRECT:
-		break;
-	default:
-		break;
+		m_cb->dispatchWithOrderedAppend(param->threadGroupX, param->threadGroupY, param->threadGroupZ, mode);
 	}
 }
 
@@ -994,12 +1265,14 @@ void GnmCommandProcessor::onGnmLegacy(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBod
 		uint32_t threadGroupX = itBody[0];
 		uint32_t threadGroupY = itBody[1];
 		uint32_t threadGroupZ = itBody[2];
+		++m_stateStats.dispatchCount;
 		m_cb->dispatch(threadGroupX, threadGroupY, threadGroupZ);
 	}
 		break;
 	case IT_DRAW_INDEX_AUTO:
 	{
 		uint32_t indexCount = itBody[0];
+		++m_stateStats.drawCount;
 		m_cb->drawIndexAuto(indexCount);
 	}
 		break;
@@ -1047,6 +1320,7 @@ void GnmCommandProcessor::onDrawIndex(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBod
 {
 	GnmCmdDrawIndex* param = (GnmCmdDrawIndex*)pm4Hdr;
 	DrawModifier modifier = { 0 };
+	++m_stateStats.drawCount;
 	modifier.renderTargetSliceOffset = (param->predAndMod >> 29) & 0b111;
 	if (!modifier.renderTargetSliceOffset)
 	{
@@ -1062,6 +1336,7 @@ void GnmCommandProcessor::onDrawIndexAuto(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* i
 {
 	GnmCmdDrawIndexAuto* param = (GnmCmdDrawIndexAuto*)pm4Hdr;
 	DrawModifier modifier = { 0 };
+	++m_stateStats.drawCount;
 	modifier.renderTargetSliceOffset = (param->predAndMod >> 29) & 0b111;
 	if (!modifier.renderTargetSliceOffset)
 	{
@@ -1078,7 +1353,12 @@ void GnmCommandProcessor::onSetViewport(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itB
 	float dmin = *reinterpret_cast<float*>(&itBody[1]);
 	float dmax = *reinterpret_cast<float*>(&itBody[2]);
 
-	PPM4_TYPE_3_HEADER nextPacket = getNextPm4(pm4Hdr);
+	PPM4_TYPE_3_HEADER nextPacket = getNextPm4InBuffer(pm4Hdr);
+	if (!nextPacket)
+	{
+		LOG_ERR("Viewport packet without its transform packet, the command buffer ends here.");
+		return;
+	}
 	uint32_t* nextItBody = reinterpret_cast<uint32_t*>(nextPacket + 1);
 
 	float scale[3] = { 0.0 };
@@ -3,9 +3,13 @@
 #include "GnmCommandBuffer.h"
 #include "GnmCommon.h"
 #include "GnmOpCode.h"
+#include "GnmRegisterShadow.h"
 
 #include "Violet/VltRc.h"
 
+#include <array>
+#include <vector>
+
 namespace sce
 {
 	namespace vlt
@@ -40,7 +44,31 @@ namespace sce
 			vlt::Rc<vlt::VltCommandList> 
 				processCommandBuffer(const void* commandBuffer, uint32_t commandSize);
 
+			// Process all command buffers of one submit call into a single command list,
+			// so the whole batch goes to the GPU in one queue submission.
+			// ccbGpuAddrs may be null, as may be any of its entries.
+			vlt::Rc<vlt::VltCommandList>
+				processCommandBuffers(uint32_t           count,
+									  const void* const* dcbGpuAddrs,
+									  const uint32_t*    dcbSizesInBytes,
+									  const void* const* ccbGpuAddrs,
+									  const uint32_t*    ccbSizesInBytes);
+
+			// Counters of redundant state, accumulated over all command buffers processed.
+			const GnmStateStatistics& stateStatistics() const
+			{
+				return m_stateStats;
+			}
+
 		private:
+			// Type 3 packets and private packets are dispatched through tables
+			// indexed by opcode, built at compile time.
+			using PacketHandler      = void (GnmCommandProcessor::*)(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			using PacketHandlerTable = std::array<PacketHandler, 256>;
+
+			static constexpr PacketHandlerTable buildType3Handlers();
+			static constexpr PacketHandlerTable buildPrivateHandlers();
+
 			void processPM4Type0(PPM4_TYPE_0_HEADER pm4Hdr, uint32_t* regDataX);
 			void processPM4Type3(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
 
@@ -75,9 +103,29 @@ namespace sce
 			void onDispatchDrawGfx09(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
 			void onGetLodStatsGfx09(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
 			void onReleaseMem(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onUnsupportedOpcode(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onInvalidOpcode(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+
+			// Constant engine packet handlers
+			void processCEPacket(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onWriteConstRam(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onDumpConstRam(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onLoadConstRam(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onIncrementCeCounter(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
 
 			// Private
 			void onGnmPrivate(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onPrivateIgnored(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onInitializeDefaultHardwareState(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onSetEmbeddedVsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onSetVsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onSetPsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onSetCsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onUpdatePsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onUpdateVsShader(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onSetVgtControl(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onWaitUntilSafeForRendering(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+			void onDispatchDirect(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
 			// Legacy packets used in old SDKs.
 			void onGnmLegacy(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
 
@@ -107,9 +155,45 @@ namespace sce
 				return getNextNPm4<HdrType>(thisPm4, 1);
 			}
 
+			// Same as getNextPm4, but returns null if the next packet
+			// doesn't lie completely inside the command buffer being processed.
+			template <typename HdrType>
+			HdrType getNextPm4InBuffer(HdrType thisPm4)
+			{
+				const uint32_t* nextPm4 = (const uint32_t*)getNextPm4(thisPm4);
+				if (nextPm4 >= m_cmdEnd ||
+					PM4_LENGTH_DW(*nextPm4) > uint32_t(m_cmdEnd - nextPm4))
+				{
+					return nullptr;
+				}
+				return (HdrType)nextPm4;
+			}
+
 			bool processCmdInternal(const void* commandBuffer, uint32_t commandSize);
 
+			// Shadows the registers of a SET_CONTEXT_REG packet.
+			// Returns false if the gnm call the packet starts changes nothing,
+			// in which case it must not be forwarded.
+			bool shadowContextRegs(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+
+			// Shadows packets skipped as part of a gnm call,
+			// so the shadow never misses a register write.
+			void shadowSkippedPackets(const PM4_HEADER* pm4Hdr, uint32_t count);
+
+			// Run the constant engine until it increments the CE counter
+			// or reaches the end of the constant command buffer.
+			// Returns false if there is nothing left to run.
+			bool runConstantEngine();
+
+			// Address and size of the buffer an INDIRECT_BUFFER or INDIRECT_BUFFER_CNST packet calls,
+			// returns false if it can't be run from the current depth.
+			bool getIndirectBuffer(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t depth, const uint32_t** buffer, uint32_t* sizeInBytes);
+			void onIndirectBufferConst(PPM4_TYPE_3_HEADER pm4Hdr, uint32_t* itBody);
+
 		private:
+			static const PacketHandlerTable s_type3Handlers;
+			static const PacketHandlerTable s_privateHandlers;
+
 			GnmCommandBuffer* m_cb;
 
 			// Flip packet is the last pm4 packet of a command buffer,
@@ -126,6 +210,28 @@ namespace sce
 			// This should be the the real pm4 packet count which forms a gnm call minus one.
 			// e.g. 2 packets makes gnm call, m_skipPm4Count = 1
 			uint32_t m_skipPm4Count = 0;
+
+			// End of the draw command buffer being processed.
+			const uint32_t* m_cmdEnd = nullptr;
+			// Number of indirect buffers the draw engine is inside of.
+			uint32_t m_indirectDepth = 0;
+
+			// The constant command buffer is not processed in one go,
+			// but interleaved with its draw command buffer at WAIT_ON_CE_COUNTER packets.
+			// This keeps the order the DE observes on hardware, where the CE runs ahead
+			// and the two engines synchronize through the CE/DE counters.
+			const uint32_t*      m_ceCursor  = nullptr;
+			const uint32_t*      m_ceEnd     = nullptr;
+			uint32_t             m_ceCounter = 0;
+			// Where the constant engine continues once a called constant buffer ends.
+			const uint32_t*      m_ceReturnCursor = nullptr;
+			const uint32_t*      m_ceReturnEnd    = nullptr;
+			std::vector<uint8_t> m_constRam;
+
+			// Register writes which change nothing are dropped here,
+			// the command buffer only sees real state changes.
+			GnmRegisterShadow  m_shadow;
+			GnmStateStatistics m_stateStats = {};
 		};
 
 	}  // namespace Gnm
@@ -1410,6 +1410,44 @@ typedef struct PM4_ME_INCREMENT_DE_COUNTER
 
 } PM4ME_INCREMENT_DE_COUNTER, *PPM4ME_INCREMENT_DE_COUNTER;
 
+//--------------------INDIRECT_BUFFER--------------------
+typedef struct PM4_ME_INDIRECT_BUFFER
+{
+    union
+    {
+        PM4_ME_TYPE_3_HEADER                     header;
+        uint32_t                               ordinal1;
+    };
+
+    uint32_t                                 ib_base_lo;
+
+    union
+    {
+        struct
+        {
+            uint32_t                         ib_base_hi : 16;
+            uint32_t                          reserved1 : 16;
+        } bitfields3;
+        uint32_t                               ordinal3;
+    };
+
+    union
+    {
+        struct
+        {
+            uint32_t                            ib_size : 20;
+            uint32_t                              chain : 1;
+            uint32_t                          reserved1 : 2;
+            uint32_t                              valid : 1;
+            uint32_t                               vmid : 4;
+            uint32_t                       cache_policy : 2;
+            uint32_t                          reserved2 : 2;
+        } bitfields4;
+        uint32_t                               ordinal4;
+    };
+
+} PM4ME_INDIRECT_BUFFER, *PPM4ME_INDIRECT_BUFFER;
+
 //--------------------LOAD_CONFIG_REG--------------------
 typedef struct PM4_ME_LOAD_CONFIG_REG
 {
@@ -2788,5 +2826,101 @@ typedef struct PM4_ME_LOAD_UCONFIG_REG_INDEX__GFX10
 } PM4ME_LOAD_UCONFIG_REG_INDEX__GFX10, *PPM4ME_LOAD_UCONFIG_REG_INDEX__GFX10;
 
 
+//--------------------CE WRITE_CONST_RAM--------------------
+typedef struct PM4_CE_WRITE_CONST_RAM
+{
+    union
+    {
+        PM4_ME_TYPE_3_HEADER                     header;
+        uint32_t                               ordinal1;
+    };
+
+    union
+    {
+        struct
+        {
+            uint32_t                       const_ram_offset : 16;
+            uint32_t                          reserved1 : 16;
+        } bitfields2;
+        uint32_t                               ordinal2;
+    };
+
+    // followed by the data dwords to write
+
+} PM4CE_WRITE_CONST_RAM, *PPM4CE_WRITE_CONST_RAM;
+
+//--------------------CE DUMP_CONST_RAM--------------------
+typedef struct PM4_CE_DUMP_CONST_RAM
+{
+    union
+    {
+        PM4_ME_TYPE_3_HEADER                     header;
+        uint32_t                               ordinal1;
+    };
+
+    union
+    {
+        struct
+        {
+            uint32_t                       const_ram_offset : 16;
+            uint32_t                          reserved1 : 9;
+            uint32_t                       cache_policy : 2;
+            uint32_t                          reserved2 : 5;
+        } bitfields2;
+        uint32_t                               ordinal2;
+    };
+
+    union
+    {
+        struct
+        {
+            uint32_t                         num_dwords : 15;
+            uint32_t                          reserved1 : 17;
+        } bitfields3;
+        uint32_t                               ordinal3;
+    };
+
+    uint32_t                                    addr_lo;
+
+    uint32_t                                    addr_hi;
+
+} PM4CE_DUMP_CONST_RAM, *PPM4CE_DUMP_CONST_RAM;
+
+//--------------------CE LOAD_CONST_RAM--------------------
+typedef struct PM4_CE_LOAD_CONST_RAM
+{
+    union
+    {
+        PM4_ME_TYPE_3_HEADER                     header;
+        uint32_t                               ordinal1;
+    };
+
+    uint32_t                                    addr_lo;
+
+    uint32_t                                    addr_hi;
+
+    union
+    {
+        struct
+        {
+            uint32_t                         num_dwords : 15;
+            uint32_t                          reserved1 : 17;
+        } bitfields4;
+        uint32_t                               ordinal4;
+    };
+
+    union
+    {
+        struct
+        {
+            uint32_t                       const_ram_offset : 16;
+            uint32_t                          reserved1 : 16;
+        } bitfields5;
+        uint32_t                               ordinal5;
+    };
+
+} PM4CE_LOAD_CONST_RAM, *PPM4CE_LOAD_CONST_RAM;
+
+
 }  // namespace sce::Gnm
 
@@ -0,0 +1,69 @@
+#include "GnmRegisterShadow.h"
+
+#include <algorithm>
+
+namespace sce::Gnm
+{
+
+constexpr uint32_t c_contextRegCount = 0x400;
+constexpr uint32_t c_shRegCount      = 0x400;
+constexpr uint32_t c_uconfigRegCount = 0x1000;
+
+GnmRegisterShadow::GnmRegisterShadow()
+{
+	initRegisterFile(kRegisterSpaceContext, c_contextRegCount);
+	initRegisterFile(kRegisterSpaceSh, c_shRegCount);
+	initRegisterFile(kRegisterSpaceUconfig, c_uconfigRegCount);
+}
+
+GnmRegisterShadow::~GnmRegisterShadow()
+{
+}
+
+void GnmRegisterShadow::initRegisterFile(GnmRegisterSpace space, uint32_t count)
+{
+	auto& file = m_spaces[space];
+	file.values.resize(count);
+	file.valid.resize(count / 64);
+}
+
+bool GnmRegisterShadow::write(GnmRegisterSpace space,
+							  uint32_t         offset,
+							  const uint32_t*  values,
+							  uint32_t         count)
+{
+	auto& file = m_spaces[space];
+
+	// Registers we don't shadow always count as changed.
+	if (offset > file.values.size() || count > file.values.size() - offset)
+	{
+		return true;
+	}
+
+	bool changed = false;
+	for (uint32_t i = 0; i != count; ++i)
+	{
+		uint32_t  reg   = offset + i;
+		uint64_t  bit   = 1ull << (reg % 64);
+		uint64_t& valid = file.valid[reg / 64];
+		if ((valid & bit) && file.values[reg] == values[i])
+		{
+			continue;
+		}
+
+		file.values[reg] = values[i];
+		valid |= bit;
+		changed = true;
+	}
+	return changed;
+}
+
+void GnmRegisterShadow::invalidate()
+{
+	for (auto& file : m_spaces)
+	{
+		std::fill(file.valid.begin(), file.valid.end(), 0);
+	}
+}
+
+}  // namespace sce::Gnm
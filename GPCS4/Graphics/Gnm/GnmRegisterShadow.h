@@ -0,0 +1,73 @@
+#pragma once
+
+#include "GnmCommon.h"
+
+#include <array>
+#include <vector>
+
+namespace sce::Gnm
+{
+
+	enum GnmRegisterSpace : uint32_t
+	{
+		kRegisterSpaceContext = 0,  // SET_CONTEXT_REG, based at 0xA000
+		kRegisterSpaceSh      = 1,  // SET_SH_REG, based at 0x2C00
+		kRegisterSpaceUconfig = 2,  // SET_UCONFIG_REG, based at 0xC000
+		kRegisterSpaceCount
+	};
+
+	struct GnmStateStatistics
+	{
+		uint64_t registerPackets;
+		// Register packets dropped because they changed nothing.
+		uint64_t redundantPackets;
+		uint64_t drawCount;
+		uint64_t dispatchCount;
+		// Indirect buffers run from the draw and constant command buffers,
+		// and those not run, being nested too deep or empty.
+		uint64_t indirectBufferCount;
+		uint64_t skippedIndirectBufferCount;
+	};
+
+	// Last values written to the context, SH and uconfig registers.
+	class GnmRegisterShadow
+	{
+	public:
+		GnmRegisterShadow();
+		~GnmRegisterShadow();
+
+		/**
+		 * \brief Writes consecutive registers
+		 *
+		 * \param space Register space.
+		 * \param offset First register, relative to the space base.
+		 * \param values Register values.
+		 * \param count Number of registers.
+		 * \returns False if all registers held these values already.
+		 */
+		bool write(GnmRegisterSpace space,
+				   uint32_t         offset,
+				   const uint32_t*  values,
+				   uint32_t         count);
+
+		/**
+		 * \brief Forgets all register values
+		 *
+		 * The next write to any register counts as a change.
+		 */
+		void invalidate();
+
+	private:
+		struct RegisterFile
+		{
+			std::vector<uint32_t> values;
+			std::vector<uint64_t> valid;
+		};
+
+		void initRegisterFile(GnmRegisterSpace space, uint32_t count);
+
+	private:
+		std::array<RegisterFile, kRegisterSpaceCount> m_spaces;
+	};
+
+}  // namespace sce::Gnm
@@ -597,7 +597,7 @@ namespace sce
 		/**
 		 * @brief Converts untiled surface data to tiled surface data as tiling arguments specify.
 		 *
-		 * Internally, this function chooses an appropriate <c>Tiler</c> class (<c>TilerLinear</c>, <c>Tiler1d</c>, or <c>Tiler2d</c>) and calls its tileSurface() method. Only a single mip level (<c><i>tp.m_mipLevel</i></c>) will be processed.
+		 * Internally, this function passes the whole surface to tileSurfaceRegions(), which splits it into bands for the shared thread pool. Only a single mip level (<c><i>tp.m_mipLevel</i></c>) will be processed.
 		 *
 		 * @param[out] outTiledSurface			Receives the tiled surface data. Use the computeTiledSurfaceSize() function to determine the minimum 
 		 *										required size of this buffer. This pointer must not be <c>NULL</c>.
@@ -614,7 +614,7 @@ namespace sce
 		/**
 		 * @brief Converts tiled surface data to untiled surface data as tiling arguments specify.
 		 *
-		 * Internally, this function chooses an appropriate <c>Tiler</c> class (<c>TilerLinear</c>, <c>Tiler1d</c>, or <c>Tiler2d</c>) and calls its detileSurface() method. Only a single mip level (<c><i>tp.m_mipLevel</i></c>) will be processed.
+		 * Internally, this function passes the whole surface to detileSurfaceRegions(), which splits it into bands for the shared thread pool. Only a single mip level (<c><i>tp.m_mipLevel</i></c>) will be processed.
 		 *
 		 * @param[out] outUntiledSurface		Pointer to which this function writes untiled surface data. Call the computeUntiledSurfaceSize() function to determine the minimum 
 		 *										required size of this buffer. This pointer must not be <c>NULL</c>.
@@ -628,6 +628,47 @@ namespace sce
 		 */
 		int32_t detileSurface(void *outUntiledSurface, const void *tiledSurface, const TilingParameters *tp);
 
+		/**
+		 * @brief Tiles a batch of surface subregions on the worker threads of the shared thread pool.
+		 *
+		 * Each region is split into bands of whole macro-tile rows (micro-tile rows for 1D and linear tile modes) and whole tile-thick slices,
+		 * and the bands of all regions are tiled concurrently. The result is the same as calling tileSurfaceRegion() once per region.
+		 *
+		 * @param[out] outTiledSurface			The base address of the destination surface that is to receive the tiled surface data. Use computeTiledSurfaceSize() to determine the minimum required buffer size.
+		 * @param[in] untiledSurfaces			Array of <c><i>numRegions</i></c> pointers to the source untiled data of each region, laid out as tileSurfaceRegion() expects it.
+		 * @param[in] tp						The tiling parameters.
+		 * @param[in] destRegions				Array of <c><i>numRegions</i></c> regions in the destination surface. The regions must not overlap.
+		 * @param[in] numRegions				The number of regions in the batch.
+		 * @param[in] sourcePitch				The pitch of each untiled source, in pixels (for render targets) or in elements (for textures).
+		 * @param[in] sourceSlicePitch			The size of one Z-slice of each untiled source, in pixels (for render targets) or in elements (for textures).
+		 *
+		 * @return								A status code from GpuAddress::Status. If several regions fail, the status of one of them.
+		 *
+		 * @sa tileSurfaceRegion(), detileSurfaceRegions()
+		 */
+		int32_t tileSurfaceRegions(void *outTiledSurface, const void *const *untiledSurfaces, const TilingParameters *tp, const SurfaceRegion *destRegions, uint32_t numRegions, uint32_t sourcePitch, uint32_t sourceSlicePitch);
+
+		/**
+		 * @brief Detiles a batch of surface subregions on the worker threads of the shared thread pool.
+		 *
+		 * Each region is split into bands of whole macro-tile rows (micro-tile rows for 1D and linear tile modes) and whole tile-thick slices,
+		 * and the bands of all regions are detiled concurrently. The result is the same as calling detileSurfaceRegion() once per region.
+		 *
+		 * @param[out] outUntiledSurfaces		Array of <c><i>numRegions</i></c> pointers to the destination buffers of each region, laid out as detileSurfaceRegion() writes them.
+		 *										The buffers must not overlap.
+		 * @param[in] tiledSurface				The base address of the source-tiled surface data. This pointer must not be <c>NULL</c>.
+		 * @param[in] tp						The tiling parameters.
+		 * @param[in] srcRegions				Array of <c><i>numRegions</i></c> regions in the source surface.
+		 * @param[in] numRegions				The number of regions in the batch.
+		 * @param[in] destPitch					The pitch of each destination buffer, in pixels (for render targets) or in elements (for textures).
+		 * @param[in] destSlicePitch			The size of one Z-slice of each destination buffer, in pixels (for render targets) or in elements (for textures).
+		 *
+		 * @return								A status code from GpuAddress::Status. If several regions fail, the status of one of them.
+		 *
+		 * @sa detileSurfaceRegion(), tileSurfaceRegions()
+		 */
+		int32_t detileSurfaceRegions(void *const *outUntiledSurfaces, const void *tiledSurface, const TilingParameters *tp, const SurfaceRegion *srcRegions, uint32_t numRegions, uint32_t destPitch, uint32_t destSlicePitch);
+
 		/////////////////////////////////////////////////////////
 		// Buffer swizzling functions
 		/////////////////////////////////////////////////////////
@@ -1275,6 +1316,8 @@ namespace sce
 		 */
 		bool isMicroTiled(Gnm::TileMode tileMode);
 
+		struct TilingTables;
+
 		/**
 		 * @brief Helper class to tile/detile a surface.
 		 *
@@ -1431,6 +1474,17 @@ namespace sce
 			 * @return								A status code from GpuAddress::Status.
 			 */
 			int32_t detileSurfaceRegion(void *outUntiledPixels, const void *tiledPixels, const SurfaceRegion *srcRegion, uint32_t destPitch, uint32_t destSlicePitch);
+
+			/**
+			 * @brief Gets the granularity at which a region can be split into bands that are tiled or detiled independently.
+			 *
+			 * No two bands touch the same row, so they may be processed concurrently.
+			 *
+			 * @param[out] outBandHeight			Receives the band height, in elements. Bands start at multiples of this value. This pointer must not be <c>NULL</c>.
+			 * @param[out] outBandDepth				Receives the band depth, in slices. Bands start at multiples of this value. This pointer must not be <c>NULL</c>.
+			 * @param[out] outBitsPerPixel			Receives the size of one pixel in the untiled surface data, including all of its fragments. This pointer must not be <c>NULL</c>.
+			 */
+			void getBandSize(uint32_t *outBandHeight, uint32_t *outBandDepth, uint32_t *outBitsPerPixel) const;
 		};
 
 		/**
@@ -1567,8 +1621,20 @@ namespace sce
 			 */
 			int32_t detileSurfaceRegion(void *outUntiledPixels, const void *tiledPixels, const SurfaceRegion *srcRegion, uint32_t destPitch, uint32_t destSlicePitch);
 
+			/**
+			 * @brief Gets the granularity at which a region can be split into bands that are tiled or detiled independently.
+			 *
+			 * No two bands touch the same micro tile, so they may be processed concurrently.
+			 *
+			 * @param[out] outBandHeight			Receives the band height, in elements. Bands start at multiples of this value. This pointer must not be <c>NULL</c>.
+			 * @param[out] outBandDepth				Receives the band depth, in slices. Bands start at multiples of this value. This pointer must not be <c>NULL</c>.
+			 * @param[out] outBitsPerPixel			Receives the size of one pixel in the untiled surface data, including all of its fragments. This pointer must not be <c>NULL</c>.
+			 */
+			void getBandSize(uint32_t *outBandHeight, uint32_t *outBandDepth, uint32_t *outBitsPerPixel) const;
+
 		private:
 			Gnm::MicroTileMode m_microTileMode;
+			const TilingTables *m_tables;
 			// constants
 			uint32_t m_tileThickness;
 			uint32_t m_tileBytes;
@@ -1744,9 +1810,28 @@ namespace sce
 			 * @return								A status code from GpuAddress::Status.
 			 */
             int32_t detileSurfaceRegionOneFragment(void *outUntiledPixels, const void *inTiledPixels, const SurfaceRegion *srcRegion, uint32_t destPitch, uint32_t destSlicePitch, uint32_t fragment);
+
+			/**
+			 * @brief Gets the granularity at which a region can be split into bands that are tiled or detiled independently.
+			 *
+			 * No two bands touch the same macro-tile row, so they may be processed concurrently.
+			 *
+			 * @param[out] outBandHeight			Receives the band height, in elements. Bands start at multiples of this value. This pointer must not be <c>NULL</c>.
+			 * @param[out] outBandDepth				Receives the band depth, in slices. Bands start at multiples of this value. This pointer must not be <c>NULL</c>.
+			 * @param[out] outBitsPerPixel			Receives the size of one pixel in the untiled surface data, including all of its fragments. This pointer must not be <c>NULL</c>.
+			 */
+			void getBandSize(uint32_t *outBandHeight, uint32_t *outBandDepth, uint32_t *outBitsPerPixel) const;
 		private:
+			// Tiles (kTile) or detiles subRegion one micro tile at a time, for the cases the
+			// micro tile kernels can't handle. Fragments [firstFragment, firstFragment+numFragments)
+			// are interleaved in the untiled data, which starts at region's corner.
+			template <bool kTile>
+			int32_t copyMicroTiles(uint8_t *outBytes, const uint8_t *inBytes, const SurfaceRegion &region, const SurfaceRegion &subRegion,
+								   uint32_t firstFragment, uint32_t numFragments, uint32_t pitch, uint32_t slicePitch) const;
+
 			Gnm::MicroTileMode m_microTileMode;
 			Gnm::PipeConfig m_pipeConfig;
+			const TilingTables *m_tables;
 			uint32_t m_arraySlice;
 			// constants
 			uint32_t m_numFragmentsPerPixel;
@@ -1769,6 +1854,18 @@ namespace sce
 			uint32_t m_pipeMask;
 			uint32_t m_bankSwizzleMask;
 			uint32_t m_pipeSwizzleMask;
+
+			// per-surface strides, see init()
+			uint32_t m_tileBytes;
+			uint32_t m_fragmentBits;
+			uint32_t m_slicesPerTile;
+			uint32_t m_splitTileBytes;
+			uint32_t m_tileThicknessBits;
+			uint32_t m_macroTileWidthBits;
+			uint32_t m_macroTileHeightBits;
+			uint64_t m_macroTileBytes;
+			uint64_t m_macroTilesPerRow;
+			uint64_t m_sliceBytes;
 		};
 #endif // !DOXYGEN_IGNORE
 	}
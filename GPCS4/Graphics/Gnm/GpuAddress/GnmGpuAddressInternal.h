@@ -3,6 +3,13 @@
 #include "GnmGpuAddress.h"
 #include "Gnm/GnmConstant.h"
 
+#include <vector>
+
+namespace util::cpu
+{
+	struct CpuFeatures;
+}
+
 
 namespace sce
 {
@@ -84,6 +91,90 @@ namespace sce
 		const uint32_t kNumMicroTilePixels = kMicroTileWidth*kMicroTileHeight;
 		const uint32_t kCmaskCacheBits = 0x400;
 		const uint32_t kHtileCacheBits = 0x4000;
+
+		/** @brief Selects one set of TilingTables.
+
+			Only the fields that change where an element lands inside a macro tile are part of the key.
+			Pitch, height and fragment count only affect per-tile strides, so surfaces that differ in them share tables.
+			For 1D-tiled surfaces, set the bank fields to 0.
+		*/
+		struct TilingTableKey
+		{
+			uint32_t m_bitsPerElement;
+			Gnm::MicroTileMode m_microTileMode;
+			Gnm::ArrayMode m_arrayMode;
+			Gnm::PipeConfig m_pipeConfig;
+			uint32_t m_bankWidth;
+			uint32_t m_bankHeight;
+			uint32_t m_numBanks;
+
+			bool operator==(const TilingTableKey &other) const
+			{
+				return m_bitsPerElement == other.m_bitsPerElement && m_microTileMode == other.m_microTileMode &&
+					m_arrayMode == other.m_arrayMode && m_pipeConfig == other.m_pipeConfig &&
+					m_bankWidth == other.m_bankWidth && m_bankHeight == other.m_bankHeight && m_numBanks == other.m_numBanks;
+			}
+		};
+
+		/** @brief Lookup tables that replace the per-element bit twiddling of getElementIndex(), getPipeIndex() and getBankIndex().
+
+			Pipe and bank bits are each an XOR of some x bits and some y bits, so they split into one table
+			indexed by micro tile column and one indexed by micro tile row.
+		*/
+		struct TilingTables
+		{
+			uint16_t m_elementIndex[8*8*8];    ///< Element index inside a micro tile, indexed by (z%8, y%8, x%8).
+			std::vector<uint8_t> m_columnSwizzle; ///< Pipe (low nibble) and bank (high nibble) bits each micro tile column contributes.
+			std::vector<uint8_t> m_rowSwizzle;    ///< Pipe (low nibble) and bank (high nibble) bits each micro tile row contributes.
+			uint32_t m_columnMask;
+			uint32_t m_rowMask;
+
+			uint32_t getElementIndex(uint32_t x, uint32_t y, uint32_t z) const
+			{
+				return m_elementIndex[((z & 7) << 6) | ((y & 7) << 3) | (x & 7)];
+			}
+			uint32_t getPipeIndex(uint32_t x, uint32_t y) const
+			{
+				return (m_columnSwizzle[(x / kMicroTileWidth) & m_columnMask] ^ m_rowSwizzle[(y / kMicroTileHeight) & m_rowMask]) & 0xF;
+			}
+			uint32_t getBankIndex(uint32_t x, uint32_t y) const
+			{
+				return (m_columnSwizzle[(x / kMicroTileWidth) & m_columnMask] ^ m_rowSwizzle[(y / kMicroTileHeight) & m_rowMask]) >> 4;
+			}
+		};
+
+		/** @brief Returns the tables for a key, building them on first use.
+			The tables are never freed, so the returned pointer stays valid. This function is thread-safe.
+		*/
+		const TilingTables *getTilingTables(const TilingTableKey &key);
+
+		/** @brief Reports how many getTilingTables() calls found existing tables (hits) and how many had to build them (misses).
+		*/
+		void getTilingTableCacheStats(uint64_t *outHits, uint64_t *outMisses);
+
+		/** @brief Reports how many texture layout lookups (computeTotalTiledTextureSize(), computeTextureSurfaceOffsetAndSize()) were served from the layout cache (hits) and how many had to compute the layout (misses).
+		*/
+		void getTextureLayoutCacheStats(uint64_t *outHits, uint64_t *outMisses);
+
+		/** @brief Same as swizzleBufferData(), but picks the element kernels for the given CPU features instead of the host's.
+			@param cpu Features the kernels may use. Must be a subset of the host's features.
+		*/
+		int32_t swizzleBufferDataForCpu(const util::cpu::CpuFeatures &cpu, Gnm::GpuMode targetGpuMode, void *outSwizzledData, const void *linearData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride);
+
+		/** @brief Same as deswizzleBufferData(), but picks the element kernels for the given CPU features instead of the host's.
+			@param cpu Features the kernels may use. Must be a subset of the host's features.
+		*/
+		int32_t deswizzleBufferDataForCpu(const util::cpu::CpuFeatures &cpu, Gnm::GpuMode targetGpuMode, void *outLinearData, const void *swizzledData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride);
+
+		/** @brief Reference implementation of swizzleBufferData(), which computes the address of every byte on its own.
+			It is slow, but simple enough to check the element kernels against.
+		*/
+		int32_t swizzleBufferDataBytewise(Gnm::GpuMode targetGpuMode, void *outSwizzledData, const void *linearData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride);
+
+		/** @brief Reference implementation of deswizzleBufferData(), which computes the address of every byte on its own.
+			It is slow, but simple enough to check the element kernels against.
+		*/
+		int32_t deswizzleBufferDataBytewise(Gnm::GpuMode targetGpuMode, void *outLinearData, const void *swizzledData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride);
 	}
 }
 
@@ -1,13 +1,100 @@
 ﻿#include "GnmGpuAddressInternal.h"
 #include "GnmGpuAddress.h"
 
+#include "UtilCpu.h"
+
 using namespace sce;
 using namespace sce::GpuAddress;
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 LOG_CHANNEL("GpuAddress");
 
+// Define to run the byte-wise swizzler after every element kernel and compare the results.
+// Tests/TestGnmSwizzler.cpp checks every kernel the same way, this catches layouts it doesn't cover.
+// #define GPU_ADDRESS_VERIFY_SWIZZLE
+
+// A block of indexStride records is stored one swizzle element at a time:
+// the first element of every record, then the second element of every record, and so on.
+// The kernels below move whole elements of one block, records may be less than indexStride for the last block.
+typedef void (*SwizzleBlockFunc)(uint8_t *swizzled, const uint8_t *linear, uint32_t elemStride, uint32_t indexStride, uint32_t records);
+typedef void (*DeswizzleBlockFunc)(uint8_t *linear, const uint8_t *swizzled, uint32_t elemStride, uint32_t indexStride, uint32_t records);
+
+template<uint32_t ElemSize>
+static void swizzleBlock(uint8_t *__restrict swizzled, const uint8_t *__restrict linear, uint32_t elemStride, uint32_t indexStride, uint32_t records)
+{
+	for(uint32_t offset = 0; offset < elemStride; offset += ElemSize)
+	{
+		uint8_t *dst = swizzled + offset * indexStride;
+		const uint8_t *src = linear + offset;
+		for(uint32_t iRecord = 0; iRecord < records; ++iRecord)
+			memcpy(dst + iRecord * ElemSize, src + iRecord * elemStride, ElemSize);
+	}
+}
+
+template<uint32_t ElemSize>
+static void deswizzleBlock(uint8_t *__restrict linear, const uint8_t *__restrict swizzled, uint32_t elemStride, uint32_t indexStride, uint32_t records)
+{
+	for(uint32_t offset = 0; offset < elemStride; offset += ElemSize)
+	{
+		uint8_t *dst = linear + offset;
+		const uint8_t *src = swizzled + offset * indexStride;
+		for(uint32_t iRecord = 0; iRecord < records; ++iRecord)
+			memcpy(dst + iRecord * elemStride, src + iRecord * ElemSize, ElemSize);
+	}
+}
+
+// The same element of eight consecutive records is gathered into one register.
+// For 8 and 16 byte elements, gathers are no faster than plain moves.
+UTIL_TARGET("avx2")
+static void swizzleBlock4Avx2(uint8_t *__restrict swizzled, const uint8_t *__restrict linear, uint32_t elemStride, uint32_t indexStride, uint32_t records)
+{
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int(elemStride)));
+	for(uint32_t offset = 0; offset < elemStride; offset += 4)
+	{
+		uint8_t *dst = swizzled + offset * indexStride;
+		const uint8_t *src = linear + offset;
+		uint32_t iRecord = 0;
+		for(; iRecord + 8 <= records; iRecord += 8)
+		{
+			const __m256i elems = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src + iRecord * elemStride), index, 1);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + iRecord * 4), elems);
+		}
+		for(; iRecord < records; ++iRecord)
+			memcpy(dst + iRecord * 4, src + iRecord * elemStride, 4);
+	}
+}
+
+static SwizzleBlockFunc getSwizzleBlockFunc(const util::cpu::CpuFeatures &cpu, Gnm::BufferSwizzleElementSize swizzleSize, uint32_t elemStride)
+{
+	// Gather indices are signed 32 bit.
+	const bool useAvx2 = cpu.avx2 && elemStride <= 0x7FFFFFFF / 8;
+	switch(swizzleSize)
+	{
+	case Gnm::kBufferSwizzleElementSize2:  return swizzleBlock<2>;
+	case Gnm::kBufferSwizzleElementSize4:  return useAvx2 ? swizzleBlock4Avx2 : swizzleBlock<4>;
+	case Gnm::kBufferSwizzleElementSize8:  return swizzleBlock<8>;
+	case Gnm::kBufferSwizzleElementSize16: return swizzleBlock<16>;
+	default:                               return nullptr;
+	}
+}
+
+static DeswizzleBlockFunc getDeswizzleBlockFunc(const util::cpu::CpuFeatures &cpu, Gnm::BufferSwizzleElementSize swizzleSize)
+{
+	// AVX2 has no scatter, no deswizzle kernel needs more than the baseline.
+	SCE_GNM_UNUSED(cpu);
+	switch(swizzleSize)
+	{
+	case Gnm::kBufferSwizzleElementSize2:  return deswizzleBlock<2>;
+	case Gnm::kBufferSwizzleElementSize4:  return deswizzleBlock<4>;
+	case Gnm::kBufferSwizzleElementSize8:  return deswizzleBlock<8>;
+	case Gnm::kBufferSwizzleElementSize16: return deswizzleBlock<16>;
+	default:                               return nullptr;
+	}
+}
+
 int32_t sce::GpuAddress::computeSwizzledBufferSize(Gnm::GpuMode targetGpuMode, uint64_t *outSizeBytes, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
 {
 	SCE_GNM_UNUSED(targetGpuMode);
@@ -30,49 +117,110 @@ int32_t sce::GpuAddress::computeSwizzledBufferSize(uint64_t *outSizeBytes, uint3
 	return computeSwizzledBufferSize(Gnm::kGpuModeBase, outSizeBytes, elementSizeInBytes, numElements, swizzleSize, swizzleStride);
 }
 
-int32_t sce::GpuAddress::swizzleBufferData(Gnm::GpuMode targetGpuMode, void *outSwizzledData, const void *linearData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
+int32_t sce::GpuAddress::swizzleBufferDataBytewise(Gnm::GpuMode targetGpuMode, void *outSwizzledData, const void *linearData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
 {
-	SCE_GNM_ASSERT_MSG_RETURN(outSwizzledData != NULL, kStatusInvalidArgument, "outSwizzledData must not be NULL.");
-	SCE_GNM_ASSERT_MSG_RETURN(linearData != NULL, kStatusInvalidArgument, "linearData must not be NULL.");
-	SCE_GNM_ASSERT_MSG_RETURN( (uint32_t)swizzleSize <= Gnm::kBufferSwizzleElementSize16, kStatusInvalidArgument, "swizzleSize (%d) is not a valid enum value.", swizzleSize);
-	SCE_GNM_ASSERT_MSG_RETURN( (uint32_t)swizzleStride <= Gnm::kBufferSwizzleStride64, kStatusInvalidArgument, "swizzleStride (%d) is not a valid enum value.", swizzleStride);
+	uint64_t swizzledBufferSize = 0;
+	int32_t status = computeSwizzledBufferSize(targetGpuMode, &swizzledBufferSize, elemStride, numElements, swizzleSize, swizzleStride);
+	if (status != kStatusSuccess)
+		return status;
 	uint32_t actualElemSize = 2 << swizzleSize;
 	uint32_t actualIndexStride = 8 << swizzleStride;
 
-	SCE_GNM_ASSERT_MSG_RETURN( (elemStride % actualElemSize) == 0, kStatusInvalidArgument, "elemStride (%u) must be a multiple of 2<<swizzleSize (%d).", elemStride, swizzleSize);
-
 	uint8_t *swizzledBytes = (uint8_t*)outSwizzledData;
 	const uint8_t *linearBytes = (const uint8_t*)linearData;
 	uint32_t linearBufferSize = elemStride*numElements;
+	for(uint32_t iRecord=0; iRecord<numElements; ++iRecord)
+	{
+		for(uint32_t iOffset=0; iOffset<elemStride; ++iOffset)
+		{
+			const uint8_t *pLinear = linearBytes + iRecord*elemStride + iOffset;
+			uint8_t *pSwizzled = swizzledBytes +
+				((iRecord / actualIndexStride) * elemStride + (iOffset / actualElemSize) * actualElemSize) * actualIndexStride +
+				(iRecord % actualIndexStride) * actualElemSize +
+				(iOffset % actualElemSize);
+			SCE_GNM_ASSERT_MSG_RETURN(pLinear >= linearBytes && pLinear < linearBytes+linearBufferSize, kStatusInternalTilingError, "linear offset is outside buffer bounds");
+			SCE_GNM_ASSERT_MSG_RETURN(pSwizzled >= swizzledBytes && pSwizzled < swizzledBytes+swizzledBufferSize, kStatusInternalTilingError, "swizzled offset is outside buffer bounds");
+			*pSwizzled = *pLinear;
+		}
+	}
+	return kStatusSuccess;
+}
+
+int32_t sce::GpuAddress::deswizzleBufferDataBytewise(Gnm::GpuMode targetGpuMode, void *outLinearData, const void *swizzledData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
+{
 	uint64_t swizzledBufferSize = 0;
 	int32_t status = computeSwizzledBufferSize(targetGpuMode, &swizzledBufferSize, elemStride, numElements, swizzleSize, swizzleStride);
 	if (status != kStatusSuccess)
 		return status;
-#ifdef SCE_GNM_DEBUG
-	memset(outSwizzledData, 0xCD, swizzledBufferSize);
-#endif
+	uint32_t actualElemSize = 2 << swizzleSize;
+	uint32_t actualIndexStride = 8 << swizzleStride;
+
+	uint8_t *linearBytes = (uint8_t*)outLinearData;
+	const uint8_t *swizzledBytes = (const uint8_t*)swizzledData;
+	uint32_t linearBufferSize = elemStride*numElements;
 	for(uint32_t iRecord=0; iRecord<numElements; ++iRecord)
 	{
 		for(uint32_t iOffset=0; iOffset<elemStride; ++iOffset)
 		{
-			const uint8_t *pLinear = linearBytes + iRecord*elemStride + iOffset;
-			uint8_t *pSwizzled = swizzledBytes +
+			uint8_t *pLinear = linearBytes + iRecord*elemStride + iOffset;
+			const uint8_t *pSwizzled = swizzledBytes +
 				((iRecord / actualIndexStride) * elemStride + (iOffset / actualElemSize) * actualElemSize) * actualIndexStride +
 				(iRecord % actualIndexStride) * actualElemSize +
 				(iOffset % actualElemSize);
 			SCE_GNM_ASSERT_MSG_RETURN(pLinear >= linearBytes && pLinear < linearBytes+linearBufferSize, kStatusInternalTilingError, "linear offset is outside buffer bounds");
 			SCE_GNM_ASSERT_MSG_RETURN(pSwizzled >= swizzledBytes && pSwizzled < swizzledBytes+swizzledBufferSize, kStatusInternalTilingError, "swizzled offset is outside buffer bounds");
-			*pSwizzled = *pLinear;
+			*pLinear = *pSwizzled;
 		}
 	}
 	return kStatusSuccess;
 }
+
+int32_t sce::GpuAddress::swizzleBufferDataForCpu(const util::cpu::CpuFeatures &cpu, Gnm::GpuMode targetGpuMode, void *outSwizzledData, const void *linearData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
+{
+	SCE_GNM_ASSERT_MSG_RETURN(outSwizzledData != NULL, kStatusInvalidArgument, "outSwizzledData must not be NULL.");
+	SCE_GNM_ASSERT_MSG_RETURN(linearData != NULL, kStatusInvalidArgument, "linearData must not be NULL.");
+	SCE_GNM_ASSERT_MSG_RETURN( (uint32_t)swizzleSize <= Gnm::kBufferSwizzleElementSize16, kStatusInvalidArgument, "swizzleSize (%d) is not a valid enum value.", swizzleSize);
+	SCE_GNM_ASSERT_MSG_RETURN( (uint32_t)swizzleStride <= Gnm::kBufferSwizzleStride64, kStatusInvalidArgument, "swizzleStride (%d) is not a valid enum value.", swizzleStride);
+	uint32_t actualElemSize = 2 << swizzleSize;
+	uint32_t actualIndexStride = 8 << swizzleStride;
+
+	SCE_GNM_ASSERT_MSG_RETURN( (elemStride % actualElemSize) == 0, kStatusInvalidArgument, "elemStride (%u) must be a multiple of 2<<swizzleSize (%d).", elemStride, swizzleSize);
+
+	uint8_t *swizzledBytes = (uint8_t*)outSwizzledData;
+	const uint8_t *linearBytes = (const uint8_t*)linearData;
+	uint64_t swizzledBufferSize = 0;
+	int32_t status = computeSwizzledBufferSize(targetGpuMode, &swizzledBufferSize, elemStride, numElements, swizzleSize, swizzleStride);
+	if (status != kStatusSuccess)
+		return status;
+#ifdef SCE_GNM_DEBUG
+	memset(outSwizzledData, 0xCD, swizzledBufferSize);
+#endif
+	const auto blockFunc = getSwizzleBlockFunc(cpu, swizzleSize, elemStride);
+	const uint64_t blockBytes = uint64_t(elemStride) * actualIndexStride;
+	for(uint32_t iRecord=0; iRecord<numElements; iRecord += actualIndexStride)
+	{
+		const uint32_t records = std::min(actualIndexStride, numElements - iRecord);
+		blockFunc(swizzledBytes + (iRecord / actualIndexStride) * blockBytes, linearBytes + uint64_t(iRecord) * elemStride, elemStride, actualIndexStride, records);
+	}
+#ifdef GPU_ADDRESS_VERIFY_SWIZZLE
+	std::vector<uint8_t> expected(swizzledBytes, swizzledBytes + swizzledBufferSize);
+	status = swizzleBufferDataBytewise(targetGpuMode, expected.data(), linearBytes, elemStride, numElements, swizzleSize, swizzleStride);
+	if (status != kStatusSuccess)
+		return status;
+	SCE_GNM_ASSERT_MSG_RETURN(memcmp(expected.data(), swizzledBytes, expected.size()) == 0, kStatusInternalTilingError, "swizzled data differs from the byte-wise swizzler (stride %u, size %u, index stride %u)", elemStride, actualElemSize, actualIndexStride);
+#endif
+	return kStatusSuccess;
+}
+int32_t sce::GpuAddress::swizzleBufferData(Gnm::GpuMode targetGpuMode, void *outSwizzledData, const void *linearData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
+{
+	return swizzleBufferDataForCpu(util::cpu::features(), targetGpuMode, outSwizzledData, linearData, elemStride, numElements, swizzleSize, swizzleStride);
+}
 int32_t sce::GpuAddress::swizzleBufferData(void *outSwizzledData, const void *linearData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride) // DEPRECATED
 {
 	return swizzleBufferData(Gnm::kGpuModeBase, outSwizzledData, linearData, elemStride, numElements, swizzleSize, swizzleStride);
 }
 
-int32_t sce::GpuAddress::deswizzleBufferData(Gnm::GpuMode targetGpuMode, void *outLinearData, const void *swizzledData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
+int32_t sce::GpuAddress::deswizzleBufferDataForCpu(const util::cpu::CpuFeatures &cpu, Gnm::GpuMode targetGpuMode, void *outLinearData, const void *swizzledData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
 {
 	SCE_GNM_ASSERT_MSG_RETURN(outLinearData != NULL, kStatusInvalidArgument, "outLinearData must not be NULL.");
 	SCE_GNM_ASSERT_MSG_RETURN(swizzledData != NULL, kStatusInvalidArgument, "swizzledData must not be NULL.");
@@ -93,22 +241,26 @@ int32_t sce::GpuAddress::deswizzleBufferData(Gnm::GpuMode targetGpuMode, void *o
 #ifdef SCE_GNM_DEBUG
 	memset(outLinearData, 0xCD, linearBufferSize);
 #endif
-	for(uint32_t iRecord=0; iRecord<numElements; ++iRecord)
+	const auto blockFunc = getDeswizzleBlockFunc(cpu, swizzleSize);
+	const uint64_t blockBytes = uint64_t(elemStride) * actualIndexStride;
+	for(uint32_t iRecord=0; iRecord<numElements; iRecord += actualIndexStride)
 	{
-		for(uint32_t iOffset=0; iOffset<elemStride; ++iOffset)
-		{
-			uint8_t *pLinear = linearBytes + iRecord*elemStride + iOffset;
-			const uint8_t *pSwizzled = swizzledBytes +
-				((iRecord / actualIndexStride) * elemStride + (iOffset / actualElemSize) * actualElemSize) * actualIndexStride +
-				(iRecord % actualIndexStride) * actualElemSize +
-				(iOffset % actualElemSize);
-			SCE_GNM_ASSERT_MSG_RETURN(pLinear >= linearBytes && pLinear < linearBytes+linearBufferSize, kStatusInternalTilingError, "linear offset is outside buffer bounds");
-			SCE_GNM_ASSERT_MSG_RETURN(pSwizzled >= swizzledBytes && pSwizzled < swizzledBytes+swizzledBufferSize, kStatusInternalTilingError, "swizzled offset is outside buffer bounds");
-			*pLinear = *pSwizzled;
-		}
+		const uint32_t records = std::min(actualIndexStride, numElements - iRecord);
+		blockFunc(linearBytes + uint64_t(iRecord) * elemStride, swizzledBytes + (iRecord / actualIndexStride) * blockBytes, elemStride, actualIndexStride, records);
 	}
+#ifdef GPU_ADDRESS_VERIFY_SWIZZLE
+	std::vector<uint8_t> expected(linearBytes, linearBytes + linearBufferSize);
+	status = deswizzleBufferDataBytewise(targetGpuMode, expected.data(), swizzledBytes, elemStride, numElements, swizzleSize, swizzleStride);
+	if (status != kStatusSuccess)
+		return status;
+	SCE_GNM_ASSERT_MSG_RETURN(memcmp(expected.data(), linearBytes, expected.size()) == 0, kStatusInternalTilingError, "linear data differs from the byte-wise deswizzler (stride %u, size %u, index stride %u)", elemStride, actualElemSize, actualIndexStride);
+#endif
 	return kStatusSuccess;
 }
+int32_t sce::GpuAddress::deswizzleBufferData(Gnm::GpuMode targetGpuMode, void *outLinearData, const void *swizzledData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride)
+{
+	return deswizzleBufferDataForCpu(util::cpu::features(), targetGpuMode, outLinearData, swizzledData, elemStride, numElements, swizzleSize, swizzleStride);
+}
 int32_t sce::GpuAddress::deswizzleBufferData(void *outLinearData, const void *swizzledData, uint32_t elemStride, uint32_t numElements, Gnm::BufferSwizzleElementSize swizzleSize, Gnm::BufferSwizzleStride swizzleStride) // DEPRECATED
 {
 	return deswizzleBufferData(Gnm::kGpuModeBase, outLinearData, swizzledData, elemStride, numElements, swizzleSize, swizzleStride);
@@ -0,0 +1,301 @@
+﻿#pragma once
+
+#include "GnmTilerSSE2.h"
+#include "UtilCpu.h"
+
+#include <cstdint>
+
+// AVX2 versions of the micro tile kernels in GnmTilerSSE2.h.
+// They move whole 32-byte row pairs where the SSE2 kernels move 16-byte halves,
+// so only element sizes whose rows are at least 16 bytes wide have one here.
+// Only kernels which measured faster than the SSE2 ones are kept, see getTileFunc() in GnmTiler.cpp.
+// Every function may only be called after checking util::cpu::features().avx2.
+
+namespace sce
+{
+	namespace GpuAddress
+	{
+		/** @brief Loads two unaligned 16-byte rows into the low and high halves of one register.
+		*/
+		UTIL_TARGET("avx2") inline __m256i loadRowPairAvx2(const uint8_t *lo, const uint8_t *hi)
+		{
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)), 1);
+		}
+
+		/** @brief Stores the low and high halves of a register into two unaligned 16-byte rows.
+		*/
+		UTIL_TARGET("avx2") inline void storeRowPairAvx2(uint8_t *lo, uint8_t *hi, const __m256i pair)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lo), _mm256_castsi256_si128(pair));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(hi), _mm256_extracti128_si256(pair, 1));
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 32bpp surface, using the Display microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void tile32bppDisplayAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m256i *dest32s         = (      __m256i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint32_t);
+
+			int32_t loopCount = 4;
+			do
+			{
+				const __m256i row0 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes) );
+				const __m256i row1 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes) );
+				srcBytes += 2*srcPitchBytes;
+
+				_mm256_storeu_si256( dest32s + 0, _mm256_permute2x128_si256(row0, row1, 0x20) );
+				_mm256_storeu_si256( dest32s + 1, _mm256_permute2x128_si256(row0, row1, 0x31) );
+				dest32s += 2;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 64bpp surface, using the Display microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void tile64bppDisplayAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m256i *dest32s         = (      __m256i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint64_t);
+
+			int32_t loopCount = 4;
+			do
+			{
+				const __m256i row00 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes + 0*32) );
+				const __m256i row01 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes + 1*32) );
+				const __m256i row10 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes + 0*32) );
+				const __m256i row11 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes + 1*32) );
+				srcBytes += 2*srcPitchBytes;
+
+				_mm256_storeu_si256( dest32s + 0, _mm256_permute2x128_si256(row00, row10, 0x20) );
+				_mm256_storeu_si256( dest32s + 1, _mm256_permute2x128_si256(row00, row10, 0x31) );
+				_mm256_storeu_si256( dest32s + 2, _mm256_permute2x128_si256(row01, row11, 0x20) );
+				_mm256_storeu_si256( dest32s + 3, _mm256_permute2x128_si256(row01, row11, 0x31) );
+				dest32s += 4;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Detiles an 8x8 microtile of an 64bpp surface, using the Display microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the untiled data.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] destPitch Number of elements in one row of destination data.
+			@param[in] destSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void detile64bppDisplayAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t destPitch, const uint32_t destSlicePitch)
+		{
+			SCE_GNM_UNUSED(destSlicePitch);
+			const __m256i *src32s    = (const __m256i*)srcTileBase;
+			uint8_t       *destBytes = (      uint8_t*)destTileBase;
+			const uint32_t destPitchBytes = destPitch*sizeof(uint64_t);
+
+			int32_t loopCount = 4;
+			do
+			{
+				const __m256i lo0 = _mm256_loadu_si256( src32s + 0 );
+				const __m256i hi0 = _mm256_loadu_si256( src32s + 1 );
+				const __m256i lo1 = _mm256_loadu_si256( src32s + 2 );
+				const __m256i hi1 = _mm256_loadu_si256( src32s + 3 );
+				src32s += 4;
+
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 0*destPitchBytes + 0*32), _mm256_permute2x128_si256(lo0, hi0, 0x20) );
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 0*destPitchBytes + 1*32), _mm256_permute2x128_si256(lo1, hi1, 0x20) );
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 1*destPitchBytes + 0*32), _mm256_permute2x128_si256(lo0, hi0, 0x31) );
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 1*destPitchBytes + 1*32), _mm256_permute2x128_si256(lo1, hi1, 0x31) );
+				destBytes += 2*destPitchBytes;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 16bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void tile16bppThinAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m256i *dest32s         = (      __m256i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint16_t);
+
+			int32_t loopCount = 2;
+			do
+			{
+				// Rows 0 and 2 share a register, as do rows 1 and 3,
+				// so each half produces what the SSE2 kernel does for its row pair.
+				const __m256i row02 = loadRowPairAvx2(srcBytes + 0*srcPitchBytes, srcBytes + 2*srcPitchBytes);
+				const __m256i row13 = loadRowPairAvx2(srcBytes + 1*srcPitchBytes, srcBytes + 3*srcPitchBytes);
+				srcBytes += 4*srcPitchBytes;
+
+				_mm256_storeu_si256( dest32s + 0, _mm256_unpacklo_epi32(row02, row13) );
+				_mm256_storeu_si256( dest32s + 1, _mm256_unpackhi_epi32(row02, row13) );
+				dest32s += 2;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 32bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void tile32bppThinAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m256i *dest32s         = (      __m256i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint32_t);
+
+			int32_t loopCount = 2;
+			do
+			{
+				const __m256i row0 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes) );
+				const __m256i row1 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes) );
+				const __m256i row2 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 2*srcPitchBytes) );
+				const __m256i row3 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 3*srcPitchBytes) );
+				srcBytes += 4*srcPitchBytes;
+
+				// 2x2 blocks: the low halves hold columns 0-3, the high halves columns 4-7.
+				const __m256i lo01 = _mm256_unpacklo_epi64(row0, row1);
+				const __m256i hi01 = _mm256_unpackhi_epi64(row0, row1);
+				const __m256i lo23 = _mm256_unpacklo_epi64(row2, row3);
+				const __m256i hi23 = _mm256_unpackhi_epi64(row2, row3);
+
+				_mm256_storeu_si256( dest32s + 0, _mm256_permute2x128_si256(lo01, hi01, 0x20) );
+				_mm256_storeu_si256( dest32s + 1, _mm256_permute2x128_si256(lo23, hi23, 0x20) );
+				_mm256_storeu_si256( dest32s + 2, _mm256_permute2x128_si256(lo01, hi01, 0x31) );
+				_mm256_storeu_si256( dest32s + 3, _mm256_permute2x128_si256(lo23, hi23, 0x31) );
+				dest32s += 4;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Detiles an 8x8 microtile of an 32bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the untiled data.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] destPitch Number of elements in one row of destination data.
+			@param[in] destSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void detile32bppThinAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t destPitch, const uint32_t destSlicePitch)
+		{
+			SCE_GNM_UNUSED(destSlicePitch);
+			const __m256i *src32s    = (const __m256i*)srcTileBase;
+			uint8_t       *destBytes = (      uint8_t*)destTileBase;
+			const uint32_t destPitchBytes = destPitch*sizeof(uint32_t);
+
+			int32_t loopCount = 2;
+			do
+			{
+				const __m256i tile0 = _mm256_loadu_si256( src32s + 0 );
+				const __m256i tile1 = _mm256_loadu_si256( src32s + 1 );
+				const __m256i tile2 = _mm256_loadu_si256( src32s + 2 );
+				const __m256i tile3 = _mm256_loadu_si256( src32s + 3 );
+				src32s += 4;
+
+				const __m256i lo01 = _mm256_permute2x128_si256(tile0, tile2, 0x20);
+				const __m256i hi01 = _mm256_permute2x128_si256(tile0, tile2, 0x31);
+				const __m256i lo23 = _mm256_permute2x128_si256(tile1, tile3, 0x20);
+				const __m256i hi23 = _mm256_permute2x128_si256(tile1, tile3, 0x31);
+
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 0*destPitchBytes), _mm256_unpacklo_epi64(lo01, hi01) );
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 1*destPitchBytes), _mm256_unpackhi_epi64(lo01, hi01) );
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 2*destPitchBytes), _mm256_unpacklo_epi64(lo23, hi23) );
+				_mm256_storeu_si256( reinterpret_cast<__m256i*>(destBytes + 3*destPitchBytes), _mm256_unpackhi_epi64(lo23, hi23) );
+				destBytes += 4*destPitchBytes;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 64bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void tile64bppThinAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m256i *dest32s         = (      __m256i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint64_t);
+
+			int32_t loopCount = 2;
+			do
+			{
+				for (uint32_t half = 0; half < 2; ++half)
+				{
+					const __m256i row0 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes + half*32) );
+					const __m256i row1 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes + half*32) );
+					const __m256i row2 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 2*srcPitchBytes + half*32) );
+					const __m256i row3 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(srcBytes + 3*srcPitchBytes + half*32) );
+
+					_mm256_storeu_si256( dest32s + 0, _mm256_permute2x128_si256(row0, row1, 0x20) );
+					_mm256_storeu_si256( dest32s + 1, _mm256_permute2x128_si256(row0, row1, 0x31) );
+					_mm256_storeu_si256( dest32s + 2, _mm256_permute2x128_si256(row2, row3, 0x20) );
+					_mm256_storeu_si256( dest32s + 3, _mm256_permute2x128_si256(row2, row3, 0x31) );
+					dest32s += 4;
+				}
+				srcBytes += 4*srcPitchBytes;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 128bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx2") inline void tile128bppThinAvx2(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m256i *dest32s         = (      __m256i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(__m128i);
+
+			// Horizontal element pairs stay together, so this is a plain copy of 32-byte blocks.
+			int32_t loopCount = 2;
+			do
+			{
+				_mm256_storeu_si256( dest32s + 0x00, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes + 0*32)) );
+				_mm256_storeu_si256( dest32s + 0x01, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes + 0*32)) );
+				_mm256_storeu_si256( dest32s + 0x02, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes + 1*32)) );
+				_mm256_storeu_si256( dest32s + 0x03, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes + 1*32)) );
+				_mm256_storeu_si256( dest32s + 0x08, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes + 2*32)) );
+				_mm256_storeu_si256( dest32s + 0x09, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes + 2*32)) );
+				_mm256_storeu_si256( dest32s + 0x0A, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 0*srcPitchBytes + 3*32)) );
+				_mm256_storeu_si256( dest32s + 0x0B, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 1*srcPitchBytes + 3*32)) );
+
+				_mm256_storeu_si256( dest32s + 0x04, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 2*srcPitchBytes + 0*32)) );
+				_mm256_storeu_si256( dest32s + 0x05, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 3*srcPitchBytes + 0*32)) );
+				_mm256_storeu_si256( dest32s + 0x06, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 2*srcPitchBytes + 1*32)) );
+				_mm256_storeu_si256( dest32s + 0x07, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 3*srcPitchBytes + 1*32)) );
+				_mm256_storeu_si256( dest32s + 0x0C, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 2*srcPitchBytes + 2*32)) );
+				_mm256_storeu_si256( dest32s + 0x0D, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 3*srcPitchBytes + 2*32)) );
+				_mm256_storeu_si256( dest32s + 0x0E, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 2*srcPitchBytes + 3*32)) );
+				_mm256_storeu_si256( dest32s + 0x0F, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBytes + 3*srcPitchBytes + 3*32)) );
+
+				srcBytes += 4*srcPitchBytes;
+				dest32s += 0x10;
+			}
+			while (--loopCount);
+		}
+
+	}
+}
@@ -0,0 +1,196 @@
+﻿#pragma once
+
+#include "GnmTilerAVX2.h"
+
+#include <cstdint>
+
+// AVX-512 versions of the micro tile kernels in GnmTilerSSE2.h.
+// Each store writes one whole 64-byte cache line of the tiled micro tile,
+// which only pays off once a row holds at least 32 bytes.
+// Only kernels which measured faster than the AVX2 and SSE2 ones are kept.
+// Every function may only be called after checking util::cpu::features().avx512f.
+
+namespace sce
+{
+	namespace GpuAddress
+	{
+		/** @brief Loads two unaligned 32-byte rows into the low and high halves of one register.
+		*/
+		UTIL_TARGET("avx512f") inline __m512i loadRowPairAvx512(const uint8_t *lo, const uint8_t *hi)
+		{
+			return _mm512_inserti64x4(_mm512_castsi256_si512(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lo))),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hi)), 1);
+		}
+
+		/** @brief Stores the low and high halves of a register into two unaligned 32-byte rows.
+		*/
+		UTIL_TARGET("avx512f") inline void storeRowPairAvx512(uint8_t *lo, uint8_t *hi, const __m512i pair)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lo), _mm512_castsi512_si256(pair));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(hi), _mm512_extracti64x4_epi64(pair, 1));
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 64bpp surface, using the Display microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx512f") inline void tile64bppDisplayAvx512(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m512i *dest64s         = (      __m512i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint64_t);
+
+			// Interleaves the 16-byte quarters of two rows.
+			const __m512i lineLo = _mm512_set_epi64(11, 10,  3,  2,  9,  8,  1,  0);
+			const __m512i lineHi = _mm512_set_epi64(15, 14,  7,  6, 13, 12,  5,  4);
+
+			int32_t loopCount = 4;
+			do
+			{
+				const __m512i row0 = _mm512_loadu_si512( srcBytes + 0*srcPitchBytes );
+				const __m512i row1 = _mm512_loadu_si512( srcBytes + 1*srcPitchBytes );
+				srcBytes += 2*srcPitchBytes;
+
+				_mm512_storeu_si512( dest64s + 0, _mm512_permutex2var_epi64(row0, lineLo, row1) );
+				_mm512_storeu_si512( dest64s + 1, _mm512_permutex2var_epi64(row0, lineHi, row1) );
+				dest64s += 2;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Detiles an 8x8 microtile of an 64bpp surface, using the Display microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the untiled data.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] destPitch Number of elements in one row of destination data.
+			@param[in] destSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx512f") inline void detile64bppDisplayAvx512(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t destPitch, const uint32_t destSlicePitch)
+		{
+			SCE_GNM_UNUSED(destSlicePitch);
+			const __m512i *src64s    = (const __m512i*)srcTileBase;
+			uint8_t       *destBytes = (      uint8_t*)destTileBase;
+			const uint32_t destPitchBytes = destPitch*sizeof(uint64_t);
+
+			const __m512i rowLo = _mm512_set_epi64(13, 12,  9,  8,  5,  4,  1,  0);
+			const __m512i rowHi = _mm512_set_epi64(15, 14, 11, 10,  7,  6,  3,  2);
+
+			int32_t loopCount = 4;
+			do
+			{
+				const __m512i line0 = _mm512_loadu_si512( src64s + 0 );
+				const __m512i line1 = _mm512_loadu_si512( src64s + 1 );
+				src64s += 2;
+
+				_mm512_storeu_si512( destBytes + 0*destPitchBytes, _mm512_permutex2var_epi64(line0, rowLo, line1) );
+				_mm512_storeu_si512( destBytes + 1*destPitchBytes, _mm512_permutex2var_epi64(line0, rowHi, line1) );
+				destBytes += 2*destPitchBytes;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 32bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx512f") inline void tile32bppThinAvx512(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m512i *dest64s         = (      __m512i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint32_t);
+
+			const __m512i lineLo = _mm512_set_epi64(13, 12,  5,  4,  9,  8,  1,  0);
+			const __m512i lineHi = _mm512_set_epi64(15, 14,  7,  6, 11, 10,  3,  2);
+
+			int32_t loopCount = 2;
+			do
+			{
+				const __m512i row02 = loadRowPairAvx512(srcBytes + 0*srcPitchBytes, srcBytes + 2*srcPitchBytes);
+				const __m512i row13 = loadRowPairAvx512(srcBytes + 1*srcPitchBytes, srcBytes + 3*srcPitchBytes);
+				srcBytes += 4*srcPitchBytes;
+
+				// 2x2 blocks of columns 0-1, 4-5 in lo and 2-3, 6-7 in hi.
+				const __m512i lo = _mm512_unpacklo_epi64(row02, row13);
+				const __m512i hi = _mm512_unpackhi_epi64(row02, row13);
+
+				_mm512_storeu_si512( dest64s + 0, _mm512_permutex2var_epi64(lo, lineLo, hi) );
+				_mm512_storeu_si512( dest64s + 1, _mm512_permutex2var_epi64(lo, lineHi, hi) );
+				dest64s += 2;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Tiles an 8x8 microtile of an 64bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the untiled data.
+			@param[in] srcPitch Number of elements in one row of source data.
+			@param[in] srcSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx512f") inline void tile64bppThinAvx512(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t srcPitch, const uint32_t srcSlicePitch)
+		{
+			SCE_GNM_UNUSED(srcSlicePitch);
+			const uint8_t *srcBytes  = (const uint8_t*)srcTileBase;
+			__m512i *dest64s         = (      __m512i*)destTileBase;
+			const uint32_t srcPitchBytes = srcPitch*sizeof(uint64_t);
+
+			const __m512i lineLo = _mm512_set_epi64(11, 10,  3,  2,  9,  8,  1,  0);
+			const __m512i lineHi = _mm512_set_epi64(15, 14,  7,  6, 13, 12,  5,  4);
+
+			int32_t loopCount = 2;
+			do
+			{
+				const __m512i row0 = _mm512_loadu_si512( srcBytes + 0*srcPitchBytes );
+				const __m512i row1 = _mm512_loadu_si512( srcBytes + 1*srcPitchBytes );
+				const __m512i row2 = _mm512_loadu_si512( srcBytes + 2*srcPitchBytes );
+				const __m512i row3 = _mm512_loadu_si512( srcBytes + 3*srcPitchBytes );
+				srcBytes += 4*srcPitchBytes;
+
+				_mm512_storeu_si512( dest64s + 0, _mm512_permutex2var_epi64(row0, lineLo, row1) );
+				_mm512_storeu_si512( dest64s + 1, _mm512_permutex2var_epi64(row2, lineLo, row3) );
+				_mm512_storeu_si512( dest64s + 2, _mm512_permutex2var_epi64(row0, lineHi, row1) );
+				_mm512_storeu_si512( dest64s + 3, _mm512_permutex2var_epi64(row2, lineHi, row3) );
+				dest64s += 4;
+			}
+			while (--loopCount);
+		}
+
+		/** @brief Detiles an 8x8 microtile of an 64bpp surface, using the Thin microtile mode.
+			@param[out] destTileBase Pointer to the beginning of the destination microtile in the untiled data.
+			@param[in] srcTileBase Pointer to the beginning of the source microtile in the tiled data. This pointer must be 16-byte aligned.
+			@param[in] destPitch Number of elements in one row of destination data.
+			@param[in] destSlicePitch This parameter is ignored.
+		*/
+		UTIL_TARGET("avx512f") inline void detile64bppThinAvx512(void * __restrict destTileBase, const void * __restrict srcTileBase, const uint32_t destPitch, const uint32_t destSlicePitch)
+		{
+			SCE_GNM_UNUSED(destSlicePitch);
+			const __m512i *src64s    = (const __m512i*)srcTileBase;
+			uint8_t       *destBytes = (      uint8_t*)destTileBase;
+			const uint32_t destPitchBytes = destPitch*sizeof(uint64_t);
+
+			const __m512i rowLo = _mm512_set_epi64(13, 12,  9,  8,  5,  4,  1,  0);
+			const __m512i rowHi = _mm512_set_epi64(15, 14, 11, 10,  7,  6,  3,  2);
+
+			int32_t loopCount = 2;
+			do
+			{
+				const __m512i line0 = _mm512_loadu_si512( src64s + 0 );
+				const __m512i line1 = _mm512_loadu_si512( src64s + 1 );
+				const __m512i line2 = _mm512_loadu_si512( src64s + 2 );
+				const __m512i line3 = _mm512_loadu_si512( src64s + 3 );
+				src64s += 4;
+
+				_mm512_storeu_si512( destBytes + 0*destPitchBytes, _mm512_permutex2var_epi64(line0, rowLo, line2) );
+				_mm512_storeu_si512( destBytes + 1*destPitchBytes, _mm512_permutex2var_epi64(line0, rowHi, line2) );
+				_mm512_storeu_si512( destBytes + 2*destPitchBytes, _mm512_permutex2var_epi64(line1, rowLo, line3) );
+				_mm512_storeu_si512( destBytes + 3*destPitchBytes, _mm512_permutex2var_epi64(line1, rowHi, line3) );
+				destBytes += 4*destPitchBytes;
+			}
+			while (--loopCount);
+		}
+	}
+}
@@ -1666,7 +1666,7 @@ namespace sce
 				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 0*destSlicePitchBytes + 7*destRowPitchBytes + 7*16), _mm_load_si128(src16s + 0xDB) );
 				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 1*destSlicePitchBytes + 6*destRowPitchBytes + 4*16), _mm_load_si128(src16s + 0xD4) );
 				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 1*destSlicePitchBytes + 6*destRowPitchBytes + 5*16), _mm_load_si128(src16s + 0xD5) );
-				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 1*destSlicePitchBytes + 7*destRowPitchBytes + 4*16), _mm_load_si128(src16s + 0xE6) );
+				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 1*destSlicePitchBytes + 7*destRowPitchBytes + 4*16), _mm_load_si128(src16s + 0xD6) );
 				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 1*destSlicePitchBytes + 7*destRowPitchBytes + 5*16), _mm_load_si128(src16s + 0xD7) );
 				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 1*destSlicePitchBytes + 6*destRowPitchBytes + 6*16), _mm_load_si128(src16s + 0xDC) );
 				_mm_storeu_si128( reinterpret_cast<__m128i*>(destBytes + 1*destSlicePitchBytes + 6*destRowPitchBytes + 7*16), _mm_load_si128(src16s + 0xDD) );
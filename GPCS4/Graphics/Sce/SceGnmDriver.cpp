@@ -6,6 +6,7 @@
 #include "UtilMath.h"
 #include "sce_errors.h"
 
+#include "Gnm/GnmCapture.h"
 #include "Gnm/GnmCommandBufferDraw.h"
 #include "Gnm/GnmCommandBufferDummy.h"
 #include "Gnm/GnmCommandProcessor.h"
@@ -26,10 +27,14 @@ namespace sce
 	{
 		bool success = initGnmDriver();
 		LOG_ASSERT(success == true, "init Gnm Driver failed.");
+
+		m_frontEndThread = std::thread([this]() { runFrontEnd(); });
 	}
 
 	SceGnmDriver::~SceGnmDriver()
 	{
+		stopFrontEnd();
+
 		destroyGpuQueues();
 
 		m_presenter = nullptr;
@@ -119,23 +124,107 @@ namespace sce
 		// There's only one hardware graphics queue for most of modern GPUs, including the one on PS4.
 		// Thus a PS4 game will call submit function to submit command buffers sequentially,
 		// and normally in one same thread.
-		// We just emulate the GPU, parsing and executing one command buffer per call.
+		//
+		// For real PS4 system, the submit call is asynchronous,
+		// so we only queue the command buffers here and let the front end thread
+		// parse and execute them, while the game goes on building the next frame.
+		// The game must not overwrite the command buffers before the GPU is done,
+		// which it already ensures through labels and EOP events.
+
+		// All the command buffers of one call are translated into one command list,
+		// so a batch costs a single queue submission no matter how many buffers it has.
+		// The arrays belong to the caller, copy them out.
+
+		SceSubmitRequest request = {};
+		request.cmd.dcbs.assign(dcbGpuAddrs, dcbGpuAddrs + count);
+		request.cmd.dcbSizes.assign(dcbSizesInBytes, dcbSizesInBytes + count);
+		if (ccbGpuAddrs && ccbSizesInBytes)
+		{
+			request.cmd.ccbs.assign(ccbGpuAddrs, ccbGpuAddrs + count);
+			request.cmd.ccbSizes.assign(ccbSizesInBytes, ccbSizesInBytes + count);
+		}
+		request.videoOutHandle     = videoOutHandle;
+		request.displayBufferIndex = displayBufferIndex;
+		request.flipMode           = flipMode;
+		request.flipArg            = flipArg;
+
+		// Capture before the front end may patch any packet.
+		auto& capture = Gnm::GetGnmCaptureWriter();
+		if (capture.isOpen())
+		{
+			capture.captureSubmit(count,
+								  request.cmd.dcbs.data(), request.cmd.dcbSizes.data(),
+								  request.cmd.ccbs.empty() ? nullptr : request.cmd.ccbs.data(),
+								  request.cmd.ccbs.empty() ? nullptr : request.cmd.ccbSizes.data(),
+								  videoOutHandle, displayBufferIndex, flipMode, flipArg);
+		}
 
-		// TODO:
-		// For real PS4 system, the submit call is asynchronous.
-		// Thus for future development, we should record vulkan command buffer asynchronously too,
-		// reducing time period of the submit call.
+		pushSubmission(std::move(request));
 
-		LOG_ASSERT(count == 1, "Currently only support 1 cmdbuff at one call.");
+		return SCE_OK;
+	}
 
-		SceGpuCommand cmd = {};
-		cmd.buffer        = dcbGpuAddrs[0];
-		cmd.size          = dcbSizesInBytes[0];
-		auto cmdList      = m_graphicsQueue->record(cmd);
+	void SceGnmDriver::pushSubmission(SceSubmitRequest&& request)
+	{
+		std::unique_lock<std::mutex> lock(m_submitMutex);
 
-		submitPresent(cmdList);
+		m_submitCondOnTake.wait(lock, [this]
+								{ return m_submitCount < MaxPendingSubmissions; });
 
-		return SCE_OK;
+		uint32_t tail      = (m_submitHead + m_submitCount) % MaxPendingSubmissions;
+		m_submitRing[tail] = std::move(request);
+		++m_submitCount;
+
+		m_submitCondOnAdd.notify_one();
+	}
+
+	void SceGnmDriver::runFrontEnd()
+	{
+		while (true)
+		{
+			SceSubmitRequest* request = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(m_submitMutex);
+
+				m_submitCondOnAdd.wait(lock, [this]
+									   { return m_submitCount != 0 || m_stopped; });
+
+				// Drain the ring before leaving.
+				if (m_submitCount == 0)
+				{
+					break;
+				}
+
+				// The slot stays ours until we release it below.
+				request = &m_submitRing[m_submitHead];
+			}
+
+			auto cmdList = m_graphicsQueue->record(request->cmd);
+			submitPresent(cmdList);
+
+			// Only now the slot becomes free, so that the request
+			// being processed counts as in flight too.
+			{
+				std::lock_guard<std::mutex> lock(m_submitMutex);
+				m_submitHead = (m_submitHead + 1) % MaxPendingSubmissions;
+				--m_submitCount;
+			}
+			m_submitCondOnTake.notify_one();
+		}
+	}
+
+	void SceGnmDriver::stopFrontEnd()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_submitMutex);
+			m_stopped = true;
+		}
+		m_submitCondOnAdd.notify_one();
+
+		if (m_frontEndThread.joinable())
+		{
+			m_frontEndThread.join();
+		}
 	}
 
 	void SceGnmDriver::submitPresent(
@@ -1,11 +1,15 @@
 #pragma once
 
 #include "SceCommon.h"
+#include "SceGpuQueue.h"
 
 #include "Violet/VltRc.h"
 
 #include <array>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 namespace sce
 {
@@ -29,6 +33,21 @@ namespace sce
 	constexpr uint32_t MaxQueueId           = 8;
 	constexpr uint32_t MaxComputeQueueCount = MaxPipeId * MaxQueueId;
 
+	// Number of submissions the GPU front end may lag behind the game,
+	// including the one being processed.
+	// It matches a double buffered flip queue, which is what most games use,
+	// when the ring is full, the submit call blocks until a frame retires.
+	constexpr uint32_t MaxPendingSubmissions = 2;
+
+	struct SceSubmitRequest
+	{
+		SceGpuCommand cmd;
+		uint32_t      videoOutHandle;
+		uint32_t      displayBufferIndex;
+		uint32_t      flipMode;
+		int64_t       flipArg;
+	};
+
 	class SceGnmDriver
 	{
 		friend class SceVideoOut;
@@ -88,6 +107,16 @@ namespace sce
 
 		void destroyGpuQueues();
 
+		// Queue a request for the front end thread,
+		// blocks while MaxPendingSubmissions requests are in flight.
+		void pushSubmission(SceSubmitRequest&& request);
+
+		// GPU front end thread, records, submits and presents
+		// requests in the order they were pushed.
+		void runFrontEnd();
+
+		void stopFrontEnd();
+
 	private:
 		vlt::Rc<vlt::VltInstance> m_instance;
 		vlt::Rc<vlt::VltAdapter>  m_adapter;
@@ -97,6 +126,16 @@ namespace sce
 		std::unique_ptr<SceGpuQueue> m_graphicsQueue;
 		std::array<std::unique_ptr<SceGpuQueue>, MaxComputeQueueCount>
 			m_computeQueues;
+
+		std::mutex              m_submitMutex;
+		std::condition_variable m_submitCondOnAdd;
+		std::condition_variable m_submitCondOnTake;
+		std::thread             m_frontEndThread;
+		bool                    m_stopped     = false;
+		uint32_t                m_submitHead  = 0;
+		uint32_t                m_submitCount = 0;
+		std::array<SceSubmitRequest, MaxPendingSubmissions>
+			m_submitRing = {};
 	};
 
 }  // namespace sce
\ No newline at end of file
@@ -29,7 +29,11 @@ namespace sce
 	Rc<VltCommandList>
 	SceGpuQueue::record(const SceGpuCommand& cmd)
 	{
-		return m_cp->processCommandBuffer(cmd.buffer, cmd.size);
+		return m_cp->processCommandBuffers(
+			static_cast<uint32_t>(cmd.dcbs.size()),
+			cmd.dcbs.data(), cmd.dcbSizes.data(),
+			cmd.ccbs.empty() ? nullptr : cmd.ccbs.data(),
+			cmd.ccbs.empty() ? nullptr : cmd.ccbSizes.data());
 	}
 
 	void SceGpuQueue::submit(const SceGpuSubmission& submission)
@@ -42,8 +46,9 @@ namespace sce
 
 	void SceGpuQueue::present(const vlt::Rc<ScePresenter>& presenter)
 	{
-		VltSubmitStatus status = {};
-		m_device->presentImage(presenter, &status);
+		// The frame finishes asynchronously, a status
+		// on the stack would not live long enough.
+		m_device->presentImage(presenter, nullptr);
 	}
 
 	void SceGpuQueue::createQueue(SceQueueType type)
@@ -5,6 +5,7 @@
 #include "Violet/VltRc.h"
 
 #include <memory>
+#include <vector>
 
 namespace sce
 {
@@ -28,10 +29,14 @@ namespace sce
 		Compute  = 1
 	};
 
+	// Command buffers of one submit call.
+	// ccbs may be empty, or hold null for a dcb without constant command buffer.
 	struct SceGpuCommand
 	{
-		const void* buffer = nullptr;
-		uint32_t    size   = 0;
+		std::vector<const void*> dcbs;
+		std::vector<uint32_t>    dcbSizes;
+		std::vector<const void*> ccbs;
+		std::vector<uint32_t>    ccbSizes;
 	};
 
 	struct SceGpuSubmission
@@ -52,8 +57,8 @@ namespace sce
 		/**
 	     * \brief Record command list.
 	     * 
-	     * Convert Gnm command buffer to Violet command list.
-	     * \param cmd Gnm command buffer.
+	     * Convert Gnm command buffers to a single Violet command list.
+	     * \param cmd Gnm command buffers.
 	     * \param displayBufferIndex Current display buffer index, 
 	     *                           using to index render target.
 	     * \returns The Violet command list recorded.
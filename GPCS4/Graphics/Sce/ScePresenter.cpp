@@ -64,7 +64,14 @@ namespace sce
 		info.pSwapchains        = &m_swapchain;
 		info.pImageIndices      = &m_imageIndex;
 		info.pResults           = nullptr;
-		return vkQueuePresentKHR(m_device.queue, &info);
+
+		VkResult status = vkQueuePresentKHR(m_device.queue, &info);
+
+		// Several frames may be in flight now, the next
+		// one must not reuse semaphores of this one.
+		m_frameIndex += 1;
+		m_frameIndex %= m_semaphores.size();
+		return status;
 	}
 
 	VkResult ScePresenter::recreateSwapChain(const PresenterDesc& desc)
@@ -1,10 +1,53 @@
 #include "SpirvCompression.h"
 
+#include "UtilCpu.h"
+
+#include <array>
+#include <cstring>
+
 using namespace util;
 
 namespace sce::pssl
 {
 
+  /**
+   * \brief Lookup tables for the SIMD codec
+   *
+   * Indexed by a control byte, which stores the
+   * byte count minus one of four DWORDs.
+   */
+  struct SpirvCodecTables {
+    std::array<uint8_t, 256>                     length;
+    alignas(16) std::array<std::array<uint8_t, 16>, 256> encode;
+    alignas(16) std::array<std::array<uint8_t, 16>, 256> decode;
+
+    SpirvCodecTables() {
+      for (uint32_t ctrl = 0; ctrl < 256; ctrl++) {
+        uint32_t offset = 0;
+
+        // Shuffle indices with the top bit set produce zero
+        encode[ctrl].fill(0x80);
+        decode[ctrl].fill(0x80);
+
+        for (uint32_t w = 0; w < 4; w++) {
+          uint32_t bytes = ((ctrl >> (2 * w)) & 3) + 1;
+
+          for (uint32_t b = 0; b < bytes; b++) {
+            encode[ctrl][offset + b] = uint8_t(4 * w + b);
+            decode[ctrl][4 * w + b]  = uint8_t(offset + b);
+          }
+
+          offset += bytes;
+        }
+
+        length[ctrl] = uint8_t(offset);
+      }
+    }
+  };
+
+  static const SpirvCodecTables g_codecTables;
+
+
   SpirvCompressedBuffer::SpirvCompressedBuffer()
   : m_size(0) {
 
@@ -22,6 +65,36 @@ namespace sce::pssl
     // each DWORD, a two-bit integer is stored which indicates
     // the number of bytes it takes in the compressed buffer.
     // This way, it can achieve a compression ratio of ~50%.
+    if (cpu::features().sse41)
+      this->compressSse41(data);
+    else
+      this->compressScalar(data);
+  }
+
+
+  SpirvCompressedBuffer::~SpirvCompressedBuffer() {
+
+  }
+
+
+  SpirvCodeBuffer SpirvCompressedBuffer::decompress() const {
+    SpirvCodeBuffer code(m_size);
+    uint32_t* data = code.data();
+
+    if (m_size == 0)
+      return code;
+
+    if (cpu::features().ssse3)
+      this->decompressSsse3(data);
+    else
+      this->decompressScalar(data);
+
+    return code;
+  }
+
+
+  void SpirvCompressedBuffer::compressScalar(
+    const uint32_t*         data) {
     m_mask.reserve((m_size + NumMaskWords - 1) / NumMaskWords);
     m_code.reserve((m_size + 1) / 2);
 
@@ -65,19 +138,77 @@ namespace sce::pssl
     m_code.shrink_to_fit();
   }
 
-    
-  SpirvCompressedBuffer::~SpirvCompressedBuffer() {
 
-  }
+  UTIL_TARGET("sse4.1")
+  void SpirvCompressedBuffer::compressSse41(
+    const uint32_t*         data) {
+    // Every group of four DWORDs is compacted with a single
+    // shuffle. Stores always write 16 bytes, so reserve room
+    // for the worst case plus one full store.
+    m_mask.resize((m_size + NumMaskWords - 1) / NumMaskWords);
+    m_code.resize((4 * m_size + 16 + 7) / 8);
 
+    auto ctrlBytes = reinterpret_cast<uint8_t*>(m_mask.data());
+    auto codeBytes = reinterpret_cast<uint8_t*>(m_code.data());
+    auto dst       = codeBytes;
 
-  SpirvCodeBuffer SpirvCompressedBuffer::decompress() const {
-    SpirvCodeBuffer code(m_size);
-    uint32_t* data = code.data();
+    const __m128i limit8  = _mm_set1_epi32(0x000000FF);
+    const __m128i limit16 = _mm_set1_epi32(0x0000FFFF);
+    const __m128i limit24 = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i shifts  = _mm_setr_epi32(1, 4, 16, 64);
 
-    if (m_size == 0)
-      return code;
+    uint32_t i = 0;
+
+    for ( ; i + 4 <= m_size; i += 4) {
+      __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+      // Each comparison yields -1 for words that fit into
+      // the given number of bits, so 3 + sum is the byte
+      // count minus one, as stored in the control byte.
+      __m128i fits = _mm_add_epi32(
+        _mm_add_epi32(
+          _mm_cmpeq_epi32(_mm_min_epu32(words, limit8),  words),
+          _mm_cmpeq_epi32(_mm_min_epu32(words, limit16), words)),
+          _mm_cmpeq_epi32(_mm_min_epu32(words, limit24), words));
+
+      __m128i counts = _mm_mullo_epi32(
+        _mm_add_epi32(fits, _mm_set1_epi32(3)), shifts);
+
+      // Bit fields don't overlap, so summing the bytes works
+      __m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+      uint32_t ctrl = uint32_t(_mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4));
+
+      __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(g_codecTables.encode[ctrl].data()));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(words, shuffle));
+
+      ctrlBytes[i / 4] = uint8_t(ctrl);
+      dst += g_codecTables.length[ctrl];
+    }
+
+    for ( ; i < m_size; i++) {
+      uint32_t word  = data[i];
+      uint32_t bytes = 0;
+
+      if      (word < (1 <<  8)) bytes = 0;
+      else if (word < (1 << 16)) bytes = 1;
+      else if (word < (1 << 24)) bytes = 2;
+      else                       bytes = 3;
+
+      ctrlBytes[i / 4] |= uint8_t(bytes << (2 * (i % 4)));
+
+      std::memcpy(dst, &word, bytes + 1);
+      dst += bytes + 1;
+    }
 
+    // Bytes past the end are still zero, which matches
+    // the padding written by the scalar version.
+    m_code.resize((dst - codeBytes + 7) / 8);
+    m_code.shrink_to_fit();
+  }
+
+
+  void SpirvCompressedBuffer::decompressScalar(
+          uint32_t*         data) const {
     uint32_t maskIdx = 0;
     uint32_t codeIdx = 0;
 
@@ -106,8 +237,38 @@ namespace sce::pssl
         srcMask >>= 2;
       }
     }
+  }
 
-    return code;
+
+  UTIL_TARGET("ssse3")
+  void SpirvCompressedBuffer::decompressSsse3(
+          uint32_t*         data) const {
+    auto ctrlBytes = reinterpret_cast<const uint8_t*>(m_mask.data());
+    auto src       = reinterpret_cast<const uint8_t*>(m_code.data());
+    auto srcEnd    = src + m_code.size() * sizeof(uint64_t);
+
+    uint32_t i = 0;
+
+    // Loads always read 16 bytes, the last few groups
+    // are handled below so we don't read past the end.
+    for ( ; i + 4 <= m_size && src + 16 <= srcEnd; i += 4) {
+      uint32_t ctrl = ctrlBytes[i / 4];
+
+      __m128i words   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(g_codecTables.decode[ctrl].data()));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(words, shuffle));
+
+      src += g_codecTables.length[ctrl];
+    }
+
+    for ( ; i < m_size; i++) {
+      uint32_t bytes = ((ctrlBytes[i / 4] >> (2 * (i % 4))) & 3) + 1;
+      uint32_t word  = 0;
+
+      std::memcpy(&word, src, bytes);
+      data[i] = word;
+      src += bytes;
+    }
   }
 
-}
\ No newline at end of file
+}
@@ -12,8 +12,18 @@ namespace sce::pssl
    *
    * Implements a fast in-memory compression
    * to keep memory footprint low.
+   *
+   * Viewed as bytes, the mask holds one control byte
+   * per four DWORDs and the code holds the DWORDs with
+   * leading null bytes removed, which is the layout
+   * used by StreamVByte. This allows SIMD versions of
+   * the codec that produce exactly the same buffers
+   * as the scalar version, which is kept as reference.
    */
   class SpirvCompressedBuffer {
+    // Runs each codec path on its own, see Tests/TestSpirvCompression.cpp
+    friend struct SpirvCompressionTester;
+
     constexpr static uint32_t NumMaskWords = 32;
   public:
 
@@ -32,6 +42,18 @@ namespace sce::pssl
     std::vector<uint64_t> m_mask;
     std::vector<uint64_t> m_code;
 
+    void compressScalar(
+      const uint32_t*         data);
+
+    void compressSse41(
+      const uint32_t*         data);
+
+    void decompressScalar(
+            uint32_t*         data) const;
+
+    void decompressSsse3(
+            uint32_t*         data) const;
+
   };
 
 }
\ No newline at end of file
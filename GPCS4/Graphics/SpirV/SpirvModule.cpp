@@ -518,6 +518,9 @@ namespace sce::pssl
     m_typeConstDefs.putIns  (op, 3);
     m_typeConstDefs.putWord (typeId);
     m_typeConstDefs.putWord (resultId);
+    
+    m_typeConstIds.emplace(
+      this->getDeclKey(op, typeId, 0, nullptr), resultId);
     return resultId;
   }
     
@@ -531,6 +534,9 @@ namespace sce::pssl
     m_typeConstDefs.putWord (typeId);
     m_typeConstDefs.putWord (resultId);
     m_typeConstDefs.putWord (value);
+    
+    m_typeConstIds.emplace(
+      this->getDeclKey(spv::OpSpecConstant, typeId, 1, &value), resultId);
     return resultId;
   }
   
@@ -774,6 +780,12 @@ namespace sce::pssl
     m_typeConstDefs.putWord(resultId);
     m_typeConstDefs.putWord(typeId);
     m_typeConstDefs.putWord(length);
+    
+    // Regular lookups used to find unique types as well
+    // if they were declared first, so keep doing that.
+    std::array<uint32_t, 2> args = {{ typeId, length }};
+    m_typeConstIds.emplace(this->getDeclKey(
+      spv::OpTypeArray, 0, args.size(), args.data()), resultId);
     return resultId;
   }
   
@@ -794,6 +806,9 @@ namespace sce::pssl
     m_typeConstDefs.putIns (spv::OpTypeRuntimeArray, 3);
     m_typeConstDefs.putWord(resultId);
     m_typeConstDefs.putWord(typeId);
+    
+    m_typeConstIds.emplace(this->getDeclKey(
+      spv::OpTypeRuntimeArray, 0, 1, &typeId), resultId);
     return resultId;
   }
   
@@ -831,6 +846,9 @@ namespace sce::pssl
     
     for (uint32_t i = 0; i < memberCount; i++)
       m_typeConstDefs.putWord(memberTypes[i]);
+    
+    m_typeConstIds.emplace(this->getDeclKey(
+      spv::OpTypeStruct, 0, memberCount, memberTypes), resultId);
     return resultId;
   }
   
@@ -3669,19 +3687,14 @@ namespace sce::pssl
           spv::Op                 op, 
           uint32_t                argCount,
     const uint32_t*               argIds) {
-    // Since the type info is stored in the code buffer,
-    // we can use the code buffer to look up type IDs as
-    // well. Result IDs are always stored as argument 1.
-    for (auto ins : m_typeConstDefs) {
-      bool match = ins.opCode() == op
-                && ins.length() == 2 + argCount;
-      
-      for (uint32_t i = 0; i < argCount && match; i++)
-        match &= ins.arg(2 + i) == argIds[i];
-      
-      if (match)
-        return ins.arg(1);
-    }
+    // Scanning the code buffer for an existing declaration
+    // would be quadratic in the number of types, so we keep
+    // a map from the declaration words to the result ID.
+    auto entry = m_typeConstIds.find(
+      this->getDeclKey(op, 0, argCount, argIds));
+    
+    if (entry != m_typeConstIds.end())
+      return entry->second;
     
     // Type not yet declared, create a new one.
     uint32_t resultId = this->allocateId();
@@ -3690,6 +3703,8 @@ namespace sce::pssl
     
     for (uint32_t i = 0; i < argCount; i++)
       m_typeConstDefs.putWord(argIds[i]);
+    
+    m_typeConstIds.emplace(m_declKey, resultId);
     return resultId;
   }
   
@@ -3699,23 +3714,14 @@ namespace sce::pssl
           uint32_t                typeId,
           uint32_t                argCount,
     const uint32_t*               argIds) {
-    // Avoid declaring constants multiple times
-    for (auto ins : m_typeConstDefs) {
-      bool match = ins.opCode() == op
-                && ins.length() == 3 + argCount
-                && ins.arg(1)   == typeId;
-      
-      for (uint32_t i = 0; i < argCount && match; i++)
-        match &= ins.arg(3 + i) == argIds[i];
-      
-      if (!match)
-        continue;
-      
-      uint32_t id = ins.arg(2);
-
-      if (m_lateConsts.find(id) == m_lateConsts.end())
-        return id;
-    }
+    // Avoid declaring constants multiple times. Late
+    // constants are never added to the map since their
+    // value is not known until setLateConst is called.
+    auto entry = m_typeConstIds.find(
+      this->getDeclKey(op, typeId, argCount, argIds));
+    
+    if (entry != m_typeConstIds.end())
+      return entry->second;
     
     // Constant not yet declared, make a new one
     uint32_t resultId = this->allocateId();
@@ -3725,10 +3731,36 @@ namespace sce::pssl
     
     for (uint32_t i = 0; i < argCount; i++)
       m_typeConstDefs.putWord(argIds[i]);
+    
+    m_typeConstIds.emplace(m_declKey, resultId);
     return resultId;
   }
   
   
+  const std::vector<uint32_t>& SpirvModule::getDeclKey(
+          spv::Op                 op,
+          uint32_t                typeId,
+          uint32_t                argCount,
+    const uint32_t*               argIds) {
+    // The key consists of the instruction word and all
+    // operands except for the result ID. Types have no
+    // result type, in which case typeId is zero.
+    const uint32_t wordCount = (typeId ? 3 : 2) + argCount;
+    
+    m_declKey.clear();
+    m_declKey.push_back(
+        (static_cast<uint32_t>(op)        <<  0)
+      | (static_cast<uint32_t>(wordCount) << 16));
+    
+    if (typeId)
+      m_declKey.push_back(typeId);
+    
+    for (uint32_t i = 0; i < argCount; i++)
+      m_declKey.push_back(argIds[i]);
+    return m_declKey;
+  }
+  
+  
   void SpirvModule::instImportGlsl450() {
     m_instExtGlsl450 = this->allocateId();
     const char* name = "GLSL.std.450";
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <unordered_map>
 #include <unordered_set>
 
 #include "SpirvCodeBuffer.h"
@@ -30,6 +31,21 @@ namespace sce::pssl
     uint32_t sMinLod       = 0;
   };
 
+  /**
+   * \brief Declaration key hash
+   * 
+   * Hashes the words of a type or constant
+   * declaration, excluding its result ID.
+   */
+  struct SpirvDeclHash {
+    size_t operator () (const std::vector<uint32_t>& words) const {
+      size_t hash = 0;
+      for (uint32_t word : words)
+        hash ^= word + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+      return hash;
+    }
+  };
+
   constexpr uint32_t spvVersion(uint32_t major, uint32_t minor) {
     return (major << 16) | (minor << 8);
   }
@@ -1272,6 +1288,13 @@ namespace sce::pssl
     SpirvCodeBuffer m_code;
 
     std::unordered_set<uint32_t> m_lateConsts;
+
+    // Maps type and constant declarations to their result
+    // IDs, so that we don't have to scan m_typeConstDefs.
+    std::unordered_map<
+      std::vector<uint32_t>, uint32_t,
+      SpirvDeclHash>             m_typeConstIds;
+    std::vector<uint32_t>        m_declKey;
     
     uint32_t defType(
             spv::Op                 op, 
@@ -1284,6 +1307,12 @@ namespace sce::pssl
             uint32_t                argCount,
       const uint32_t*               argIds);
     
+    const std::vector<uint32_t>& getDeclKey(
+            spv::Op                 op,
+            uint32_t                typeId,
+            uint32_t                argCount,
+      const uint32_t*               argIds);
+    
     void instImportGlsl450();
     
     uint32_t getImageOperandWordCount(
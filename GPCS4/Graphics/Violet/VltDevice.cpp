@@ -61,6 +61,10 @@ namespace sce::vlt
 
 	void VltDevice::waitForIdle()
 	{
+		// Make sure all command lists are recycled
+		// before we tear down anything they use.
+		m_submissionQueue.synchronize();
+
 		if (vkDeviceWaitIdle(m_device) != VK_SUCCESS)
 			Logger::err("DxvkDevice: waitForIdle: Operation failed");
 	}
@@ -113,11 +117,23 @@ namespace sce::vlt
 		const Rc<sce::ScePresenter>& presenter, 
 		VltSubmitStatus* status)
 	{
-		status->result = VK_NOT_READY;
+		if (status)
+			status->result = VK_NOT_READY;
 
 		VltPresentInfo presentInfo;
 		presentInfo.presenter = presenter;
 		m_submissionQueue.present(presentInfo, status);
 	}
 
+	VkResult VltDevice::waitForSubmission(VltSubmitStatus* status)
+	{
+		m_submissionQueue.synchronizeSubmission(status);
+		return status->result.load();
+	}
+
+	void VltDevice::setMaxFramesInFlight(uint32_t maxFramesInFlight)
+	{
+		m_submissionQueue.setMaxFramesInFlight(maxFramesInFlight);
+	}
+
 }  // namespace sce::vlt
\ No newline at end of file
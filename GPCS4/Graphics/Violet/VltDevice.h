@@ -201,12 +201,33 @@ namespace sce::vlt
          * the submission thread. The status of this operation
          * can be retrieved with \ref waitForSubmission.
          * \param [in] presenter The presenter
-         * \param [out] status Present status
+         * \param [out] status Present status, may be \c nullptr
          */
 		void presentImage(
 			const Rc<sce::ScePresenter>& presenter,
 			VltSubmitStatus*             status);
 
+		/**
+         * \brief Waits for a present to finish
+         *
+         * Returns once all command lists submitted
+         * before the present have been executed.
+         * \param [in] status Status passed to \ref presentImage
+         * \returns Result of the present and submissions
+         */
+		VkResult waitForSubmission(
+			VltSubmitStatus* status);
+
+		/**
+         * \brief Limits the number of frames in flight
+         *
+         * \ref presentImage blocks while the GPU is this
+         * many frames behind. One disables frame overlap.
+         * \param [in] maxFramesInFlight Frame count
+         */
+		void setMaxFramesInFlight(
+			uint32_t maxFramesInFlight);
+
 		/**
         * \brief Waits until the device becomes idle
         * 
@@ -8,37 +8,148 @@ namespace sce::vlt
 	VltSubmissionQueue::VltSubmissionQueue(VltDevice* device) :
 		m_device(device)
 	{
+		m_finishThread = std::thread([this]() { finishCmdLists(); });
 	}
 
 	VltSubmissionQueue::~VltSubmissionQueue()
 	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopped = true;
+		}
+		m_finishCond.notify_one();
+
+		if (m_finishThread.joinable())
+		{
+			m_finishThread.join();
+		}
+	}
+
+	void VltSubmissionQueue::setMaxFramesInFlight(uint32_t maxFramesInFlight)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_maxFramesInFlight = std::max(maxFramesInFlight, 1u);
+		}
+		m_retireCond.notify_all();
 	}
 
 	void VltSubmissionQueue::submit(const VltSubmitInfo& submission)
 	{
 		auto& cmdList = submission.cmdList;
 		cmdList->submit(submission.waitSync, submission.wakeSync);
-		m_submitQueue.push(std::move(cmdList));
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_finishQueue.push({ cmdList, nullptr });
+			++m_pending;
+		}
+		m_finishCond.notify_one();
 	}
 
 	void VltSubmissionQueue::present(
 		const VltPresentInfo& presentInfo,
 		VltSubmitStatus*      status)
 	{
-		auto& presenter = presentInfo.presenter;
-		presenter->presentImage();
+		auto&    presenter = presentInfo.presenter;
+		VkResult result    = presenter->presentImage();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			if (status)
+			{
+				status->result = result;
+			}
+			status = nullptr;
+		}
+
+		m_finishQueue.push({ nullptr, status });
+		++m_pending;
+		++m_framesInFlight;
+		m_finishCond.notify_one();
+
+		// Frame pacing, instead of waiting for this frame,
+		// only wait for the oldest one if too many are queued.
+		m_retireCond.wait(lock, [this]
+						  { return m_framesInFlight < m_maxFramesInFlight; });
+	}
+
+	void VltSubmissionQueue::synchronizeSubmission(
+		VltSubmitStatus* status)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_retireCond.wait(lock, [status]
+						  { return status->result.load() != VK_NOT_READY; });
+	}
+
+	void VltSubmissionQueue::synchronize()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_retireCond.wait(lock, [this]
+						  { return m_pending == 0; });
+	}
+
+	void VltSubmissionQueue::finishCmdLists()
+	{
+		VkResult frameResult = VK_SUCCESS;
+
+		while (true)
+		{
+			VltSubmitEntry entry;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+
+				m_finishCond.wait(lock, [this]
+								  { return !m_finishQueue.empty() || m_stopped; });
+
+				if (m_finishQueue.empty())
+				{
+					break;
+				}
+
+				entry = std::move(m_finishQueue.front());
+				m_finishQueue.pop();
+			}
+
+			if (entry.cmdList != nullptr)
+			{
+				// Wait for command buffer submit finish.
+				VkResult result = entry.cmdList->synchronize();
+				if (result != VK_SUCCESS)
+				{
+					frameResult = result;
+				}
+
+				// After submit done, reset cmdlist to release resource.
+				entry.cmdList->reset();
 
+				// Finally, recycle the cmdlist for next use.
+				m_device->recycleCommandList(entry.cmdList);
+			}
 
-		auto cmdList = m_submitQueue.front();
-		m_submitQueue.pop();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
 
-		// Wait for command buffer submit finish.
-		cmdList->synchronize();
+				// Entries are finished in order, so a frame marker
+				// means every command list of the frame is done.
+				if (entry.cmdList == nullptr)
+				{
+					if (entry.status)
+					{
+						entry.status->result = frameResult;
+					}
 
-		// After submit done, reset cmdlist to release resource.
-		cmdList->reset();
+					frameResult = VK_SUCCESS;
+					--m_framesInFlight;
+				}
 
-		// Finally, recycle the cmdlist for next use.
-		m_device->recycleCommandList(cmdList);
+				--m_pending;
+			}
+			m_retireCond.notify_all();
+		}
 	}
-}  // namespace sce::vlt
\ No newline at end of file
+}  // namespace sce::vlt
@@ -3,7 +3,10 @@
 #include "VltCommon.h"
 #include "VltCmdList.h"
 
+#include <condition_variable>
+#include <mutex>
 #include <queue>
+#include <thread>
 
 namespace sce
 {
@@ -47,29 +50,79 @@ namespace sce
 		};
 
 		/**
-         * \brief A submission queue to submit cmdlist asynchronously.
+         * \brief Submission queue
          *
-         * TODO:
-         * Currently this is a dummy queue, which uses synchronous submit.
-	     * This exists just for future compatibility when we really need a asynchronous queue.
-	     * I didn't do that because synchronous queue is more easier to debug.
+         * Command lists are submitted on the calling thread, while a
+         * finisher thread waits for their fences, then resets and recycles
+         * them. Presenting only blocks when too many frames are still
+         * being processed by the GPU, so that CPU and GPU work overlap.
          */
 		class VltSubmissionQueue
 		{
+			// A value of 1 makes presenting wait for the frame to finish.
+			constexpr static uint32_t DefaultMaxFramesInFlight = 2;
+
 		public:
 			VltSubmissionQueue(VltDevice* device);
 			~VltSubmissionQueue();
 
+			/**
+			 * \brief Sets number of frames the GPU may lag behind
+			 * \param [in] maxFramesInFlight Frame count, at least 1
+			 */
+			void setMaxFramesInFlight(uint32_t maxFramesInFlight);
+
 			void submit(
 				const VltSubmitInfo& submission);
 
+			/**
+			 * \brief Presents an image
+			 *
+			 * The status becomes \c VK_NOT_READY, and is set to the
+			 * result once all command lists submitted before the
+			 * present have finished execution. It must stay valid
+			 * until then. May be \c nullptr.
+			 */
 			void present(
 				const VltPresentInfo& presentInfo,
 				VltSubmitStatus*      status);
 
+			/**
+			 * \brief Waits for a present to finish
+			 * \param [in] status Status passed to \ref present
+			 */
+			void synchronizeSubmission(
+				VltSubmitStatus* status);
+
+			/**
+			 * \brief Waits for all command lists to finish
+			 *
+			 * All command lists are recycled after this returns.
+			 */
+			void synchronize();
+
 		private:
-			VltDevice*                     m_device;
-			std::queue<Rc<VltCommandList>> m_submitQueue;
+			// A null command list marks the end of a frame.
+			struct VltSubmitEntry
+			{
+				Rc<VltCommandList> cmdList;
+				VltSubmitStatus*   status;
+			};
+
+			void finishCmdLists();
+
+		private:
+			VltDevice* m_device;
+
+			std::mutex                 m_mutex;
+			std::condition_variable    m_finishCond;
+			std::condition_variable    m_retireCond;
+			std::queue<VltSubmitEntry> m_finishQueue;
+			uint32_t                   m_pending           = 0;
+			uint32_t                   m_framesInFlight    = 0;
+			uint32_t                   m_maxFramesInFlight = DefaultMaxFramesInFlight;
+			bool                       m_stopped           = false;
+			std::thread                m_finishThread;
 		};
 	} // namespace vlt
 }  // namespace sce
\ No newline at end of file
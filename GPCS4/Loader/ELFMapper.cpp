@@ -1,6 +1,7 @@
 #include "ELFMapper.h"
 
 #include "Emulator/ModuleSystemCommon.h"
+#include "Emulator/SceModuleSystem.h"
 #include "Platform.h"
 
 #include <algorithm>
@@ -31,9 +32,11 @@ bool ELFMapper::loadFile(std::string const &filePath, NativeModule *mod)
 
 		m_moduleData = mod;
 
-		if (!plat::LoadFile(filePath, mod->m_fileMemory))
+		// Map instead of reading the file, the tables are parsed in place
+		// and segments are copied into the image straight from the mapping.
+		if (!mod->m_fileMapping.open(filePath))
 		{
-			LOG_ERR("failed to load file %s", filePath.c_str());
+			LOG_ERR("failed to map file %s", filePath.c_str());
 			break;
 		}
 
@@ -45,8 +48,7 @@ bool ELFMapper::loadFile(std::string const &filePath, NativeModule *mod)
 bool ELFMapper::validateHeader()
 {
 
-	bool retVal      = false;
-	auto &fileMemory = m_moduleData->m_fileMemory;
+	bool retVal = false;
 
 	do
 	{
@@ -56,13 +58,15 @@ bool ELFMapper::validateHeader()
 			break;
 		}
 
+		auto &fileMemory = m_moduleData->m_fileMapping;
+
 		if (fileMemory.size() < sizeof(*m_moduleData->m_elfHeader))
 		{
 			LOG_ERR("file size error. size=%d", fileMemory.size());
 			break;
 		}
 
-		m_moduleData->m_elfHeader = reinterpret_cast<Elf64_Ehdr *>(fileMemory.data());
+		m_moduleData->m_elfHeader = reinterpret_cast<const Elf64_Ehdr *>(fileMemory.data());
 		auto elfHeader            = m_moduleData->m_elfHeader;
 
 		if (strncmp((const char *)elfHeader->e_ident, ELFMAG, SELFMAG))
@@ -100,17 +104,24 @@ bool ELFMapper::parseSegmentHeaders()
 			break;
 		}
 
-		auto&        fileMemory     = m_moduleData->m_fileMemory;
-		MODULE_INFO& info           = m_moduleData->m_moduleInfo;
-		uint8_t*     pSegmentHeader = fileMemory.data() + m_moduleData->m_elfHeader->e_phoff;
-		uint32_t     shCount        = m_moduleData->m_elfHeader->e_phnum;
+		auto&          fileMemory     = m_moduleData->m_fileMapping;
+		MODULE_INFO&   info           = m_moduleData->m_moduleInfo;
+		const uint8_t* pSegmentHeader = fileMemory.data() + m_moduleData->m_elfHeader->e_phoff;
+		uint32_t       shCount        = m_moduleData->m_elfHeader->e_phnum;
+
+		if (m_moduleData->m_elfHeader->e_phoff + shCount * sizeof(Elf64_Phdr) > fileMemory.size())
+		{
+			LOG_ERR("segment headers out of file range");
+			retVal = false;
+			break;
+		}
 
 		m_moduleData->m_segmentHeaders.resize(shCount);
 
 		memcpy(m_moduleData->m_segmentHeaders.data(), pSegmentHeader,
 			   shCount * sizeof(Elf64_Phdr));
 
-		uint8_t *pBuffer = fileMemory.data();
+		const uint8_t *pBuffer = fileMemory.data();
 
 		for (auto &hdr : m_moduleData->m_segmentHeaders)
 		{
@@ -189,9 +200,8 @@ bool ELFMapper::parseDynamicSection()
 
 	do
 	{
-		Elf64_Dyn *pDynEntries = reinterpret_cast<Elf64_Dyn *>(info.pDynamic);
-		uint32_t dynEntriesCount   = info.nDynamicSize / sizeof(Elf64_Dyn);
-		uint8_t *pStrTab          = info.pStrTab;
+		auto     pDynEntries     = reinterpret_cast<const Elf64_Dyn *>(info.pDynamic);
+		uint32_t dynEntriesCount = info.nDynamicSize / sizeof(Elf64_Dyn);
 
 		for (uint32_t i = 0; i < dynEntriesCount; i++)
 		{
@@ -290,15 +300,15 @@ bool ELFMapper::mapImageIntoMemory()
 // TODO: clean up the verbose code here when it is done.
 bool ELFMapper::parseSymbols()
 {
-	MODULE_INFO &info = m_moduleData->m_moduleInfo;
-	auto pSymbolTable = (Elf64_Sym *)info.pSymTab;
-	auto tableSize    = info.nSymTabSize / sizeof(Elf64_Sym);
+	MODULE_INFO &info   = m_moduleData->m_moduleInfo;
+	auto tableSize      = info.nSymTabSize / sizeof(Elf64_Sym);
+	auto &symbolManager = CSceModuleSystem::GetInstance()->getSymbolManager();
 
 	for (uint32_t i = 0; i < tableSize; i++)
 	{
-		auto const &symbol = reinterpret_cast<Elf64_Sym *>(info.pSymTab)[i];
+		auto const &symbol = reinterpret_cast<const Elf64_Sym *>(info.pSymTab)[i];
 		auto binding       = ELF64_ST_BIND(symbol.st_info);
-		auto name          = (char *)(&info.pStrTab[symbol.st_name]);
+		auto name          = (const char *)(&info.pStrTab[symbol.st_name]);
 		auto isDef         = symbol.st_value == 0 ? "UNDEF" : "EXPORT";
 		SymbolInfo si      = {};
 
@@ -347,8 +357,10 @@ bool ELFMapper::parseSymbols()
 					LOG_ERR("fail to find information for symbol %s", name);
 				}
 			}
-			si.address = reinterpret_cast<uint64_t>(addr);
-			auto idx   = m_moduleData->m_symbols.size();
+			si.moduleId  = symbolManager.internName(si.moduleName);
+			si.libraryId = symbolManager.internName(si.libraryName);
+			si.address   = reinterpret_cast<uint64_t>(addr);
+			auto idx     = m_moduleData->m_symbols.size();
 			m_moduleData->m_symbols.emplace_back(si);
 			m_moduleData->m_nameSymbolMap.insert(std::make_pair(name, idx));
 			if (symbol.st_value != 0)
@@ -391,8 +403,10 @@ bool ELFMapper::parseSymbols()
 					LOG_ERR("fail to find information for symbol %s", name);
 				}
 			}
-			si.address = reinterpret_cast<uint64_t>(addr);
-			auto idx   = m_moduleData->m_symbols.size();
+			si.moduleId  = symbolManager.internName(si.moduleName);
+			si.libraryId = symbolManager.internName(si.libraryName);
+			si.address   = reinterpret_cast<uint64_t>(addr);
+			auto idx     = m_moduleData->m_symbols.size();
 			m_moduleData->m_symbols.emplace_back(si);
 			m_moduleData->m_nameSymbolMap.insert(std::make_pair(name, idx));
 			if (symbol.st_value != 0)
@@ -414,7 +428,7 @@ bool ELFMapper::parseSymbols()
 bool ELFMapper::prepareTables(Elf64_Dyn const &entry, uint32_t index)
 {
 	MODULE_INFO &info  = m_moduleData->m_moduleInfo;
-	uint8_t *pDynBaseAddr = info.pSceDynLib;
+	const uint8_t *pDynBaseAddr = info.pSceDynLib;
 	bool retVal        = true;
 
 	switch (entry.d_tag)
@@ -579,13 +593,13 @@ bool ELFMapper::prepareTables(Elf64_Dyn const &entry, uint32_t index)
 bool ELFMapper::parseSingleDynEntry(Elf64_Dyn const &entry, uint32_t index)
 {
 	MODULE_INFO &info = m_moduleData->m_moduleInfo;
-	uint8_t *strTable    = info.pStrTab;
+	const uint8_t *strTable = info.pStrTab;
 
 	switch (entry.d_tag)
 	{
 	case DT_NEEDED:
 	{
-		char *fileName = (char *)&strTable[entry.d_un.d_ptr];
+		auto fileName = reinterpret_cast<const char *>(&strTable[entry.d_un.d_ptr]);
 		m_moduleData->m_neededFiles.push_back(fileName);
 		LOG_DEBUG("DT_NEEDED: %s", fileName);
 	}
@@ -595,7 +609,7 @@ bool ELFMapper::parseSingleDynEntry(Elf64_Dyn const &entry, uint32_t index)
 	{
 		IMPORT_MODULE mod;
 		mod.value   = entry.d_un.d_val;
-		mod.strName = reinterpret_cast<char *>(&strTable[mod.name_offset]);
+		mod.strName = reinterpret_cast<const char *>(&strTable[mod.name_offset]);
 		m_moduleData->m_exportModules.push_back(mod);
 		LOG_DEBUG("DT_SCE_MODULE_INFO: %s", mod.strName.c_str());
 	}
@@ -605,7 +619,7 @@ bool ELFMapper::parseSingleDynEntry(Elf64_Dyn const &entry, uint32_t index)
 	{
 		IMPORT_MODULE mod;
 		mod.value   = entry.d_un.d_val;
-		mod.strName = reinterpret_cast<char *>(&strTable[mod.name_offset]);
+		mod.strName = reinterpret_cast<const char *>(&strTable[mod.name_offset]);
 		m_moduleData->m_importModules.push_back(mod);
 		LOG_DEBUG("DT_SCE_NEEDED_MODULE: %s", mod.strName.c_str());
 	}
@@ -615,7 +629,7 @@ bool ELFMapper::parseSingleDynEntry(Elf64_Dyn const &entry, uint32_t index)
 	{
 		IMPORT_LIBRARY lib;
 		lib.value   = entry.d_un.d_val;
-		lib.strName = reinterpret_cast<char *>(&strTable[lib.name_offset]);
+		lib.strName = reinterpret_cast<const char *>(&strTable[lib.name_offset]);
 		m_moduleData->m_exportLibraries.push_back(lib);
 		LOG_DEBUG("DT_SCE_EXPORT_LIB %s", lib.strName.c_str());
 	}
@@ -625,7 +639,7 @@ bool ELFMapper::parseSingleDynEntry(Elf64_Dyn const &entry, uint32_t index)
 	{
 		IMPORT_LIBRARY lib;
 		lib.value   = entry.d_un.d_val;
-		lib.strName = reinterpret_cast<char *>(&strTable[lib.name_offset]);
+		lib.strName = reinterpret_cast<const char *>(&strTable[lib.name_offset]);
 		m_moduleData->m_importLibraries.push_back(lib);
 		LOG_DEBUG("DT_SCE_IMPORT_LIB %s", lib.strName.c_str());
 	}
@@ -685,7 +699,7 @@ bool ELFMapper::mapCodeSegment(Elf64_Phdr const &phdr)
 {
 	bool retVal       = false;
 	MODULE_INFO &info = m_moduleData->m_moduleInfo;
-	auto &fileData    = m_moduleData->m_fileMemory;
+	auto &fileData    = m_moduleData->m_fileMapping;
 	do
 	{
 		if (fileData.empty())
@@ -697,7 +711,7 @@ bool ELFMapper::mapCodeSegment(Elf64_Phdr const &phdr)
 		info.pCodeAddr = reinterpret_cast<uint8_t*>(
 			util::alignDown(size_t(info.pMappedAddr + phdr.p_vaddr), phdr.p_align));
 
-		uint8_t *fileDataPtr = fileData.data() + phdr.p_offset;
+		const uint8_t *fileDataPtr = fileData.data() + phdr.p_offset;
 
 		memcpy(info.pCodeAddr, fileDataPtr, phdr.p_filesz);
 		if (m_moduleData->m_elfHeader->e_entry != 0)
@@ -728,7 +742,7 @@ bool ELFMapper::mapSecReloSegment(Elf64_Phdr const &phdr)
 {
 	bool retVal       = false;
 	MODULE_INFO &info = m_moduleData->m_moduleInfo;
-	auto &fileData    = m_moduleData->m_fileMemory;
+	auto &fileData    = m_moduleData->m_fileMapping;
 
 	do
 	{
@@ -739,7 +753,7 @@ bool ELFMapper::mapSecReloSegment(Elf64_Phdr const &phdr)
 
 		uint8_t *relroAddr = reinterpret_cast<uint8_t *>(
 			util::alignDown(size_t(info.pMappedAddr + phdr.p_vaddr), phdr.p_align));
-		uint8_t *fileDataPtr = fileData.data() + phdr.p_offset;
+		const uint8_t *fileDataPtr = fileData.data() + phdr.p_offset;
 
 		memcpy(relroAddr, fileDataPtr, phdr.p_filesz);
 		retVal = true;
@@ -753,7 +767,7 @@ bool ELFMapper::mapDataSegment(Elf64_Phdr const &phdr)
 {
 	bool retVal       = false;
 	MODULE_INFO &info = m_moduleData->m_moduleInfo;
-	auto &fileData    = m_moduleData->m_fileMemory;
+	auto &fileData    = m_moduleData->m_fileMapping;
 
 	do
 	{
@@ -766,7 +780,7 @@ bool ELFMapper::mapDataSegment(Elf64_Phdr const &phdr)
 		info.pDataAddr = reinterpret_cast<uint8_t *>(
 			util::alignDown(size_t(info.pMappedAddr) + phdr.p_vaddr, phdr.p_align));
 
-		uint8_t *fileDataPtr = fileData.data() + phdr.p_offset;
+		const uint8_t *fileDataPtr = fileData.data() + phdr.p_offset;
 		memcpy(info.pDataAddr, fileDataPtr, phdr.p_filesz);
 
 		if (info.pProcParam != nullptr)
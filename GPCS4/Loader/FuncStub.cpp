@@ -1,11 +1,28 @@
 #include "FuncStub.h"
 #include "PlatDebug.h"
+#include "Emulator/ModuleSystemCommon.h"
+
+#include "xbyak/xbyak.h"
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <fstream>
+
+#ifndef _MSC_VER
+#include <x86intrin.h>
+#else
+#include <intrin.h>
+#endif
 
 LOG_CHANNEL(Loader.FuncStub);
 
+// Allocation granularity of the views
+constexpr size_t JitChunkSize          = 0x10000;
+constexpr size_t ProfileThunkTotalSize = 0x1000;
+
 static void logFunc(const char *log) 
 {
-	LOG_TRACE(log); 
+	LOG_TRACE("%s", log);
 }
 
 // Trap the debugger when an unresolved function is called.
@@ -43,34 +60,95 @@ const std::vector<uint8_t> FuncStubGenerator::funcTemplate = {
 	0xFF, 0xE0 // jmp rax
 };
 
-JitFunctionPool::JitFunctionPool(size_t funcSize, size_t funcNum) :
-	m_funcSize{ util::align(funcSize, (size_t)16) }, m_funcNum{ funcNum }, m_index{ 0 }
+#ifndef MODSYS_STUB_PROFILE_TIME
+
+const std::vector<uint8_t> CallCounterGenerator::funcTemplate = {
+	0x49, 0xBB, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, // movabs r11, _calls
+	0xF0, 0x49, 0xFF, 0x03,                                     // lock inc qword ptr [r11]
+	0x49, 0xBB, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, // movabs r11, _dest
+	0x41, 0xFF, 0xE3                                            // jmp r11
+};
+
+constexpr size_t CounterDestOffset = 0x10;
+
+#else  // MODSYS_STUB_PROFILE_TIME
+
+const std::vector<uint8_t> CallCounterGenerator::funcTemplate = {
+	0x49, 0xBB, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, // movabs r11, _profile
+	0x49, 0xBA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, // movabs r10, _dest
+	0xFF, 0x25, 0x00, 0x00, 0x00, 0x00,                         // jmp qword ptr [rip]
+	0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA              // _thunk
+};
+
+constexpr size_t CounterDestOffset  = 0x0C;
+constexpr size_t CounterThunkOffset = 0x1A;
+
+#endif  // MODSYS_STUB_PROFILE_TIME
+
+// Timing of a stubbed call in flight on current thread.
+struct ProfileFrame
+{
+	StubProfile *profile;
+	uint64_t     retAddr;
+	uint64_t     start;
+};
+
+static thread_local std::vector<ProfileFrame> t_profileFrames;
+
+// Called on function entry, redirects the return to exitThunk.
+static void PS4API profileEnter(StubProfile *profile, uint64_t *retSlot, uint64_t exitThunk)
+{
+	profile->calls.fetch_add(1, std::memory_order_relaxed);
+	t_profileFrames.push_back({ profile, *retSlot, __rdtsc() });
+	*retSlot = exitThunk;
+}
+
+// Called on function return, returns the original return address.
+static uint64_t PS4API profileLeave()
 {
-	m_totalSize = m_funcSize * funcNum;
-	auto memory = plat::VMAllocate(nullptr, m_totalSize,
-									  plat::VMAT_RESERVE_COMMIT, plat::VMPF_CPU_RWX);
+	auto frame = t_profileFrames.back();
+	t_profileFrames.pop_back();
 
-	m_memory.reset(reinterpret_cast<uint8_t *>(memory));
+	frame.profile->cycles.fetch_add(__rdtsc() - frame.start, std::memory_order_relaxed);
+	return frame.retAddr;
 }
 
-uint8_t *JitFunctionPool::newFunctionMemory()
+JitFunctionPool::JitFunctionPool(size_t funcSize) :
+	m_funcSize{ util::align(funcSize, (size_t)16) },
+	m_funcNum{ JitChunkSize / m_funcSize },
+	m_index{ 0 }
 {
+}
+
+uint8_t *JitFunctionPool::newFunctionMemory(uint8_t **writable)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	uint8_t *retPtr = nullptr;
 	do
 	{
-		if (m_memory.get() == nullptr)
+		if (writable == nullptr)
 		{
 			LOG_ERR("null pointer error");
 			break;
 		}
 
-		if (m_index == m_funcNum)
+		if (m_chunks.empty() || m_index == m_funcNum)
 		{
-			LOG_ERR("OUT OF MEMORY");
-			break;
+			plat::DualMapping chunk;
+			if (!chunk.create(JitChunkSize))
+			{
+				LOG_ERR("fail to allocate jit chunk, %zu chunks allocated", m_chunks.size());
+				break;
+			}
+
+			m_chunks.push_back(std::move(chunk));
+			m_index = 0;
 		}
 
-		retPtr = &m_memory.get()[m_funcSize * m_index];
+		auto &chunk = m_chunks.back();
+		*writable   = &chunk.writable()[m_funcSize * m_index];
+		retPtr      = &chunk.executable()[m_funcSize * m_index];
 		m_index += 1;
 
 	} while (false);
@@ -78,30 +156,42 @@ uint8_t *JitFunctionPool::newFunctionMemory()
 	return retPtr;
 }
 
-uint8_t *JitFunctionPool::getFunctionMemory(size_t index)
+bool FuncStubGenerator::attach(void *memory)
 {
-	uint8_t *retPtr = nullptr;
+	bool retval = false;
 	do
 	{
-		if (m_memory.get() == nullptr)
+		if (memory == nullptr)
 		{
 			LOG_ERR("null pointer error");
 			break;
 		}
+		m_memory = reinterpret_cast<uint8_t *>(memory);
+		memcpy(m_memory, funcTemplate.data(), funcTemplate.size());
+		retval = true;
+	} while (false);
 
-		if (index > m_index)
-		{
-			LOG_ERR("index out of range");
-			break;
-		}
+	return retval;
+}
 
-		retPtr = &m_memory.get()[m_funcSize * index];
-	} while (false);
+size_t FuncStubGenerator::size() const { return funcTemplate.size(); }
 
-	return retPtr;
+void FuncStubGenerator::patchLogString(const char *logString)
+{
+	patch(0x24, reinterpret_cast<uint64_t>(logString));
 }
 
-bool FuncStubGenerator::attach(void *memory)
+void FuncStubGenerator::patchLogFunction(void (*logFunctionPtr)(const char *))
+{
+	patch(0x2e, reinterpret_cast<uint64_t>(logFunctionPtr));
+}
+
+void FuncStubGenerator::patchDestPointer(const void *dest)
+{
+	patch(0x5c, reinterpret_cast<uint64_t>(dest));
+}
+
+bool CallCounterGenerator::attach(void *memory)
 {
 	bool retval = false;
 	do
@@ -119,55 +209,155 @@ bool FuncStubGenerator::attach(void *memory)
 	return retval;
 }
 
-size_t FuncStubGenerator::size() const { return funcTemplate.size(); }
+size_t CallCounterGenerator::size() const { return funcTemplate.size(); }
 
-void FuncStubGenerator::patchLogString(const char *logString)
+void CallCounterGenerator::patchProfile(StubProfile *profile)
 {
-	patch(0x24, reinterpret_cast<uint64_t>(logString));
+#ifndef MODSYS_STUB_PROFILE_TIME
+	patch(0x02, reinterpret_cast<uint64_t>(&profile->calls));
+#else
+	patch(0x02, reinterpret_cast<uint64_t>(profile));
+#endif
 }
 
-void FuncStubGenerator::patchLogFunction(void (*logFunctionPtr)(const char *))
+void CallCounterGenerator::patchDestPointer(const void *dest)
 {
-	patch(0x2e, reinterpret_cast<uint64_t>(logFunctionPtr));
+	patch(CounterDestOffset, reinterpret_cast<uint64_t>(dest));
 }
 
-void FuncStubGenerator::patchDestPointer(const void *dest)
+void CallCounterGenerator::patchProfileThunk(const void *thunk)
 {
-	patch(0x5c, reinterpret_cast<uint64_t>(dest));
+#ifdef MODSYS_STUB_PROFILE_TIME
+	patch(CounterThunkOffset, reinterpret_cast<uint64_t>(thunk));
+#endif
 }
 
-FuncStubManager::FuncStubManager(JitFunctionPool *pool, FuncStubGenerator *stub)
-	: m_pool{pool}, m_stub{stub}
+FuncStubManager::FuncStubManager() :
+	m_pool{ std::max(m_logStub.size(), m_counterStub.size()) }
 {
+#ifdef MODSYS_STUB_PROFILE_TIME
+	if (!generateProfileThunks())
+	{
+		LOG_ERR("fail to generate profile thunks, stubs will not be profiled");
+	}
+#endif
 }
 
-void *FuncStubManager::generate(std::string const &message, void *dest)
+void *FuncStubManager::generate(std::string const &name,
+								std::string const &message,
+								void *dest)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	void *retPtr = nullptr;
+	do
+	{
+#ifdef MODSYS_STUB_LOG_CALLS
+		dest = generateLogStub(message, dest);
+		if (dest == nullptr)
+		{
+			break;
+		}
+#endif  // MODSYS_STUB_LOG_CALLS
+
+#ifdef MODSYS_STUB_PROFILE
+		dest = generateCounterStub(name, dest);
+#endif  // MODSYS_STUB_PROFILE
+
+		retPtr = dest;
+	} while (false);
+
+	return retPtr;
+}
+
+void *FuncStubManager::generateUnknown(std::string const &name,
+									   std::string const &message)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	void *retPtr = nullptr;
+	do
+	{
+		auto dest = generateLogStub(message, (void *)trapDebugger);
+		if (dest == nullptr)
+		{
+			break;
+		}
+
+#ifdef MODSYS_STUB_PROFILE
+		dest = generateCounterStub(name, dest);
+#endif  // MODSYS_STUB_PROFILE
+
+		retPtr = dest;
+	} while (false);
+
+	return retPtr;
+}
+
+void *FuncStubManager::generateLogStub(std::string const &message, void *dest)
 {
 	void *retPtr = nullptr;
 	do
 	{
-		auto index = m_messageList.size();
 		m_messageList.push_back(message);
+		auto msgPtr = m_messageList.back().c_str();
+
+		uint8_t *writable = nullptr;
+		auto funcMem      = m_pool.newFunctionMemory(&writable);
+		if (funcMem == nullptr)
+		{
+			break;
+		}
+
+		auto ret = m_logStub.attach(writable);
+		if (!ret)
+		{
+			break;
+		}
+
+		m_logStub.patchLogString(msgPtr);
+		m_logStub.patchLogFunction(logFunc);
+		m_logStub.patchDestPointer(dest);
 
-		auto &msg   = m_messageList.at(index);
-		auto msgPtr = msg.c_str();
+		retPtr = funcMem;
+	} while (false);
+
+	return retPtr;
+}
+
+void *FuncStubManager::generateCounterStub(std::string const &name, void *dest)
+{
+	void *retPtr = nullptr;
+	do
+	{
+#ifdef MODSYS_STUB_PROFILE_TIME
+		if (m_profileEnter == nullptr)
+		{
+			retPtr = dest;
+			break;
+		}
+#endif  // MODSYS_STUB_PROFILE_TIME
 
-		auto funcMem = m_pool->newFunctionMemory();
+		// Functions with the same name share one profile,
+		// no matter which module imports them.
+		auto &profile = m_profiles[name];
 
+		uint8_t *writable = nullptr;
+		auto funcMem      = m_pool.newFunctionMemory(&writable);
 		if (funcMem == nullptr)
 		{
 			break;
 		}
 
-		auto ret = m_stub->attach(funcMem);
+		auto ret = m_counterStub.attach(writable);
 		if (!ret)
 		{
 			break;
 		}
 
-		m_stub->patchLogString(msgPtr);
-		m_stub->patchLogFunction(logFunc);
-		m_stub->patchDestPointer(dest);
+		m_counterStub.patchProfile(&profile);
+		m_counterStub.patchDestPointer(dest);
+		m_counterStub.patchProfileThunk(m_profileEnter);
 
 		retPtr = funcMem;
 	} while (false);
@@ -175,16 +365,152 @@ void *FuncStubManager::generate(std::string const &message, void *dest)
 	return retPtr;
 }
 
-void *FuncStubManager::generateUnknown(std::string const &message)
+bool FuncStubManager::generateProfileThunks()
+{
+	using namespace Xbyak::util;
+
+	bool ret = false;
+	do
+	{
+		if (!m_profileThunks.create(ProfileThunkTotalSize))
+		{
+			break;
+		}
+
+		auto writable   = m_profileThunks.writable();
+		auto executable = m_profileThunks.executable();
+		try
+		{
+			Xbyak::CodeGenerator gen(m_profileThunks.size(), writable);
+
+			// Exit thunk, the callee returns here.
+			// Preserve the return registers.
+			auto exitThunk = executable + gen.getSize();
+			gen.push(rax);
+			gen.push(rdx);
+			gen.push(rbp);
+			gen.mov(rbp, rsp);
+			gen.and_(rsp, -16);
+			gen.sub(rsp, 2 * 16);
+			gen.movdqu(gen.ptr[rsp], xmm0);
+			gen.movdqu(gen.ptr[rsp + 16], xmm1);
+			gen.mov(rax, reinterpret_cast<uint64_t>(profileLeave));
+			gen.call(rax);
+			gen.mov(r11, rax);
+			gen.movdqu(xmm0, gen.ptr[rsp]);
+			gen.movdqu(xmm1, gen.ptr[rsp + 16]);
+			gen.mov(rsp, rbp);
+			gen.pop(rbp);
+			gen.pop(rdx);
+			gen.pop(rax);
+			gen.jmp(r11);
+
+			// Enter thunk, reached from a stub with the profile in r11
+			// and the destination in r10.
+			// Preserve the argument registers.
+			gen.align(16);
+			auto enterThunk = executable + gen.getSize();
+			gen.push(rbp);
+			gen.mov(rbp, rsp);
+			gen.push(rdi);
+			gen.push(rsi);
+			gen.push(rdx);
+			gen.push(rcx);
+			gen.push(r8);
+			gen.push(r9);
+			gen.push(r10);
+			// al holds vector register count of varargs calls
+			gen.push(rax);
+			gen.and_(rsp, -16);
+			gen.sub(rsp, 8 * 16);
+			for (int i = 0; i != 8; ++i)
+			{
+				gen.movdqu(gen.ptr[rsp + i * 16], Xbyak::Xmm(i));
+			}
+			gen.mov(rdi, r11);
+			gen.lea(rsi, gen.ptr[rbp + 8]);
+			gen.mov(rdx, reinterpret_cast<uint64_t>(exitThunk));
+			gen.mov(rax, reinterpret_cast<uint64_t>(profileEnter));
+			gen.call(rax);
+			for (int i = 0; i != 8; ++i)
+			{
+				gen.movdqu(Xbyak::Xmm(i), gen.ptr[rsp + i * 16]);
+			}
+			gen.lea(rsp, gen.ptr[rbp - 8 * 8]);
+			gen.pop(rax);
+			gen.pop(r10);
+			gen.pop(r9);
+			gen.pop(r8);
+			gen.pop(rcx);
+			gen.pop(rdx);
+			gen.pop(rsi);
+			gen.pop(rdi);
+			gen.pop(rbp);
+			gen.jmp(r10);
+
+			m_profileEnter = enterThunk;
+		}
+		catch (const Xbyak::Error &e)
+		{
+			LOG_ERR("generate profile thunk failed: %s", e.what());
+			break;
+		}
+
+		ret = true;
+	} while (false);
+
+	return ret;
+}
+
+bool FuncStubManager::dumpProfile(std::string const &fileName) const
 {
-	return generate(message, (void*)trapDebugger);
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	bool retVal = false;
+	do
+	{
+		using ProfileEntry = std::pair<const std::string *, const StubProfile *>;
+
+		std::vector<ProfileEntry> entries;
+		entries.reserve(m_profiles.size());
+		for (auto &profile : m_profiles)
+		{
+			entries.emplace_back(&profile.first, &profile.second);
+		}
+
+		std::sort(entries.begin(), entries.end(),
+				  [](ProfileEntry const &a, ProfileEntry const &b)
+				  { return a.second->calls.load() > b.second->calls.load(); });
+
+		std::ofstream ofs;
+		ofs.open(fileName);
+
+		if (!ofs.is_open())
+		{
+			LOG_ERR("Failed to open file: %s", fileName.c_str());
+			break;
+		}
+
+		// cycles are only counted with MODSYS_STUB_PROFILE_TIME
+		ofs << "calls cycles function\n";
+		for (auto &entry : entries)
+		{
+			auto line = fmt::format("{} {} {}\n",
+									entry.second->calls.load(),
+									entry.second->cycles.load(),
+									*entry.first);
+			ofs << line;
+		}
+
+		retVal = true;
+	} while (false);
+
+	return retVal;
 }
 
 FuncStubManager *GetFuncStubManager() 
 { 
-	static FuncStubGenerator generator = {};
-	static JitFunctionPool pool        = {generator.size(), 5000};
-	static FuncStubManager manager     = { &pool, &generator };
+	static FuncStubManager manager = {};
 	
 	return &manager;
 }
@@ -3,22 +3,31 @@
 #include "GPCS4Common.h"
 #include "Platform.h"
 
+#include <atomic>
+#include <deque>
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <mutex>
+#include <unordered_map>
 
+// Executable memory for small generated functions, grows by chunks on demand.
+// Functions are written through the writable view of a chunk
+// and called through its executable view, see plat::DualMapping.
 class JitFunctionPool
 {
 public:
-	JitFunctionPool(size_t funcSize, size_t funcNum);
-	uint8_t *newFunctionMemory();
-	uint8_t *getFunctionMemory(size_t index);
+	JitFunctionPool(size_t funcSize);
+
+	// Returns the executable address of a new function,
+	// whose code must be written to *writable.
+	uint8_t *newFunctionMemory(uint8_t **writable);
 
 private:
-	plat::memory_ptr m_memory;
+	std::mutex m_mutex;
+	std::vector<plat::DualMapping> m_chunks;
 	const size_t m_funcSize;
-	size_t m_funcNum;
-	size_t m_totalSize;
+	const size_t m_funcNum;
 	size_t m_index;
 };
 
@@ -44,16 +53,68 @@ private:
 	const static std::vector<uint8_t> funcTemplate;
 };
 
+struct StubProfile
+{
+	std::atomic<uint64_t> calls  = { 0 };
+	std::atomic<uint64_t> cycles = { 0 };
+};
+
+// Counts calls of a function and jumps to it, only used with MODSYS_STUB_PROFILE.
+// With MODSYS_STUB_PROFILE_TIME, it enters the profile thunk instead.
+class CallCounterGenerator
+{
+public:
+	CallCounterGenerator() = default;
+	bool attach(void *memory);
+	void patchProfile(StubProfile *profile);
+	void patchDestPointer(const void *destPointer);
+	void patchProfileThunk(const void *thunk);
+	size_t size() const;
+
+private:
+	template <typename T>
+	void patch(size_t offset, T value)
+	{
+		auto ptr = reinterpret_cast<T *>(&m_memory[offset]);
+		*ptr     = value;
+	}
+
+	uint8_t *m_memory;
+	const static std::vector<uint8_t> funcTemplate;
+};
+
 class FuncStubManager
 {
 public:
-	FuncStubManager(JitFunctionPool *pool, FuncStubGenerator *funcStub);
-	void *generate(std::string const &message, void *dest);
-	void *generateUnknown(std::string const &message);
+	FuncStubManager();
+
+	// name identifies the function in the profile,
+	// message is logged on every call with MODSYS_STUB_LOG_CALLS.
+	void *generate(std::string const &name, std::string const &message, void *dest);
+	// message is always logged, before trapping the debugger.
+	void *generateUnknown(std::string const &name, std::string const &message);
+
+	// Writes call counts of all stubbed functions, the most called first.
+	// Nothing is counted without MODSYS_STUB_PROFILE.
+	bool dumpProfile(std::string const &fileName) const;
+
+private:
+	void *generateLogStub(std::string const &message, void *dest);
+	void *generateCounterStub(std::string const &name, void *dest);
+	bool generateProfileThunks();
+
 private:
-	std::vector<std::string> m_messageList;
-	JitFunctionPool *m_pool;
-	FuncStubGenerator *m_stub;
+	// Stubs are generated while modules relocate in parallel,
+	// and on first call with lazy binding.
+	mutable std::mutex m_mutex;
+	// deque never moves the strings the stubs point to
+	std::deque<std::string> m_messageList;
+	std::unordered_map<std::string, StubProfile> m_profiles;
+	FuncStubGenerator m_logStub;
+	CallCounterGenerator m_counterStub;
+	JitFunctionPool m_pool;
+	plat::DualMapping m_profileThunks;
+	const uint8_t *m_profileEnter = nullptr;
 };
 
 FuncStubManager *GetFuncStubManager();
@@ -1,8 +1,12 @@
 #include "ModuleLoader.h"
 
 #include "UtilString.h"
+#include "UtilThreadPool.h"
 #include "Platform.h"
 
+#include <algorithm>
+#include <chrono>
+
 LOG_CHANNEL(Loader.ModuleLoader);
 
 #define ADD_BLACK_MODULE(name) (name".sprx")
@@ -23,10 +27,18 @@ ModuleLoader::ModuleLoader(CSceModuleSystem &modSystem,
 {
 }
 
+void ModuleLoader::setParallelLoading(bool enable)
+{
+	m_parallelLoading = enable;
+}
+
 bool ModuleLoader::loadModule(std::string const &fileName,
 							  NativeModule **modOut)
 {
+	using Clock = std::chrono::steady_clock;
+
 	bool retVal = false;
+	auto start  = Clock::now();
 	do
 	{
 		NativeModule mod = {};
@@ -38,15 +50,20 @@ bool ModuleLoader::loadModule(std::string const &fileName,
 			break;
 		}
 
+		retVal = addDepedenciesToLoad(mod);
+		if (!retVal)
+		{
+			break;
+		}
+
 // Output NIDs of functions that are not implemented in HLE.
 #ifdef MODSYS_OUTPUT_NOT_IMPLEMENTED_HLE
 		mod.outputUnresolvedSymbols("unresolved_HLE.txt");
 #endif // MODSYS_OUTPUT_NOT_IMPLEMENTED_HLE
 
-		retVal = m_modSystem.registerNativeModule(mod.fileName, std::move(mod));
+		retVal = registerModule(std::move(mod));
 		if (!retVal)
 		{
-			LOG_ERR("Failed to register module: %s", mod.fileName.c_str());
 			break;
 		}
 
@@ -56,18 +73,32 @@ bool ModuleLoader::loadModule(std::string const &fileName,
 			break;
 		}
 
-		retVal = m_linker.relocateModules();
+		auto loaded = Clock::now();
+		retVal      = m_linker.relocateModules();
 		if (!retVal)
 		{
 			break;
 		}
 
-		retVal = initializeModules();
+		auto relocated = Clock::now();
+		retVal         = initializeModules();
 		if (!retVal)
 		{
 			break;
 		}
 
+		// Everything the emulator does before the first instruction of the executable,
+		// enable the channel's debug output to see it.
+		auto initialized = Clock::now();
+		auto toMs        = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+		LOG_DEBUG("%zu modules, %s: load %.1f ms, relocate %.1f ms, init %.1f ms, total %.1f ms",
+				  m_modSystem.getAllNativeModules().size(),
+				  m_parallelLoading ? "parallel" : "serial",
+				  toMs(loaded - start),
+				  toMs(relocated - loaded),
+				  toMs(initialized - relocated),
+				  toMs(initialized - start));
+
 		*modOut = &(m_modSystem.getAllNativeModules()[0]);
 		retVal  = true;
 	} while (false);
@@ -101,57 +132,48 @@ bool ModuleLoader::loadModuleFromFile(std::string const &fileName,
 			break;
 		}
 
-		retVal = m_mapper.loadFile(fileName, mod);
-		if (!retVal)
-		{
-			break;
-		}
+		ELFMapper mapper;
 
-		retVal = m_mapper.validateHeader();
+		retVal = mapper.loadFile(fileName, mod);
 		if (!retVal)
 		{
 			break;
 		}
 
-		retVal = m_mapper.parseSegmentHeaders();
+		retVal = mapper.validateHeader();
 		if (!retVal)
 		{
 			break;
 		}
 
-		retVal = m_mapper.parseDynamicSection();
+		retVal = mapper.parseSegmentHeaders();
 		if (!retVal)
 		{
 			break;
 		}
 
-		retVal = m_mapper.mapImageIntoMemory();
+		retVal = mapper.parseDynamicSection();
 		if (!retVal)
 		{
 			break;
 		}
 
-		retVal = m_mapper.parseSymbols();
+		retVal = mapper.mapImageIntoMemory();
 		if (!retVal)
 		{
 			break;
 		}
 
-		retVal = addDepedenciesToLoad(*mod);
+		// Failing to patch is not fatal, unpatched code falls back to exception.
+		auto& info = mod->getModuleInfo();
+		TLSManager::GetInstance()->patchTLSAccess(info.pCodeAddr, info.nCodeSize);
+
+		retVal = mapper.parseSymbols();
 		if (!retVal)
 		{
 			break;
 		}
 
-		for (auto &id : mod->getExportSymbols())
-		{
-			const SymbolInfo *info = nullptr;
-			mod->getSymbol(id, &info);
-
-			registerSymbol(*mod, info->symbolName,
-						   reinterpret_cast<void *>(info->address));
-		}
-
 		retVal = true;
 	} while (false);
 
@@ -163,47 +185,99 @@ bool ModuleLoader::loadDependencies()
 	bool retVal = true;
 	bool moduleNotFoundIgnore = false;
 
-	while (!m_filesToLoad.empty())
+	// Files are loaded in waves, each one being the files needed
+	// by the previous wave. Modules don't depend on each other
+	// until relocation, so a whole wave is loaded in parallel.
+	// Registration stays on this thread, in queue order,
+	// which keeps module order and thus TLS indices stable.
+	while (!m_filesToLoad.empty() && retVal)
 	{
-		auto fileName = m_filesToLoad.front();
-		m_filesToLoad.pop();
+		std::vector<std::string> paths;
 
-		if (!m_modSystem.isFileAllowedToLoad(fileName))
+		while (!m_filesToLoad.empty())
 		{
-			LOG_DEBUG("File %s is not loadable", fileName.c_str());
-			continue;
-		}
+			auto fileName = m_filesToLoad.front();
+			m_filesToLoad.pop();
+
+			if (!m_modSystem.isFileAllowedToLoad(fileName))
+			{
+				LOG_DEBUG("File %s is not loadable", fileName.c_str());
+				continue;
+			}
+
+			std::string path = {};
 
-		std::string path = {};
+			retVal = mapModuleNameToFilePath(fileName, &path);
+			if (!retVal)
+			{
+				LOG_ERR("Unable to locate file %s", fileName.c_str());
+				break;
+			}
+
+			// Several modules of the previous wave may need the same file.
+			if (std::find(paths.begin(), paths.end(), path) == paths.end())
+			{
+				paths.push_back(std::move(path));
+			}
+		}
 
-		retVal = mapModuleNameToFilePath(fileName, &path);
 		if (!retVal)
 		{
-			LOG_ERR("Unable to locate file %s", fileName.c_str());
 			break;
 		}
 
-		bool exist = false;
-		auto mod = NativeModule{};
-		retVal   = loadModuleFromFile(path, &mod, &exist);
-		if (!retVal)
+		std::vector<NativeModule> mods(paths.size());
+		std::vector<uint8_t>      loaded(paths.size());
+		std::vector<uint8_t>      exists(paths.size());
+
+		auto load = [&](size_t i) {
+			bool exist = false;
+			loaded[i]  = loadModuleFromFile(paths[i], &mods[i], &exist);
+			exists[i]  = exist;
+		};
+
+		if (m_parallelLoading)
+		{
+			util::ThreadPool::shared().parallelFor(paths.size(), load);
+		}
+		else
 		{
-			LOG_ERR("Failed to load module %s", fileName.c_str());
+			for (size_t i = 0; i < paths.size(); i++)
+			{
+				load(i);
+			}
+		}
+
+		for (size_t i = 0; i < mods.size(); i++)
+		{
+			auto &mod = mods[i];
+			if (!loaded[i])
+			{
+				LOG_ERR("Failed to load module %s", paths[i].c_str());
 
 #ifdef MODSYS_IGNORE_NOT_FOUND_MODULES
-			moduleNotFoundIgnore = true;
-			continue;
+				moduleNotFoundIgnore = true;
+				continue;
 #else  // MODSYS_IGNORE_NOT_FOUND_MODULES
-			break;
+				retVal = false;
+				break;
 #endif // MODSYS_IGNORE_NOT_FOUND_MODULES
-		}
+			}
 
-		if (!exist)
-		{
-			retVal = m_modSystem.registerNativeModule(mod.fileName, std::move(mod));
+			if (exists[i])
+			{
+				continue;
+			}
+
+			retVal = addDepedenciesToLoad(mod);
+			if (!retVal)
+			{
+				break;
+			}
+
+			retVal = registerModule(std::move(mod));
 			if (!retVal)
 			{
-				LOG_ERR("Failed to register module: %s", mod.fileName.c_str());
 				break;
 			}
 		}
@@ -277,30 +351,34 @@ bool ModuleLoader::mapFilePathToModuleName(std::string const &filePath,
 	return retVal;
 }
 
-bool ModuleLoader::registerSymbol(NativeModule const &mod,
-								  std::string const &encName,
-								  void *pointer)
+bool ModuleLoader::registerModule(NativeModule &&mod)
 {
 	bool retVal = false;
 	do
 	{
-		std::string modName = {};
-		std::string libName = {};
-		uint64_t nid        = 0;
+		std::string fileName = mod.fileName;
 
-		retVal = mod.getExportSymbolInfo(encName, &modName, &libName, &nid);
+		retVal = m_modSystem.registerNativeModule(fileName, std::move(mod));
 		if (!retVal)
 		{
+			LOG_ERR("Failed to register module: %s", fileName.c_str());
 			break;
 		}
 
-		retVal = m_modSystem.registerNativeSymbol(modName, libName, nid, pointer);
+		// Export symbols only once the module is owned by the module system,
+		// a module that fails to load must not leave symbols behind.
+		NativeModule *registered = nullptr;
+		retVal = m_modSystem.getNativeModule(fileName, &registered);
 		if (!retVal)
 		{
 			break;
 		}
 
-		retVal = true;
+		// Names were decoded once by parseSymbols.
+		for (auto &id : registered->getExportSymbols())
+		{
+			registerSymbol(*registered, id);
+		}
 	} while (false);
 
 	return retVal;
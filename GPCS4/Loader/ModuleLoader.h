@@ -17,6 +17,10 @@ class ModuleLoader
 public:
 	ModuleLoader(CSceModuleSystem &modSystem, CLinker &linker);
 	bool loadModule(std::string const &fileName, NativeModule **mod);
+
+	// Load the files of a dependency wave on the shared thread pool, which is the default.
+	// Turned off, files are loaded one after another, to compare load times.
+	void setParallelLoading(bool enable);
 private:
 	bool loadModuleFromFile(std::string const &fileName,
 							NativeModule *mod,
@@ -27,9 +31,7 @@ private:
 	bool mapFilePathToModuleName(std::string const &filePath,
 								 std::string *modName);
 
-	bool registerSymbol(NativeModule const &mod,
-						std::string const &encName,
-						void *pointer);
+	bool registerModule(NativeModule &&mod);
 	bool registerSymbol(NativeModule const &mod, size_t idx);
 	bool initializeModules();
 
@@ -37,7 +39,7 @@ private:
 	std::queue<std::string> m_filesToLoad;
 	CSceModuleSystem &m_modSystem;
 	CLinker &m_linker;
-	ELFMapper m_mapper;
+	bool m_parallelLoading = true;
 
 	// init_proc of modules in this black list will not be called.
 	const static std::set<std::string> m_moduleInitBlackList;
@@ -1,6 +1,13 @@
 #include "PlatFile.h"
 #include <fstream>
 
+#ifndef GPCS4_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  //GPCS4_WINDOWS
+
 namespace plat
 {;
 
@@ -70,17 +77,171 @@ bool StoreFile(const std::string& strFilename, const std::vector<uint8_t>& vtDat
 }
 
 
+FileMapping::~FileMapping()
+{
+	close();
+}
+
+FileMapping::FileMapping(FileMapping&& other) noexcept :
+	m_pView(other.m_pView),
+	m_nSize(other.m_nSize)
+{
+	other.m_pView = nullptr;
+	other.m_nSize = 0;
+}
+
+FileMapping& FileMapping::operator=(FileMapping&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		m_pView       = other.m_pView;
+		m_nSize       = other.m_nSize;
+		other.m_pView = nullptr;
+		other.m_nSize = 0;
+	}
+	return *this;
+}
+
+
 #ifdef GPCS4_WINDOWS
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #undef WIN32_LEAN_AND_MEAN
 
+bool FileMapping::open(const std::string& strFilename)
+{
+	bool   bRet     = false;
+	HANDLE hFile    = INVALID_HANDLE_VALUE;
+	HANDLE hMapping = nullptr;
+	do
+	{
+		close();
+
+		if (strFilename.empty())
+		{
+			break;
+		}
+
+		hFile = CreateFileA(strFilename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+							nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE)
+		{
+			break;
+		}
+
+		LARGE_INTEGER nFileSize = {};
+		// Empty files can't be mapped.
+		if (!GetFileSizeEx(hFile, &nFileSize) || nFileSize.QuadPart == 0)
+		{
+			break;
+		}
+
+		hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!hMapping)
+		{
+			break;
+		}
+
+		// The view keeps the mapping object alive,
+		// no need to hold the handles.
+		void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+		if (!pView)
+		{
+			break;
+		}
+
+		m_pView = reinterpret_cast<const uint8_t*>(pView);
+		m_nSize = static_cast<size_t>(nFileSize.QuadPart);
+
+		bRet = true;
+	} while (false);
+
+	if (hMapping)
+	{
+		CloseHandle(hMapping);
+	}
+
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hFile);
+	}
 
+	return bRet;
+}
 
+void FileMapping::close()
+{
+	if (m_pView)
+	{
+		UnmapViewOfFile(m_pView);
+	}
+
+	m_pView = nullptr;
+	m_nSize = 0;
+}
 
 #else
 
+bool FileMapping::open(const std::string& strFilename)
+{
+	bool bRet = false;
+	int  fd   = -1;
+	do
+	{
+		close();
+
+		if (strFilename.empty())
+		{
+			break;
+		}
+
+		fd = ::open(strFilename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			break;
+		}
+
+		struct stat st = {};
+		// Empty files can't be mapped.
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			break;
+		}
+
+		// The mapping keeps the file alive,
+		// no need to hold the descriptor.
+		void* pView = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (pView == MAP_FAILED)
+		{
+			break;
+		}
+
+		m_pView = reinterpret_cast<const uint8_t*>(pView);
+		m_nSize = static_cast<size_t>(st.st_size);
+
+		bRet = true;
+	} while (false);
+
+	if (fd != -1)
+	{
+		::close(fd);
+	}
+
+	return bRet;
+}
+
+void FileMapping::close()
+{
+	if (m_pView)
+	{
+		munmap(const_cast<uint8_t*>(m_pView), m_nSize);
+	}
+
+	m_pView = nullptr;
+	m_nSize = 0;
+}
 
 #endif  //GPCS4_WINDOWS
 
@@ -28,4 +28,43 @@ struct FileCloser
 
 typedef std::unique_ptr<FILE, FileCloser> file_uptr;
 
+// Read only view of a whole file.
+// Pages are backed by the file itself instead of private memory,
+// so they are only loaded on access and the OS may drop them any time.
+class FileMapping
+{
+public:
+	FileMapping() = default;
+	~FileMapping();
+
+	FileMapping(FileMapping&& other) noexcept;
+	FileMapping& operator=(FileMapping&& other) noexcept;
+
+	FileMapping(const FileMapping&) = delete;
+	FileMapping& operator=(const FileMapping&) = delete;
+
+	bool open(const std::string& strFilename);
+
+	void close();
+
+	const uint8_t* data() const
+	{
+		return m_pView;
+	}
+
+	size_t size() const
+	{
+		return m_nSize;
+	}
+
+	bool empty() const
+	{
+		return m_nSize == 0;
+	}
+
+private:
+	const uint8_t* m_pView = nullptr;
+	size_t         m_nSize = 0;
+};
+
 }
@@ -1,5 +1,14 @@
 #include "PlatMemory.h"
 
+#ifdef GPCS4_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#endif  //GPCS4_LINUX
+
 LOG_CHANNEL(Platform.UtilMemory);
 
 namespace plat
@@ -7,6 +16,37 @@ namespace plat
 
 
 
+DualMapping::~DualMapping()
+{
+	close();
+}
+
+DualMapping::DualMapping(DualMapping&& other) noexcept :
+	m_pWritable(other.m_pWritable),
+	m_pExecutable(other.m_pExecutable),
+	m_nSize(other.m_nSize)
+{
+	other.m_pWritable   = nullptr;
+	other.m_pExecutable = nullptr;
+	other.m_nSize       = 0;
+}
+
+DualMapping& DualMapping::operator=(DualMapping&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		m_pWritable         = other.m_pWritable;
+		m_pExecutable       = other.m_pExecutable;
+		m_nSize             = other.m_nSize;
+		other.m_pWritable   = nullptr;
+		other.m_pExecutable = nullptr;
+		other.m_nSize       = 0;
+	}
+	return *this;
+}
+
+
 #ifdef GPCS4_WINDOWS
 
 #define WIN32_LEAN_AND_MEAN
@@ -175,6 +215,11 @@ void VMFree(void* pAddress)
 	VirtualFree(pAddress, 0, MEM_RELEASE);
 }
 
+bool VMDecommit(void* pAddress, size_t nSize)
+{
+	return VirtualFree(pAddress, nSize, MEM_DECOMMIT);
+}
+
 bool VMProtect(void* pAddress, size_t nSize, 
 	VM_PROTECT_FLAG nNewProtect, VM_PROTECT_FLAG* pOldProtect)
 {
@@ -210,9 +255,376 @@ bool VMQuery(void* pAddress, MemoryInformation* pInfo)
 }
 
 
+bool DualMapping::create(size_t nSize)
+{
+	bool   bRet     = false;
+	HANDLE hMapping = nullptr;
+	do
+	{
+		close();
+
+		if (nSize == 0)
+		{
+			break;
+		}
+
+		uint64_t nMapSize = nSize;
+		hMapping          = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_EXECUTE_READWRITE,
+											   static_cast<DWORD>(nMapSize >> 32),
+											   static_cast<DWORD>(nMapSize), nullptr);
+		if (!hMapping)
+		{
+			break;
+		}
+
+		// The views keep the mapping object alive,
+		// no need to hold the handle.
+		void* pWritable = MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, nSize);
+		if (!pWritable)
+		{
+			break;
+		}
+
+		void* pExecutable = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, nSize);
+		if (!pExecutable)
+		{
+			UnmapViewOfFile(pWritable);
+			break;
+		}
+
+		m_pWritable   = reinterpret_cast<uint8_t*>(pWritable);
+		m_pExecutable = reinterpret_cast<uint8_t*>(pExecutable);
+		m_nSize       = nSize;
+
+		bRet = true;
+	} while (false);
+
+	if (hMapping)
+	{
+		CloseHandle(hMapping);
+	}
+
+	return bRet;
+}
+
+void DualMapping::close()
+{
+	if (m_pWritable)
+	{
+		UnmapViewOfFile(m_pWritable);
+	}
+
+	if (m_pExecutable)
+	{
+		UnmapViewOfFile(m_pExecutable);
+	}
+
+	m_pWritable   = nullptr;
+	m_pExecutable = nullptr;
+	m_nSize       = 0;
+}
+
 #elif defined(GPCS4_LINUX)
 
-//TODO: Other platform implementation 
+// mmap knows no reserved but uncommitted memory. A reservation is mapped
+// without access, committing pages inside it changes their protection.
+// munmap needs the size VMFree isn't given, so allocations are kept here.
+static std::mutex                  g_allocationMutex;
+static std::map<uintptr_t, size_t> g_allocations;
+
+// GPCS4 flag to POSIX flag
+inline int GetProtectFlag(VM_PROTECT_FLAG nOldFlag)
+{
+	int nNewFlag = PROT_NONE;
+
+	if (nOldFlag & VMPF_CPU_READ)
+	{
+		nNewFlag |= PROT_READ;
+	}
+
+	if (nOldFlag & VMPF_CPU_WRITE)
+	{
+		nNewFlag |= PROT_READ | PROT_WRITE;
+	}
+
+	if (nOldFlag & VMPF_CPU_EXEC)
+	{
+		nNewFlag |= PROT_READ | PROT_EXEC;
+	}
+
+	return nNewFlag;
+}
+
+static void* MapAnonymous(void* pAddress, size_t nSize, int nProtect)
+{
+	// Fails if anything is mapped there already, like VirtualAlloc does.
+	int   nFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (pAddress ? MAP_FIXED_NOREPLACE : 0);
+	void* pAddr  = mmap(pAddress, nSize, nProtect, nFlags, -1, 0);
+	if (pAddr == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	// Kernels before 4.17 take the address as a hint only.
+	if (pAddress && pAddr != pAddress)
+	{
+		munmap(pAddr, nSize);
+		return nullptr;
+	}
+	return pAddr;
+}
+
+static void AddAllocation(void* pAddress, size_t nSize)
+{
+	std::lock_guard<std::mutex> lock(g_allocationMutex);
+	g_allocations[reinterpret_cast<uintptr_t>(pAddress)] = nSize;
+}
+
+void* VMAllocate(void* pAddress, size_t nSize, 
+	VM_ALLOCATION_TYPE nType, VM_PROTECT_FLAG nProtect)
+{
+	void* pMemory = nullptr;
+	do
+	{
+		int nProt = (nType & VMAT_COMMIT) ? GetProtectFlag(nProtect) : PROT_NONE;
+
+		// Like VirtualAlloc, the range is widened to whole pages.
+		uintptr_t nBegin = util::alignDown(reinterpret_cast<uintptr_t>(pAddress), VM_PAGE_SIZE);
+		uintptr_t nEnd   = util::align(reinterpret_cast<uintptr_t>(pAddress) + nSize, VM_PAGE_SIZE);
+
+		if (!(nType & VMAT_RESERVE))
+		{
+			// Commit inside an earlier reservation.
+			if (!pAddress || mprotect(reinterpret_cast<void*>(nBegin), nEnd - nBegin, nProt) != 0)
+			{
+				break;
+			}
+			pMemory = reinterpret_cast<void*>(nBegin);
+			break;
+		}
+
+		pMemory = MapAnonymous(reinterpret_cast<void*>(nBegin), nEnd - nBegin, nProt);
+		if (pMemory)
+		{
+			AddAllocation(pMemory, nEnd - nBegin);
+		}
+	} while (false);
+	return pMemory;
+}
+
+void* VMAllocateAlign(void* pAddress, size_t nSize, size_t nAlign, 
+	VM_ALLOCATION_TYPE nType, VM_PROTECT_FLAG nProtect)
+{
+
+#ifdef GPCS4_DEBUG
+	// See the Windows version.
+	const uint32_t debugAlign = 0x10000000;
+	nAlign                    = debugAlign;
+#endif
+
+	void* pAlignedAddr = nullptr;
+	do
+	{
+		// Map enough to hold an aligned range, then give back both ends.
+		nSize         = util::align(nSize, VM_PAGE_SIZE);
+		size_t nTotal = nSize + nAlign;
+		int    nProt  = (nType & VMAT_COMMIT) ? GetProtectFlag(nProtect) : PROT_NONE;
+		void*  pAddr  = mmap(pAddress, nTotal, nProt, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (pAddr == MAP_FAILED)
+		{
+			break;
+		}
+
+		uintptr_t nBegin   = reinterpret_cast<uintptr_t>(pAddr);
+		uintptr_t nAligned = util::align(nBegin, nAlign);
+		if (nAligned != nBegin)
+		{
+			munmap(pAddr, nAligned - nBegin);
+		}
+		if (nBegin + nTotal != nAligned + nSize)
+		{
+			munmap(reinterpret_cast<void*>(nAligned + nSize), nBegin + nTotal - nAligned - nSize);
+		}
+
+		pAlignedAddr = reinterpret_cast<void*>(nAligned);
+		AddAllocation(pAlignedAddr, nSize);
+	} while (false);
+
+	return pAlignedAddr;
+}
+
+void VMFree(void* pAddress)
+{
+	size_t nSize = 0;
+	{
+		std::lock_guard<std::mutex> lock(g_allocationMutex);
+		auto iter = g_allocations.find(reinterpret_cast<uintptr_t>(pAddress));
+		if (iter == g_allocations.end())
+		{
+			LOG_ERR("%p was not allocated by VMAllocate.", pAddress);
+			return;
+		}
+		nSize = iter->second;
+		g_allocations.erase(iter);
+	}
+	munmap(pAddress, nSize);
+}
+
+bool VMDecommit(void* pAddress, size_t nSize)
+{
+	// Mapping over the pages drops their content and keeps the range reserved.
+	void* pAddr = mmap(pAddress, nSize, PROT_NONE,
+					   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	return pAddr != MAP_FAILED;
+}
+
+bool VMProtect(void* pAddress, size_t nSize, 
+	VM_PROTECT_FLAG nNewProtect, VM_PROTECT_FLAG* pOldProtect)
+{
+	if (pOldProtect)
+	{
+		MemoryInformation info = {};
+		*pOldProtect           = VMQuery(pAddress, &info) ? info.nRegionProtect : VMPF_NOACCESS;
+	}
+	return mprotect(pAddress, nSize, GetProtectFlag(nNewProtect)) == 0;
+}
+
+bool VMQuery(void* pAddress, MemoryInformation* pInfo)
+{
+	bool ret = false;
+	do
+	{
+		FILE* pMaps = fopen("/proc/self/maps", "r");
+		if (!pMaps)
+		{
+			break;
+		}
+
+		// Lines are sorted by address. A free region reaches up to the next mapping.
+		// As VirtualQuery does, the region starts at the queried page.
+		uintptr_t nAddress = util::alignDown(reinterpret_cast<uintptr_t>(pAddress), VM_PAGE_SIZE);
+		uintptr_t nFreeEnd = UINTPTR_MAX;
+		bool      bMapped  = false;
+
+		char line[512];
+		while (fgets(line, sizeof(line), pMaps))
+		{
+			unsigned long long nBegin   = 0;
+			unsigned long long nEnd     = 0;
+			char               perms[5] = {};
+			if (sscanf(line, "%llx-%llx %4s", &nBegin, &nEnd, perms) != 3)
+			{
+				continue;
+			}
+
+			if (nEnd <= nAddress)
+			{
+				continue;
+			}
+
+			if (nBegin > nAddress)
+			{
+				nFreeEnd = nBegin;
+				break;
+			}
+
+			uint32_t nProtect = VMPF_NOACCESS;
+			nProtect |= perms[0] == 'r' ? VMPF_CPU_READ : 0;
+			nProtect |= perms[1] == 'w' ? VMPF_CPU_WRITE : 0;
+			nProtect |= perms[2] == 'x' ? VMPF_CPU_EXEC : 0;
+
+			pInfo->pRegionStart   = reinterpret_cast<void*>(nAddress);
+			pInfo->nRegionSize    = nEnd - nAddress;
+			pInfo->nRegionState   = nProtect == VMPF_NOACCESS ? VMRS_RESERVE : VMRS_COMMIT;
+			pInfo->nRegionProtect = static_cast<VM_PROTECT_FLAG>(nProtect);
+			bMapped               = true;
+			break;
+		}
+		fclose(pMaps);
+
+		if (!bMapped)
+		{
+			pInfo->pRegionStart   = reinterpret_cast<void*>(nAddress);
+			pInfo->nRegionSize    = nFreeEnd - nAddress;
+			pInfo->nRegionState   = VMRS_FREE;
+			pInfo->nRegionProtect = VMPF_NOACCESS;
+		}
+
+		ret = true;
+	} while (false);
+	return ret;
+}
+
+bool DualMapping::create(size_t nSize)
+{
+	bool bRet = false;
+	int  fd   = -1;
+	do
+	{
+		close();
+
+		if (nSize == 0)
+		{
+			break;
+		}
+
+		fd = memfd_create("gpcs4-dual-mapping", MFD_CLOEXEC);
+		if (fd == -1)
+		{
+			break;
+		}
+
+		if (ftruncate(fd, static_cast<off_t>(nSize)) != 0)
+		{
+			break;
+		}
+
+		// The views keep the memory file alive,
+		// no need to hold the descriptor.
+		void* pWritable = mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (pWritable == MAP_FAILED)
+		{
+			break;
+		}
+
+		void* pExecutable = mmap(nullptr, nSize, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+		if (pExecutable == MAP_FAILED)
+		{
+			munmap(pWritable, nSize);
+			break;
+		}
+
+		m_pWritable   = reinterpret_cast<uint8_t*>(pWritable);
+		m_pExecutable = reinterpret_cast<uint8_t*>(pExecutable);
+		m_nSize       = nSize;
+
+		bRet = true;
+	} while (false);
+
+	if (fd != -1)
+	{
+		::close(fd);
+	}
+
+	return bRet;
+}
+
+void DualMapping::close()
+{
+	if (m_pWritable)
+	{
+		munmap(m_pWritable, m_nSize);
+	}
+
+	if (m_pExecutable)
+	{
+		munmap(m_pExecutable, m_nSize);
+	}
+
+	m_pWritable   = nullptr;
+	m_pExecutable = nullptr;
+	m_nSize       = 0;
+}
 
 #endif  //GPCS4_WINDOWS
 
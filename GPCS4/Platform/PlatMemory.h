@@ -56,6 +56,10 @@ void* VMAllocateAlign(void* pAddress, size_t nSize, size_t nAlign,
 
 void VMFree(void* pAddress);
 
+// Decommit pages inside a reservation, the address range stays reserved
+// until the whole reservation is released by VMFree.
+bool VMDecommit(void* pAddress, size_t nSize);
+
 bool VMProtect(void* pAddress, size_t nSize, 
 	VM_PROTECT_FLAG nNewProtect, VM_PROTECT_FLAG* pOldProtect = nullptr);
 
@@ -75,4 +79,45 @@ struct MemoryUnMapper
 // auto release smart memory pointer
 typedef std::unique_ptr<uint8_t, MemoryUnMapper> memory_ptr;
 
+// Anonymous memory mapped at two addresses, a writable view and an executable view.
+// Code can be written through the writable view while other code in the same pages
+// is running, without any page ever being writable and executable.
+// Generated code must not use rip relative addressing across the views.
+class DualMapping
+{
+public:
+	DualMapping() = default;
+	~DualMapping();
+
+	DualMapping(DualMapping&& other) noexcept;
+	DualMapping& operator=(DualMapping&& other) noexcept;
+
+	DualMapping(const DualMapping&) = delete;
+	DualMapping& operator=(const DualMapping&) = delete;
+
+	bool create(size_t nSize);
+
+	void close();
+
+	uint8_t* writable() const
+	{
+		return m_pWritable;
+	}
+
+	uint8_t* executable() const
+	{
+		return m_pExecutable;
+	}
+
+	size_t size() const
+	{
+		return m_nSize;
+	}
+
+private:
+	uint8_t* m_pWritable   = nullptr;
+	uint8_t* m_pExecutable = nullptr;
+	size_t   m_nSize       = 0;
+};
+
 }
\ No newline at end of file
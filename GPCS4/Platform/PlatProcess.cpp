@@ -8,6 +8,7 @@ namespace plat
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <Psapi.h>
 #undef WIN32_LEAN_AND_MEAN
 
 uint64_t GetProcessTimeCounter()
@@ -57,6 +58,22 @@ uint64_t GetProcessTimeFrequency()
 	return nFreq;
 }
 
+size_t GetProcessResidentSize()
+{
+	size_t nSize = 0;
+	do 
+	{
+		PROCESS_MEMORY_COUNTERS stCounters = {};
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &stCounters, sizeof(stCounters)))
+		{
+			break;
+		}
+
+		nSize = stCounters.WorkingSetSize;
+	} while (false);
+	return nSize;
+}
+
 #else
 
 #endif  //GPCS4_WINDOWS
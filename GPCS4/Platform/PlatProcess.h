@@ -9,4 +9,7 @@ uint64_t GetProcessTimeCounter();
 
 uint64_t GetProcessTimeFrequency();
 
+// Bytes of the process's memory currently resident in physical memory.
+size_t GetProcessResidentSize();
+
 }
@@ -20,6 +20,36 @@ void ThreadYield()
 	SwitchToThread();
 }
 
+uint32_t RawTlsAlloc()
+{
+	DWORD index = TlsAlloc();
+	return index == TLS_OUT_OF_INDEXES ? RAW_TLS_INVALID_INDEX : index;
+}
+
+void RawTlsFree(uint32_t index)
+{
+	TlsFree(index);
+}
+
+void RawTlsSetValue(uint32_t index, void* value)
+{
+	TlsSetValue(index, value);
+}
+
+uint32_t RawTlsGetOffset(uint32_t index)
+{
+	// The first TLS_MINIMUM_AVAILABLE slots live inside the TEB,
+	// at TEB.TlsSlots (gs:[0x1480]) on x64.
+	// The expansion slots need an extra indirection, we don't support them.
+	const uint32_t tlsSlotsOffset = 0x1480;
+	uint32_t       offset         = 0;
+	if (index < TLS_MINIMUM_AVAILABLE)
+	{
+		offset = tlsSlotsOffset + index * sizeof(void*);
+	}
+	return offset;
+}
+
 
 #elif defined(GPCS4_LINUX)
 
@@ -35,6 +65,24 @@ void ThreadYield()
 
 }
 
+uint32_t RawTlsAlloc()
+{
+	return RAW_TLS_INVALID_INDEX;
+}
+
+void RawTlsFree(uint32_t index)
+{
+}
+
+void RawTlsSetValue(uint32_t index, void* value)
+{
+}
+
+uint32_t RawTlsGetOffset(uint32_t index)
+{
+	return 0;
+}
+
 #endif  //GPCS4_WINDOWS
 
 
@@ -9,4 +9,20 @@ uint64_t GetThreadId(void);
 
 void ThreadYield();
 
+// Raw thread local storage slot.
+// Unlike thread_local variables, the slot can be read by generated code
+// with a single segment-relative load, without calling any function.
+
+constexpr uint32_t RAW_TLS_INVALID_INDEX = 0xFFFFFFFF;
+
+uint32_t RawTlsAlloc();
+
+void RawTlsFree(uint32_t index);
+
+void RawTlsSetValue(uint32_t index, void* value);
+
+// Returns the gs relative offset of the slot,
+// or 0 if the slot can't be accessed directly.
+uint32_t RawTlsGetOffset(uint32_t index);
+
 }
@@ -6,7 +6,6 @@ LOG_CHANNEL(SceModules.SceLibkernel.tls);
 
 void* PS4API __tls_get_addr(tls_index *ti)
 {
-	LOG_SCE_DUMMY_IMPL();
 	auto tlsManager = TLSManager::GetInstance();
 	return tlsManager->tlsGetAddr(ti->ti_module, ti->ti_offset);
 }
\ No newline at end of file
@@ -4,6 +4,6 @@
 
 struct tls_index
 {
-	unsigned long ti_module;
-	unsigned long ti_offset;
+	uint64_t ti_module;
+	uint64_t ti_offset;
 };
\ No newline at end of file
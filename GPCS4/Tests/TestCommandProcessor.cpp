@@ -0,0 +1,238 @@
+#include "TestRunner.h"
+#include "Gnm/GnmCommandBufferDummy.h"
+#include "Gnm/GnmCommandProcessor.h"
+
+#include "Violet/VltCmdList.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace sce::Gnm;
+
+// Only the command processor is measured, every call it forwards lands here and does nothing.
+class GnmCommandBufferNull : public GnmCommandBufferDummy
+{
+public:
+	GnmCommandBufferNull() :
+		GnmCommandBufferDummy(nullptr)
+	{
+	}
+};
+
+struct CommandStream
+{
+	std::vector<uint32_t> dwords;
+	uint32_t              packetCount = 0;
+	uint32_t              drawCount   = 0;
+
+	void emit(IT_OpCodeType opcode, std::initializer_list<uint32_t> body)
+	{
+		emitHeader(PM4_HEADER_BUILD(body.size() + 1, opcode, 0), body);
+	}
+
+	void emitPrivate(IT_OpCodePriv priv, std::initializer_list<uint32_t> body)
+	{
+		emitHeader(PM4_HEADER_BUILD(body.size() + 1, IT_GNM_PRIVATE, priv), body);
+	}
+
+	void emitHeader(uint32_t header, std::initializer_list<uint32_t> body)
+	{
+		dwords.push_back(header);
+		dwords.insert(dwords.end(), body.begin(), body.end());
+		++packetCount;
+	}
+};
+
+// A stream shaped like what games submit: mostly register writes and user data,
+// with a draw every few dozen packets. Values are drawn from small sets,
+// so a good part of the writes is redundant, as it is in real frames.
+static CommandStream makeCommandStream(std::mt19937& rng, uint32_t packetCount)
+{
+	static const uint32_t contextRegs[] = {
+		OP_HINT_SET_DB_RENDER_CONTROL,
+		OP_HINT_SET_RENDER_TARGET_MASK,
+		OP_HINT_SET_PRIMITIVE_SETUP,
+		0x1E0,  // blend control of render target 0
+		0x1E1,
+	};
+
+	CommandStream stream;
+	while (stream.packetCount < packetCount)
+	{
+		uint32_t kind  = rng() % 100;
+		uint32_t value = rng() % 4;
+		if (kind < 35)
+		{
+			uint32_t reg = contextRegs[rng() % std::size(contextRegs)];
+			stream.emit(IT_SET_CONTEXT_REG, { reg, value });
+		}
+		else if (kind < 65)
+		{
+			// Vertex shader user data, the hint comes first in its own NOP packet.
+			uint32_t slot = rng() % 12;
+			if (rng() % 3)
+			{
+				stream.emit(IT_NOP, { OP_HINT_SET_USER_DATA_REGION });
+				stream.emit(IT_SET_SH_REG, { 0x0C + slot, value, value + 1, value + 2, value + 3 });
+			}
+			else
+			{
+				// The address is never dereferenced by the null command buffer.
+				uint64_t address = 0x100000000ull + value * 0x100;
+				stream.emit(IT_NOP, { OP_HINT_SET_VSHARP_IN_USER_DATA });
+				stream.emit(IT_SET_SH_REG, { 0x0C + slot, uint32_t(address), uint32_t(address >> 32) });
+			}
+		}
+		else if (kind < 80)
+		{
+			stream.emit(IT_NOP, { 0 });
+		}
+		else if (kind < 95)
+		{
+			switch (rng() % 4)
+			{
+			case 0:
+				stream.emitPrivate(OP_PRIV_SET_VGT_CONTROL, { value, 0 });
+				break;
+			case 1:
+				stream.emitPrivate(OP_PRIV_WAIT_UNTIL_SAFE_FOR_RENDERING, { 0, value, 0, 0, 0, 0 });
+				break;
+			default:
+				stream.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 3 * (value + 1), 0, 0, 0, 0, 0 });
+				++stream.drawCount;
+				break;
+			}
+		}
+		else if (rng() % 2)
+		{
+			stream.emit(IT_SET_UCONFIG_REG, { OP_HINT_SET_PRIMITIVE_TYPE_BASE, kPrimitiveTypeTriList });
+		}
+		else
+		{
+			stream.emit(IT_INDEX_TYPE, { value & 1 });
+		}
+	}
+
+	return stream;
+}
+
+GPCS4_BENCH(CommandProcessorPackets)
+{
+	constexpr uint32_t PacketCount = 1 << 20;
+	constexpr uint32_t LoopCount   = 20;
+
+	std::mt19937 rng(0x5EED);
+	auto         stream = makeCommandStream(rng, PacketCount);
+	uint32_t     size   = uint32_t(stream.dwords.size() * sizeof(uint32_t));
+
+	GnmCommandBufferNull commandBuffer;
+	GnmCommandProcessor  processor;
+	processor.attachCommandBuffer(&commandBuffer);
+
+	// Warm up, and take the statistics of a single pass.
+	processor.processCommandBuffer(stream.dwords.data(), size);
+	GnmStateStatistics stats = processor.stateStatistics();
+
+	double seconds = test::measureSeconds([&]
+	{
+		for (uint32_t i = 0; i != LoopCount; ++i)
+		{
+			processor.processCommandBuffer(stream.dwords.data(), size);
+		}
+	});
+
+	double packets = double(stream.packetCount) * LoopCount;
+	printf("  %u packets, %u draws, %u bytes, %u runs\n", stream.packetCount, stream.drawCount, size, LoopCount);
+	printf("  %8.1f Mpackets/s %8.1f MB/s %8.1f ns/packet\n",
+		   packets / seconds / 1e6,
+		   double(size) * LoopCount / seconds / 1e6,
+		   seconds * 1e9 / packets);
+	printf("  register packets %llu, redundant %llu\n",
+		   static_cast<unsigned long long>(stats.registerPackets),
+		   static_cast<unsigned long long>(stats.redundantPackets));
+	return true;
+}
+
+// The viewport call is a pair of packets, a command buffer
+// ending after the first one must not be read past its end.
+GPCS4_TEST(CommandProcessorViewportAtEnd)
+{
+	CommandStream stream;
+	stream.emit(IT_SET_CONTEXT_REG, { 0xB4, 0, 0x3F800000 });
+	uint32_t size = uint32_t(stream.dwords.size() * sizeof(uint32_t));
+
+	// Nothing follows the packet in memory either.
+	std::unique_ptr<uint32_t[]> buffer(new uint32_t[stream.dwords.size()]);
+	std::copy(stream.dwords.begin(), stream.dwords.end(), buffer.get());
+
+	GnmCommandBufferNull commandBuffer;
+	GnmCommandProcessor  processor;
+	processor.attachCommandBuffer(&commandBuffer);
+
+	// The second time the registers are unchanged, but without the transform packet
+	// the pair can't be known to be redundant.
+	processor.processCommandBuffer(buffer.get(), size);
+	processor.processCommandBuffer(buffer.get(), size);
+
+	GnmStateStatistics stats = processor.stateStatistics();
+	TEST_CHECK(stats.registerPackets == 2);
+	TEST_CHECK(stats.redundantPackets == 0);
+	return true;
+}
+
+static void emitIndirectBuffer(CommandStream& stream, IT_OpCodeType opcode, const CommandStream& buffer)
+{
+	uint64_t address = reinterpret_cast<uintptr_t>(buffer.dwords.data());
+	stream.emit(opcode, { uint32_t(address), uint32_t(address >> 32), uint32_t(buffer.dwords.size()) });
+}
+
+// Indirect buffers run in place of their packet, on either engine, one level deep.
+GPCS4_TEST(CommandProcessorIndirectBuffers)
+{
+	uint32_t dumped[4] = {};
+	uint64_t dumpAddr  = reinterpret_cast<uintptr_t>(dumped);
+
+	// The called draw buffer tries to call itself, which is one level too deep.
+	CommandStream calledDcb;
+	calledDcb.dwords.reserve(64);
+	calledDcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 3, 0, 0, 0, 0, 0 });
+	calledDcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 6, 0, 0, 0, 0, 0 });
+	emitIndirectBuffer(calledDcb, IT_INDIRECT_BUFFER, calledDcb);
+
+	CommandStream dcb;
+	dcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 3, 0, 0, 0, 0, 0 });
+	emitIndirectBuffer(dcb, IT_INDIRECT_BUFFER, calledDcb);
+	dcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 3, 0, 0, 0, 0, 0 });
+
+	// The called constant buffer fills the constant RAM, the caller dumps it again after the call.
+	CommandStream calledCcb;
+	calledCcb.emit(IT_WRITE_CONST_RAM, { 0, 0x11, 0x22 });
+	calledCcb.emit(IT_DUMP_CONST_RAM, { 0, 2, uint32_t(dumpAddr), uint32_t(dumpAddr >> 32) });
+
+	CommandStream ccb;
+	emitIndirectBuffer(ccb, IT_INDIRECT_BUFFER_CNST, calledCcb);
+	dumpAddr += 2 * sizeof(uint32_t);
+	ccb.emit(IT_DUMP_CONST_RAM, { 0, 2, uint32_t(dumpAddr), uint32_t(dumpAddr >> 32) });
+
+	GnmCommandBufferNull commandBuffer;
+	GnmCommandProcessor  processor;
+	processor.attachCommandBuffer(&commandBuffer);
+
+	const void* dcbs[]     = { dcb.dwords.data() };
+	uint32_t    dcbSizes[] = { uint32_t(dcb.dwords.size() * sizeof(uint32_t)) };
+	const void* ccbs[]     = { ccb.dwords.data() };
+	uint32_t    ccbSizes[] = { uint32_t(ccb.dwords.size() * sizeof(uint32_t)) };
+	processor.processCommandBuffers(1, dcbs, dcbSizes, ccbs, ccbSizes);
+
+	GnmStateStatistics stats = processor.stateStatistics();
+	TEST_CHECK(stats.drawCount == 4);
+	TEST_CHECK(stats.indirectBufferCount == 2);
+	TEST_CHECK(stats.skippedIndirectBufferCount == 1);
+	TEST_CHECK(dumped[0] == 0x11 && dumped[1] == 0x22);
+	TEST_CHECK(dumped[2] == 0x11 && dumped[3] == 0x22);
+	return true;
+}
@@ -0,0 +1,144 @@
+#include "TestRunner.h"
+#include "Gnm/GnmCapture.h"
+#include "Gnm/GnmCommandBufferDummy.h"
+#include "Gnm/GnmCommandProcessor.h"
+
+#include "Violet/VltCmdList.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <initializer_list>
+#include <iterator>
+
+using namespace sce::Gnm;
+
+// Packets written straight into guest memory, where the capture reads them from.
+struct GuestPacketWriter
+{
+	uint32_t* begin;
+	uint32_t* cursor;
+
+	explicit GuestPacketWriter(void* memory) :
+		begin(reinterpret_cast<uint32_t*>(memory)),
+		cursor(begin)
+	{
+	}
+
+	void emit(IT_OpCodeType opcode, std::initializer_list<uint32_t> body)
+	{
+		emitHeader(PM4_HEADER_BUILD(body.size() + 1, opcode, 0), body);
+	}
+
+	void emitPrivate(IT_OpCodePriv priv, std::initializer_list<uint32_t> body)
+	{
+		emitHeader(PM4_HEADER_BUILD(body.size() + 1, IT_GNM_PRIVATE, priv), body);
+	}
+
+	void emitHeader(uint32_t header, std::initializer_list<uint32_t> body)
+	{
+		*cursor++ = header;
+		for (uint32_t dword : body)
+		{
+			*cursor++ = dword;
+		}
+	}
+
+	uint32_t sizeInBytes() const
+	{
+		return uint32_t((cursor - begin) * sizeof(uint32_t));
+	}
+};
+
+static uint32_t lowPart(const void* address)
+{
+	return uint32_t(reinterpret_cast<uintptr_t>(address));
+}
+
+static uint32_t highPart(const void* address)
+{
+	return uint32_t(reinterpret_cast<uintptr_t>(address) >> 32);
+}
+
+// Only the processor is checked, every call it forwards lands here and does nothing.
+class GnmCommandBufferCaptureNull : public GnmCommandBufferDummy
+{
+public:
+	GnmCommandBufferCaptureNull() :
+		GnmCommandBufferDummy(nullptr)
+	{
+	}
+};
+
+// A submission is captured, run live, and its guest memory released.
+// Replaying the capture maps the memory back at the same address
+// and must give what the live run gave, loop after loop.
+GPCS4_TEST(GnmCaptureRoundTrip)
+{
+	constexpr size_t   GuestSize   = 0x10000;
+	constexpr uint32_t LoopCount   = 3;
+	const uint32_t     constants[] = { 0x11, 0x22, 0x33, 0x44 };
+
+	// The replayer maps guest memory in 64KB units, so nothing else may live there.
+	uint8_t* guest = reinterpret_cast<uint8_t*>(plat::VMAllocateAlign(nullptr, GuestSize, GuestSize,
+																	   plat::VMAT_RESERVE_COMMIT, plat::VMPF_CPU_RW));
+	TEST_CHECK(guest != nullptr);
+
+	GuestPacketWriter calledDcb(guest + 0x1000);
+	calledDcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 3, 0, 0, 0, 0, 0 });
+	calledDcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 6, 0, 0, 0, 0, 0 });
+
+	GuestPacketWriter dcb(guest);
+	dcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 3, 0, 0, 0, 0, 0 });
+	dcb.emit(IT_INDIRECT_BUFFER, { lowPart(calledDcb.begin), highPart(calledDcb.begin), calledDcb.sizeInBytes() / 4 });
+	dcb.emitPrivate(OP_PRIV_DRAW_INDEX_AUTO, { 3, 0, 0, 0, 0, 0 });
+
+	// The constant engine copies the constants through its RAM into the dump area.
+	uint32_t* source = reinterpret_cast<uint32_t*>(guest + 0x3000);
+	uint32_t* dump   = reinterpret_cast<uint32_t*>(guest + 0x3100);
+	std::copy(std::begin(constants), std::end(constants), source);
+
+	GuestPacketWriter ccb(guest + 0x2000);
+	ccb.emit(IT_LOAD_CONST_RAM, { lowPart(source), highPart(source), 4, 0 });
+	ccb.emit(IT_DUMP_CONST_RAM, { 0, 4, lowPart(dump), highPart(dump) });
+
+	auto fileName = (std::filesystem::temp_directory_path() / "gpcs4_capture_test.pm4c").string();
+
+	const void* dcbs[]     = { dcb.begin };
+	uint32_t    dcbSizes[] = { dcb.sizeInBytes() };
+	const void* ccbs[]     = { ccb.begin };
+	uint32_t    ccbSizes[] = { ccb.sizeInBytes() };
+
+	GnmCaptureWriter writer;
+	TEST_CHECK(writer.open(fileName));
+	writer.captureSubmit(1, dcbs, dcbSizes, ccbs, ccbSizes, 0, 0, 0, 0);
+	writer.close();
+
+	GnmCommandBufferCaptureNull commandBuffer;
+	GnmCommandProcessor         processor;
+	processor.attachCommandBuffer(&commandBuffer);
+	processor.processCommandBuffers(1, dcbs, dcbSizes, ccbs, ccbSizes);
+	GnmStateStatistics live = processor.stateStatistics();
+	TEST_CHECK(live.drawCount == 4);
+	TEST_CHECK(live.indirectBufferCount == 1);
+	TEST_CHECK(std::equal(std::begin(constants), std::end(constants), dump));
+
+	plat::VMFree(guest);
+
+	// The dump area is restored empty, as it was captured, before every loop.
+	GnmReplayStatistics replayed = {};
+	{
+		GnmCaptureReplayer replayer;
+		TEST_CHECK(replayer.open(fileName));
+		TEST_CHECK(replayer.replay(LoopCount, &replayed));
+		TEST_CHECK(std::equal(std::begin(constants), std::end(constants), dump));
+	}
+	std::remove(fileName.c_str());
+
+	TEST_CHECK(replayed.submitCount == LoopCount);
+	TEST_CHECK(replayed.commandBytes == uint64_t(dcbSizes[0] + ccbSizes[0]) * LoopCount);
+	TEST_CHECK(replayed.state.drawCount == live.drawCount * LoopCount);
+	TEST_CHECK(replayed.state.indirectBufferCount == live.indirectBufferCount * LoopCount);
+	TEST_CHECK(replayed.state.skippedIndirectBufferCount == 0);
+	return true;
+}
@@ -0,0 +1,160 @@
+#include "TestRunner.h"
+#include "Gnm/GpuAddress/GnmGpuAddressInternal.h"
+#include "UtilCpu.h"
+
+#include <random>
+#include <vector>
+
+using namespace sce;
+using namespace sce::GpuAddress;
+
+struct SwizzleKernelSet
+{
+	const char*            name;
+	util::cpu::CpuFeatures features;
+};
+
+// The baseline kernels always run, the host's too if it has any better ones.
+static std::vector<SwizzleKernelSet> getSwizzleKernelSets()
+{
+	std::vector<SwizzleKernelSet> sets = { { "element", util::cpu::CpuFeatures() } };
+	if (util::cpu::features().avx2)
+	{
+		sets.push_back({ "avx2", util::cpu::features() });
+	}
+	return sets;
+}
+
+static std::vector<uint8_t> makeLinearData(std::mt19937& rng, size_t size)
+{
+	std::vector<uint8_t> data(size);
+	for (auto& byte : data)
+	{
+		byte = uint8_t(rng());
+	}
+	return data;
+}
+
+static bool checkSwizzleLayout(std::mt19937&                        rng,
+							   const std::vector<SwizzleKernelSet>& kernelSets,
+							   uint32_t                             elemStride,
+							   uint32_t                             numElements,
+							   Gnm::BufferSwizzleElementSize        swizzleSize,
+							   Gnm::BufferSwizzleStride             swizzleStride)
+{
+	uint64_t swizzledSize = 0;
+	TEST_CHECK(computeSwizzledBufferSize(Gnm::kGpuModeBase, &swizzledSize, elemStride, numElements, swizzleSize, swizzleStride) == kStatusSuccess);
+
+	auto linear = makeLinearData(rng, size_t(elemStride) * numElements);
+
+	// Nothing writes the padding of the last block, so every output starts from the same fill.
+	std::vector<uint8_t> expected(swizzledSize, 0xCD);
+	TEST_CHECK(swizzleBufferDataBytewise(Gnm::kGpuModeBase, expected.data(), linear.data(), elemStride, numElements, swizzleSize, swizzleStride) == kStatusSuccess);
+
+	std::vector<uint8_t> roundTrip(linear.size(), 0xCD);
+	TEST_CHECK(deswizzleBufferDataBytewise(Gnm::kGpuModeBase, roundTrip.data(), expected.data(), elemStride, numElements, swizzleSize, swizzleStride) == kStatusSuccess);
+	TEST_CHECK(roundTrip == linear);
+
+	for (const auto& kernelSet : kernelSets)
+	{
+		std::vector<uint8_t> swizzled(swizzledSize, 0xCD);
+		TEST_CHECK(swizzleBufferDataForCpu(kernelSet.features, Gnm::kGpuModeBase, swizzled.data(), linear.data(), elemStride, numElements, swizzleSize, swizzleStride) == kStatusSuccess);
+		TEST_CHECK(swizzled == expected);
+
+		std::vector<uint8_t> deswizzled(linear.size(), 0xCD);
+		TEST_CHECK(deswizzleBufferDataForCpu(kernelSet.features, Gnm::kGpuModeBase, deswizzled.data(), expected.data(), elemStride, numElements, swizzleSize, swizzleStride) == kStatusSuccess);
+		TEST_CHECK(deswizzled == linear);
+	}
+	return true;
+}
+
+// Every swizzle element size and index stride, every record size up to 64 bytes,
+// and every record count up to three blocks, so full, partial and single record blocks are all covered.
+GPCS4_TEST(GnmSwizzlerKernels)
+{
+	constexpr uint32_t MaxElemStride = 64;
+
+	std::mt19937 rng(0x5EED);
+	auto         kernelSets = getSwizzleKernelSets();
+	for (uint32_t sizeIndex = Gnm::kBufferSwizzleElementSize2; sizeIndex <= Gnm::kBufferSwizzleElementSize16; ++sizeIndex)
+	{
+		auto     swizzleSize = Gnm::BufferSwizzleElementSize(sizeIndex);
+		uint32_t elemSize    = 2 << sizeIndex;
+		for (uint32_t strideIndex = Gnm::kBufferSwizzleStride8; strideIndex <= Gnm::kBufferSwizzleStride64; ++strideIndex)
+		{
+			auto     swizzleStride = Gnm::BufferSwizzleStride(strideIndex);
+			uint32_t indexStride   = 8 << strideIndex;
+			for (uint32_t elemStride = elemSize; elemStride <= MaxElemStride; elemStride += elemSize)
+			{
+				for (uint32_t numElements = 1; numElements <= 3 * indexStride; ++numElements)
+				{
+					if (!checkSwizzleLayout(rng, kernelSets, elemStride, numElements, swizzleSize, swizzleStride))
+					{
+						printf("  element size %u, index stride %u, record size %u, %u records\n",
+							   elemSize, indexStride, elemStride, numElements);
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+GPCS4_BENCH(GnmSwizzlerThroughput)
+{
+	constexpr uint32_t ElemStride  = 32;
+	constexpr uint32_t NumElements = 1 << 16;
+	constexpr uint32_t LoopCount   = 20;
+
+	const auto swizzleStride = Gnm::kBufferSwizzleStride16;
+
+	std::mt19937 rng(0x5EED);
+	auto         kernelSets = getSwizzleKernelSets();
+	auto         linear     = makeLinearData(rng, size_t(ElemStride) * NumElements);
+	double       bytes      = double(linear.size()) * LoopCount;
+
+	printf("  %u records of %u bytes, index stride 16, MB/s of linear data\n", NumElements, ElemStride);
+	printf("  %-5s %-10s %10s %10s\n", "elem", "kernel", "swizzle", "deswizzle");
+	for (uint32_t sizeIndex = Gnm::kBufferSwizzleElementSize2; sizeIndex <= Gnm::kBufferSwizzleElementSize16; ++sizeIndex)
+	{
+		auto     swizzleSize  = Gnm::BufferSwizzleElementSize(sizeIndex);
+		uint64_t swizzledSize = 0;
+		computeSwizzledBufferSize(Gnm::kGpuModeBase, &swizzledSize, ElemStride, NumElements, swizzleSize, swizzleStride);
+
+		std::vector<uint8_t> swizzled(swizzledSize);
+		std::vector<uint8_t> deswizzled(linear.size());
+
+		auto measure = [&](auto&& swizzle, auto&& deswizzle, const char* name)
+		{
+			double swizzleSeconds = test::measureSeconds([&]
+			{
+				for (uint32_t i = 0; i != LoopCount; ++i)
+				{
+					swizzle(swizzled.data(), linear.data(), ElemStride, NumElements, swizzleSize, swizzleStride);
+				}
+			});
+			double deswizzleSeconds = test::measureSeconds([&]
+			{
+				for (uint32_t i = 0; i != LoopCount; ++i)
+				{
+					deswizzle(deswizzled.data(), swizzled.data(), ElemStride, NumElements, swizzleSize, swizzleStride);
+				}
+			});
+			test::doNotOptimize(deswizzled);
+			printf("  %-5u %-10s %10.1f %10.1f\n", 2u << sizeIndex, name, bytes / swizzleSeconds / 1e6, bytes / deswizzleSeconds / 1e6);
+		};
+
+		measure([](auto... args) { return swizzleBufferDataBytewise(Gnm::kGpuModeBase, args...); },
+				[](auto... args) { return deswizzleBufferDataBytewise(Gnm::kGpuModeBase, args...); },
+				"byte-wise");
+		for (const auto& kernelSet : kernelSets)
+		{
+			const auto& cpu = kernelSet.features;
+			measure([&](auto... args) { return swizzleBufferDataForCpu(cpu, Gnm::kGpuModeBase, args...); },
+					[&](auto... args) { return deswizzleBufferDataForCpu(cpu, Gnm::kGpuModeBase, args...); },
+					kernelSet.name);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,955 @@
+#include "TestRunner.h"
+#include "Gnm/GnmTexture.h"
+#include "Gnm/GpuAddress/GnmGpuAddress.h"
+#include "Gnm/GpuAddress/GnmGpuAddressInternal.h"
+#include "Gnm/GpuAddress/GnmTilerAVX512.h"
+#include "UtilCpu.h"
+#include "UtilThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <vector>
+
+using namespace sce;
+using namespace sce::GpuAddress;
+
+static TilingParameters makeTilingParameters(Gnm::TileMode tileMode,
+											 uint32_t      bitsPerElement,
+											 uint32_t      width,
+											 uint32_t      height,
+											 uint32_t      depth,
+											 uint32_t      numFragments)
+{
+	TilingParameters tp;
+	memset(&tp, 0, sizeof(tp));
+	tp.m_tileMode             = tileMode;
+	tp.m_minGpuMode           = Gnm::kGpuModeBase;
+	tp.m_linearWidth          = width;
+	tp.m_linearHeight         = height;
+	tp.m_linearDepth          = depth;
+	tp.m_numFragmentsPerPixel = numFragments;
+	tp.m_bitsPerFragment      = bitsPerElement;
+	return tp;
+}
+
+// The surface functions tile with the array mode computeSurfaceInfo() settles on,
+// which is not always the tile mode's own, e.g. for 128 bpp display surfaces.
+static bool correctTileMode(TilingParameters* tp, bool* outMacroTiled)
+{
+	SurfaceInfo info = {};
+	TEST_CHECK(computeSurfaceInfo(&info, tp) == kStatusSuccess);
+	TEST_CHECK(adjustTileMode(tp->m_minGpuMode, &tp->m_tileMode, tp->m_tileMode, info.m_arrayMode) == kStatusSuccess);
+	TEST_CHECK(isMacroTiled(info.m_arrayMode) || isMicroTiled(info.m_arrayMode));
+	*outMacroTiled = isMacroTiled(info.m_arrayMode);
+	return true;
+}
+
+// The tiled byte offset of every element, one element at a time, in the order the untiled data
+// stores them: slices, rows, columns, then fragments. This is what the block copies must match.
+static bool getElementOffsets(std::vector<uint64_t>* outOffsets, const TilingParameters& surfaceTp, const SurfaceRegion& region)
+{
+	TilingParameters tp         = surfaceTp;
+	bool             macroTiled = false;
+	TEST_CHECK(correctTileMode(&tp, &macroTiled));
+
+	Tiler1d tiler1d;
+	Tiler2d tiler2d;
+	TEST_CHECK((macroTiled ? tiler2d.init(&tp) : tiler1d.init(&tp)) == kStatusSuccess);
+
+	outOffsets->clear();
+	for (uint32_t z = region.m_front; z != region.m_back; ++z)
+	{
+		for (uint32_t y = region.m_top; y != region.m_bottom; ++y)
+		{
+			for (uint32_t x = region.m_left; x != region.m_right; ++x)
+			{
+				for (uint32_t f = 0; f != tp.m_numFragmentsPerPixel; ++f)
+				{
+					uint64_t offset = 0;
+					TEST_CHECK((macroTiled ? tiler2d.getTiledElementByteOffset(&offset, x, y, z, f)
+										   : tiler1d.getTiledElementByteOffset(&offset, x, y, z)) == kStatusSuccess);
+					outOffsets->push_back(offset);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static uint32_t regionPitch(const SurfaceRegion& region)
+{
+	return region.m_right - region.m_left;
+}
+
+static uint32_t regionSlicePitch(const SurfaceRegion& region)
+{
+	return regionPitch(region) * (region.m_bottom - region.m_top);
+}
+
+// Detiles and tiles the whole surface, an unaligned sub region, and the two halves
+// of the surface as one batch, and compares each against the per-element offsets.
+static bool checkTilerLayout(std::mt19937& rng, const TilingParameters& tp)
+{
+	const uint32_t elemBytes  = tp.m_bitsPerFragment / 8;
+	const uint32_t width      = tp.m_linearWidth;
+	const uint32_t height     = tp.m_linearHeight;
+	const uint32_t depth      = tp.m_linearDepth;
+	const uint32_t pixelBytes = elemBytes * tp.m_numFragmentsPerPixel;
+
+	uint64_t           tiledSize = 0;
+	Gnm::AlignmentType align     = 0;
+	TEST_CHECK(computeTiledSurfaceSize(&tiledSize, &align, &tp) == kStatusSuccess);
+
+	std::vector<uint8_t> tiled(tiledSize);
+	for (auto& byte : tiled)
+	{
+		byte = uint8_t(rng());
+	}
+
+	auto gather = [&](const SurfaceRegion& region, std::vector<uint8_t>* outUntiled)
+	{
+		std::vector<uint64_t> offsets;
+		if (!getElementOffsets(&offsets, tp, region))
+		{
+			return false;
+		}
+		outUntiled->resize(offsets.size() * elemBytes);
+		for (size_t i = 0; i != offsets.size(); ++i)
+		{
+			TEST_CHECK(offsets[i] + elemBytes <= tiled.size());
+			memcpy(outUntiled->data() + i * elemBytes, tiled.data() + offsets[i], elemBytes);
+		}
+		return true;
+	};
+
+	// Only the bytes of the region are compared, nothing else is written.
+	auto checkTiled = [&](const SurfaceRegion& region, const std::vector<uint8_t>& retiled)
+	{
+		std::vector<uint64_t> offsets;
+		if (!getElementOffsets(&offsets, tp, region))
+		{
+			return false;
+		}
+		for (auto offset : offsets)
+		{
+			TEST_CHECK(memcmp(retiled.data() + offset, tiled.data() + offset, elemBytes) == 0);
+		}
+		return true;
+	};
+
+	SurfaceRegion whole = { 0, 0, 0, width, height, depth };
+	SurfaceRegion inner = { 3, 5, 0, width - 2, height - 1, depth };
+	SurfaceRegion halves[] = {
+		{ 0, 0, 0, width, height / 2, depth },
+		{ 0, height / 2, 0, width, height, depth },
+	};
+
+	std::vector<uint8_t> expected;
+	TEST_CHECK(gather(whole, &expected));
+
+	std::vector<uint8_t> untiled(expected.size(), 0xCD);
+	TEST_CHECK(detileSurface(untiled.data(), tiled.data(), &tp) == kStatusSuccess);
+	TEST_CHECK(untiled == expected);
+
+	std::vector<uint8_t> retiled(tiled.size(), 0xCD);
+	TEST_CHECK(tileSurface(retiled.data(), expected.data(), &tp) == kStatusSuccess);
+	TEST_CHECK(checkTiled(whole, retiled));
+
+	std::vector<uint8_t> expectedInner;
+	TEST_CHECK(gather(inner, &expectedInner));
+
+	std::vector<uint8_t> untiledInner(expectedInner.size(), 0xCD);
+	TEST_CHECK(detileSurfaceRegion(untiledInner.data(), tiled.data(), &tp, &inner, regionPitch(inner), regionSlicePitch(inner)) == kStatusSuccess);
+	TEST_CHECK(untiledInner == expectedInner);
+
+	std::vector<uint8_t> retiledInner(tiled.size(), 0xCD);
+	TEST_CHECK(tileSurfaceRegion(retiledInner.data(), expectedInner.data(), &tp, &inner, regionPitch(inner), regionSlicePitch(inner)) == kStatusSuccess);
+	TEST_CHECK(checkTiled(inner, retiledInner));
+
+	// Both halves are laid out with the whole surface's pitches, each in its own buffer.
+	const size_t         sliceBytes = size_t(width) * height * pixelBytes;
+	std::vector<uint8_t> untiledHalves[2];
+	void*                untiledHalfPtrs[2];
+	const void*          untiledHalfConstPtrs[2];
+	for (uint32_t i = 0; i != 2; ++i)
+	{
+		untiledHalves[i].assign(sliceBytes * depth, 0xCD);
+		untiledHalfPtrs[i]      = untiledHalves[i].data();
+		untiledHalfConstPtrs[i] = untiledHalves[i].data();
+	}
+	TEST_CHECK(detileSurfaceRegions(untiledHalfPtrs, tiled.data(), &tp, halves, 2, width, width * height) == kStatusSuccess);
+
+	std::vector<uint8_t> retiledHalves(tiled.size(), 0xCD);
+	TEST_CHECK(tileSurfaceRegions(retiledHalves.data(), untiledHalfConstPtrs, &tp, halves, 2, width, width * height) == kStatusSuccess);
+	for (uint32_t i = 0; i != 2; ++i)
+	{
+		std::vector<uint8_t> expectedHalf;
+		TEST_CHECK(gather(halves[i], &expectedHalf));
+
+		// Each slice of a half only fills the start of a whole surface slice.
+		const size_t halfSliceBytes = size_t(regionSlicePitch(halves[i])) * pixelBytes;
+		for (uint32_t z = 0; z != depth; ++z)
+		{
+			TEST_CHECK(memcmp(untiledHalves[i].data() + z * sliceBytes,
+							  expectedHalf.data() + z * halfSliceBytes,
+							  halfSliceBytes) == 0);
+		}
+		TEST_CHECK(checkTiled(halves[i], retiledHalves));
+	}
+	return true;
+}
+
+// Every 1D and 2D tile mode the tilers have a fast path for, every element size, and every
+// fragment count of the depth modes, on a surface whose edges cut through micro and macro tiles.
+GPCS4_TEST(GnmTilerRegions)
+{
+	const Gnm::TileMode tileModes[] = {
+		Gnm::kTileModeDisplay_1dThin,
+		Gnm::kTileModeThin_1dThin,
+		Gnm::kTileModeDepth_1dThin,
+		Gnm::kTileModeThick_1dThick,
+		Gnm::kTileModeDisplay_2dThin,
+		Gnm::kTileModeThin_2dThin,
+		Gnm::kTileModeDepth_2dThin_64,
+		Gnm::kTileModeDepth_2dThin_256,
+		Gnm::kTileModeDepth_2dThin_1K,
+		Gnm::kTileModeThick_2dThick,
+	};
+
+	std::mt19937 rng(0x5EED);
+	for (auto tileMode : tileModes)
+	{
+		Gnm::MicroTileMode microTileMode;
+		Gnm::ArrayMode     arrayMode;
+		TEST_CHECK(getMicroTileMode(&microTileMode, tileMode) == kStatusSuccess);
+		TEST_CHECK(getArrayMode(&arrayMode, tileMode) == kStatusSuccess);
+
+		const bool     thick = getMicroTileThickness(arrayMode) > 1;
+		const uint32_t depth = thick ? 5 : 1;
+		for (uint32_t bitsPerElement : { 8u, 16u, 32u, 64u, 128u })
+		{
+			for (uint32_t numFragments : { 1u, 2u, 4u, 8u })
+			{
+				if (numFragments > 1 && (microTileMode != Gnm::kMicroTileModeDepth || !isMacroTiled(arrayMode)))
+				{
+					continue;
+				}
+
+				// Display tiling has no 128 bpp layout, the element index maps pairs of elements to one place.
+				if (bitsPerElement == 128 && microTileMode == Gnm::kMicroTileModeDisplay)
+				{
+					continue;
+				}
+
+				auto tp = makeTilingParameters(tileMode, bitsPerElement, 77, 45, depth, numFragments);
+				if (!checkTilerLayout(rng, tp))
+				{
+					printf("  tile mode 0x%02X, %u bits per element, %u fragments\n", tileMode, bitsPerElement, numFragments);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+GPCS4_BENCH(GnmTilerSurfaces)
+{
+	struct SurfaceSize
+	{
+		const char* name;
+		uint32_t    width;
+		uint32_t    height;
+	};
+
+	const SurfaceSize sizes[] = {
+		{ "1080p", 1920, 1080 },
+		{ "4K", 3840, 2160 },
+	};
+
+	const struct
+	{
+		const char*   name;
+		Gnm::TileMode tileMode;
+	} modes[] = {
+		{ "1d thin", Gnm::kTileModeThin_1dThin },
+		{ "1d depth", Gnm::kTileModeDepth_1dThin },
+		{ "2d display", Gnm::kTileModeDisplay_2dThin },
+		{ "2d thin", Gnm::kTileModeThin_2dThin },
+		{ "2d depth", Gnm::kTileModeDepth_2dThin_64 },
+	};
+
+	constexpr uint32_t BitsPerElement = 32;
+	constexpr uint32_t LoopCount      = 5;
+
+	printf("  %u bpp, ms per surface, %u threads in the pool\n", BitsPerElement, util::ThreadPool::shared().concurrency());
+	printf("  %-6s %-11s %12s %12s %12s %12s %12s\n", "size", "mode", "per-element", "detile 1t", "detile pool", "tile 1t", "tile pool");
+	for (const auto& size : sizes)
+	{
+		for (const auto& mode : modes)
+		{
+			auto tp = makeTilingParameters(mode.tileMode, BitsPerElement, size.width, size.height, 1, 1);
+
+			uint64_t           tiledSize = 0;
+			Gnm::AlignmentType align     = 0;
+			computeTiledSurfaceSize(&tiledSize, &align, &tp);
+
+			std::vector<uint8_t> tiled(tiledSize, 0x5A);
+			std::vector<uint8_t> untiled(size_t(size.width) * size.height * BitsPerElement / 8);
+			SurfaceRegion        region = { 0, 0, 0, size.width, size.height, 1 };
+
+			// The single-threaded path is the tiler itself, the pooled one splits the surface into bands.
+			TilingParameters tilerTp    = tp;
+			bool             macroTiled = false;
+			correctTileMode(&tilerTp, &macroTiled);
+
+			Tiler1d tiler1d;
+			Tiler2d tiler2d;
+			macroTiled ? tiler2d.init(&tilerTp) : tiler1d.init(&tilerTp);
+
+			auto measure = [&](auto&& func)
+			{
+				func();
+				double seconds = test::measureSeconds([&]
+				{
+					for (uint32_t i = 0; i != LoopCount; ++i)
+					{
+						func();
+					}
+				});
+				test::doNotOptimize(untiled);
+				test::doNotOptimize(tiled);
+				return seconds * 1000.0 / LoopCount;
+			};
+
+			double perElement = measure([&]
+			{
+				uint32_t* out = reinterpret_cast<uint32_t*>(untiled.data());
+				for (uint32_t y = 0; y != size.height; ++y)
+				{
+					for (uint32_t x = 0; x != size.width; ++x)
+					{
+						uint64_t offset = 0;
+						macroTiled ? tiler2d.getTiledElementByteOffset(&offset, x, y, 0, 0)
+								   : tiler1d.getTiledElementByteOffset(&offset, x, y, 0);
+						memcpy(out++, tiled.data() + offset, sizeof(uint32_t));
+					}
+				}
+			});
+			double detileSingle = measure([&]
+			{
+				macroTiled ? tiler2d.detileSurfaceRegion(untiled.data(), tiled.data(), &region, size.width, size.width * size.height)
+						   : tiler1d.detileSurfaceRegion(untiled.data(), tiled.data(), &region, size.width, size.width * size.height);
+			});
+			double detilePool = measure([&]
+			{
+				detileSurface(untiled.data(), tiled.data(), &tp);
+			});
+			double tileSingle = measure([&]
+			{
+				macroTiled ? tiler2d.tileSurfaceRegion(tiled.data(), untiled.data(), &region, size.width, size.width * size.height)
+						   : tiler1d.tileSurfaceRegion(tiled.data(), untiled.data(), &region, size.width, size.width * size.height);
+			});
+			double tilePool = measure([&]
+			{
+				tileSurface(tiled.data(), untiled.data(), &tp);
+			});
+
+			printf("  %-6s %-11s %12.2f %12.2f %12.2f %12.2f %12.2f\n",
+				   size.name, mode.name, perElement, detileSingle, detilePool, tileSingle, tilePool);
+		}
+	}
+	return true;
+}
+
+// Every micro tile kernel, with the AVX2 and AVX-512 versions next to the SSE2 one they replace.
+struct MicroTileKernel
+{
+	const char*   name;
+	uint32_t      bitsPerElement;
+	uint32_t      thickness;
+	MicroTileFunc tile[3];
+	MicroTileFunc detile[3];
+};
+
+static const char* const MicroTileIsaNames[] = { "SSE2", "AVX2", "AVX-512" };
+
+static const MicroTileKernel MicroTileKernels[] = {
+	{ "8bpp display", 8, 1, { tile8bppDisplaySse2 }, { detile8bppDisplaySse2 } },
+	{ "16bpp display", 16, 1, { tile16bppDisplaySse2 }, { detile16bppDisplaySse2 } },
+	{ "32bpp display", 32, 1, { tile32bppDisplaySse2, tile32bppDisplayAvx2 }, { detile32bppDisplaySse2 } },
+	{ "64bpp display", 64, 1, { tile64bppDisplaySse2, tile64bppDisplayAvx2, tile64bppDisplayAvx512 }, { detile64bppDisplaySse2, detile64bppDisplayAvx2, detile64bppDisplayAvx512 } },
+	{ "8bpp thin", 8, 1, { tile8bppThinSse2 }, { detile8bppThinSse2 } },
+	{ "16bpp thin", 16, 1, { tile16bppThinSse2, tile16bppThinAvx2 }, { detile16bppThinSse2 } },
+	{ "32bpp thin", 32, 1, { tile32bppThinSse2, tile32bppThinAvx2, tile32bppThinAvx512 }, { detile32bppThinSse2, detile32bppThinAvx2 } },
+	{ "64bpp thin", 64, 1, { tile64bppThinSse2, tile64bppThinAvx2, tile64bppThinAvx512 }, { detile64bppThinSse2, nullptr, detile64bppThinAvx512 } },
+	{ "128bpp thin", 128, 1, { tile128bppThinSse2, tile128bppThinAvx2 }, { detile128bppThinSse2 } },
+	{ "8bpp thick", 8, 4, { tile8bppThickSse2 }, { detile8bppThickSse2 } },
+	{ "16bpp thick", 16, 4, { tile16bppThickSse2 }, { detile16bppThickSse2 } },
+	{ "32bpp thick", 32, 4, { tile32bppThickSse2 }, { detile32bppThickSse2 } },
+	{ "64bpp thick", 64, 4, { tile64bppThickSse2 }, { detile64bppThickSse2 } },
+	{ "128bpp thick", 128, 4, { tile128bppThickSse2 }, { detile128bppThickSse2 } },
+};
+
+// Kernels of the instruction sets the host lacks are left out.
+static bool isMicroTileIsaSupported(uint32_t isa)
+{
+	const auto& cpu = util::cpu::features();
+	return isa == 0 || (isa == 1 && cpu.avx2) || (isa == 2 && cpu.avx512f);
+}
+
+// The kernels store to the tiled micro tile with aligned stores.
+struct MicroTileBuffers
+{
+	std::vector<uint8_t> linear;
+	std::vector<uint8_t> tiledStorage;
+	uint8_t*             tiled;
+
+	MicroTileBuffers(size_t linearSize, size_t tiledSize) :
+		linear(linearSize), tiledStorage(tiledSize + 64)
+	{
+		tiled = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(tiledStorage.data()) + 63) & ~uintptr_t(63));
+	}
+};
+
+GPCS4_TEST(GnmTilerKernels)
+{
+	// An odd pitch, so no source or destination row is aligned.
+	constexpr uint32_t Pitch      = 37;
+	constexpr uint32_t SlicePitch = Pitch * 9;
+
+	std::mt19937 rng(0x5EED);
+	for (const auto& kernel : MicroTileKernels)
+	{
+		const uint32_t   elemBytes = kernel.bitsPerElement / 8;
+		const size_t     tileBytes = size_t(64) * kernel.thickness * elemBytes;
+		MicroTileBuffers source(size_t(SlicePitch) * kernel.thickness * elemBytes, tileBytes);
+		for (auto& byte : source.linear)
+		{
+			byte = uint8_t(rng());
+		}
+		for (size_t i = 0; i != tileBytes; ++i)
+		{
+			source.tiled[i] = uint8_t(rng());
+		}
+
+		MicroTileBuffers expected(source.linear.size(), tileBytes);
+		memset(expected.tiled, 0xCD, tileBytes);
+		std::fill(expected.linear.begin(), expected.linear.end(), 0xCD);
+		kernel.tile[0](expected.tiled, source.linear.data(), Pitch, SlicePitch);
+		kernel.detile[0](expected.linear.data(), source.tiled, Pitch, SlicePitch);
+
+		for (uint32_t isa = 1; isa != 3; ++isa)
+		{
+			if (!isMicroTileIsaSupported(isa))
+			{
+				continue;
+			}
+
+			MicroTileBuffers result(source.linear.size(), tileBytes);
+			if (kernel.tile[isa])
+			{
+				memset(result.tiled, 0xCD, tileBytes);
+				kernel.tile[isa](result.tiled, source.linear.data(), Pitch, SlicePitch);
+				if (memcmp(result.tiled, expected.tiled, tileBytes) != 0)
+				{
+					printf("  %s tile, %s\n", kernel.name, MicroTileIsaNames[isa]);
+					return false;
+				}
+			}
+			if (kernel.detile[isa])
+			{
+				std::fill(result.linear.begin(), result.linear.end(), 0xCD);
+				kernel.detile[isa](result.linear.data(), source.tiled, Pitch, SlicePitch);
+				if (result.linear != expected.linear)
+				{
+					printf("  %s detile, %s\n", kernel.name, MicroTileIsaNames[isa]);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+GPCS4_BENCH(GnmTilerKernelThroughput)
+{
+	constexpr uint32_t RunCount = 7;
+
+	// One row of micro tiles. On the narrow surface it stays in L1,
+	// on the wide one the rows of the thicker kernels don't.
+	auto measure = [&](MicroTileFunc func, const MicroTileKernel& kernel, bool tile, uint32_t pitch)
+	{
+		const uint32_t   tileCount  = pitch / 8;
+		const uint32_t   loopCount  = 25600 / tileCount;
+		const uint32_t   elemBytes  = kernel.bitsPerElement / 8;
+		const uint32_t   slicePitch = pitch * 8;
+		const size_t     tileBytes  = size_t(64) * kernel.thickness * elemBytes;
+		MicroTileBuffers buffers(size_t(slicePitch) * kernel.thickness * elemBytes, tileBytes * tileCount);
+
+		double best = 0.0;
+		for (uint32_t run = 0; run != RunCount; ++run)
+		{
+			double seconds = test::measureSeconds([&]
+			{
+				for (uint32_t i = 0; i != loopCount; ++i)
+				{
+					for (uint32_t t = 0; t != tileCount; ++t)
+					{
+						uint8_t* linear = buffers.linear.data() + t * 8 * elemBytes;
+						uint8_t* tiled  = buffers.tiled + t * tileBytes;
+						tile ? func(tiled, linear, pitch, slicePitch) : func(linear, tiled, pitch, slicePitch);
+					}
+				}
+			});
+			test::doNotOptimize(buffers.linear);
+			best = run == 0 ? seconds : std::min(best, seconds);
+		}
+		return best * 1e9 / (double(loopCount) * tileCount);
+	};
+
+	for (uint32_t pitch : { 64u, 1024u })
+	{
+		printf("  ns per micro tile, best of %u runs, %u elements pitch, tile/detile\n", RunCount, pitch);
+		printf("  %-14s %13s %13s %13s\n", "kernel", MicroTileIsaNames[0], MicroTileIsaNames[1], MicroTileIsaNames[2]);
+		for (const auto& kernel : MicroTileKernels)
+		{
+			printf("  %-14s", kernel.name);
+			for (uint32_t isa = 0; isa != 3; ++isa)
+			{
+				if (!isMicroTileIsaSupported(isa) || (!kernel.tile[isa] && !kernel.detile[isa]))
+				{
+					printf(" %13s", "-");
+					continue;
+				}
+
+				char tileTime[16]   = "-";
+				char detileTime[16] = "-";
+				if (kernel.tile[isa])
+				{
+					snprintf(tileTime, sizeof(tileTime), "%.1f", measure(kernel.tile[isa], kernel, true, pitch));
+				}
+				if (kernel.detile[isa])
+				{
+					snprintf(detileTime, sizeof(detileTime), "%.1f", measure(kernel.detile[isa], kernel, false, pitch));
+				}
+
+				char cell[32];
+				snprintf(cell, sizeof(cell), "%s/%s", tileTime, detileTime);
+				printf(" %13s", cell);
+			}
+			printf("\n");
+		}
+	}
+	return true;
+}
+
+// Hash of the tiled bit offset of every element, over all tile modes, both GPU modes, every element size
+// and fragment count, for a volume and an array slice. The expected value was taken from the tiler before
+// it read addresses out of lookup tables, when every offset was computed from the element coordinates.
+GPCS4_TEST(GnmTilerTableOffsets)
+{
+	constexpr uint32_t Width  = 45;
+	constexpr uint32_t Height = 27;
+
+	uint64_t count = 0;
+	uint64_t hash  = 14695981039346656037ull;
+	for (uint32_t tileMode = 0; tileMode <= Gnm::kTileModeThick_3dXThick; ++tileMode)
+	{
+		for (auto gpuMode : { Gnm::kGpuModeBase, Gnm::kGpuModeNeo })
+		{
+			for (uint32_t bitsPerElement : { 8u, 16u, 32u, 64u, 128u })
+			{
+				for (uint32_t numFragments : { 1u, 2u, 4u, 8u })
+				{
+					for (uint32_t arraySlice : { 0u, 3u })
+					{
+						auto tp         = makeTilingParameters(Gnm::TileMode(tileMode), bitsPerElement, Width, Height, arraySlice ? 1 : 5, numFragments);
+						tp.m_minGpuMode = gpuMode;
+						tp.m_arraySlice = arraySlice;
+
+						SurfaceInfo info = {};
+						if (computeSurfaceInfo(&info, &tp) != kStatusSuccess)
+						{
+							continue;
+						}
+
+						// Micro tiled surfaces have no fragment index.
+						bool    macroTiled = isMacroTiled(info.m_arrayMode);
+						Tiler1d tiler1d;
+						Tiler2d tiler2d;
+						if (macroTiled ? tiler2d.init(&tp) != kStatusSuccess
+									   : !isMicroTiled(info.m_arrayMode) || numFragments != 1 || tiler1d.init(&tp) != kStatusSuccess)
+						{
+							continue;
+						}
+
+						for (uint32_t z = 0; z != tp.m_linearDepth; ++z)
+						{
+							for (uint32_t y = 0; y != Height; ++y)
+							{
+								for (uint32_t x = 0; x != Width; ++x)
+								{
+									for (uint32_t f = 0; f != numFragments; ++f)
+									{
+										uint64_t offset = 0;
+										macroTiled ? tiler2d.getTiledElementBitOffset(&offset, x, y, z, f)
+												   : tiler1d.getTiledElementBitOffset(&offset, x, y, z);
+										hash = (hash ^ offset) * 1099511628211ull;
+										++count;
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	TEST_CHECK(count == 24348600);
+	TEST_CHECK(hash == 0xe83f746a9269ee65ull);
+	return true;
+}
+
+// The textures a frame samples, detiled once each per frame: block compressed material maps,
+// render targets, back buffers, depth and shadow maps. After the first frame every tiler
+// finds its tables in the cache.
+GPCS4_BENCH(GnmTilerFrameTextures)
+{
+	struct FrameTexture
+	{
+		Gnm::TileMode tileMode;
+		uint32_t      bitsPerElement;
+		uint32_t      width;
+		uint32_t      height;
+		bool          blockCompressed;
+	};
+
+	std::vector<FrameTexture> textures;
+	for (uint32_t i = 0; i != 24; ++i)
+	{
+		textures.push_back({ Gnm::kTileModeThin_2dThin, 8, 512u << (i % 3), 512u << (i % 3), true });  // BC3, BC5, BC7
+	}
+	for (uint32_t i = 0; i != 12; ++i)
+	{
+		textures.push_back({ Gnm::kTileModeThin_2dThin, 4, 256u << (i % 3), 256u << (i % 3), true });  // BC1, BC4
+	}
+	for (uint32_t i = 0; i != 8; ++i)
+	{
+		textures.push_back({ Gnm::kTileModeThin_2dThin, 32, 256u << (i % 2), 256u << (i % 2), false });
+	}
+	for (uint32_t i = 0; i != 4; ++i)
+	{
+		textures.push_back({ Gnm::kTileModeThin_2dThin, 64, 1920, 1080, false });
+	}
+	for (uint32_t i = 0; i != 2; ++i)
+	{
+		textures.push_back({ Gnm::kTileModeDisplay_2dThin, 32, 1920, 1080, false });
+	}
+	textures.push_back({ Gnm::kTileModeDepth_2dThin_64, 32, 1920, 1080, false });
+	textures.push_back({ Gnm::kTileModeDepth_2dThin_64, 32, 2048, 2048, false });
+	textures.push_back({ Gnm::kTileModeThin_1dThin, 32, 64, 64, false });
+
+	constexpr uint32_t FrameCount = 5;
+
+	std::vector<uint8_t> tiled(64 << 20);
+	std::vector<uint8_t> untiled(64 << 20);
+
+	uint64_t hitsBefore   = 0;
+	uint64_t missesBefore = 0;
+	getTilingTableCacheStats(&hitsBefore, &missesBefore);
+
+	double   detileSeconds = 0.0;
+	double   offsetSeconds = 0.0;
+	uint64_t elementCount  = 0;
+	uint64_t checksum      = 0;
+	for (uint32_t frame = 0; frame != FrameCount; ++frame)
+	{
+		for (const auto& texture : textures)
+		{
+			auto tp                = makeTilingParameters(texture.tileMode, texture.bitsPerElement, texture.width, texture.height, 1, 1);
+			tp.m_isBlockCompressed = texture.blockCompressed;
+
+			detileSeconds += test::measureSeconds([&]
+			{
+				detileSurface(untiled.data(), tiled.data(), &tp);
+			});
+
+			if (texture.tileMode == Gnm::kTileModeThin_1dThin)
+			{
+				continue;
+			}
+
+			// Block compressed elements are 4x4 texel blocks.
+			Tiler2d  tiler(&tp);
+			uint32_t width  = texture.blockCompressed ? texture.width / 4 : texture.width;
+			uint32_t height = texture.blockCompressed ? texture.height / 4 : texture.height;
+			offsetSeconds += test::measureSeconds([&]
+			{
+				for (uint32_t y = 0; y != height; ++y)
+				{
+					for (uint32_t x = 0; x != width; ++x)
+					{
+						uint64_t offset = 0;
+						tiler.getTiledElementBitOffset(&offset, x, y, 0, 0);
+						checksum += offset;
+					}
+				}
+			});
+			elementCount += uint64_t(width) * height;
+		}
+	}
+	test::doNotOptimize(checksum);
+	test::doNotOptimize(untiled);
+
+	uint64_t hits   = 0;
+	uint64_t misses = 0;
+	getTilingTableCacheStats(&hits, &misses);
+	hits -= hitsBefore;
+	misses -= missesBefore;
+
+	printf("  %zu textures, %u frames\n", textures.size(), FrameCount);
+	printf("  detileSurface %8.1f ms/frame, getTiledElementBitOffset %6.2f ns/element\n",
+		   detileSeconds * 1000.0 / FrameCount,
+		   offsetSeconds * 1e9 / double(elementCount));
+	printf("  table cache %llu hits, %llu misses, hit rate %.1f%%\n",
+		   static_cast<unsigned long long>(hits),
+		   static_cast<unsigned long long>(misses),
+		   hits + misses ? 100.0 * double(hits) / double(hits + misses) : 0.0);
+	return true;
+}
+
+// Random T#s of every texture type, with formats, tile modes, padded pitches, mip chains and pow2 padding.
+static Gnm::Texture makeRandomTexture(std::mt19937& rng)
+{
+	static const Gnm::TextureType types[] = {
+		Gnm::kTextureType2d,
+		Gnm::kTextureType2dArray,
+		Gnm::kTextureTypeCubemap,
+		Gnm::kTextureType3d,
+		Gnm::kTextureType2dMsaa,
+	};
+	static const uint32_t dataFormats[] = { 1, 2, 3, 4, 5, 7, 10, 12, 13, 14, 35, 36, 37, 38, 39, 40, 41 };
+	static const Gnm::TileMode tileModes[] = {
+		Gnm::kTileModeThin_1dThin,
+		Gnm::kTileModeThin_2dThin,
+		Gnm::kTileModeDisplay_2dThin,
+		Gnm::kTileModeDisplay_LinearAligned,
+		Gnm::kTileModeThick_1dThick,
+		Gnm::kTileModeDepth_2dThin_64,
+	};
+
+	Gnm::Texture texture;
+	memset(&texture, 0, sizeof(texture));
+	auto& tsharp = texture.m_tsharp;
+
+	Gnm::TextureType type = types[rng() % std::size(types)];
+	bool             pow2 = rng() % 2;
+	uint32_t         width  = pow2 ? 1u << (rng() % 13) : 1 + rng() % 4096;
+	uint32_t         height = rng() % 3 == 0 ? width : (pow2 ? 1u << (rng() % 13) : 1 + rng() % 4096);
+	switch (type)
+	{
+	case Gnm::kTextureType3d:
+		width        = 1 + rng() % 512;
+		height       = 1 + rng() % 512;
+		tsharp.depth = rng() % 256;
+		break;
+	case Gnm::kTextureTypeCubemap:
+		height       = width;
+		tsharp.depth = rng() % 4;
+		break;
+	case Gnm::kTextureType2dArray:
+		tsharp.depth = rng() % 16;
+		break;
+	default:
+		break;
+	}
+
+	tsharp.baseaddr256 = (uint64_t(rng() % (1u << 30)) << 4) | (rng() % 16);
+	tsharp.type        = type;
+	tsharp.dfmt        = dataFormats[rng() % std::size(dataFormats)];
+	tsharp.width       = width - 1;
+	tsharp.height      = height - 1;
+	tsharp.tiling_idx  = tileModes[rng() % std::size(tileModes)];
+
+	uint32_t pitch = width;
+	if (rng() % 2)
+	{
+		uint32_t align = tsharp.tiling_idx == Gnm::kTileModeThin_1dThin ? 8 : 64;
+		pitch          = (width + align - 1) / align * align;
+	}
+	tsharp.pitch = pitch - 1;
+
+	uint32_t mipCount = 1;
+	while ((std::max(width, height) >> (mipCount - 1)) > 1)
+	{
+		++mipCount;
+	}
+	// For MSAA textures the field holds the fragment count.
+	tsharp.last_level = type == Gnm::kTextureType2dMsaa ? rng() % 3 : rng() % mipCount;
+	tsharp.pow2pad    = rng() % 4 == 0;
+	return texture;
+}
+
+// Hash of the total size and of the offset and size of every mip of the first slices.
+// What a failing call leaves in its outputs is not part of the result.
+static uint64_t hashTextureLayout(const Gnm::Texture& texture, uint64_t hash)
+{
+	auto mix = [&](uint64_t value)
+	{
+		hash = (hash ^ value) * 1099511628211ull;
+	};
+
+	uint64_t           totalSize = 0;
+	Gnm::AlignmentType align     = 0;
+	int32_t            status    = computeTotalTiledTextureSize(&totalSize, &align, &texture);
+	mix(uint32_t(status));
+	if (status == kStatusSuccess)
+	{
+		mix(totalSize);
+		mix(align);
+	}
+
+	uint32_t sliceCount = std::min(texture.getTotalArraySliceCount(), 8u);
+	for (uint32_t mip = 0; mip <= 16; ++mip)
+	{
+		for (uint32_t slice = 0; slice != sliceCount; ++slice)
+		{
+			uint64_t offset = 0;
+			uint64_t size   = 0;
+			status          = computeTextureSurfaceOffsetAndSize(&offset, &size, &texture, mip, slice);
+			mix(uint32_t(status));
+			if (status == kStatusSuccess)
+			{
+				mix(offset);
+				mix(size);
+			}
+		}
+	}
+	return hash;
+}
+
+// The expected hash was taken from the tree before texture layouts were cached,
+// the same textures are resolved twice so the second pass reads the cache.
+GPCS4_TEST(GnmTilerTextureLayouts)
+{
+	constexpr uint32_t TextureCount = 4000;
+
+	for (uint32_t pass = 0; pass != 2; ++pass)
+	{
+		std::mt19937 rng(0x5EED);
+		uint64_t     hash = 14695981039346656037ull;
+		for (uint32_t i = 0; i != TextureCount; ++i)
+		{
+			hash = hashTextureLayout(makeRandomTexture(rng), hash);
+		}
+		TEST_CHECK(hash == 0xa531ecb5ab9a8c97ull);
+	}
+	return true;
+}
+
+// Texture resolve as a draw does it: every bound T# is looked up once.
+// The first lookup of a layout computes it, later ones read it from the cache.
+GPCS4_BENCH(GnmTilerTextureResolve)
+{
+	constexpr uint32_t WorkingSetSize   = 64;
+	constexpr uint32_t TexturesPerDraw  = 8;
+	constexpr uint32_t DrawCount        = 20000;
+	constexpr uint32_t DistinctTextures = 2000;
+
+	std::mt19937              rng(0xD4A3);
+	std::vector<Gnm::Texture> distinct;
+	for (uint32_t i = 0; i != DistinctTextures; ++i)
+	{
+		distinct.push_back(makeRandomTexture(rng));
+	}
+
+	uint64_t hitsBefore   = 0;
+	uint64_t missesBefore = 0;
+	getTextureLayoutCacheStats(&hitsBefore, &missesBefore);
+
+	uint64_t checksum    = 0;
+	auto     resolveLast = [&](const Gnm::Texture& texture)
+	{
+		uint64_t offset = 0;
+		uint64_t size   = 0;
+		computeTextureSurfaceOffsetAndSize(&offset, &size, &texture, texture.getLastMipLevel(), 0);
+		checksum += offset + size;
+	};
+	auto resolveTotal = [&](const Gnm::Texture& texture)
+	{
+		uint64_t           size  = 0;
+		Gnm::AlignmentType align = 0;
+		int32_t            status = computeTotalTiledTextureSize(&size, &align, &texture);
+		checksum += size;
+		return status == kStatusSuccess;
+	};
+
+	// Distinct descriptors, each one seen for the first time.
+	double missSeconds = test::measureSeconds([&]
+	{
+		for (const auto& texture : distinct)
+		{
+			resolveLast(texture);
+		}
+	});
+
+	// Layouts that fail to resolve are not cached, and a game doesn't bind such textures.
+	std::vector<Gnm::Texture> workingSet;
+	for (const auto& texture : distinct)
+	{
+		if (workingSet.size() != WorkingSetSize && resolveTotal(texture))
+		{
+			workingSet.push_back(texture);
+		}
+	}
+	TEST_CHECK(workingSet.size() == WorkingSetSize);
+
+	uint64_t hitsWarm   = 0;
+	uint64_t missesWarm = 0;
+	getTextureLayoutCacheStats(&hitsWarm, &missesWarm);
+
+	double hitSeconds = test::measureSeconds([&]
+	{
+		for (uint32_t draw = 0; draw != DrawCount; ++draw)
+		{
+			for (uint32_t i = 0; i != TexturesPerDraw; ++i)
+			{
+				resolveLast(workingSet[(draw * 3 + i) % WorkingSetSize]);
+			}
+		}
+	});
+
+	double totalSeconds = test::measureSeconds([&]
+	{
+		for (uint32_t draw = 0; draw != DrawCount; ++draw)
+		{
+			for (uint32_t i = 0; i != TexturesPerDraw; ++i)
+			{
+				resolveTotal(workingSet[(draw * 3 + i) % WorkingSetSize]);
+			}
+		}
+	});
+	test::doNotOptimize(checksum);
+
+	uint64_t hits   = 0;
+	uint64_t misses = 0;
+	getTextureLayoutCacheStats(&hits, &misses);
+
+	double resolveCount = double(DrawCount) * TexturesPerDraw;
+	printf("  computeTextureSurfaceOffsetAndSize, last mip\n");
+	printf("    first lookup %8.1f ns/texture\n", missSeconds * 1e9 / DistinctTextures);
+	printf("    cached       %8.1f ns/texture %8.1f ns/draw of %u textures\n",
+		   hitSeconds * 1e9 / resolveCount, hitSeconds * 1e9 / DrawCount, TexturesPerDraw);
+	printf("  computeTotalTiledTextureSize, cached %8.1f ns/texture\n", totalSeconds * 1e9 / resolveCount);
+	printf("  layout cache, setup %llu hits, %llu misses\n",
+		   static_cast<unsigned long long>(hitsWarm - hitsBefore),
+		   static_cast<unsigned long long>(missesWarm - missesBefore));
+	printf("  layout cache, draws %llu hits, %llu misses\n",
+		   static_cast<unsigned long long>(hits - hitsWarm),
+		   static_cast<unsigned long long>(misses - missesWarm));
+	return true;
+}
@@ -0,0 +1,237 @@
+#include "TestRunner.h"
+#include "Emulator/Memory.h"
+#include "SceModules/sce_errors.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+constexpr size_t MappedBlockBase = SCE_KERNEL_APP_MAP_AREA_START_ADDR + 0x100000000ull;
+
+// Maps blocks of one page, stride bytes apart.
+static std::vector<void*> mapBlocks(MemoryAllocator& allocator, uint32_t count, size_t stride)
+{
+	std::vector<void*> blocks;
+	blocks.reserve(count);
+	for (uint32_t i = 0; i != count; ++i)
+	{
+		void* addr = reinterpret_cast<void*>(MappedBlockBase + i * stride);
+		if (allocator.mapFlexibleMemory(&addr, SCE_LOGICAL_PAGE_SIZE, SCE_KERNEL_PROT_CPU_READ, 0) != SCE_OK)
+		{
+			break;
+		}
+		blocks.push_back(addr);
+	}
+	return blocks;
+}
+
+static void unmapBlocks(MemoryAllocator& allocator, const std::vector<void*>& blocks)
+{
+	for (auto block : blocks)
+	{
+		allocator.memoryUnmap(block, SCE_LOGICAL_PAGE_SIZE);
+	}
+}
+
+GPCS4_TEST(MemoryAllocatorFindBlock)
+{
+	auto allocator = std::make_unique<MemoryAllocator>();
+	// Every block has a gap after it.
+	auto blocks    = mapBlocks(*allocator, 1000, 2 * SCE_LOGICAL_PAGE_SIZE);
+	TEST_CHECK(blocks.size() == 1000);
+
+	for (auto block : blocks)
+	{
+		auto  start = reinterpret_cast<uint8_t*>(block);
+		void* blockStart = nullptr;
+		void* blockEnd   = nullptr;
+		TEST_CHECK(allocator->queryMemoryProtection(start, &blockStart, &blockEnd, nullptr) == SCE_OK);
+		TEST_CHECK(blockStart == start && blockEnd == start + SCE_LOGICAL_PAGE_SIZE);
+		TEST_CHECK(allocator->queryMemoryProtection(start + SCE_LOGICAL_PAGE_SIZE - 1, &blockStart, nullptr, nullptr) == SCE_OK);
+		TEST_CHECK(blockStart == start);
+		TEST_CHECK(allocator->queryMemoryProtection(start + SCE_LOGICAL_PAGE_SIZE, nullptr, nullptr, nullptr) == SCE_KERNEL_ERROR_EACCES);
+	}
+
+	unmapBlocks(*allocator, blocks);
+	TEST_CHECK(allocator->queryMemoryProtection(blocks.front(), nullptr, nullptr, nullptr) == SCE_KERNEL_ERROR_EACCES);
+	return true;
+}
+
+// The block list as it was kept before the map, found by walking every block.
+struct LinearBlockList
+{
+	struct Block
+	{
+		size_t start;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+
+	const Block* find(size_t addr) const
+	{
+		for (const auto& block : blocks)
+		{
+			if (addr >= block.start && addr < block.start + block.size)
+			{
+				return &block;
+			}
+		}
+		return nullptr;
+	}
+};
+
+GPCS4_BENCH(MemoryAllocatorFindBlockThroughput)
+{
+	constexpr uint32_t BlockCount        = 100000;
+	constexpr uint32_t LookupCount       = 1000000;
+	constexpr uint32_t LinearLookupCount = 2000;
+
+	auto allocator = std::make_unique<MemoryAllocator>();
+
+	std::vector<void*> blocks;
+	double mapSeconds = test::measureSeconds([&]
+	{
+		// Adjacent blocks, a host may limit the number of separate mappings.
+		blocks = mapBlocks(*allocator, BlockCount, SCE_LOGICAL_PAGE_SIZE);
+	});
+	if (blocks.size() != BlockCount)
+	{
+		printf("  only %zu blocks could be mapped\n", blocks.size());
+		unmapBlocks(*allocator, blocks);
+		return false;
+	}
+
+	std::mt19937 rng(0x5EED);
+	std::vector<size_t> addresses(LookupCount);
+	for (auto& addr : addresses)
+	{
+		addr = reinterpret_cast<size_t>(blocks[rng() % BlockCount]) + rng() % SCE_LOGICAL_PAGE_SIZE;
+	}
+
+	size_t found = 0;
+	double mapLookupSeconds = test::measureSeconds([&]
+	{
+		for (auto addr : addresses)
+		{
+			void* start = nullptr;
+			found += allocator->queryMemoryProtection(reinterpret_cast<void*>(addr), &start, nullptr, nullptr) == SCE_OK;
+		}
+	});
+	test::doNotOptimize(found);
+
+	LinearBlockList linear;
+	for (auto block : blocks)
+	{
+		linear.blocks.push_back({ reinterpret_cast<size_t>(block), SCE_LOGICAL_PAGE_SIZE });
+	}
+	size_t linearFound = 0;
+	double linearSeconds = test::measureSeconds([&]
+	{
+		for (uint32_t i = 0; i != LinearLookupCount; ++i)
+		{
+			linearFound += linear.find(addresses[i]) != nullptr;
+		}
+	});
+	test::doNotOptimize(linearFound);
+
+	double unmapSeconds = test::measureSeconds([&]
+	{
+		unmapBlocks(*allocator, blocks);
+	});
+
+	printf("  %u blocks, ns per operation\n", BlockCount);
+	printf("  map %10.1f\n", mapSeconds * 1e9 / BlockCount);
+	printf("  unmap %8.1f\n", unmapSeconds * 1e9 / BlockCount);
+	printf("  lookup, block map    %12.1f\n", mapLookupSeconds * 1e9 / LookupCount);
+	printf("  lookup, linear scan  %12.1f\n", linearSeconds * 1e9 / LinearLookupCount);
+	return found == LookupCount && linearFound == LinearLookupCount;
+}
+
+struct ReallocGrowth
+{
+	uint32_t moves       = 0;
+	size_t   copiedBytes = 0;
+	bool     intact      = true;
+};
+
+// Grows a block in doubling steps, as a guest std::vector does,
+// and counts the steps which had to move it.
+static ReallocGrowth growByDoubling(MemoryAllocator& allocator, size_t firstSize, size_t finalSize)
+{
+	ReallocGrowth growth;
+
+	auto ptr = reinterpret_cast<uint8_t*>(allocator.sce_malloc(firstSize));
+	if (!ptr)
+	{
+		growth.intact = false;
+		return growth;
+	}
+	ptr[0]             = 1;
+	ptr[firstSize - 1] = 1;
+
+	for (size_t size = firstSize; size < finalSize; size *= 2)
+	{
+		auto grown = reinterpret_cast<uint8_t*>(allocator.sce_realloc(ptr, size * 2));
+		if (!grown)
+		{
+			growth.intact = false;
+			break;
+		}
+
+		if (grown != ptr)
+		{
+			++growth.moves;
+			growth.copiedBytes += size;
+		}
+		growth.intact &= grown[0] == 1 && grown[size - 1] == 1;
+		grown[size * 2 - 1] = 1;
+		ptr                 = grown;
+	}
+
+	allocator.sce_free(ptr);
+	return growth;
+}
+
+// Growing to 64MB copies less than the final size in total,
+// where moving on every step copied nearly all of it.
+GPCS4_TEST(MemoryAllocatorReallocGrowth)
+{
+	constexpr size_t FirstSize = 1024 * 1024;
+	constexpr size_t FinalSize = 64 * 1024 * 1024;
+
+	auto allocator = std::make_unique<MemoryAllocator>();
+	auto growth    = growByDoubling(*allocator, FirstSize, FinalSize);
+	TEST_CHECK(growth.intact);
+	TEST_CHECK(growth.moves == 3);
+	TEST_CHECK(growth.copiedBytes < FinalSize / 2);
+
+	// The headroom is released with the block.
+	growth = growByDoubling(*allocator, FirstSize, FinalSize);
+	TEST_CHECK(growth.intact);
+	TEST_CHECK(growth.moves == 3);
+	return true;
+}
+
+GPCS4_BENCH(MemoryAllocatorReallocGrowthTime)
+{
+	constexpr size_t   FirstSize = 64 * 1024;
+	constexpr size_t   FinalSize = 64 * 1024 * 1024;
+	constexpr uint32_t LoopCount = 10;
+
+	auto allocator = std::make_unique<MemoryAllocator>();
+
+	ReallocGrowth growth;
+	double seconds = test::measureSeconds([&]
+	{
+		for (uint32_t i = 0; i != LoopCount; ++i)
+		{
+			growth = growByDoubling(*allocator, FirstSize, FinalSize);
+		}
+	});
+
+	printf("  %zu KB to %zu MB in doubling steps, %u runs\n", FirstSize / 1024, FinalSize / (1024 * 1024), LoopCount);
+	printf("  %8.2f ms per growth, %u moves, %.1f MB copied\n",
+		   seconds * 1e3 / LoopCount, growth.moves, double(growth.copiedBytes) / (1024 * 1024));
+	return growth.intact;
+}
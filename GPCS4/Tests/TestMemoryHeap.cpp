@@ -0,0 +1,240 @@
+#include "TestRunner.h"
+#include "Emulator/Memory.h"
+#include "PlatProcess.h"
+#include "SceModules/sce_errors.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const size_t g_heapTestSizes[] = { 1, 16, 24, 100, 256, 1000, 1500, 4096, 5000, 8192 };
+
+GPCS4_TEST(MemoryHeapAllocateFree)
+{
+	auto allocator = std::make_unique<MemoryAllocator>();
+
+	std::vector<std::pair<uint8_t*, size_t>> blocks;
+	for (uint32_t round = 0; round != 200; ++round)
+	{
+		for (size_t size : g_heapTestSizes)
+		{
+			auto ptr = reinterpret_cast<uint8_t*>(allocator->sce_malloc(size));
+			TEST_CHECK(ptr != nullptr);
+			TEST_CHECK(reinterpret_cast<size_t>(ptr) % MemoryHeap::MinAlignment == 0);
+			std::memset(ptr, static_cast<int>(size + round), size);
+			blocks.emplace_back(ptr, size);
+		}
+	}
+
+	for (uint32_t i = 0; i != blocks.size(); ++i)
+	{
+		auto ptr  = blocks[i].first;
+		auto size = blocks[i].second;
+		auto fill = static_cast<uint8_t>(size + i / std::size(g_heapTestSizes));
+		TEST_CHECK(ptr[0] == fill && ptr[size - 1] == fill);
+		allocator->sce_free(ptr);
+	}
+
+	// A block larger than the heap handles goes to the VM path.
+	void* large = allocator->sce_malloc(MemoryHeap::MaxSmallSize + 1);
+	TEST_CHECK(large != nullptr);
+	allocator->sce_free(large);
+	return true;
+}
+
+// A thread cache holding blocks must not touch its heap after the heap is destroyed,
+// and must serve a new heap created afterwards.
+GPCS4_TEST(MemoryHeapOutlivedByThreadCache)
+{
+	auto allocator = std::make_unique<MemoryAllocator>();
+
+	std::mutex              mutex;
+	std::condition_variable cond;
+	uint32_t                step    = 0;
+	bool                    passed  = true;
+	MemoryAllocator*        current = allocator.get();
+
+	auto waitStep = [&](uint32_t value)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [&] { return step == value; });
+	};
+	auto setStep = [&](uint32_t value)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		step = value;
+		cond.notify_all();
+	};
+
+	// Leave some free blocks in the calling thread's cache.
+	auto touchAll = [&]()
+	{
+		bool succeeded = true;
+		for (size_t size : g_heapTestSizes)
+		{
+			void* ptr = current->sce_malloc(size);
+			succeeded &= ptr != nullptr;
+			if (ptr)
+			{
+				std::memset(ptr, 0, size);
+				current->sce_free(ptr);
+			}
+		}
+		return succeeded;
+	};
+
+	std::thread worker([&]()
+	{
+		touchAll();
+		setStep(1);
+
+		waitStep(2);
+		passed = touchAll();
+	});
+
+	waitStep(1);
+	touchAll();
+	allocator.reset();
+	allocator = std::make_unique<MemoryAllocator>();
+	current   = allocator.get();
+	setStep(2);
+
+	worker.join();
+	TEST_CHECK(passed);
+	TEST_CHECK(touchAll());
+	return true;
+}
+
+// Pointers the allocator never returned, but which fall inside memory it mapped,
+// must be rejected without releasing the mapping around them.
+GPCS4_TEST(MemoryHeapStrayFree)
+{
+	auto allocator = std::make_unique<MemoryAllocator>();
+
+	auto block = reinterpret_cast<uint8_t*>(allocator->sce_malloc(64));
+	TEST_CHECK(block != nullptr);
+
+	// The last slab of the arena was never handed out.
+	auto arenaBase = reinterpret_cast<uint8_t*>(reinterpret_cast<uintptr_t>(block) & ~(MemoryHeap::ArenaSize - 1));
+	allocator->sce_free(arenaBase + (MemoryHeap::SlabsPerArena - 1) * MemoryHeap::SlabSize);
+	TEST_CHECK(allocator->sce_realloc(arenaBase + (MemoryHeap::SlabsPerArena - 1) * MemoryHeap::SlabSize, 32) == nullptr);
+	TEST_CHECK(allocator->queryMemoryProtection(block, nullptr, nullptr, nullptr) == SCE_OK);
+	std::memset(block, 0, 64);
+	allocator->sce_free(block);
+
+	// A pointer into a block mapped for a large malloc.
+	size_t largeSize = MemoryHeap::MaxSmallSize * 2;
+	auto   large     = reinterpret_cast<uint8_t*>(allocator->sce_malloc(largeSize));
+	TEST_CHECK(large != nullptr);
+	allocator->sce_free(large + plat::VM_PAGE_SIZE);
+	TEST_CHECK(allocator->sce_realloc(large + plat::VM_PAGE_SIZE, largeSize * 2) == nullptr);
+	TEST_CHECK(allocator->queryMemoryProtection(large, nullptr, nullptr, nullptr) == SCE_OK);
+	std::memset(large, 0, largeSize);
+	allocator->sce_free(large);
+	return true;
+}
+
+static void allocateFreeLoop(MemoryAllocator* allocator, size_t size, uint32_t loopCount)
+{
+	constexpr uint32_t BatchCount = 256;
+	void*              blocks[BatchCount];
+	for (uint32_t loop = 0; loop != loopCount; ++loop)
+	{
+		for (uint32_t i = 0; i != BatchCount; ++i)
+		{
+			blocks[i] = allocator ? allocator->sce_malloc(size) : std::malloc(size);
+			test::doNotOptimize(blocks[i]);
+		}
+		for (uint32_t i = 0; i != BatchCount; ++i)
+		{
+			allocator ? allocator->sce_free(blocks[i]) : std::free(blocks[i]);
+		}
+	}
+}
+
+GPCS4_BENCH(MemoryHeapMallocFree)
+{
+	constexpr uint32_t LoopCount      = 2000;
+	constexpr uint32_t OperationCount = LoopCount * 256 * 2;
+
+	auto     allocator   = std::make_unique<MemoryAllocator>();
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	printf("  %-6s %12s %12s %14s %14s\n", "size", "heap ns/op", "host ns/op", "heap Mops/s mt", "host Mops/s mt");
+	for (size_t size : g_heapTestSizes)
+	{
+		// Warm up, so arena mapping is not part of the numbers.
+		allocateFreeLoop(allocator.get(), size, 1);
+
+		double heapSeconds = test::measureSeconds([&] { allocateFreeLoop(allocator.get(), size, LoopCount); });
+		double hostSeconds = test::measureSeconds([&] { allocateFreeLoop(nullptr, size, LoopCount); });
+
+		auto runThreads = [&](MemoryAllocator* target)
+		{
+			return test::measureSeconds([&]
+			{
+				std::vector<std::thread> threads;
+				for (uint32_t i = 0; i != threadCount; ++i)
+				{
+					threads.emplace_back(allocateFreeLoop, target, size, LoopCount);
+				}
+				for (auto& thread : threads)
+				{
+					thread.join();
+				}
+			});
+		};
+
+		double heapMtSeconds = runThreads(allocator.get());
+		double hostMtSeconds = runThreads(nullptr);
+
+		printf("  %-6zu %12.1f %12.1f %14.1f %14.1f\n",
+			   size,
+			   heapSeconds * 1e9 / OperationCount,
+			   hostSeconds * 1e9 / OperationCount,
+			   OperationCount * threadCount / heapMtSeconds / 1e6,
+			   OperationCount * threadCount / hostMtSeconds / 1e6);
+	}
+	printf("  %u threads in the multi-threaded columns.\n", threadCount);
+	return true;
+}
+
+// Resident memory while many small blocks are alive, and after all of them are freed.
+// The heap decommits slabs which become empty, so most of it should go back to the host.
+GPCS4_BENCH(MemoryHeapResidentSize)
+{
+	constexpr size_t BlockSize  = 256;
+	constexpr size_t BlockCount = 256 * 1024;
+
+	std::vector<void*> blocks(BlockCount);
+
+	auto measure = [&](MemoryAllocator* allocator, const char* name)
+	{
+		double base = double(plat::GetProcessResidentSize());
+		for (auto& block : blocks)
+		{
+			block = allocator ? allocator->sce_malloc(BlockSize) : std::malloc(BlockSize);
+			std::memset(block, 1, BlockSize);
+		}
+		double peak = double(plat::GetProcessResidentSize());
+		for (auto block : blocks)
+		{
+			allocator ? allocator->sce_free(block) : std::free(block);
+		}
+		double after = double(plat::GetProcessResidentSize());
+		printf("  %-5s %12.1f %14.1f\n", name, (peak - base) / 1e6, (after - base) / 1e6);
+	};
+
+	auto allocator = std::make_unique<MemoryAllocator>();
+	printf("  %zu blocks of %zu bytes, resident MB above the starting point\n", BlockCount, BlockSize);
+	printf("  %-5s %12s %14s\n", "", "all alive", "all freed");
+	measure(allocator.get(), "heap");
+	measure(nullptr, "host");
+	return true;
+}
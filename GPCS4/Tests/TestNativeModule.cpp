@@ -0,0 +1,191 @@
+#include "TestRunner.h"
+#include "Emulator/Module.h"
+#include "UtilString.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static const char NidAlphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+-";
+
+struct NativeModuleTester
+{
+	static bool decodeSymbol(const NativeModule& module, std::string const& name,
+							 uint32_t* modId, uint32_t* libId, uint64_t* nid)
+	{
+		return module.decodeSymbol(name, modId, libId, nid);
+	}
+};
+
+// The 64 bit NID takes 6 bits for each of the first 10 characters and 4 for the last one.
+static std::string encodeNid(uint64_t nid)
+{
+	std::string str;
+	for (uint32_t i = 0; i != 10; ++i)
+	{
+		str += NidAlphabet[(nid >> (58 - 6 * i)) & 0x3F];
+	}
+	str += NidAlphabet[(nid & 0xF) << 2];
+	return str;
+}
+
+static std::string encodeId(uint32_t id)
+{
+	std::string str;
+	do
+	{
+		str.insert(str.begin(), NidAlphabet[id & 0x3F]);
+		id >>= 6;
+	} while (id != 0);
+	return str;
+}
+
+// The decoder this replaced: split the name, then look every character up with strchr.
+static bool decodeValueByScan(std::string const& encodedStr, uint64_t& value)
+{
+	if (encodedStr.size() > 11)
+	{
+		return false;
+	}
+
+	value = 0;
+	for (size_t i = 0; i < encodedStr.size(); ++i)
+	{
+		auto pChPos = strchr(NidAlphabet, encodedStr[i]);
+		if (pChPos == nullptr)
+		{
+			return false;
+		}
+
+		uint32_t nIndex = static_cast<uint32_t>(pChPos - NidAlphabet);
+		if (i < 10)
+		{
+			value = (value << 6) | nIndex;
+		}
+		else
+		{
+			value = (value << 4) | (nIndex >> 2);
+		}
+	}
+	return true;
+}
+
+static bool decodeSymbolByScan(std::string const& name, uint32_t* modId, uint32_t* libId, uint64_t* nid)
+{
+	std::vector<std::string> parts = util::str::split(name, '#');
+	if (parts.size() < 3)
+	{
+		return false;
+	}
+
+	uint64_t lib = 0;
+	uint64_t mod = 0;
+	if (!decodeValueByScan(parts[0], *nid) ||
+		!decodeValueByScan(parts[1], lib) ||
+		!decodeValueByScan(parts[2], mod))
+	{
+		return false;
+	}
+	*libId = static_cast<uint32_t>(lib);
+	*modId = static_cast<uint32_t>(mod);
+	return true;
+}
+
+struct EncodedSymbol
+{
+	std::string name;
+	uint32_t    modId;
+	uint32_t    libId;
+	uint64_t    nid;
+};
+
+// Most imports name one of the first few modules and libraries, a few need two characters.
+static std::vector<EncodedSymbol> makeEncodedSymbols(uint32_t count)
+{
+	std::mt19937_64 rng(0x5EED);
+
+	std::vector<EncodedSymbol> symbols;
+	symbols.reserve(count);
+	for (uint32_t i = 0; i != count; ++i)
+	{
+		EncodedSymbol symbol;
+		symbol.nid   = rng();
+		symbol.libId = uint32_t(rng() % 16 == 0 ? rng() % 4096 : rng() % 64);
+		symbol.modId = uint32_t(rng() % 16 == 0 ? rng() % 4096 : rng() % 64);
+		symbol.name  = encodeNid(symbol.nid) + "#" + encodeId(symbol.libId) + "#" + encodeId(symbol.modId);
+		symbols.push_back(std::move(symbol));
+	}
+	return symbols;
+}
+
+GPCS4_TEST(NativeModuleDecodeSymbol)
+{
+	NativeModule module;
+
+	for (const auto& symbol : makeEncodedSymbols(10000))
+	{
+		uint32_t modId = 0;
+		uint32_t libId = 0;
+		uint64_t nid   = 0;
+		TEST_CHECK(NativeModuleTester::decodeSymbol(module, symbol.name, &modId, &libId, &nid));
+		TEST_CHECK(nid == symbol.nid);
+		TEST_CHECK(libId == symbol.libId);
+		TEST_CHECK(modId == symbol.modId);
+	}
+
+	const char* invalidNames[] = {
+		"",
+		"abcdefghijk",
+		"abcdefghijk#B",
+		"abcdefghij*#B#C",
+		"abcdefghijk#B#C.",
+		"abcdefghijk#B\x80#C",
+		"abcdefghijkl#B#C",
+		"abcdefghijk#B#CDEFGHIJKLMN",
+	};
+	for (auto name : invalidNames)
+	{
+		uint32_t modId = 0;
+		uint32_t libId = 0;
+		uint64_t nid   = 0;
+		TEST_CHECK(!NativeModuleTester::decodeSymbol(module, name, &modId, &libId, &nid));
+	}
+	return true;
+}
+
+GPCS4_BENCH(NativeModuleDecodeThroughput)
+{
+	constexpr uint32_t SymbolCount = 100000;
+	constexpr uint32_t LoopCount   = 20;
+
+	NativeModule module;
+	auto         symbols = makeEncodedSymbols(SymbolCount);
+
+	auto measure = [&](auto&& decode, const char* name)
+	{
+		uint64_t checksum = 0;
+		double   seconds  = test::measureSeconds([&]
+		{
+			for (uint32_t i = 0; i != LoopCount; ++i)
+			{
+				for (const auto& symbol : symbols)
+				{
+					uint32_t modId = 0;
+					uint32_t libId = 0;
+					uint64_t nid   = 0;
+					decode(symbol.name, &modId, &libId, &nid);
+					checksum += nid + libId + modId;
+				}
+			}
+		});
+		test::doNotOptimize(checksum);
+		printf("  %-10s %8.1f ns/symbol\n", name, seconds * 1e9 / (double(SymbolCount) * LoopCount));
+	};
+
+	printf("  %u encoded symbol names, %u runs\n", SymbolCount, LoopCount);
+	measure(decodeSymbolByScan, "scan");
+	measure([&](auto&&... args) { return NativeModuleTester::decodeSymbol(module, args...); }, "table");
+	return true;
+}
@@ -0,0 +1,58 @@
+#include "TestRunner.h"
+
+#include <vector>
+
+namespace test
+{;
+
+struct TestCase
+{
+	CaseType     type;
+	const char*  name;
+	CaseFunction function;
+};
+
+// Function local so registration doesn't depend on the initialization order of translation units.
+static std::vector<TestCase>& getCaseList()
+{
+	static std::vector<TestCase> s_caseList;
+	return s_caseList;
+}
+
+CaseRegistrar::CaseRegistrar(CaseType type, const char* name, CaseFunction function)
+{
+	getCaseList().push_back({ type, name, function });
+}
+
+int runCases(CaseType type, const std::string& filter)
+{
+	uint32_t runCount  = 0;
+	uint32_t failCount = 0;
+	for (auto const& testCase : getCaseList())
+	{
+		if (testCase.type != type)
+		{
+			continue;
+		}
+
+		if (!filter.empty() && std::string(testCase.name).find(filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		printf("[ RUN  ] %s\n", testCase.name);
+		bool passed = testCase.function();
+		printf("[ %s ] %s\n", passed ? " OK " : "FAIL", testCase.name);
+
+		++runCount;
+		if (!passed)
+		{
+			++failCount;
+		}
+	}
+
+	printf("%u cases run, %u failed.\n", runCount, failCount);
+	return failCount == 0 ? 0 : -1;
+}
+
+}  // namespace test
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "GPCS4Common.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// In-tree self checks and microbenchmarks.
+//
+// Cases register themselves at static initialization time through GPCS4_TEST / GPCS4_BENCH,
+// and are run from the command line with --test or --bench, optionally filtered by name.
+// A test returns false on failure, a benchmark prints its own numbers and returns false
+// only if it could not run.
+
+namespace test
+{;
+
+enum class CaseType
+{
+	Test,
+	Bench,
+};
+
+using CaseFunction = bool (*)();
+
+struct CaseRegistrar
+{
+	CaseRegistrar(CaseType type, const char* name, CaseFunction function);
+};
+
+// Run every case of the given type whose name contains filter,
+// return 0 if all of them passed.
+int runCases(CaseType type, const std::string& filter);
+
+// Seconds taken by one call to func.
+template <typename Func>
+double measureSeconds(Func&& func)
+{
+	auto begin = std::chrono::steady_clock::now();
+	func();
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(end - begin).count();
+}
+
+// Keep the compiler from optimizing away a value we only compute for timing.
+template <typename T>
+inline void doNotOptimize(T const& value)
+{
+	static volatile const void* s_sink;
+	s_sink = &value;
+}
+
+}  // namespace test
+
+#define GPCS4_TEST_CASE(type, name)                                                        \
+	static bool name();                                                                    \
+	static const test::CaseRegistrar s_registrar_##name(test::CaseType::type, #name, name); \
+	static bool name()
+
+#define GPCS4_TEST(name)  GPCS4_TEST_CASE(Test, name)
+#define GPCS4_BENCH(name) GPCS4_TEST_CASE(Bench, name)
+
+// Print the failed condition and fail the current test.
+#define TEST_CHECK(cond)                                                      \
+	do                                                                        \
+	{                                                                         \
+		if (!(cond))                                                          \
+		{                                                                     \
+			printf("  %s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); \
+			return false;                                                     \
+		}                                                                     \
+	} while (false)
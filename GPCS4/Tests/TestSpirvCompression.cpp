@@ -0,0 +1,221 @@
+#include "TestRunner.h"
+#include "Graphics/SpirV/SpirvCompression.h"
+#include "UtilCpu.h"
+
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace sce::pssl
+{
+
+struct SpirvCompressionTester
+{
+	enum class Codec
+	{
+		Scalar,
+		Simd,
+	};
+
+	static SpirvCompressedBuffer compress(const std::vector<uint32_t>& words, Codec codec)
+	{
+		SpirvCompressedBuffer buffer;
+		buffer.m_size = uint32_t(words.size());
+
+		if (codec == Codec::Simd)
+		{
+			buffer.compressSse41(words.data());
+		}
+		else
+		{
+			buffer.compressScalar(words.data());
+		}
+		return buffer;
+	}
+
+	static std::vector<uint32_t> decompress(const SpirvCompressedBuffer& buffer, Codec codec)
+	{
+		std::vector<uint32_t> words(buffer.m_size);
+		if (buffer.m_size == 0)
+		{
+			return words;
+		}
+
+		if (codec == Codec::Simd)
+		{
+			buffer.decompressSsse3(words.data());
+		}
+		else
+		{
+			buffer.decompressScalar(words.data());
+		}
+		return words;
+	}
+
+	static bool sameLayout(const SpirvCompressedBuffer& a, const SpirvCompressedBuffer& b)
+	{
+		return a.m_size == b.m_size &&
+			   a.m_mask == b.m_mask &&
+			   a.m_code == b.m_code;
+	}
+};
+
+}  // namespace sce::pssl
+
+using namespace sce::pssl;
+using Codec = SpirvCompressionTester::Codec;
+
+// Words taking 1 to 4 bytes in equal shares, with the byte count boundaries mixed in.
+static std::vector<uint32_t> makeMixedWords(std::mt19937& rng, uint32_t count)
+{
+	static const uint32_t s_edgeWords[] = {
+		0x00000000, 0x000000FF, 0x00000100, 0x0000FFFF,
+		0x00010000, 0x00FFFFFF, 0x01000000, 0xFFFFFFFF
+	};
+
+	std::vector<uint32_t> words(count);
+	for (auto& word : words)
+	{
+		uint32_t kind = rng() % 5;
+		if (kind == 4)
+		{
+			word = s_edgeWords[rng() % std::size(s_edgeWords)];
+		}
+		else
+		{
+			uint32_t bits = 8 * (kind + 1);
+			word          = bits == 32 ? rng() : rng() & ((1u << bits) - 1);
+		}
+	}
+	return words;
+}
+
+// Shaped like real SPIR-V: instruction headers, small consecutive ids, now and then a constant.
+static std::vector<uint32_t> makeShaderWords(std::mt19937& rng, uint32_t count)
+{
+	std::vector<uint32_t> words;
+	words.reserve(count);
+
+	uint32_t nextId = 1;
+	while (words.size() < count)
+	{
+		uint32_t operandCount = 1 + rng() % 5;
+		words.push_back(((operandCount + 1) << 16) | (rng() % 400));
+		for (uint32_t i = 0; i != operandCount && words.size() < count; ++i)
+		{
+			words.push_back(rng() % 16 == 0 ? rng() : 1 + rng() % nextId);
+		}
+		nextId += 1 + rng() % 2;
+	}
+	return words;
+}
+
+static bool checkRoundTrip(const std::vector<uint32_t>& words)
+{
+	auto const& features = util::cpu::features();
+
+	auto scalar = SpirvCompressionTester::compress(words, Codec::Scalar);
+	TEST_CHECK(SpirvCompressionTester::decompress(scalar, Codec::Scalar) == words);
+
+	if (features.sse41)
+	{
+		// The SIMD encoder must produce the very same buffer.
+		auto simd = SpirvCompressionTester::compress(words, Codec::Simd);
+		TEST_CHECK(SpirvCompressionTester::sameLayout(scalar, simd));
+	}
+
+	if (features.ssse3)
+	{
+		TEST_CHECK(SpirvCompressionTester::decompress(scalar, Codec::Simd) == words);
+	}
+
+	// And the public interface, whichever path it picks.
+	SpirvCodeBuffer code(uint32_t(words.size()), words.data());
+	SpirvCodeBuffer decompressed = SpirvCompressedBuffer(code).decompress();
+	TEST_CHECK(std::vector<uint32_t>(decompressed.data(), decompressed.data() + decompressed.dwords()) == words);
+	return true;
+}
+
+GPCS4_TEST(SpirvCompressionRoundTrip)
+{
+	auto const& features = util::cpu::features();
+	if (!features.sse41 || !features.ssse3)
+	{
+		printf("  SIMD codec not supported by this CPU, only the scalar codec is checked.\n");
+	}
+
+	std::mt19937 rng(0x5EED);
+
+	// Every length around the group and mask word boundaries.
+	for (uint32_t count = 0; count <= 200; ++count)
+	{
+		for (uint32_t round = 0; round != 8; ++round)
+		{
+			TEST_CHECK(checkRoundTrip(makeMixedWords(rng, count)));
+		}
+	}
+
+	for (uint32_t count : { 4096u, 65537u, 1000003u })
+	{
+		TEST_CHECK(checkRoundTrip(makeMixedWords(rng, count)));
+		TEST_CHECK(checkRoundTrip(makeShaderWords(rng, count)));
+	}
+
+	// All words the same width.
+	for (uint32_t word : { 0x7Fu, 0x7FFFu, 0x7FFFFFu, 0x7FFFFFFFu })
+	{
+		TEST_CHECK(checkRoundTrip(std::vector<uint32_t>(1027, word)));
+	}
+	return true;
+}
+
+GPCS4_BENCH(SpirvCompressionCodec)
+{
+	constexpr uint32_t WordCount = 1 << 20;
+	constexpr uint32_t LoopCount = 20;
+
+	auto const& features = util::cpu::features();
+
+	std::mt19937 rng(0x5EED);
+	auto         words = makeShaderWords(rng, WordCount);
+	double       bytes = double(WordCount) * sizeof(uint32_t) * LoopCount;
+
+	auto measureCompress = [&](Codec codec)
+	{
+		return test::measureSeconds([&]
+		{
+			for (uint32_t i = 0; i != LoopCount; ++i)
+			{
+				auto buffer = SpirvCompressionTester::compress(words, codec);
+				test::doNotOptimize(buffer);
+			}
+		});
+	};
+
+	auto compressed        = SpirvCompressionTester::compress(words, Codec::Scalar);
+	auto measureDecompress = [&](Codec codec)
+	{
+		return test::measureSeconds([&]
+		{
+			for (uint32_t i = 0; i != LoopCount; ++i)
+			{
+				auto decompressed = SpirvCompressionTester::decompress(compressed, codec);
+				test::doNotOptimize(decompressed);
+			}
+		});
+	};
+
+	printf("  %u dwords of shader-like code, %u runs, MB/s of uncompressed data\n", WordCount, LoopCount);
+	printf("  compress   scalar %8.1f", bytes / measureCompress(Codec::Scalar) / 1e6);
+	if (features.sse41)
+	{
+		printf("   sse4.1 %8.1f", bytes / measureCompress(Codec::Simd) / 1e6);
+	}
+	printf("\n  decompress scalar %8.1f", bytes / measureDecompress(Codec::Scalar) / 1e6);
+	if (features.ssse3)
+	{
+		printf("   ssse3  %8.1f", bytes / measureDecompress(Codec::Simd) / 1e6);
+	}
+	printf("\n");
+	return true;
+}
@@ -0,0 +1,78 @@
+#include "TestRunner.h"
+#include "Graphics/SpirV/SpirvModule.h"
+
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace sce::pssl;
+
+// Declaring the same type or constant twice must give the same ID,
+// as long as neither of them is one of the unique declarations.
+GPCS4_TEST(SpirvModuleDeclarations)
+{
+	std::mt19937 rng(0x5EED);
+	SpirvModule  module(spvVersion(1, 3));
+
+	uint32_t u32Type = module.defIntType(32, 0);
+	TEST_CHECK(module.defIntType(32, 0) == u32Type);
+	TEST_CHECK(module.defIntType(32, 1) != u32Type);
+
+	std::unordered_map<uint32_t, uint32_t> constIds;
+	std::unordered_map<uint32_t, uint32_t> idValues;
+	for (uint32_t i = 0; i != 4096; ++i)
+	{
+		uint32_t value = rng() % 1024;
+		uint32_t id    = module.constu32(value);
+
+		auto constIter = constIds.emplace(value, id).first;
+		TEST_CHECK(constIter->second == id);
+		auto idIter = idValues.emplace(id, value).first;
+		TEST_CHECK(idIter->second == value);
+	}
+
+	uint32_t length      = module.constu32(4);
+	uint32_t arrayType   = module.defArrayType(u32Type, length);
+	uint32_t uniqueArray = module.defArrayTypeUnique(u32Type, length);
+	TEST_CHECK(module.defArrayType(u32Type, length) == arrayType);
+	TEST_CHECK(uniqueArray != arrayType);
+	TEST_CHECK(module.defArrayTypeUnique(u32Type, length) != uniqueArray);
+
+	// A unique declaration is still found by a later plain one.
+	uint32_t otherLength = module.constu32(5);
+	uint32_t firstArray  = module.defArrayTypeUnique(u32Type, otherLength);
+	TEST_CHECK(module.defArrayType(u32Type, otherLength) == firstArray);
+
+	uint32_t vec4Type = module.defVectorType(u32Type, 4);
+	TEST_CHECK(module.defVectorType(u32Type, 4) == vec4Type);
+	TEST_CHECK(module.constvec4u32(1, 2, 3, 4) == module.constvec4u32(1, 2, 3, 4));
+	TEST_CHECK(module.constvec4u32(1, 2, 3, 4) != module.constvec4u32(4, 3, 2, 1));
+	return true;
+}
+
+GPCS4_BENCH(SpirvModuleDeclarationThroughput)
+{
+	constexpr uint32_t DeclCount = 16384;
+
+	printf("  %u distinct constants and %u distinct array types, each declared twice\n", DeclCount, DeclCount);
+	printf("  %10s %10s %12s\n", "build ms", "ns/decl", "SPIR-V bytes");
+
+	size_t codeSize = 0;
+	double seconds  = test::measureSeconds([&]
+	{
+		SpirvModule module(spvVersion(1, 3));
+		uint32_t    u32Type = module.defIntType(32, 0);
+		for (uint32_t pass = 0; pass != 2; ++pass)
+		{
+			for (uint32_t i = 0; i != DeclCount; ++i)
+			{
+				module.defArrayType(u32Type, module.constu32(i + 1));
+			}
+		}
+		codeSize = module.compile().size();
+	});
+
+	double declCount = 4.0 * DeclCount;
+	printf("  %10.1f %10.1f %12zu\n", seconds * 1e3, seconds * 1e9 / declCount, codeSize);
+	return true;
+}
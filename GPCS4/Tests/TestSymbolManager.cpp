@@ -0,0 +1,140 @@
+#include "TestRunner.h"
+#include "Emulator/ModuleManger.h"
+#include "Emulator/PolicyManager.h"
+#include "Emulator/SymbolManager.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Builtin and native implementations of a few modules' symbols,
+// with some modules only native, and one preferring native.
+struct SymbolSet
+{
+	static constexpr uint32_t ModuleCount        = 8;
+	static constexpr uint32_t BuiltinModuleCount = 6;
+	static constexpr uint32_t LibraryCount       = 4;
+
+	struct Symbol
+	{
+		std::string modName;
+		std::string libName;
+		uint32_t    modId;
+		uint32_t    libId;
+		uint64_t    nid;
+	};
+
+	ModuleManager       modules;
+	PolicyManager       policies{ modules };
+	SymbolManager       symbols;
+	std::vector<Symbol> list;
+
+	explicit SymbolSet(uint32_t nidsPerLibrary)
+	{
+		std::mt19937_64 rng(0x5EED);
+		for (uint32_t m = 0; m != ModuleCount; ++m)
+		{
+			std::string modName = "libSceTest" + std::to_string(m);
+			if (m < BuiltinModuleCount)
+			{
+				modules.registerBuiltinModule(modName);
+			}
+
+			for (uint32_t l = 0; l != LibraryCount; ++l)
+			{
+				std::string libName = modName + "_" + std::to_string(l);
+				for (uint32_t n = 0; n != nidsPerLibrary; ++n)
+				{
+					uint64_t nid = rng();
+					if (m < BuiltinModuleCount)
+					{
+						symbols.registerBuiltinSymbol(modName, libName, nid, addressOf(list.size(), false));
+					}
+					symbols.registerNativeSymbol(modName, libName, nid, addressOf(list.size(), true));
+					list.push_back({ modName, libName, symbols.internName(modName), symbols.internName(libName), nid });
+				}
+			}
+		}
+
+		policies.declareModule("libSceTest1").withDefault(Policy::UseNative);
+	}
+
+	static const void* addressOf(size_t index, bool native)
+	{
+		return reinterpret_cast<const void*>((index + 1) * 0x10 + native);
+	}
+
+	// How symbols were resolved before names were interned:
+	// the policy by names, then the address by names.
+	const void* resolveByName(const Symbol& symbol) const
+	{
+		auto policy = policies.getSymbolPolicy(symbol.modName, symbol.libName, symbol.nid);
+		return policy == Policy::UseBuiltin ? symbols.findBuiltinSymbol(symbol.modName, symbol.libName, symbol.nid)
+											: symbols.findNativeSymbol(symbol.modName, symbol.libName, symbol.nid);
+	}
+
+	const void* resolveById(const Symbol& symbol) const
+	{
+		Policy policy = Policy::UseBuiltin;
+		return symbols.resolveSymbol(policies, symbol.modId, symbol.libId, symbol.nid, &policy);
+	}
+};
+
+GPCS4_TEST(SymbolManagerResolve)
+{
+	SymbolSet set(100);
+	for (size_t i = 0; i != set.list.size(); ++i)
+	{
+		const auto& symbol = set.list[i];
+		bool        native = symbol.modName == "libSceTest1" ||
+					  set.modules.isBuiltinModuleDefined(symbol.modName) == false;
+		TEST_CHECK(set.resolveById(symbol) == SymbolSet::addressOf(i, native));
+		TEST_CHECK(set.resolveByName(symbol) == set.resolveById(symbol));
+	}
+
+	SymbolSet::Symbol unknown = set.list.front();
+	unknown.nid ^= 1;
+	TEST_CHECK(set.resolveById(unknown) == nullptr);
+	return true;
+}
+
+// The lookups relocating NID symbols makes, in random order.
+GPCS4_BENCH(SymbolResolveThroughput)
+{
+	constexpr uint32_t NidsPerLibrary = 2000;
+	constexpr uint32_t ResolveCount   = 200000;
+
+	SymbolSet set(NidsPerLibrary);
+
+	std::mt19937 rng(0x5EED);
+	std::vector<uint32_t> order(ResolveCount);
+	for (auto& index : order)
+	{
+		index = rng() % set.list.size();
+	}
+
+	auto measure = [&](auto&& resolve)
+	{
+		uintptr_t sum = 0;
+		double seconds = test::measureSeconds([&]
+		{
+			for (auto index : order)
+			{
+				sum += reinterpret_cast<uintptr_t>(resolve(set.list[index]));
+			}
+		});
+		test::doNotOptimize(sum);
+		return seconds;
+	};
+
+	// The first pass by id also fills the policy cache.
+	double firstSeconds = measure([&](const auto& symbol) { return set.resolveById(symbol); });
+	double idSeconds    = measure([&](const auto& symbol) { return set.resolveById(symbol); });
+	double nameSeconds  = measure([&](const auto& symbol) { return set.resolveByName(symbol); });
+
+	printf("  %zu symbols, %u relocations, ns per relocation\n", set.list.size(), ResolveCount);
+	printf("  by name and policy    %8.1f\n", nameSeconds * 1e9 / ResolveCount);
+	printf("  by id, first pass     %8.1f\n", firstSeconds * 1e9 / ResolveCount);
+	printf("  by id, policy cached  %8.1f\n", idSeconds * 1e9 / ResolveCount);
+	return true;
+}
@@ -0,0 +1,120 @@
+#include "TestRunner.h"
+#include "Emulator/TLSHandler.h"
+
+#include <cstring>
+
+// Keep clear of ids used by real modules.
+constexpr uint32_t TestTLSModuleId = 64;
+
+struct TLSManagerTester
+{
+	static void* tlsGetAddrSlow(TLSManager* tlsMgr, uint32_t moduleId, uint64_t offset)
+	{
+		return tlsMgr->tlsGetAddrSlow(moduleId, offset);
+	}
+};
+
+// A dynamic module loaded after another one was unloaded may reuse its id,
+// the thread must not keep seeing the unloaded module's block.
+GPCS4_TEST(TLSModuleIdReuse)
+{
+	auto tlsMgr = TLSManager::GetInstance();
+
+	uint8_t imageA[16];
+	uint8_t imageB[16];
+	std::memset(imageA, 'A', sizeof(imageA));
+	std::memset(imageB, 'B', sizeof(imageB));
+
+	TLSBlock block  = {};
+	block.address   = imageA;
+	block.initSize  = sizeof(imageA);
+	block.totalSize = 64;
+	block.align     = 16;
+	block.index     = TestTLSModuleId;
+	block.isDynamic = true;
+	tlsMgr->registerTLSBlock(block);
+
+	auto first = reinterpret_cast<uint8_t*>(tlsMgr->tlsGetAddr(TestTLSModuleId, 0));
+	TEST_CHECK(first != nullptr);
+	TEST_CHECK(first[0] == 'A' && first[sizeof(imageA)] == 0);
+	TEST_CHECK(reinterpret_cast<uintptr_t>(first) % block.align == 0);
+	TEST_CHECK(tlsMgr->tlsGetAddr(TestTLSModuleId, 8) == first + 8);
+
+	// Leave a mark only the old block has.
+	first[1] = 'X';
+
+	tlsMgr->unregisterTLSBlock(block);
+	block.address = imageB;
+	tlsMgr->registerTLSBlock(block);
+
+	auto second = reinterpret_cast<uint8_t*>(tlsMgr->tlsGetAddr(TestTLSModuleId, 0));
+	TEST_CHECK(second != nullptr);
+	TEST_CHECK(second[0] == 'B' && second[1] == 'B');
+
+	tlsMgr->unregisterTLSBlock(block);
+	return true;
+}
+
+GPCS4_BENCH(TLSGetAddrThroughput)
+{
+	constexpr uint32_t FastLoopCount = 10000000;
+	constexpr uint32_t SlowLoopCount = 1000000;
+	constexpr uint32_t NewBlockCount = 10000;
+
+	auto tlsMgr = TLSManager::GetInstance();
+
+	uint8_t image[16] = {};
+
+	TLSBlock block  = {};
+	block.address   = image;
+	block.initSize  = sizeof(image);
+	block.totalSize = 256;
+	block.align     = 16;
+	block.index     = TestTLSModuleId;
+	block.isDynamic = true;
+	tlsMgr->registerTLSBlock(block);
+
+	// Allocates the block for this thread, every later call can take the fast path.
+	void* first = tlsMgr->tlsGetAddr(TestTLSModuleId, 0);
+
+	uintptr_t sum = 0;
+	double fastSeconds = test::measureSeconds([&]
+	{
+		for (uint32_t i = 0; i != FastLoopCount; ++i)
+		{
+			sum += reinterpret_cast<uintptr_t>(tlsMgr->tlsGetAddr(TestTLSModuleId, i & 0xFF));
+		}
+	});
+
+	double slowSeconds = test::measureSeconds([&]
+	{
+		for (uint32_t i = 0; i != SlowLoopCount; ++i)
+		{
+			sum += reinterpret_cast<uintptr_t>(TLSManagerTester::tlsGetAddrSlow(tlsMgr, TestTLSModuleId, i & 0xFF));
+		}
+	});
+
+	// Registering any block outdates the DTV of every thread,
+	// the next lookup rebuilds it.
+	TLSBlock other  = block;
+	other.index     = TestTLSModuleId + 1;
+	double newBlockSeconds = test::measureSeconds([&]
+	{
+		for (uint32_t i = 0; i != NewBlockCount; ++i)
+		{
+			tlsMgr->registerTLSBlock(other);
+			sum += reinterpret_cast<uintptr_t>(tlsMgr->tlsGetAddr(TestTLSModuleId, 0));
+			tlsMgr->unregisterTLSBlock(other);
+		}
+	});
+	test::doNotOptimize(sum);
+
+	bool passed = tlsMgr->tlsGetAddr(TestTLSModuleId, 0) == first;
+	tlsMgr->unregisterTLSBlock(block);
+
+	printf("  ns per __tls_get_addr\n");
+	printf("  fast path, DTV up to date          %8.1f\n", fastSeconds * 1e9 / FastLoopCount);
+	printf("  slow path, DTV up to date          %8.1f\n", slowSeconds * 1e9 / SlowLoopCount);
+	printf("  register, first lookup, unregister %8.1f\n", newBlockSeconds * 1e9 / NewBlockCount);
+	return passed;
+}
@@ -0,0 +1,71 @@
+#include "UtilCpu.h"
+
+#if defined(__clang__) || defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+namespace util::cpu
+{
+
+	static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+	{
+#if defined(__clang__) || defined(__GNUC__)
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+		__cpuidex(reinterpret_cast<int*>(regs), leaf, subleaf);
+#endif
+	}
+
+	static uint64_t xgetbv(uint32_t index)
+	{
+#if defined(__clang__) || defined(__GNUC__)
+		// _xgetbv requires the xsave target feature on clang
+		uint32_t eax = 0;
+		uint32_t edx = 0;
+		__asm__ volatile("xgetbv"
+						 : "=a"(eax), "=d"(edx)
+						 : "c"(index));
+		return (static_cast<uint64_t>(edx) << 32) | eax;
+#else
+		return _xgetbv(index);
+#endif
+	}
+
+	static CpuFeatures detectFeatures()
+	{
+		CpuFeatures features = {};
+		uint32_t    regs[4]  = {};
+
+		cpuid(0, 0, regs);
+		uint32_t maxLeaf = regs[0];
+
+		cpuid(1, 0, regs);
+		features.ssse3 = (regs[2] & (1u << 9)) != 0;
+		features.sse41 = (regs[2] & (1u << 19)) != 0;
+
+		bool osxsave = (regs[2] & (1u << 27)) != 0;
+		bool avx     = (regs[2] & (1u << 28)) != 0;
+		if (!osxsave || !avx || maxLeaf < 7)
+		{
+			return features;
+		}
+
+		// XMM and YMM state, then opmask and ZMM state
+		uint64_t xcr0     = xgetbv(0);
+		bool     ymmState = (xcr0 & 0x06) == 0x06;
+		bool     zmmState = (xcr0 & 0xE6) == 0xE6;
+
+		cpuid(7, 0, regs);
+		features.avx2     = ymmState && (regs[1] & (1u << 5)) != 0;
+		features.avx512f  = zmmState && (regs[1] & (1u << 16)) != 0;
+		features.avx512bw = features.avx512f && (regs[1] & (1u << 30)) != 0;
+		return features;
+	}
+
+	const CpuFeatures& features()
+	{
+		static const CpuFeatures s_features = detectFeatures();
+		return s_features;
+	}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "GPCS4Common.h"
+
+#ifndef _MSC_VER
+#include <x86intrin.h>
+#else
+#include <intrin.h>
+#endif
+
+// Allows a single function to use an instruction set
+// which is not enabled for the whole project.
+// Such functions may only be called after checking util::cpu::features().
+#if defined(__clang__) || defined(__GNUC__)
+#define UTIL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define UTIL_TARGET(isa)
+#endif
+
+namespace util::cpu
+{
+
+	/**
+	 * \brief Instruction set extensions of the host CPU
+	 *
+	 * AVX features are only reported if the OS
+	 * saves the extended register state too.
+	 */
+	struct CpuFeatures
+	{
+		bool ssse3    = false;
+		bool sse41    = false;
+		bool avx2     = false;
+		bool avx512f  = false;
+		bool avx512bw = false;
+	};
+
+	/**
+	 * \brief Queries host CPU features
+	 *
+	 * Detection runs only once, so this is cheap
+	 * enough to be used for dispatching.
+	 * \returns Features of the host CPU
+	 */
+	const CpuFeatures& features();
+
+}
@@ -0,0 +1,121 @@
+#include "UtilThreadPool.h"
+
+#include <algorithm>
+
+namespace util
+{
+
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			m_workers.emplace_back([this]() { runWorker(); });
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopped = true;
+		}
+		m_cond.notify_all();
+
+		for (auto& worker : m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	ThreadPool& ThreadPool::shared()
+	{
+		static ThreadPool s_pool(
+			std::max(std::thread::hardware_concurrency(), 1u) - 1);
+		return s_pool;
+	}
+
+	void ThreadPool::parallelFor(
+		size_t                             count,
+		const std::function<void(size_t)>& func)
+	{
+		// Not worth waking anyone up
+		if (count <= 1 || m_workers.empty())
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				func(i);
+			}
+			return;
+		}
+
+		auto job   = std::make_shared<Job>();
+		job->func  = &func;
+		job->count = count;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(job);
+		}
+		m_cond.notify_all();
+
+		runJob(*job);
+
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->cond.wait(lock, [&job]
+					   { return job->finished.load() == job->count; });
+	}
+
+	void ThreadPool::runJob(Job& job)
+	{
+		while (true)
+		{
+			size_t index = job.next.fetch_add(1);
+			if (index >= job.count)
+			{
+				break;
+			}
+
+			(*job.func)(index);
+
+			if (job.finished.fetch_add(1) + 1 == job.count)
+			{
+				// Lock so the waiter can't miss the notification
+				std::lock_guard<std::mutex> lock(job.mutex);
+				job.cond.notify_all();
+			}
+		}
+	}
+
+	void ThreadPool::runWorker()
+	{
+		while (true)
+		{
+			std::shared_ptr<Job> job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+
+				// Drop jobs with all indices handed out,
+				// their callers wait for completion themselves.
+				m_cond.wait(lock, [this]
+							{
+								while (!m_jobs.empty() &&
+									   m_jobs.front()->next.load() >= m_jobs.front()->count)
+								{
+									m_jobs.pop_front();
+								}
+								return !m_jobs.empty() || m_stopped;
+							});
+
+				if (m_jobs.empty())
+				{
+					break;
+				}
+
+				job = m_jobs.front();
+			}
+
+			runJob(*job);
+		}
+	}
+
+}  // namespace util
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "GPCS4Common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+
+	/**
+	 * \brief Thread pool
+	 *
+	 * Runs independent pieces of work on a fixed
+	 * set of worker threads. The calling thread takes
+	 * part in the work, so nested calls can't deadlock.
+	 */
+	class ThreadPool
+	{
+	public:
+		ThreadPool(uint32_t threadCount);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/**
+		 * \brief Shared pool
+		 *
+		 * Uses one worker less than there are
+		 * hardware threads, the caller being the last one.
+		 * \returns The process wide thread pool
+		 */
+		static ThreadPool& shared();
+
+		/**
+		 * \brief Number of threads doing work
+		 * \returns Worker count, including the caller
+		 */
+		uint32_t concurrency() const
+		{
+			return uint32_t(m_workers.size()) + 1;
+		}
+
+		/**
+		 * \brief Runs a function for a range of indices
+		 *
+		 * Indices are handed out one at a time, in no particular
+		 * order. Returns once the function has returned for all
+		 * of them. The function must not throw.
+		 * \param [in] count Number of indices
+		 * \param [in] func Function taking the index
+		 */
+		void parallelFor(
+			size_t                             count,
+			const std::function<void(size_t)>& func);
+
+	private:
+		struct Job
+		{
+			const std::function<void(size_t)>* func;
+			size_t                             count;
+			std::atomic<size_t>                next     = { 0 };
+			std::atomic<size_t>                finished = { 0 };
+			std::mutex                         mutex;
+			std::condition_variable            cond;
+		};
+
+		void runJob(Job& job);
+
+		void runWorker();
+
+	private:
+		std::mutex                       m_mutex;
+		std::condition_variable          m_cond;
+		std::deque<std::shared_ptr<Job>> m_jobs;
+		bool                             m_stopped = false;
+		std::vector<std::thread>         m_workers;
+	};
+
+}  // namespace util